@@ -0,0 +1,25 @@
+#ifndef CRC32C_HPP
+#define CRC32C_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+// CRC32C（Castagnoli多项式，与iSCSI、ext4元数据和SSE4.2的crc32指令相同），用于对象的端到端校验
+//
+// CPU支持SSE4.2和PCLMULQDQ时，长数据按三段交错送入三条互不依赖的crc32指令流，
+// 掩盖指令的3周期延迟，三段的结果再用无进位乘法（x^(8n)模多项式）合并；
+// 否则使用每次处理8字节的查表实现。两种实现的结果完全相同。
+class Crc32c {
+public:
+    // 在crc（前面数据的结果，第一段为0）之后继续计算data，分段计算与一次计算结果相同
+    static uint32_t extend(uint32_t crc, const void* data, size_t length);
+    static uint32_t compute(const void* data, size_t length) { return extend(0, data, length); }
+
+    // 查表实现，用于不支持SSE4.2的CPU以及测试中对照硬件实现
+    static uint32_t extendPortable(uint32_t crc, const void* data, size_t length);
+
+    // extend是否使用硬件指令
+    static bool hardwareAccelerated();
+};
+
+#endif // CRC32C_HPP
@@ -2,6 +2,9 @@
 #define DFCUTILS_HPP
 
 #include "netutils.hpp"
+#include "placement.hpp"
+#include "erasure_code.hpp"
+#include "put_pipeline.hpp"
 #include <array>
 #include <string>
 #include <vector>
@@ -13,11 +16,15 @@ constexpr const char* DFC_USERNAME_CONF = "Username";
 constexpr const char* DFC_PASSWORD_CONF = "Password";
 constexpr const char* DFC_PASSWORD_DELIM = ": ";
 constexpr const char* DFC_USERNAME_DELIM = ": ";
+constexpr const char* DFC_PLACEMENT_CONF = "Placement: ";
+constexpr const char* DFC_REPLICAS_CONF = "Replicas: ";
+constexpr const char* DFC_ERASURE_CONF = "ErasureCoding: ";
 
 constexpr const char* DFC_LIST_CMD = "LIST";
 constexpr const char* DFC_GET_CMD = "GET ";
 constexpr const char* DFC_PUT_CMD = "PUT ";
 constexpr const char* DFC_MKDIR_CMD = "MKDIR ";
+constexpr int MAX_BUSY_RETRIES = 5;        // 服务器回复SERVER_BUSY_STATUS时按建议的间隔重发命令的次数
 
 // DFC常量枚举
 enum DfcConstants {
@@ -30,55 +37,133 @@ struct DfcServer {
     std::string name;
     std::string address;
     int port;
+    std::string session_token;   // 服务器签发的会话令牌，重新连接时代替密码出示
+    bool per_command_auth;       // 旧服务器拒绝了文本AUTH：每条命令新建连接，由命令携带的凭据认证
     
-    DfcServer() : port(0) {}
+    DfcServer() : port(0), per_command_auth(false) {}
+};
+
+// 一条待发送的命令：同时保留文本模板和二进制帧两种编码，按每个连接协商出的版本选择
+struct DfcCommand {
+    std::string text;
+    std::vector<unsigned char> frame;
+    uint64_t request_id;
+    
+    DfcCommand() : request_id(0) {}
 };
 
 // DFC配置结构体
 struct DfcConfig {
-    std::array<std::unique_ptr<DfcServer>, MAX_SERVERS> servers;
+    std::vector<std::unique_ptr<DfcServer>> servers;   // 服务器数量不设上限
     std::unique_ptr<User> user;
     int server_count;
     EncryptionType encryption_type;  // 添加加密类型字段
+    PlacementType placement_type;
+    int replication_factor;
+    int erasure_data;       // 纠删码的数据分段数k，0表示使用多副本
+    int erasure_parity;     // 纠删码的校验分段数m
+    std::shared_ptr<const Placement> placement;   // 由服务器列表构建，readDfcConf读完配置后创建
     
-    DfcConfig() : server_count(0), encryption_type(EncryptionType::AES_256_GCM) {}  // 默认使用AES_256_GCM
+    DfcConfig() : server_count(0), encryption_type(EncryptionType::AES_256_GCM),  // 默认使用AES_256_GCM
+                  placement_type(PlacementType::RING), replication_factor(DEFAULT_REPLICATION_FACTOR),
+                  erasure_data(0), erasure_parity(0) {}
 };
 
 class DfcUtils {
 public:
     // 连接管理
+    // 连接以会话方式复用：每个服务器只在首次连接时认证一次，之后可连续执行多条命令
     static void setupConnections(std::vector<int>& connFds, const DfcConfig& conf);
     static void tearDownConnections(std::vector<int>& connFds, const DfcConfig& conf);
+    // 为尚未建立会话的服务器创建连接并认证，已有会话保持不变
     static bool createConnections(std::vector<int>& connFds, const DfcConfig& conf);
     static int getDfcSocket(const DfcServer& server);
+    // 连接服务器并协商线路协议版本；旧服务器拒绝HELLO时重新连接并使用文本协议
+    static int connectServer(const DfcServer& server);
     
     // 命令构建和验证
-    static bool commandBuilder(std::string& buffer, const std::string& format, 
+    static bool commandBuilder(DfcCommand& command, const std::string& format, 
                               const FileAttribute& fileAttr, const User& user, int flag);
     static void commandHandler(std::vector<int>& connFds, int flag, 
                               const std::string& buffer, DfcConfig& conf);
     static bool commandValidator(const std::string& buffer, int flag, FileAttribute& fileAttr);
     
     // 命令执行
-    static void commandExec(std::vector<int>& connFds, const std::string& bufferToSend, 
+    static void commandExec(std::vector<int>& connFds, const DfcCommand& command, 
                            int connCount, FileAttribute& attr, int flag, DfcConfig& conf);
-    static bool sendCommand(const std::vector<int>& connFds, const std::string& bufferToSend, 
+    static bool sendCommand(const std::vector<int>& connFds, const DfcCommand& command, 
                            int connCount);
+    // 读取服务器对命令的确认；服务器忙时按建议的间隔重发命令，重试用完仍然忙时返回SERVER_BUSY_STATUS
+    static int recvCommandStatus(int socket, const DfcCommand& command);
+    
+    // 对象放置：每个对象按远程路径和对象ID由conf.placement放在replication_factor个服务器上
+    static std::shared_ptr<const Placement> buildPlacement(const DfcConfig& conf);
+    static std::string placementPath(const FileAttribute& attr);
     
     // 文件操作
-    static void sendFileSplits(int socket, const FileSplit& fileSplit, int mod, int serverIdx);
-    static int fetchRemoteFileInfo(const std::vector<int>& connFds, int connCount, 
-                                  ServerChunksCollate& serverChunksCollate);
-    static void fetchRemoteSplits(std::vector<int>& connFds, int connCount, 
-                                 FileSplit& fileSplit, int mod, size_t fileSize = 0);
+    // PUT：按对象流水线读取、加密（纠删码时再编码）并发送，每个服务器只收到放在它上面的对象；
+    // 内存中最多同时有PUT_PIPELINE_DEPTH个对象。fileSplit只记录文件大小和对象划分，不保存内容。
+    // 对象数另外作为FILE_MANIFEST_ID对象发送给该ID的所有副本服务器。
+    // 副本服务器不可达时改放到放置顺序中后面的在线服务器；仍有对象保存不下来（纠删码时不足k个分段）时
+    // 不发送任何对象并返回false
+    static bool streamFileSplits(const std::vector<int>& connFds, int connCount, const std::string& filePath,
+                                 const std::string& path, const DfcConfig& conf, FileSplit& fileSplit);
+    // 返回错误的服务器在connFds中被置为-1；holders为持有所请求文件的服务器
+    static void fetchRemoteFileInfo(std::vector<int>& connFds, int connCount, 
+                                   ServerChunksCollate& serverChunksCollate, std::vector<int>& holders);
+    // 读取PUT时记录的对象数；所有保存它的服务器都不可达或都没有完好的副本时返回false，
+    // 其中可达的服务器都没有元数据对象时设置legacy（本系列之前上传的文件），不打印错误
+    static bool fetchObjectCount(const std::vector<int>& connFds, int connCount, const std::vector<int>& holders,
+                                 const Placement& placement, const std::string& path, int& objectCount,
+                                 bool& legacy);
+    // 没有元数据对象的旧文件：从对象0开始逐个读取，直到第一个没有任何服务器持有的对象
+    static bool fetchLegacySplits(std::vector<int>& connFds, int connCount, const std::vector<int>& holders,
+                                  FileSplit& fileSplit);
+    // 每个持有副本的服务器一个并行的流，各自读取放在该服务器上、还没有被其他流领取的对象，按对象ID放回原位；
+    // 缺失或未通过服务器校验的对象改从其他副本读取，对象数未知或有对象取不到时返回false
+    static bool fetchRemoteSplits(std::vector<int>& connFds, int connCount, const std::vector<int>& holders,
+                                 FileSplit& fileSplit, const Placement& placement, const std::string& path);
+    // 纠删码：各服务器并行读取数据分段，缺少的分段再逐个读取校验分段，每个对象用任意k个完好的分段还原；
+    // 对象数未知或有对象无法还原时返回false
+    static bool fetchErasureSplits(std::vector<int>& connFds, int connCount, const std::vector<int>& holders,
+                                   FileSplit& fileSplit, const Placement& placement, const std::string& path,
+                                   const ErasureCode& code);
+    // 把对象（前面加上4字节的长度）编码成k + m个分段，第objId个对象的第j个分段ID为objId * (k + m) + j；
+    // 编码后释放原对象的内容
+    static void encodeErasureObject(Split& object, const ErasureCode& code,
+                                    std::vector<std::unique_ptr<Split>>& fragments);
+    static bool decodeErasureObject(const ErasureCode& code, const std::vector<std::vector<uint8_t>>& fragments,
+                                    Split& object);
+    // 逐个请求模式：依次向skipIdx之外的服务器请求对象objId，取到完好的副本时替换split；
+    // present表示是否有服务器持有该对象（包括损坏的副本）
+    static bool fetchObjectReplica(const std::vector<int>& connFds, int connCount, int skipIdx, 
+                                   int objId, Split& split, bool& present);
+    // 副本服务器都没有完好的副本时：向放置顺序中接替它们的、持有该文件的服务器请求
+    // （PUT时副本服务器不可达，对象改放在了这些服务器上）；present只会被置为true
+    static bool fetchHandoffReplica(const std::vector<int>& connFds, int connCount, const std::vector<int>& holders,
+                                    const Placement& placement, uint64_t key, int objId, Split& split, bool& present);
+    // LIST：按页接收各服务器的文件列表，边聚合边按名字顺序输出，内存只与页大小和服务器数有关
+    // 纠删码文件按fragmentCount个分段、至少dataFragments个分段判断完整性（见Utils::checkComplete）
+    static void fetchRemoteFileList(std::vector<int>& connFds, int connCount, int fragmentCount = 1,
+                                    int dataFragments = 1);
+    // 接收一页文件列表；文本协议下整个列表就是一页
+    static void recvListPage(int socket, ServerChunksInfo& page, bool& more, std::string& cursor);
+    // 接收LIST/GET回复中的分片信息（二进制帧或固定大小记录），负载非法时抛出异常
+    static void recvChunksInfo(int socket, ServerChunksInfo& serverChunksInfo);
     static void fetchRemoteDirInfo(const std::vector<int>& connFds, int connCount);
     
     // 输出处理
-    static void getOutputListCommand(const ServerChunksCollate& serverChunksCollate);
-    static bool checkComplete(const std::array<bool, NUM_SERVER>& flagArray);
+    static void getOutputListCommand(const ServerChunksCollate& serverChunksCollate, int fragmentCount = 1,
+                                     int dataFragments = 1);
     
     // 认证功能
-    static bool authConnections(const std::vector<int>& connFds, const DfcConfig& conf);
+    // 二进制协议下先出示缓存的会话令牌，令牌被拒绝时在同一连接上回退到密码认证；
+    // 认证成功后服务器签发的新令牌写回server.session_token。文本协议下AUTH被拒绝时
+    // 标记server.per_command_auth并返回false，调用者重新连接，改用命令中携带的凭据
+    static bool authConnection(int socket, const User& user, DfcServer& server);
+    // 出示会话令牌，返回服务器是否接受；网络错误时抛出异常
+    static bool resumeConnection(int socket, const std::string& token);
+    static void recvSessionToken(int socket, std::string& sessionToken);
     
     // 配置文件处理
     static void readDfcConf(const std::string& filePath, DfcConfig& conf);
@@ -95,10 +180,6 @@ public:
     static void printDfcConf(const DfcConfig& conf);
     static void freeDfcConf(DfcConfig& conf);
     static void freeDfcServer(DfcServer& server);
-
-private:
-    // 文件映射表
-    static const int filePiecesMapping[4][4][2];
 };
 
 #endif // DFCUTILS_HPP
\ No newline at end of file
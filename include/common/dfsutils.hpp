@@ -3,20 +3,37 @@
 
 #include "netutils.hpp"
 #include "logger.hpp"
+#include "dfs_auth.hpp"
+#include "admission.hpp"
+#include "tenant_qos.hpp"
 #include <array>
+#include <cstdint>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 // DFS常量
-constexpr int MAX_USERS = 10;
 constexpr int MAX_CONNECTION = 10;
+constexpr int LISTEN_BACKLOG = 4096;           // listen队列长度，事件循环模式下需要容纳大量并发连接
+constexpr int DEFAULT_DISK_WORKERS = 8;        // 事件循环模式下处理命令/磁盘I/O的默认工作线程数
+constexpr size_t LIST_PAGE_ENTRIES = 1000;     // 二进制协议下LIST每页的文件数
+constexpr int DEFAULT_COMMIT_WINDOW_US = 200;   // PUT组提交的领导者同步前等待其他PUT的时间（微秒）
+constexpr uint64_t DEFAULT_DIRECT_IO_THRESHOLD = 0;   // 对象文件不小于该大小时使用O_DIRECT，0表示不使用
+constexpr uint64_t DEFAULT_OBJECT_CACHE_BYTES = 0;    // 共享内存对象缓存的大小，0表示不使用
+constexpr int DEFAULT_MAX_CONNECTIONS = 1024;       // 同时保持的连接数（fork模式为连接子进程数），达到后暂停accept
+constexpr int DEFAULT_MAX_REQUESTS = 64;            // 同时执行的命令数
+constexpr int DEFAULT_MAX_QUEUED = 256;             // 等待执行的命令数，超过时立即回复忙
+constexpr int DEFAULT_QUEUE_TIMEOUT_MS = 1000;      // 命令排队的最长时间
+constexpr uint64_t DEFAULT_INFLIGHT_BYTES = 256ULL * 1024 * 1024;   // 正在接收的PUT对象字节数的预算
+constexpr int DEFAULT_IO_TIMEOUT_SEC = 30;          // 事件循环模式下命令帧到齐、命令收发停顿的最长时间
 
 // 错误代码枚举
 enum DfsError {
     FOLDER_NOT_FOUND = 1,
     FOLDER_EXISTS = 2,
     FILE_NOT_FOUND = 3,
-    AUTH_FAILED = 4
+    AUTH_FAILED = 4,
+    SERVER_BUSY = 5
 };
 
 // 错误消息常量
@@ -24,14 +41,68 @@ constexpr const char* FOLDER_NOT_FOUND_ERROR = "Requested folder does not exists
 constexpr const char* FOLDER_EXISTS_ERROR = "Requested folder already exists on server";
 constexpr const char* FILE_NOT_FOUND_ERROR = "Requested file does not exists on server";
 constexpr const char* AUTH_FAILED_ERROR = "Invalid Username/Password. Please try again";
+constexpr const char* SERVER_BUSY_ERROR = "Server is busy. Please try again later";
+
+// 对象数据I/O后端
+enum class DfsIoBackend {
+    BLOCKING = 0,   // recv/send循环 + ifstream/ofstream
+    IO_URING = 1    // io_uring链接SQE，内核不支持时自动回退到BLOCKING
+};
+
+// 对象存储引擎
+enum class DfsStoreType {
+    FILES = 0,      // 每个对象一个隐藏文件 .文件名.分片ID
+    PACKED = 1      // 对象追加到 .dfs.store 下的段文件，后台压缩
+};
 
 // DFS配置结构体
 struct DfsConfig {
     std::string server_name;
-    std::array<std::unique_ptr<User>, MAX_USERS> users;
-    int user_count;
+    LiveUserTable users;        // 按用户名哈希索引，不再有用户数量上限；dfs.conf改变时整体替换
+    SessionTokens tokens;       // 会话令牌的签发与校验，密钥在启动时生成
+    DfsIoBackend io_backend;
+    DfsStoreType store_type;
+    int commit_window_us;
+    uint64_t direct_io_threshold;
+    std::unordered_map<std::string, TenantLimits> tenant_limits;   // dfs.conf中配置了限速的用户
     
-    DfsConfig() : user_count(0) {}
+    DfsConfig() : io_backend(DfsIoBackend::BLOCKING), store_type(DfsStoreType::FILES),
+                  commit_window_us(DEFAULT_COMMIT_WINDOW_US), direct_io_threshold(DEFAULT_DIRECT_IO_THRESHOLD) {}
+};
+
+// 服务器运行模式
+enum class DfsServerMode {
+    FORK = 0,     // 每个连接fork一个子进程（默认）
+    EPOLL = 1,    // 单进程epoll事件循环 + 有界工作线程池
+    SHARDED = 2   // 每个CPU核一个绑核线程，各自使用SO_REUSEPORT监听和独立的事件循环
+};
+
+// DFS服务器启动参数
+struct DfsServerOptions {
+    std::string server_folder;
+    int port;
+    bool debug_enabled;
+    DfsServerMode mode;
+    int workers;            // EPOLL模式下的工作线程数
+    int shards;             // SHARDED模式下的分片数，0表示使用当前可用的全部CPU核
+    DfsIoBackend io_backend;
+    DfsStoreType store_type;
+    int commit_window_us;   // PUT组提交窗口
+    uint64_t direct_io_threshold;   // 直接I/O阈值（字节）
+    uint64_t object_cache_bytes;    // 对象缓存大小（字节）
+    int max_connections;            // 连接数上限
+    AdmissionControl::Limits admission;     // 命令并发、排队和PUT字节预算
+    int metrics_port;               // Prometheus指标的HTTP端口，0表示不导出
+    int io_timeout;                 // 事件循环模式下卡住的连接被关闭之前的秒数，0表示不限制
+    
+    DfsServerOptions() : port(0), debug_enabled(true), mode(DfsServerMode::FORK), 
+                         workers(DEFAULT_DISK_WORKERS), shards(0), io_backend(DfsIoBackend::BLOCKING),
+                         store_type(DfsStoreType::FILES), commit_window_us(DEFAULT_COMMIT_WINDOW_US),
+                         direct_io_threshold(DEFAULT_DIRECT_IO_THRESHOLD),
+                         object_cache_bytes(DEFAULT_OBJECT_CACHE_BYTES), max_connections(DEFAULT_MAX_CONNECTIONS),
+                         admission{DEFAULT_MAX_REQUESTS, DEFAULT_MAX_QUEUED, DEFAULT_QUEUE_TIMEOUT_MS,
+                                   DEFAULT_INFLIGHT_BYTES},
+                         metrics_port(0), io_timeout(DEFAULT_IO_TIMEOUT_SEC) {}
 };
 
 // DFS接收命令结构体
@@ -40,24 +111,71 @@ struct DfsRecvCommand {
     User user;
     std::string folder;     // 文件夹总是以"/"结尾，不以"/"开头
     std::string file_name;
+    std::string token;      // RESUME命令出示的会话令牌
+    uint8_t wire_version;   // 命令到达时连接使用的协议版本，决定元数据回复的编码
+    uint64_t request_id;    // 二进制帧中的请求ID，回复帧原样带回
     
-    DfsRecvCommand() : flag(0) {}
+    DfsRecvCommand() : flag(0), wire_version(0), request_id(0) {}
 };
 
+// 连接上的会话状态：AUTH命令认证成功后，同一连接可以连续执行任意多条命令，
+// 后续命令不再重复认证；未认证的连接仍按旧协议执行一条命令后关闭
+// wire_version在连接开始时由HELLO握手确定，二进制协议下的命令必须先AUTH或RESUME；
+// 二进制协议下认证成功后服务器签发会话令牌，客户端之后在任意连接上用RESUME出示令牌即可建立会话
+struct DfsSession {
+    bool authenticated;
+    User user;
+    uint8_t wire_version;
+    
+    DfsSession() : authenticated(false), wire_version(0) {}
+};
+
+class ObjectIoBackend;
+class DirIndex;
+
 class DfsUtils {
 public:
+    // 启动参数解析
+    static bool parseServerOptions(int argc, char** argv, DfsServerOptions& options);
+    
     // Socket操作
-    static int getDfsSocket(int portNumber);
+    static int getDfsSocket(int portNumber, bool reusePort = false);
     
     // 认证功能
     static bool authDfsUser(const User& user, const DfsConfig& conf);
+    // 校验会话令牌并确认用户仍在用户表中，成功时取出用户名
+    static bool authDfsToken(const std::string& token, const DfsConfig& conf, std::string& username);
     
     // 命令处理
+    // 处理一个连接上的全部请求（会话或单条命令），直到连接应当关闭
     static void dfsCommandAccept(int socket, DfsConfig& conf);
+    // 处理连接上的一个请求，返回true表示会话仍然有效、连接应保持打开
+    static bool dfsHandleRequest(int socket, DfsConfig& conf, DfsSession& session);
+    // 接收并解析文本模板命令（旧协议），命令长度非法时返回false
+    static bool dfsRecvTextCommand(int socket, int commandSize, DfsRecvCommand& recvCmd);
     static bool dfsCommandDecodeAndAuth(const std::string& buffer, const std::string& format, 
                                        DfsRecvCommand& recvCmd, const DfsConfig& conf);
+    static void dfsCommandDecode(const std::string& buffer, const std::string& format, 
+                                 DfsRecvCommand& recvCmd);
+    // 处理流水线GET请求（GET_WINDOW_REQUEST/GET_STREAM_REQUEST），连续发送分片
+    static void dfsStreamObjects(int socket, const DfsConfig& conf, ObjectIoBackend& objectIo, 
+                                 const std::string& folderPath, const std::string& fileName, bool untilMissing);
+    // 按配置的存储引擎发送一个对象；打包存储中没有的对象回退到对象文件（切换存储之前写入的数据）
+    static void dfsSendObject(int socket, const DfsConfig& conf, ObjectIoBackend& objectIo, int splitId, 
+                              const std::string& objectFile);
+    static bool dfsObjectExists(const DfsConfig& conf, const std::string& objectFile);
+    // LIST/GET回复中的分片信息，按命令到达时的协议版本编码
+    static void sendChunksInfo(int socket, const DfsRecvCommand& recvCmd, 
+                               const ServerChunksInfo& serverChunksInfo);
+    // 分页发送LIST结果：page为已取出的第一页，more为1时每页之后等待客户端的LIST_NEXT
+    static void sendListPages(int socket, const DfsRecvCommand& recvCmd, DirIndex& dirIndex, 
+                              ServerChunksInfo& page, bool more);
+    // AUTH/RESUME成功后签发会话令牌（仅二进制协议）
+    static void sendSessionToken(int socket, const DfsRecvCommand& recvCmd, const DfsConfig& conf,
+                                 const std::string& username);
+    // ticket为本条命令的准入槽位，PUT按对象在其中预留字节
     static bool dfsCommandExec(int socket, const DfsRecvCommand& recvCmd, 
-                              DfsConfig& conf, int flag);
+                              DfsConfig& conf, int flag, AdmissionControl::Ticket& ticket);
     
     // 目录管理
     static void createDfsDirectory(const std::string& path);
@@ -69,7 +187,12 @@ public:
     
     // 配置文件处理
     static void readDfsConf(const std::string& filePath, DfsConfig& conf);
-    static void insertDfsUserConf(const std::string& line, DfsConfig& conf);
+    // 运行中重新读取dfs.conf，发布新的用户表并更新各用户的限速；文件无法读取或没有用户时保留当前配置
+    static bool reloadDfsConf(const std::string& filePath, DfsConfig& conf);
+    static bool loadDfsUsers(const std::string& filePath, UserTable& users,
+                             std::unordered_map<std::string, TenantLimits>& limits);
+    static void insertDfsUserConf(const std::string& line, UserTable& users,
+                                  std::unordered_map<std::string, TenantLimits>& limits);
     
     // 调试功能
     static void printDfsConf(const DfsConfig& conf);
@@ -0,0 +1,72 @@
+#ifndef ERASURE_CODE_HPP
+#define ERASURE_CODE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+constexpr int MAX_ERASURE_FRAGMENTS = 32;        // k + m的上限
+constexpr size_t ERASURE_FRAGMENT_ALIGN = 32;    // 分段长度按AVX2寄存器宽度对齐
+
+// GF(2^8)运算，生成多项式为x^8 + x^4 + x^3 + x^2 + 1（0x11D，与常见的Reed-Solomon实现相同）
+//
+// 区域乘加 dst ^= c * src 是编解码的全部开销。CPU支持AVX2或SSSE3时把每个字节拆成高低两个4位，
+// 用pshufb在c的两张16项乘积表中查表，每条指令处理32或16个字节；否则使用256x256的乘法表。
+// 各实现的结果完全相同。
+class Gf256 {
+public:
+    enum class Kernel { PORTABLE, SSSE3, AVX2 };
+
+    static uint8_t mul(uint8_t a, uint8_t b);
+    static uint8_t div(uint8_t a, uint8_t b);   // b不能为0
+    static uint8_t inv(uint8_t a);              // a不能为0
+
+    // dst ^= c * src
+    static void mulAdd(uint8_t c, const uint8_t* src, uint8_t* dst, size_t length);
+    // 查表实现，用于不支持SSSE3的CPU以及测试中对照向量实现
+    static void mulAddPortable(uint8_t c, const uint8_t* src, uint8_t* dst, size_t length);
+    // 测试用：用指定的实现计算，CPU不支持时退回查表实现
+    static void mulAddWith(Kernel kernel, uint8_t c, const uint8_t* src, uint8_t* dst, size_t length);
+
+    // mulAdd使用的实现
+    static Kernel kernel();
+    static const char* kernelName(Kernel kernel);
+};
+
+// 系统Reed-Solomon码：数据切成k个数据分段，再算出m个校验分段，k + m个分段中任意k个都能还原数据
+//
+// 编码矩阵上方是k x k的单位矩阵，下方是m x k的Cauchy矩阵 1 / (x_i + y_j)，x_i = k + i，y_j = j：
+// Cauchy矩阵的任意方子阵都可逆，因此矩阵中任意k行组成的方阵都可逆。
+// 数据分段就是原始数据本身，没有丢失数据分段时解码只是拼接。
+class ErasureCode {
+public:
+    // k、m不合法（k < 1、m < 0或k + m超过MAX_ERASURE_FRAGMENTS）时抛出异常
+    ErasureCode(int dataFragments, int parityFragments);
+
+    int dataFragments() const { return k_; }
+    int parityFragments() const { return m_; }
+    int totalFragments() const { return k_ + m_; }
+
+    // length字节的数据编码后每个分段的长度：k个分段装下数据，末尾补0，按ERASURE_FRAGMENT_ALIGN对齐
+    size_t fragmentSize(size_t length) const;
+
+    // 把data编码成k + m个长度为fragmentSize(length)的分段
+    void encode(const uint8_t* data, size_t length, std::vector<std::vector<uint8_t>>& fragments) const;
+    // fragments按分段序号排列，空的表示缺失；至少有k个长度相同的分段时还原出k * 分段长度字节的数据
+    // （包括编码时补的0），否则返回false
+    bool decode(const std::vector<std::vector<uint8_t>>& fragments, std::vector<uint8_t>& data) const;
+
+    // 识别"4+2"形式的k + m
+    static bool parse(const std::string& spec, int& dataFragments, int& parityFragments);
+
+private:
+    // rows中的k个分段对应的编码矩阵子阵的逆矩阵
+    bool invertRows(const std::vector<int>& rows, std::vector<uint8_t>& inverse) const;
+
+    int k_;
+    int m_;
+    std::vector<uint8_t> matrix_;   // (k + m) x k，按行存放
+};
+
+#endif // ERASURE_CODE_HPP
@@ -0,0 +1,98 @@
+#ifndef PLACEMENT_HPP
+#define PLACEMENT_HPP
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+constexpr int DEFAULT_REPLICATION_FACTOR = 2;   // 每个对象保存在几个服务器上
+constexpr int PLACEMENT_VIRTUAL_NODES = 160;    // 哈希环上每个服务器的虚拟节点数
+
+enum class PlacementType {
+    RING = 0,           // 一致性哈希环（默认）
+    RENDEZVOUS = 1      // 最高随机权重（HRW）哈希
+};
+
+// 对象放置：由远程路径和对象ID算出保存该对象的服务器，PUT和GET不需要交换任何信息就能找到同样的副本
+//
+// 服务器按dfc.conf中的名字参与哈希，与它在配置中的顺序无关：调整顺序不会移动对象，
+// 加入第N个服务器时只有约1/N的副本移到新服务器上，其余副本原地不动，旧服务器之间不会互相搬移对象。
+// 服务器数量不超过副本数时每个服务器都保存全部对象。
+class Placement {
+public:
+    virtual ~Placement() = default;
+
+    // 按优先顺序把保存该对象的replicationFactor()个不同服务器（serverNames中的下标）写入servers
+    void replicas(uint64_t key, std::vector<int>& servers) const { preferenceList(key, replicationFactor_, servers); }
+    // 同样的优先顺序中的前count个不同服务器（不超过服务器数量），前replicationFactor()个即replicas
+    virtual void preferenceList(uint64_t key, int count, std::vector<int>& servers) const = 0;
+    // 优先顺序中replicas之后的服务器：PUT时副本服务器不可达，副本改放在它们上面
+    void handoffs(uint64_t key, std::vector<int>& servers) const;
+    bool stores(uint64_t key, int serverIdx) const;
+    // 每个服务器保存的对象ID（升序），对象ID为[0, objectCount)
+    void objectsByServer(const std::string& path, int objectCount, std::vector<std::vector<int>>& objects) const;
+    // 纠删码：第objId个对象的第j个分段以 objId * fragmentCount + j 为ID放在该对象的第j个服务器上，
+    // 服务器比分段少时依次轮流；返回每个服务器保存的分段ID（升序）
+    static int fragmentServer(const std::vector<int>& servers, int fragment) {
+        return servers[fragment % servers.size()];
+    }
+    void fragmentsByServer(const std::string& path, int objectCount, int fragmentCount,
+                           std::vector<std::vector<int>>& fragments) const;
+
+    // PUT时部分服务器不可达（live[i]表示服务器i在线）：原本放在不可达服务器上的副本或分段依次改放到
+    // handoffs中还没有保存该对象的在线服务器上；没有这样的服务器时丢弃，由调用者检查每个对象还剩多少
+    void liveReplicas(uint64_t key, const std::vector<bool>& live, std::vector<int>& servers) const;
+    void liveObjectsByServer(const std::string& path, int objectCount, const std::vector<bool>& live,
+                             std::vector<std::vector<int>>& objects) const;
+    void liveFragmentsByServer(const std::string& path, int objectCount, int fragmentCount,
+                               const std::vector<bool>& live, std::vector<std::vector<int>>& fragments) const;
+
+    int serverCount() const { return static_cast<int>(serverNames_.size()); }
+    // 实际的副本数：不超过服务器数量
+    int replicationFactor() const { return replicationFactor_; }
+
+    // replicationFactor小于1时抛出异常
+    static std::unique_ptr<Placement> create(PlacementType type, const std::vector<std::string>& serverNames,
+                                             int replicationFactor);
+    // 识别dfc.conf中的放置方式名字（ring或rendezvous）
+    static bool parseType(const std::string& name, PlacementType& type);
+
+    // 对象的放置键：同一路径的对象ID互不相关地散开
+    static uint64_t objectKey(const std::string& path, int objId);
+    // 64位FNV-1a，再经过splitmix64的混合：与客户端的构建和平台无关
+    static uint64_t hash(const std::string& data);
+    static uint64_t mix(uint64_t value);
+
+protected:
+    Placement(const std::vector<std::string>& serverNames, int replicationFactor);
+
+    std::vector<std::string> serverNames_;
+    int replicationFactor_;
+};
+
+// 一致性哈希环：每个服务器在环上有PLACEMENT_VIRTUAL_NODES个虚拟节点，
+// 对象从它的键开始顺时针取遇到的前几个不同服务器，查找为O(log(N*V))；接替的服务器是继续顺时针遇到的服务器
+class HashRingPlacement : public Placement {
+public:
+    HashRingPlacement(const std::vector<std::string>& serverNames, int replicationFactor,
+                      int virtualNodes = PLACEMENT_VIRTUAL_NODES);
+    void preferenceList(uint64_t key, int count, std::vector<int>& servers) const override;
+
+private:
+    std::vector<std::pair<uint64_t, int>> ring_;   // (虚拟节点的哈希, 服务器下标)，按哈希排序
+};
+
+// 最高随机权重哈希：对象与每个服务器算一个分数，取分数最高的几个服务器，接替的服务器按分数依次排在后面；
+// 不需要虚拟节点，分布天然均匀，查找为O(N)，适合几十个服务器以内的集群
+class RendezvousPlacement : public Placement {
+public:
+    RendezvousPlacement(const std::vector<std::string>& serverNames, int replicationFactor);
+    void preferenceList(uint64_t key, int count, std::vector<int>& servers) const override;
+
+private:
+    std::vector<uint64_t> serverHashes_;
+};
+
+#endif // PLACEMENT_HPP
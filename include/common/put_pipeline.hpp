@@ -0,0 +1,62 @@
+#ifndef PUT_PIPELINE_HPP
+#define PUT_PIPELINE_HPP
+
+#include "utils.hpp"
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+constexpr int PUT_PIPELINE_DEPTH = 8;   // PUT时同时在内存中的对象数
+
+// 流水线式PUT：读取、编码（加密，纠删码时再切成分段）、发送三个阶段重叠进行
+//
+// 读取阶段在调用run的线程中按顺序读取对象，每个对象先占用一个槽位，槽位用完时等待；
+// 编码阶段在线程池中并行执行；每个服务器一个发送线程，按ID顺序发送放在该服务器上的分片。
+// 对象的分片发送到所有目标服务器后释放它的槽位：内存只与槽位数和对象大小有关，与文件大小无关，
+// 第i + 1个对象读取时第i个对象在加密、第i - 1个对象在发送，整体速度取决于最慢的阶段。
+class PutPipeline {
+public:
+    // 读取第objId个对象的明文
+    using ReadStage = std::function<void(int objId, Split& object)>;
+    // 把对象变成要发送的width个分片，写入pieces
+    using EncodeStage = std::function<void(Split& object, std::vector<std::unique_ptr<Split>>& pieces)>;
+    // 向一个服务器发送一个分片
+    using SendStage = std::function<void(int serverIdx, const Split& piece)>;
+
+    // 每个对象编码成width个分片，第objId个对象的第j个分片ID为 objId * width + j
+    PutPipeline(int objectCount, int width, int depth = PUT_PIPELINE_DEPTH);
+
+    // piecesByServer[s]为服务器s依次发送的分片ID（升序），列表为空的服务器不启动发送线程。
+    // 任一阶段抛出异常时停止整个流水线，等待已经开始的工作结束后重新抛出
+    void run(const ReadStage& read, const EncodeStage& encode, const SendStage& send,
+             const std::vector<std::vector<int>>& piecesByServer);
+
+    // 运行中同时占用的槽位数的最大值
+    int peakInFlight() const { return peakInFlight_; }
+
+private:
+    void encodeObject(int objId, Split& object, const EncodeStage& encode);
+    void sendTo(int serverIdx, const std::vector<int>& ids, const SendStage& send);
+    void fail(std::exception_ptr error);
+    // 调用者持有mutex_
+    void release(int objId);
+
+    int objectCount_;
+    int width_;
+    int depth_;
+
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    std::vector<std::unique_ptr<Split>> pieces_;   // 按分片ID存放，编码后写入，释放前只读
+    std::vector<bool> ready_;                      // 对象的分片是否已经编码完成
+    std::vector<int> remaining_;                   // 对象还需要发送的次数
+    int inFlight_;
+    int peakInFlight_;
+    int encoding_;                                 // 已提交到线程池还没有完成的编码
+    std::exception_ptr error_;
+};
+
+#endif // PUT_PIPELINE_HPP
@@ -2,9 +2,12 @@
 #define UTILS_HPP
 
 #include "debug.hpp"
+#include <array>
 #include <string>
 #include <vector>
 #include <memory>
+#include <set>
+#include <unordered_map>
 #include <openssl/md5.h>
 #include <glob.h>
 
@@ -13,17 +16,17 @@
 
 // 常量定义
 constexpr int CHUNKS_PER_SERVER = 2;
-constexpr int MAX_SERVERS = 10;
 constexpr int NUM_SERVER = 4;
 constexpr int MAX_CHAR_BUFF = 100;
 constexpr int MAX_FILE_BUFF = 100;
-constexpr int MAX_NUM_FILES = 100;
 
 // Ceph风格分片配置
 constexpr size_t DEFAULT_OBJECT_SIZE = 4 * 1024 * 1024;  // 4MB默认对象大小
 constexpr size_t MIN_OBJECT_SIZE = 64 * 1024;            // 64KB最小对象大小
 constexpr size_t MAX_OBJECT_SIZE = 16 * 1024 * 1024;     // 16MB最大对象大小
 constexpr int MAX_OBJECTS_PER_FILE = 1024;               // 单文件最大对象数
+// PUT时记录文件对象数的元数据对象，ID大于任何对象和纠删码分段的ID（MAX_OBJECTS_PER_FILE * MAX_ERASURE_FRAGMENTS）
+constexpr int FILE_MANIFEST_ID = 1 << 30;
 
 enum class EncryptionType {
     AES_256_GCM = 0,
@@ -55,10 +58,11 @@ struct Split {
     size_t offset;      // 在原文件中的偏移量
     std::vector<unsigned char> content;
     size_t content_length;
+    bool corrupt;       // GET：服务器上的副本未通过校验，没有内容
     
-    Split() : id(0), offset(0), content_length(0) {}
+    Split() : id(0), offset(0), content_length(0), corrupt(false) {}
     Split(int id_, size_t offset_, const std::vector<unsigned char>& content_) 
-        : id(id_), offset(offset_), content(content_), content_length(content_.size()) {}
+        : id(id_), offset(offset_), content(content_), content_length(content_.size()), corrupt(false) {}
 };
 
 // 文件分割集合结构体（Ceph风格：动态对象数量）
@@ -81,11 +85,15 @@ struct FileAttribute {
 };
 
 // 块信息结构体
+// 文本协议只带chunks中的前两个对象ID；二进制协议另外带上服务器保存的全部对象ID，
+// 以及该服务器保存的元数据对象中记录的对象数
 struct ChunkInfo {
     std::string file_name;
     std::array<int, CHUNKS_PER_SERVER> chunks;
+    std::vector<int> objects;   // 全部对象ID（升序），文本协议下为空
+    int object_count;           // -1表示该服务器没有（或读不出）元数据对象
     
-    ChunkInfo() : chunks{0, 0} {}
+    ChunkInfo() : chunks{0, 0}, object_count(-1) {}
 };
 
 // 服务器块信息结构体
@@ -96,21 +104,20 @@ struct ServerChunksInfo {
     ServerChunksInfo() : chunks(0) {}
 };
 
+// 一个文件在所有在线服务器上的对象：报告过的对象ID（不含元数据对象），以及元数据对象中记录的对象数
+// （-1表示没有服务器报告，例如本系列之前上传的文件）
+struct FileObjects {
+    std::set<int> objects;
+    int object_count;
+    bool text_protocol;     // 有服务器用文本协议回复，它不报告对象数
+    
+    FileObjects() : object_count(-1), text_protocol(false) {}
+};
+
 // 服务器块聚合结构体
+// 文件名 -> 该文件的对象；按名字哈希，插入和查找都是O(1)，文件数量和服务器数量都不设上限
 struct ServerChunksCollate {
-    std::array<std::array<char, MAX_CHAR_BUFF>, MAX_NUM_FILES> file_names;
-    std::array<std::array<bool, NUM_SERVER>, MAX_NUM_FILES> chunks;
-    int num_files;
-    
-    ServerChunksCollate() : num_files(0) {
-        // 初始化数组
-        for (auto& file_row : file_names) {
-            file_row.fill('\0');
-        }
-        for (auto& chunk_row : chunks) {
-            chunk_row.fill(false);
-        }
-    }
+    std::unordered_map<std::string, FileObjects> files;
 };
 
 class Utils {
@@ -144,6 +151,10 @@ public:
     // 文件分片加密/解密
     static void encryptDecryptFileSplit(FileSplit& fileSplit, const std::string& key, 
                                      EncryptionType encryptionType, bool isEncrypt = true);
+    // 单个对象的加密/解密，密钥由调用者派生一次后重复使用；失败时对象保持不变
+    static bool encryptDecryptSplit(Split& split, dfs::crypto::EncryptionAlgorithm algo,
+                                    const std::vector<unsigned char>& cryptoKey, bool isEncrypt = true);
+    static dfs::crypto::EncryptionAlgorithm cryptoAlgorithm(EncryptionType encryptionType);
     
     // 哈希计算
     static int getMd5SumHashMod(const std::string& filePath);
@@ -162,11 +173,12 @@ public:
     
     // 辅助函数
     static void extractFileNameAndFolder(const std::string& buffer, FileAttribute& fileAttr, int flag);
-    static int checkFileNameExist(const std::array<std::array<char, MAX_CHAR_BUFF>, MAX_NUM_FILES>& fileNames, 
-                                 const std::string& fileName, int n);
     static void insertToServerChunksCollate(ServerChunksCollate& serverChunksCollate, 
                                           const ServerChunksInfo& serverChunksInfo);
-    static bool checkComplete(const std::array<bool, NUM_SERVER>& flagArray);
+    // 文件的每个对象都至少有一个在线服务器报告时返回true；纠删码文件的对象以fragmentCount个分段保存
+    // （分段ID为 对象ID * fragmentCount + j），需要至少dataFragments个分段。没有服务器报告对象数时按
+    // 没有元数据对象的旧文件处理：对象ID从0开始连续即为完整（文本协议的回复无法判断，有对象即返回true）
+    static bool checkComplete(const FileObjects& file, int fragmentCount = 1, int dataFragments = 1);
 
 private:
     static constexpr char ROOT_FOLDER_STR = '/';
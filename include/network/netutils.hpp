@@ -11,12 +11,20 @@
 
 constexpr int MAX_SEG_SIZE = 100 * 1024 * 1024;
 constexpr int INT_SIZE = 4;
+constexpr int SPLIT_HEADER_SIZE = 9;
 constexpr unsigned char INITIAL_WRITE_FLAG = 0;
 constexpr unsigned char CHUNK_WRITE_FLAG = 1;
 constexpr unsigned char FINAL_WRITE_FLAG = 2;
+constexpr unsigned char CORRUPT_OBJECT_FLAG = 3;    // 服务器上的对象副本校验失败：分片不带内容，客户端改从其他服务器读取
 constexpr char RESET_SIG = 'N';
 constexpr char PROCEED_SIG = 'Y';
 constexpr char END_GET_SIG = 'E';
+
+// GET阶段客户端在分片ID位置发送的控制值，非负值仍表示逐个请求（发送后等待RESET_SIG）
+constexpr int GET_END_REQUEST = -1;      // 结束本次GET
+constexpr int GET_WINDOW_REQUEST = -2;   // 后跟起始ID和数量：服务器连续发送这一段分片，缺失的分片长度为0
+constexpr int GET_STREAM_REQUEST = -3;   // 后跟起始ID：服务器连续发送直到第一个缺失的分片，以长度为0的分片结束
+constexpr int SERVER_BUSY_STATUS = -2;     // 命令确认：服务器过载未执行命令，后跟建议的重试间隔（毫秒），会话连接保持可用
 constexpr int CHUNK_INFO_STRUCT_SIZE = MAX_CHAR_BUFF + NUM_SERVER * INT_SIZE;
 
 constexpr const char* GENERIC_TEMPLATE = "FLAG %d %[^\n]s";
@@ -33,15 +41,19 @@ enum CommandFlag {
     GET_FLAG = 1,
     PUT_FLAG = 2,
     MKDIR_FLAG = 3,
-    AUTH_FLAG = 4
+    AUTH_FLAG = 4,
+    RESUME_FLAG = 5     // 仅二进制协议：出示会话令牌建立会话
 };
 
 class NetUtils {
 public:
     static void fetchAndPrintError(int socket);
+    static void fetchError(int socket, std::string& message);
     
     static void sendIntValueSocket(int socket, int value);
     static void recvIntValueSocket(int socket, int& value);
+    // 与recvIntValueSocket相同，但对端在发送任何字节之前关闭连接时返回false而不是抛出异常
+    static bool tryRecvIntValueSocket(int socket, int& value);
     static void encodeIntToUchar(std::vector<unsigned char>& buffer, int n);
     static void decodeIntFromUchar(const std::vector<unsigned char>& buffer, int& n);
     
@@ -49,7 +61,15 @@ public:
     static void decodeUserStruct(const std::string& buffer, User& user);
     
     static int sendToSocket(int socket, const std::vector<unsigned char>& payload);
+    // 发送任意内存区间；flags会与MSG_NOSIGNAL合并（例如MSG_MORE让头部与随后的数据合并成一个报文段）
+    static size_t sendBytesToSocket(int socket, const unsigned char* data, size_t length, int flags = 0);
+    // 用sendfile把文件[offset, offset + length)直接从页缓存发送到socket，不经过用户态缓冲区
+    static void sendFileToSocket(int socket, int fileFd, size_t length, off_t offset = 0);
     static int recvFromSocket(int socket, std::vector<unsigned char>& payload);
+    // 从socket接收恰好length字节到data，对端提前关闭时抛出异常
+    static void recvBytesFromSocket(int socket, unsigned char* data, size_t length);
+    // 读走并丢弃socket上的length字节，用于出错时保持协议同步
+    static void discardFromSocket(int socket, size_t length, std::vector<unsigned char>& buffer);
     static void sendSignal(const std::vector<int>& connFds, unsigned char signal);
     static void recvSignal(int socket, unsigned char& payload);
     
@@ -62,6 +82,15 @@ public:
     static void decodeChunkInfoFromBuffer(const std::vector<unsigned char>& buffer, 
                                          ChunkInfo& chunkInfo);
     
+    // 9字节分片头：1字节标志 + 4字节分片ID + 4字节内容长度
+    static void encodeSplitHeader(std::vector<unsigned char>& header, int splitId, int contentLength,
+                                  unsigned char flag = INITIAL_WRITE_FLAG);
+    static void recvSplitHeader(int socket, int& splitId, int& contentLength);
+    // 读取但不取走下一个分片头，用于在接收对象内容之前按长度预留资源
+    static void peekSplitHeader(int socket, int& splitId, int& contentLength);
+    // 同时接受CORRUPT_OBJECT_FLAG（内容长度必须为0），用于GET读取服务器发送的分片
+    static void recvSplitHeader(int socket, unsigned char& flag, int& splitId, int& contentLength);
+    
     static void writeSplitToSocketAsStream(int socket, const Split& split);
     static void writeSplitFromSocketAsStream(int socket, Split& split);
     
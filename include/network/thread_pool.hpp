@@ -12,9 +12,13 @@
 
 class ThreadPool {
 public:
-    explicit ThreadPool(size_t numThreads = 4) : stop_(false) {
+    // threadInit在每个工作线程启动时执行一次（例如初始化线程局部的日志实例）
+    explicit ThreadPool(size_t numThreads = 4, std::function<void()> threadInit = nullptr) : stop_(false) {
         for (size_t i = 0; i < numThreads; ++i) {
-            workers_.emplace_back([this] {
+            workers_.emplace_back([this, threadInit] {
+                if (threadInit) {
+                    threadInit();
+                }
                 while (true) {
                     std::function<void()> task;
                     {
@@ -0,0 +1,143 @@
+#ifndef WIRE_PROTOCOL_HPP
+#define WIRE_PROTOCOL_HPP
+
+#include "utils.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// 版本化的二进制帧协议
+//
+// 握手：连接建立后客户端先发送5字节HELLO（4字节魔数 + 客户端支持的最高版本），
+// 服务器回复魔数 + 选定的版本。魔数首尾字节的最高位都为1，无论按哪种字节序都解读为
+// 负的命令长度：旧服务器分配命令缓冲区时立即失败并关闭连接（正的长度会让它按该长度
+// 分配上GB内存并继续等待）。客户端在连接关闭或WIRE_HELLO_TIMEOUT_MS内没有回复时
+// 重新连接并回退到文本模板协议。
+//
+// 帧（版本1）：
+//   u32 帧体长度（与其它int相同的线路字节序） | u8 操作码 | varint 请求ID | 字段...
+// 字段：varint无符号整数、zigzag varint有符号整数、varint长度前缀的字节串（名字不再有长度上限）
+// 帧只承载命令和元数据，分片数据、信号和状态int仍沿用原有的二进制格式
+constexpr unsigned char WIRE_MAGIC[4] = {0xDF, 'D', 'F', 0xDF};
+constexpr uint8_t WIRE_VERSION_TEXT = 0;       // printf/sscanf文本模板
+constexpr uint8_t WIRE_VERSION_BINARY = 1;
+constexpr uint8_t WIRE_VERSION_MAX = WIRE_VERSION_BINARY;
+constexpr size_t WIRE_HELLO_SIZE = 5;
+constexpr int WIRE_HELLO_TIMEOUT_MS = 5000;                // 等待HELLO回复的上限
+constexpr size_t WIRE_MAX_FRAME_SIZE = 16 * 1024 * 1024;   // 命令/元数据帧体的上限
+constexpr size_t WIRE_MAX_NAME_SIZE = 4096;                // 单个用户名/路径/文件名的上限
+
+enum class WireOpcode : uint8_t {
+    AUTH = 0x01,
+    LIST = 0x02,
+    GET = 0x03,
+    PUT = 0x04,
+    MKDIR = 0x05,
+    RESUME = 0x06,          // 用会话令牌代替密码建立会话
+    LIST_NEXT = 0x07,       // 请求LIST的下一页，携带上一页的续传游标
+    CHUNK_INFO = 0x81,      // 服务器 -> 客户端：LIST/GET的分片信息
+    SESSION_TOKEN = 0x82    // 服务器 -> 客户端：AUTH/RESUME成功后签发的会话令牌
+};
+
+// 构建一帧：构造时写入长度占位、操作码和请求ID，finish()回填长度
+class WireWriter {
+public:
+    WireWriter(WireOpcode opcode, uint64_t requestId);
+
+    void putVarint(uint64_t value);
+    void putSigned(int64_t value);
+    void putBytes(std::string_view bytes);
+
+    // 回填帧体长度，返回完整的帧（含4字节长度）
+    const std::vector<unsigned char>& finish();
+
+private:
+    std::vector<unsigned char> frame_;
+};
+
+// 在已接收的帧体上顺序解析，不复制数据；越界或编码非法时抛出std::runtime_error
+class WireReader {
+public:
+    WireReader(const unsigned char* data, size_t size);
+
+    uint64_t getVarint();
+    int64_t getSigned();
+    // 返回指向帧体内部的视图，长度超过maxSize视为非法
+    std::string_view getBytes(size_t maxSize = WIRE_MAX_NAME_SIZE);
+    bool atEnd() const { return pos_ == size_; }
+
+private:
+    const unsigned char* data_;
+    size_t size_;
+    size_t pos_;
+};
+
+// 解码后的命令帧
+struct WireCommand {
+    int flag;               // CommandFlag
+    uint64_t request_id;
+    User user;              // 仅AUTH携带
+    std::string token;      // 仅RESUME携带
+    std::string folder;
+    std::string file_name;
+
+    WireCommand() : flag(-1), request_id(0) {}
+};
+
+class WireProtocol {
+public:
+    // 握手
+    static bool isHello(int firstValue);
+    static void sendHello(int socket, uint8_t version);
+    // 读取HELLO魔数之后的版本字节（服务器）或完整的HELLO回复（客户端），返回对端版本；
+    // recvHello在WIRE_HELLO_TIMEOUT_MS内没有收到回复时抛出异常
+    static uint8_t recvHelloVersion(int socket);
+    static uint8_t recvHello(int socket);
+
+    // 帧收发：recvFrameBody在帧长度int已读取后接收帧体
+    static void sendFrame(int socket, const std::vector<unsigned char>& frame);
+    static void recvFrameBody(int socket, int frameSize, std::vector<unsigned char>& body);
+    static void recvFrame(int socket, std::vector<unsigned char>& body);
+
+    // 命令编解码：flag为CommandFlag
+    static void encodeCommand(std::vector<unsigned char>& frame, int flag, uint64_t requestId,
+                              const std::string& folder, const std::string& fileName);
+    static void encodeAuth(std::vector<unsigned char>& frame, uint64_t requestId, const User& user);
+    static void encodeResume(std::vector<unsigned char>& frame, uint64_t requestId, const std::string& token);
+    static void decodeCommand(const std::vector<unsigned char>& body, WireCommand& command);
+
+    // LIST/GET回复中的分片信息：每项只占名字长度加几个字节，取代固定116字节的ChunkInfo
+    static void encodeServerChunksInfo(std::vector<unsigned char>& frame, uint64_t requestId,
+                                       const ServerChunksInfo& serverChunksInfo);
+    static void decodeServerChunksInfo(const std::vector<unsigned char>& body, uint64_t& requestId,
+                                       ServerChunksInfo& serverChunksInfo);
+
+    // 分页LIST：每页是一个CHUNK_INFO帧，末尾追加 varint more | bytes 续传游标；
+    // more为1时客户端用LIST_NEXT带回游标请求下一页。分页字段之后是各文件的对象数（varint 文件数 | zigzag 对象数...），
+    // 每个文件的ID列表带上服务器保存的全部对象ID；GET回复按最后一页编码
+    static void encodeListPage(std::vector<unsigned char>& frame, uint64_t requestId,
+                               const ServerChunksInfo& page, bool more, const std::string& cursor);
+    static void decodeListPage(const std::vector<unsigned char>& body, uint64_t& requestId,
+                               ServerChunksInfo& page, bool& more, std::string& cursor);
+    static void encodeListNext(std::vector<unsigned char>& frame, uint64_t requestId, const std::string& cursor);
+    static void decodeListNext(const std::vector<unsigned char>& body, uint64_t& requestId, std::string& cursor);
+
+    // AUTH/RESUME成功回复之后的会话令牌，令牌对客户端是不透明的字节串
+    static void encodeSessionToken(std::vector<unsigned char>& frame, uint64_t requestId,
+                                   const std::string& token, int ttlSeconds);
+    static void decodeSessionToken(const std::vector<unsigned char>& body, uint64_t& requestId,
+                                   std::string& token, int& ttlSeconds);
+
+    static uint64_t nextRequestId();
+
+    // 客户端记录每个连接协商出的版本和最近一条命令的请求ID
+    static void setConnectionVersion(int socket, uint8_t version);
+    static uint8_t connectionVersion(int socket);
+    static void setLastRequestId(int socket, uint64_t requestId);
+    static uint64_t lastRequestId(int socket);
+    static void forgetConnection(int socket);
+};
+
+#endif // WIRE_PROTOCOL_HPP
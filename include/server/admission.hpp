@@ -0,0 +1,108 @@
+#ifndef ADMISSION_HPP
+#define ADMISSION_HPP
+
+#include <sys/types.h>
+#include <cstdint>
+
+constexpr int ADMISSION_WAIT_SLICE_MS = 50;         // 排队或等待预算时每次睡眠的最长时间，醒来后检查超时和已退出的持有者
+constexpr int ADMISSION_MIN_RETRY_AFTER_MS = 50;    // 拒绝时建议客户端等待的时间范围
+constexpr int ADMISSION_MAX_RETRY_AFTER_MS = 5000;
+
+// 服务器范围的准入控制：限制同时执行的命令数和正在接收的PUT对象字节数，过载时排队或快速拒绝
+//
+// 状态放在启动时（fork任何子进程和创建线程之前）映射的匿名共享内存中，fork模式的各连接进程、
+// epoll/分片模式的各线程共用同一组计数。布局：头部（健壮互斥锁、计数） | 槽位表
+// - 每条LIST/GET/PUT/MKDIR命令执行前占用一个槽位，槽位用完时在头部的futex上排队等待；
+//   排队的命令数达到上限或等待超时后拒绝，并根据最近命令的平均执行时间给出建议的重试间隔
+// - PUT接收每个对象之前按对象长度预留字节，预算不足时暂停读取socket，由TCP流控让客户端慢下来；
+//   一个命令同时只预留一个对象，预留在对象接收完后释放，不会出现互相等待
+// - 槽位记录持有者的pid，持有槽位的进程被杀死后，等待者会回收它的槽位和预留的字节
+class AdmissionControl {
+public:
+    struct Limits {
+        int maxRequests;            // 同时执行的命令数
+        int maxQueued;              // 等待槽位的命令数，再多的命令立即拒绝
+        int queueTimeoutMs;         // 命令排队的最长时间
+        uint64_t inflightBytes;     // 正在接收的PUT对象字节数的预算
+    };
+
+    struct Stats {
+        uint64_t admitted;
+        uint64_t queued;            // 曾经排队等待的命令数
+        uint64_t rejected;
+        uint32_t active;            // 当前执行中的命令数
+        uint32_t waiting;           // 当前排队的命令数
+        uint64_t inflightBytes;     // 当前预留的字节数
+    };
+
+    // 一条命令的准入结果；准入的命令在Ticket析构时释放槽位和预留的字节
+    class Ticket {
+    public:
+        Ticket() : control_(nullptr), slot_(-1), admitted_(true), retryAfterMs_(0) {}
+        Ticket(Ticket&& other) noexcept;
+        Ticket& operator=(Ticket&& other) noexcept;
+        ~Ticket();
+        Ticket(const Ticket&) = delete;
+        Ticket& operator=(const Ticket&) = delete;
+
+        bool admitted() const { return admitted_; }
+        // 被拒绝时建议客户端重试前等待的毫秒数
+        int retryAfterMs() const { return retryAfterMs_; }
+
+        // 为下一个对象预留bytes字节，替换此前的预留；预算不足时等待其他命令释放，0表示只释放
+        void reserve(uint64_t bytes);
+
+    private:
+        friend class AdmissionControl;
+        Ticket(AdmissionControl* control, int32_t slot, bool admitted, int retryAfterMs)
+            : control_(control), slot_(slot), admitted_(admitted), retryAfterMs_(retryAfterMs) {}
+
+        AdmissionControl* control_;
+        int32_t slot_;
+        bool admitted_;
+        int retryAfterMs_;
+    };
+
+    // 映射共享的计数和槽位表；映射失败时isAvailable()为false
+    explicit AdmissionControl(const Limits& limits);
+    ~AdmissionControl();
+    AdmissionControl(const AdmissionControl&) = delete;
+    AdmissionControl& operator=(const AdmissionControl&) = delete;
+
+    bool isAvailable() const { return header_ != nullptr; }
+
+    // 启动时创建服务器共享的准入控制
+    static void createShared(const Limits& limits);
+    // 服务器共享的准入控制，没有时返回nullptr
+    static AdmissionControl* shared();
+    // 用共享的准入控制为一条命令申请槽位，没有共享实例时直接准入
+    static Ticket admitShared();
+
+    // 申请槽位：有空闲槽位时立即返回；否则排队，队列已满或等待超时时返回被拒绝的Ticket
+    Ticket admit();
+
+    Stats stats();
+
+private:
+    struct Header;
+    struct Slot;
+
+    void lock();
+    void unlock();
+    // 等待其他命令释放槽位或字节，最多timeoutMs毫秒；调用时持有锁，返回时重新持有锁
+    void waitLocked(int timeoutMs);
+    void wakeLocked();
+    int32_t takeSlotLocked();
+    // 回收已退出进程持有的槽位，返回回收的数量
+    int reclaimLocked();
+    int retryAfterLocked() const;
+    void reserve(int32_t slot, uint64_t bytes);
+    void release(int32_t slot);
+
+    void* map_;
+    size_t mapSize_;
+    Header* header_;
+    Slot* slots_;
+};
+
+#endif // ADMISSION_HPP
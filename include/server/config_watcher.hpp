@@ -0,0 +1,38 @@
+#ifndef CONFIG_WATCHER_HPP
+#define CONFIG_WATCHER_HPP
+
+#include <string>
+
+// 监视dfs.conf，文件被改写或收到SIGHUP时通知重新加载
+// - inotify监视配置文件所在的目录：原地改写（IN_CLOSE_WRITE）和写临时文件后rename替换（IN_MOVED_TO）都能看到，
+//   只在写入方关闭文件后通知，不会读到写了一半的文件
+// - SIGHUP由signalfd接收：blockReloadSignal()在启动时屏蔽SIGHUP，之后fork的子进程和创建的线程都继承屏蔽，
+//   信号挂起在进程上等待读取，不会终止服务器
+// 两个描述符都注册在一个epoll实例中，调用者只需等待fd()可读
+class ConfigWatcher {
+public:
+    // 监视失败时isAvailable()为false，服务器继续使用启动时读取的配置
+    explicit ConfigWatcher(const std::string& path);
+    ~ConfigWatcher();
+    ConfigWatcher(const ConfigWatcher&) = delete;
+    ConfigWatcher& operator=(const ConfigWatcher&) = delete;
+
+    bool isAvailable() const { return epollFd_ >= 0; }
+    int fd() const { return epollFd_; }
+
+    // 取走已到达的事件，不阻塞；配置文件被改写或收到SIGHUP时返回true
+    bool consume();
+    // 等待最多timeoutMs（-1为一直等待），需要重新加载时返回true
+    bool wait(int timeoutMs);
+
+    // 在fork任何子进程、创建任何线程之前调用
+    static void blockReloadSignal();
+
+private:
+    std::string fileName_;
+    int epollFd_;
+    int inotifyFd_;
+    int signalFd_;
+};
+
+#endif // CONFIG_WATCHER_HPP
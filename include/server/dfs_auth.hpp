@@ -0,0 +1,78 @@
+#ifndef DFS_AUTH_HPP
+#define DFS_AUTH_HPP
+
+#include "utils.hpp"
+#include <array>
+#include <cstddef>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+constexpr size_t AUTH_DIGEST_SIZE = 32;                 // SHA-256 / HMAC-SHA256输出长度
+constexpr size_t AUTH_SALT_SIZE = 16;
+constexpr size_t SESSION_TOKEN_KEY_SIZE = 32;
+constexpr int SESSION_TOKEN_TTL_SECONDS = 15 * 60;     // 会话令牌有效期
+
+using AuthDigest = std::array<unsigned char, AUTH_DIGEST_SIZE>;
+
+// 由dfs.conf构建的用户表：按用户名哈希索引，认证一次查找即可完成，与用户数量无关
+// 表中只保存加盐的SHA-256摘要，比较使用常数时间的CRYPTO_memcmp
+class UserTable {
+public:
+    UserTable();
+
+    // 同名用户以最后一次出现的为准
+    void add(const User& user);
+    bool authenticate(const User& user) const;
+    bool contains(const std::string& username) const;
+    std::vector<std::string> usernames() const;
+    size_t size() const { return digests_.size(); }
+    void clear() { digests_.clear(); }
+
+private:
+    AuthDigest digest(const std::string& password) const;
+
+    std::array<unsigned char, AUTH_SALT_SIZE> salt_;
+    std::unordered_map<std::string, AuthDigest> digests_;
+};
+
+// 运行中可以整体替换的用户表（RCU风格发布）
+// 重新读取dfs.conf时在旁边构建完整的新表，再用一次原子指针替换发布；认证时原子地取得当前表的快照，
+// 读路径不加锁，正在进行的认证继续使用旧表，旧表在最后一个快照释放时销毁
+class LiveUserTable {
+public:
+    LiveUserTable();
+
+    std::shared_ptr<const UserTable> snapshot() const;
+    void publish(std::shared_ptr<const UserTable> table);
+
+    bool authenticate(const User& user) const { return snapshot()->authenticate(user); }
+    bool contains(const std::string& username) const { return snapshot()->contains(username); }
+    std::vector<std::string> usernames() const { return snapshot()->usernames(); }
+    size_t size() const { return snapshot()->size(); }
+    void clear() { publish(std::make_shared<const UserTable>()); }
+
+private:
+    std::shared_ptr<const UserTable> table_;
+};
+
+// 无状态的会话令牌：u64过期时间 | 用户名 | HMAC-SHA256(服务器密钥, 过期时间 | 用户名)
+// 密钥在进程启动时随机生成，fork出的子进程和各工作线程/分片共享同一密钥，
+// 任意连接上出示的令牌都可以只靠一次HMAC校验，不需要查询共享的会话表；服务器重启后旧令牌全部失效
+class SessionTokens {
+public:
+    SessionTokens();
+
+    std::string issue(const std::string& username, time_t now) const;
+    // 签名正确且未过期时返回true并取出用户名
+    bool verify(const std::string& token, time_t now, std::string& username) const;
+
+private:
+    AuthDigest sign(const unsigned char* data, size_t size) const;
+
+    std::array<unsigned char, SESSION_TOKEN_KEY_SIZE> key_;
+};
+
+#endif // DFS_AUTH_HPP
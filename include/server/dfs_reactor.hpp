@@ -0,0 +1,112 @@
+#ifndef DFS_REACTOR_HPP
+#define DFS_REACTOR_HPP
+
+#include "dfsutils.hpp"
+#include "thread_pool.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+constexpr int REACTOR_MAX_EVENTS = 1024;
+constexpr int ACCEPT_RETRY_MS = 100;   // fd用完导致accept失败后，等待多久再重试
+constexpr size_t REACTOR_MAX_GATED_FRAME = 64 * 1024;   // 事件循环等待完整到达的命令帧上限，更长的帧直接派发
+
+// epoll事件循环：单进程管理所有连接，替代每连接fork
+// - 监听套接字为非阻塞，事件循环线程只负责accept和等待连接可读
+// - 连接上有命令到达时，以EPOLLONESHOT方式摘下该连接，交给有界工作线程池
+//   执行现有的LIST/GET/PUT/MKDIR处理流程（包括磁盘I/O）
+// - 事件循环用MSG_PEEK查看帧长度，命令帧完整到达内核缓冲区后才派发；不完整时用SO_RCVLOWAT
+//   等待剩余字节，只发了半条命令的连接不占用工作线程
+// - 看门狗线程监视不完整的命令帧和正在执行的命令：命令帧ioTimeout秒内没有到齐，
+//   或命令连续ioTimeout秒没有收发任何字节时，关闭该连接的读写，阻塞在上面的收发立即出错返回
+// - 空闲连接只占用一个fd和epoll条目，不占用线程或进程
+// - workers为0时不创建线程池，命令直接在事件循环线程中执行（分片模式）
+// - 已认证的会话连接在每条命令结束后重新加入epoll，等待下一条命令
+// - 连接数达到maxConnections时暂停监听套接字的事件，新连接留在内核的listen队列中，
+//   有连接关闭后恢复accept；accept因fd用完（EMFILE/ENFILE）失败时同样暂停，
+//   有连接关闭或ACCEPT_RETRY_MS后恢复
+// - 按用户限速的等待不在执行命令的线程中睡眠：命令结束后连接暂不重新加入epoll，
+//   由timerfd在等待时间到期后再加入，同一线程上其他用户的命令不受影响；
+//   因此限速只作用在命令边界，单条命令的传输全速进行
+class DfsReactor {
+public:
+    // ioTimeoutSec为0时不启动看门狗
+    DfsReactor(int listenFd, DfsConfig& conf, int port, int workers, int maxConnections, int ioTimeoutSec);
+    ~DfsReactor();
+
+    DfsReactor(const DfsReactor&) = delete;
+    DfsReactor& operator=(const DfsReactor&) = delete;
+
+    // 运行事件循环（不返回，除非epoll出现不可恢复的错误）
+    void run();
+
+    size_t getActiveConnections() const { return activeConnections_; }
+
+private:
+    // 每个连接的状态，通过epoll_event.data.ptr关联
+    struct Connection {
+        int fd;
+        int lowat;      // 当前的SO_RCVLOWAT，等待命令帧剩余字节时大于1
+        DfsSession session;
+    };
+
+    // 看门狗监视的连接：到期时间，以及progress为true时上次看到的收发字节数
+    struct Watch {
+        uint64_t deadline;
+        uint64_t bytes;
+        bool progress;
+    };
+
+    enum class FrameState {
+        READY,      // 命令帧已完整到达（或长度非法，由处理流程报告错误）
+        PARTIAL,    // 还在等待剩余字节
+        IDLE,       // 没有可读的数据
+        CLOSED      // 对端关闭或连接出错
+    };
+
+    void acceptConnections();
+    void onReadable(Connection* conn, uint32_t events);
+    FrameState pollFrame(Connection* conn, uint32_t events);
+    void setLowat(Connection* conn, int lowat);
+    // progress为true时，每次看到收发字节增加都推迟到期时间；否则到期时间固定
+    void watch(Connection* conn, bool progress);
+    void unwatch(Connection* conn);
+    void runWatchdog();
+    void dispatch(Connection* conn);
+    void handleRequest(Connection* conn);
+    void rearmConnection(Connection* conn);
+    // 等待us微秒后再重新加入epoll；conn为空时到期后恢复accept
+    void parkConnection(Connection* conn, uint64_t us);
+    // 重新加入等待时间已到期的连接，并把timerfd设为下一个到期时间
+    void resumeParked();
+    // 调用者持有parkedMutex_
+    void armTimer(uint64_t deadline);
+    void closeConnection(Connection* conn);
+    // 打开或关闭监听套接字上的EPOLLIN
+    void setAccepting(bool accepting);
+
+    int listenFd_;
+    int epollFd_;
+    Connection timer_;                              // fd为timerfd，在epoll事件中与连接区分
+    std::mutex parkedMutex_;
+    std::multimap<uint64_t, Connection*> parked_;   // 按到期时间（CLOCK_MONOTONIC纳秒）排序，空指针表示恢复accept
+    DfsConfig& conf_;
+    int port_;
+    bool inline_;
+    size_t maxConnections_;
+    std::atomic<size_t> activeConnections_;
+    std::atomic<bool> acceptPaused_;
+    uint64_t ioTimeoutNs_;
+    std::mutex watchMutex_;
+    std::condition_variable watchCv_;
+    std::unordered_map<Connection*, Watch> watched_;
+    bool stopping_;
+    std::thread watchdog_;
+    ThreadPool workers_;
+};
+
+#endif // DFS_REACTOR_HPP
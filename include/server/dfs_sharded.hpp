@@ -0,0 +1,32 @@
+#ifndef DFS_SHARDED_HPP
+#define DFS_SHARDED_HPP
+
+#include "dfsutils.hpp"
+#include <vector>
+
+// 每核一个分片的服务器（thread-per-core）
+// - 每个分片是一个绑定到固定CPU核的线程，拥有自己的SO_REUSEPORT监听套接字，
+//   内核按连接四元组哈希把新连接分发到各分片，不存在共享的accept队列
+// - 分片内部是一个不带线程池的DfsReactor，命令在本线程内执行完成；事件循环只执行
+//   已完整到达的命令帧，只发了半条命令的连接不会占住分片，命令收发停顿超过io_timeout时
+//   由看门狗关闭连接，分片最多被一个卡住的客户端阻塞io_timeout秒
+// - 日志实例和对象I/O缓冲区都是线程局部的，分片之间只共享只读的DfsConfig
+class DfsShardedServer {
+public:
+    DfsShardedServer(DfsConfig& conf, const DfsServerOptions& options);
+
+    // 启动所有分片并等待它们退出
+    void run();
+
+    // 当前进程可用的CPU核列表（遵循sched_setaffinity/taskset的限制）
+    static std::vector<int> availableCpus();
+
+private:
+    void runShard(int shardId, int cpu);
+
+    DfsConfig& conf_;
+    const DfsServerOptions& options_;
+    std::vector<int> cpus_;
+};
+
+#endif // DFS_SHARDED_HPP
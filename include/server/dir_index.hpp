@@ -0,0 +1,90 @@
+#ifndef DIR_INDEX_HPP
+#define DIR_INDEX_HPP
+
+#include "utils.hpp"
+#include <sys/types.h>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+constexpr const char* DIR_INDEX_FILE = ".dfs.index";    // 后缀不是数字，不会被当作对象文件
+constexpr const char DIR_INDEX_MAGIC[8] = {'D', 'F', 'S', 'I', 'D', 'X', '0', '1'};
+constexpr size_t DIR_INDEX_COMPACT_MIN_RECORDS = 4096;  // 记录数超过该值且超过存活条目两倍时重写索引
+constexpr size_t DIR_INDEX_CACHE_MAX = 1024;            // 进程内缓存的目录索引数上限，超出时淘汰最久未用的
+
+// 每个目录一个持久化的元数据索引，取代LIST/GET时对整个目录的glob扫描
+//
+// 索引文件 <目录>/.dfs.index 是只追加的记录日志：
+//   8字节魔数 | 记录...
+//   对象记录：u8 'O' | u32 名字长度 | 名字 | i32 对象ID | u64 对象大小
+//   目录记录：u8 'D' | u32 名字长度 | 名字
+// 同一对象的后一条记录覆盖前一条。PUT提交对象、创建子目录时追加一条记录；
+// 索引文件不存在（旧数据或新目录）时扫描一次目录重建。
+//
+// 进程内每个目录共享一个实例，按记录偏移增量读取其他进程（fork模式的子进程）追加的记录；
+// 追加、重建和压缩在目录的flock排它锁下进行，读取不加锁，只解析完整的记录。
+// 实例按LRU缓存至多DIR_INDEX_CACHE_MAX个目录；被淘汰的实例在最后一个使用者释放后销毁，
+// 之后再访问该目录时重新加载索引文件
+class DirIndex {
+public:
+    explicit DirIndex(const std::string& folderPath);
+
+    // 进程内按目录路径共享的索引实例
+    static std::shared_ptr<DirIndex> forDirectory(const std::string& folderPath);
+    // 当前缓存的目录索引数
+    static size_t cachedDirectories();
+    // 记录rootPath下到folderPath为止的每一级子目录（创建目录后调用，已记录的不会重复追加）
+    static void recordFolderPath(const std::string& rootPath, const std::string& folderPath);
+
+    void recordObject(const std::string& fileName, int objectId, uint64_t size);
+    void recordFolder(const std::string& folderName);
+
+    // LIST：目录下的全部文件，按名字排序，带上每个文件的对象ID和对象数
+    void listFiles(ServerChunksInfo& serverChunks);
+    // 分页LIST：名字大于after的至多limit个文件，返回之后是否还有文件
+    bool listFilesPage(const std::string& after, size_t limit, ServerChunksInfo& page);
+    // GET：只返回指定文件的条目，文件不存在时返回false
+    bool findFile(const std::string& fileName, ServerChunksInfo& serverChunks);
+    // 子目录列表，格式与Utils::getFoldersInFolder相同（每行"名字/\n"）
+    int listFolders(std::vector<unsigned char>& payload);
+
+private:
+    struct FileEntry {
+        std::map<int, uint64_t> objects;    // 对象ID -> 大小
+        bool countLoaded;                   // objectCount已从元数据对象读出，元数据对象的记录更新时失效
+        int objectCount;                    // 元数据对象中的对象数，-1表示没有或读不出
+
+        FileEntry() : countLoaded(false), objectCount(-1) {}
+    };
+
+    // 读取索引文件中尚未加载的记录；文件不存在或格式不对时重建
+    // dirLocked表示调用方已持有目录锁
+    void refreshLocked(bool dirLocked);
+    // 以下在持有目录排它锁时调用
+    void rebuildLocked();
+    void compactLocked();
+    void appendLocked(const std::vector<unsigned char>& record);
+    void writeIndexFile(const std::vector<unsigned char>& contents);
+    // 解析一段记录，返回完整记录占用的字节数
+    size_t applyRecords(const unsigned char* data, size_t size);
+    void clearEntries();
+    // 填入文件的全部对象ID和元数据对象中的对象数（首次需要时读取元数据对象）
+    void fillChunkInfo(const std::string& fileName, FileEntry& entry, ChunkInfo& chunkInfo);
+    int readObjectCount(const std::string& fileName) const;
+
+    std::string folderPath_;
+    std::string indexPath_;
+    std::mutex mutex_;
+    std::map<std::string, FileEntry> files_;
+    std::set<std::string> folders_;
+    ino_t inode_;
+    off_t loadedSize_;      // 已解析的完整记录的末尾偏移
+    size_t records_;        // 已加载的记录数，用于判断何时压缩
+    size_t objects_;        // 存活的对象数
+};
+
+#endif // DIR_INDEX_HPP
@@ -0,0 +1,62 @@
+#ifndef IO_URING_HPP
+#define IO_URING_HPP
+
+#include <linux/io_uring.h>
+#include <cstddef>
+#include <cstdint>
+
+constexpr unsigned IO_URING_QUEUE_DEPTH = 64;
+
+// io_uring的最小封装，直接使用io_uring_setup/io_uring_enter系统调用，不依赖liburing
+// 每个实例只能由一个线程使用
+class IoUring {
+public:
+    explicit IoUring(unsigned entries = IO_URING_QUEUE_DEPTH);
+    ~IoUring();
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    // 内核不支持或被禁止（ENOSYS/EPERM）时返回false，调用方应回退到阻塞路径
+    bool isAvailable() const { return ringFd_ >= 0; }
+
+    // 获取一个空闲SQE（已清零），队列满时返回nullptr
+    struct io_uring_sqe* getSqe();
+
+    // 提交所有已准备的SQE，并等待至少waitNr个完成事件，返回提交数量，失败返回-errno
+    int submitAndWait(unsigned waitNr);
+
+    // 取出一个完成事件，没有可用事件时返回false
+    bool popCqe(uint64_t& userData, int& res);
+
+    // 队列中尚可准备的SQE数量
+    unsigned getFreeSqes() const;
+
+private:
+    bool setup(unsigned entries);
+    void teardown();
+
+    int ringFd_;
+
+    void* sqRingPtr_;
+    size_t sqRingSize_;
+    void* cqRingPtr_;
+    size_t cqRingSize_;
+    struct io_uring_sqe* sqes_;
+    size_t sqesSize_;
+
+    unsigned* sqHead_;
+    unsigned* sqTail_;
+    unsigned* sqRingMask_;
+    unsigned* sqRingEntries_;
+    unsigned* sqArray_;
+    unsigned sqeHead_;   // 已提交给内核的位置
+    unsigned sqeTail_;   // 已准备但尚未提交的位置
+
+    unsigned* cqHead_;
+    unsigned* cqTail_;
+    unsigned* cqRingMask_;
+    struct io_uring_cqe* cqes_;
+};
+
+#endif // IO_URING_HPP
@@ -0,0 +1,140 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <sys/types.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+constexpr int HISTOGRAM_SUB_BUCKET_BITS = 6;    // 每个2的幂区间分成32个子桶，相对误差不超过约3%
+constexpr size_t HISTOGRAM_SUB_BUCKETS = 1 << HISTOGRAM_SUB_BUCKET_BITS;
+constexpr size_t HISTOGRAM_BUCKETS = HISTOGRAM_SUB_BUCKETS + (64 - HISTOGRAM_SUB_BUCKET_BITS) * (HISTOGRAM_SUB_BUCKETS / 2);
+constexpr int METRICS_HTTP_TIMEOUT_MS = 2000;   // 导出进程读取一个HTTP请求的最长时间
+constexpr size_t METRICS_HTTP_REQUEST_MAX = 8192;
+
+// 统计延迟的命令
+enum class MetricCommand {
+    LIST = 0,
+    GET,
+    PUT,
+    MKDIR,
+    COUNT
+};
+
+// 命令内部各阶段：每次磁盘或网络调用单独计时，磁盘变慢和排队在对应阶段的长尾上可以直接看到
+enum class MetricStage {
+    AUTH = 0,       // 密码或会话令牌校验
+    QUEUE,          // 等待准入槽位
+    DISK_READ,      // 直接I/O读、载入缓存
+    DISK_WRITE,     // 对象写入
+    DISK_SYNC,      // 组提交的syncfs
+    NET_SEND,       // 对象发送（sendfile从页缓存读取的时间也计在这里）
+    NET_RECV,       // 对象接收（io_uring的PUT链中写盘的时间也计在这里）
+    COUNT
+};
+
+enum class MetricCounter {
+    BYTES_IN = 0,   // PUT接收的对象字节
+    BYTES_OUT,      // GET发送的对象字节
+    AUTH_FAILURES,
+    COUNT
+};
+
+// HDR风格的延迟直方图（微秒）：小于64的值各占一个桶，之后每个2的幂区间分成32个桶，
+// 记录只做原子加，不加锁；直方图本身放在共享内存中，可以被多个进程同时记录
+class LatencyHistogram {
+public:
+    void record(uint64_t us);
+
+    uint64_t count() const;
+    uint64_t sumUs() const;
+    uint64_t maxUs() const;
+    // 不超过limitUs的记录数（按桶的精度）
+    uint64_t countAtOrBelow(uint64_t limitUs) const;
+    // 分位数q（0~1）对应的值，没有记录时为0
+    uint64_t valueAtQuantile(double q) const;
+
+    static size_t bucketIndex(uint64_t us);
+    // 桶内的最小值和最大值
+    static uint64_t bucketLow(size_t index);
+    static uint64_t bucketHigh(size_t index);
+
+private:
+    uint64_t buckets_[HISTOGRAM_BUCKETS];
+    uint64_t count_;
+    uint64_t sumUs_;
+    uint64_t maxUs_;
+};
+
+// 服务器范围的计数和延迟直方图，以Prometheus文本格式导出
+//
+// 与对象缓存、准入控制一样放在启动时映射的匿名共享内存中，fork模式的连接进程和epoll/分片模式的线程
+// 记录到同一组计数。记录路径只有原子加（最大值用CAS），没有锁；没有共享实例时（客户端、单元测试）记录是空操作。
+// --metrics-port启用时fork一个导出进程，在该端口上用HTTP回复GET /metrics，
+// 内容包括这里的计数、准入控制、对象缓存和各用户限速的统计
+class Metrics {
+public:
+    // 在析构时把经过的时间记录到一个阶段
+    class Timer {
+    public:
+        explicit Timer(MetricStage stage);
+        ~Timer();
+        Timer(const Timer&) = delete;
+        Timer& operator=(const Timer&) = delete;
+
+    private:
+        MetricStage stage_;
+        uint64_t startNs_;
+    };
+
+    // 在析构时记录一条命令的执行时间和结果；没有调用succeeded()的命令（包括抛出异常的）计为失败
+    class CommandTimer {
+    public:
+        explicit CommandTimer(MetricCommand command);
+        ~CommandTimer();
+        CommandTimer(const CommandTimer&) = delete;
+        CommandTimer& operator=(const CommandTimer&) = delete;
+
+        void succeeded() { ok_ = true; }
+
+    private:
+        MetricCommand command_;
+        uint64_t startNs_;
+        bool ok_;
+    };
+
+    // 映射共享的计数；映射失败时isAvailable()为false
+    Metrics();
+    ~Metrics();
+    Metrics(const Metrics&) = delete;
+    Metrics& operator=(const Metrics&) = delete;
+
+    bool isAvailable() const { return state_ != nullptr; }
+
+    // 启动时创建服务器共享的计数
+    static void createShared();
+    // 服务器共享的计数，没有时返回nullptr
+    static Metrics* shared();
+
+    static void add(MetricCounter counter, uint64_t value);
+    static void recordStage(MetricStage stage, uint64_t us);
+    static void recordCommand(MetricCommand command, uint64_t us, bool ok);
+
+    uint64_t counter(MetricCounter counter) const;
+    uint64_t commands(MetricCommand command, bool ok) const;
+    const LatencyHistogram& commandLatency(MetricCommand command) const;
+    const LatencyHistogram& stageLatency(MetricStage stage) const;
+
+    // Prometheus文本格式（0.0.4）的全部指标
+    std::string render() const;
+
+    // fork导出进程，在port上提供GET /metrics，父进程退出时随之退出；返回导出进程的pid，失败时返回-1
+    static pid_t startExporter(int port);
+
+private:
+    struct State;
+
+    State* state_;
+};
+
+#endif // METRICS_HPP
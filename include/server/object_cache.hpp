@@ -0,0 +1,98 @@
+#ifndef OBJECT_CACHE_HPP
+#define OBJECT_CACHE_HPP
+
+#include <sys/types.h>
+#include <cstdint>
+#include <string>
+
+constexpr size_t OBJECT_CACHE_BLOCK_SIZE = 16 * 1024;   // 缓存空间的分配单位，对象占用一串块
+constexpr size_t OBJECT_CACHE_KEY_MAX = 240;            // 更长的对象路径不缓存
+constexpr uint64_t OBJECT_CACHE_MAX_FRACTION = 4;       // 大于预算1/4的对象不缓存，避免一个对象冲掉整个缓存
+constexpr uint64_t OBJECT_CACHE_STATS_INTERVAL = 1000;  // 每隔多少次查找记录一次命中统计
+
+// 服务器范围的对象缓存：GET过的对象保存在共享内存中，之后的GET直接从内存发送，不再读磁盘
+//
+// 缓存在启动时（fork任何子进程和创建线程之前）映射为匿名共享内存，fork模式下每个连接的子进程、
+// epoll/分片模式下的各线程看到的是同一份缓存。映射布局：
+//   头部（进程间共享的健壮互斥锁、统计计数） | 哈希桶 | 条目表 | 块链表 | 数据块
+// 对象按OBJECT_CACHE_BLOCK_SIZE分块存放，块之间用下标串成链，空闲块组成空闲链表。
+// 空间不足时按CLOCK淘汰：时钟指针扫过条目表，最近命中过的条目清除访问位后跳过，其余的被淘汰。
+//
+// 载入时按调用方给出的CRC32C校验对象内容，校验失败的对象不进入缓存；命中时直接发送已校验过的内容。
+// 缓存不负责失效：每个条目带有对象的版本（对象文件的inode和修改时间，或打包存储记录的段和序号），
+// 查找时版本不一致视为未命中并重新载入，PUT覆盖对象后不会读到旧内容。
+// 发送期间条目被钉住，不会被淘汰；载入中的条目其他请求视为未命中，直接从磁盘读取。
+class ObjectCache {
+public:
+    // 对象内容的版本，三项全部相同时缓存的内容才有效
+    struct Version {
+        uint64_t id;            // 文件存储：inode；打包存储：段编号
+        uint64_t stamp;         // 文件存储：修改时间（纳秒）；打包存储：记录序号
+        uint64_t length;
+
+        bool operator==(const Version& other) const {
+            return id == other.id && stamp == other.stamp && length == other.length;
+        }
+    };
+
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        uint64_t insertions;
+        uint64_t evictions;
+        uint64_t objects;       // 当前缓存的对象数
+        uint64_t bytes;         // 当前缓存的对象字节数
+        uint64_t capacity;      // 数据块的总字节数
+    };
+
+    // 映射budgetBytes字节数据空间的共享缓存；映射失败时isAvailable()为false
+    explicit ObjectCache(uint64_t budgetBytes);
+    ~ObjectCache();
+    ObjectCache(const ObjectCache&) = delete;
+    ObjectCache& operator=(const ObjectCache&) = delete;
+
+    bool isAvailable() const { return header_ != nullptr; }
+
+    // 启动时创建服务器共享的缓存，budgetBytes为0时不使用缓存
+    static void createShared(uint64_t budgetBytes);
+    // 服务器共享的缓存，没有时返回nullptr
+    static ObjectCache* shared();
+
+    // 发送9字节分片头和对象内容（fd中[offset, offset + length)，版本为version）：
+    // 命中时从缓存发送；未命中时先把对象从fd载入缓存再发送。
+    // 对象不可缓存（过大、空间都被钉住、正在被其他请求载入）或载入的内容与checksum不符时
+    // 不发送任何内容并返回false，由调用方从磁盘校验和发送；checksum为nullptr时不校验
+    bool sendObject(int socket, int splitId, const std::string& key, const Version& version,
+                    int fd, off_t offset, size_t length, const uint32_t* checksum = nullptr);
+    // 把对象读入data，未缓存或版本不一致时返回false
+    bool readObject(const std::string& key, const Version& version, std::string& data);
+
+    Stats stats();
+
+private:
+    struct Header;
+    struct Entry;
+
+    void lock();
+    void unlock();
+    int32_t findLocked(uint64_t hash, const std::string& key);
+    int32_t allocateLocked(uint64_t hash, const std::string& key, const Version& version, size_t length);
+    bool evictOneLocked();
+    void removeLocked(int32_t index);
+    void unpin(int32_t index);
+    bool loadBlocks(const Entry& entry, int fd, off_t offset);
+    uint32_t checksumBlocks(const Entry& entry);
+    void sendBlocks(int socket, int splitId, const Entry& entry);
+    unsigned char* block(int32_t index) const;
+    void logStats(const Stats& stats);
+
+    void* map_;
+    size_t mapSize_;
+    Header* header_;
+    int32_t* buckets_;
+    Entry* entries_;
+    int32_t* nextBlock_;
+    unsigned char* data_;
+};
+
+#endif // OBJECT_CACHE_HPP
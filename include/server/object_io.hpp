@@ -0,0 +1,197 @@
+#ifndef OBJECT_IO_HPP
+#define OBJECT_IO_HPP
+
+#include "dfsutils.hpp"
+#include "io_uring.hpp"
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+constexpr size_t URING_IO_CHUNK_SIZE = 1024 * 1024;     // GET每个读/写SQE处理的字节数，也是PUT每批链接的SQE接收的字节数
+constexpr unsigned URING_MAX_CHAIN_CHUNKS = 8;          // 单次io_uring_enter最多链接的数据块数
+constexpr size_t BLOCKING_IO_CHUNK_SIZE = 256 * 1024;   // 阻塞路径PUT每次recv/write的字节数
+constexpr size_t DIRECT_IO_ALIGNMENT = 4096;            // O_DIRECT要求缓冲区地址、文件偏移和长度按逻辑块对齐
+constexpr size_t DIRECT_IO_BUFFER_SIZE = 1024 * 1024;   // 直接I/O每次读/写的字节数
+constexpr size_t DIRECT_IO_POOL_BUFFERS = 64;           // 缓冲池中最多保留的空闲缓冲区数
+constexpr const char* OBJECT_CHECKSUM_XATTR = "user.dfs.crc32c";   // 对象文件上保存内容CRC32C的扩展属性
+
+// 直接I/O使用的对齐缓冲区池：缓冲区按DIRECT_IO_ALIGNMENT对齐，用完归还后复用，
+// 各连接的GET/PUT不必每次分配和释放1MB的对齐内存
+class AlignedBufferPool {
+public:
+    // 从池中借出的缓冲区，析构时归还
+    class Buffer {
+    public:
+        Buffer(AlignedBufferPool& pool, unsigned char* data) : pool_(&pool), data_(data) {}
+        ~Buffer();
+        Buffer(Buffer&& other) noexcept : pool_(other.pool_), data_(other.data_) { other.data_ = nullptr; }
+        Buffer(const Buffer&) = delete;
+        Buffer& operator=(const Buffer&) = delete;
+        Buffer& operator=(Buffer&&) = delete;
+
+        unsigned char* data() const { return data_; }
+        size_t size() const { return DIRECT_IO_BUFFER_SIZE; }
+
+    private:
+        AlignedBufferPool* pool_;
+        unsigned char* data_;
+    };
+
+    AlignedBufferPool() : allocated_(0) {}
+    ~AlignedBufferPool();
+    AlignedBufferPool(const AlignedBufferPool&) = delete;
+    AlignedBufferPool& operator=(const AlignedBufferPool&) = delete;
+
+    // 进程内共享的缓冲池
+    static AlignedBufferPool& instance();
+
+    // 没有空闲缓冲区时分配新的；内存不足时抛出std::bad_alloc
+    Buffer acquire();
+
+    struct Stats {
+        size_t allocated;   // 当前存在的缓冲区（借出的和空闲的）
+        size_t idle;
+    };
+    Stats stats();
+
+private:
+    void release(unsigned char* data);
+
+    std::mutex mutex_;
+    std::vector<unsigned char*> idle_;
+    size_t allocated_;
+};
+
+// 服务器对象数据路径：GET时把对象文件发送到socket，PUT时把socket上的分片写入对象文件
+// 线路格式与NetUtils::writeSplitToSocketAsStream/writeSplitFromSocketAsStream一致
+// PUT在接收的同时计算内容的CRC32C，保存在对象文件的扩展属性中；GET先校验再发送，
+// 校验失败的对象只发送带CORRUPT_OBJECT_FLAG的分片头，损坏的数据不会发到网络上
+// 设置了直接I/O阈值时，不小于阈值的对象文件用O_DIRECT读写，不经过页缓存，
+// 页缓存留给目录索引、日志等元数据和小的热点对象；文件系统不支持O_DIRECT时回退到普通读写
+class ObjectIoBackend {
+public:
+    virtual ~ObjectIoBackend() = default;
+
+    virtual const char* name() const = 0;
+
+    // 发送9字节分片头和对象内容；文件不存在时发送content_length为0的分片，校验失败时发送损坏标记
+    void sendObject(int socket, int splitId, const std::string& filePath);
+
+    // 接收9字节分片头和内容，写入fileFolder/.fileName.<id>，返回分片ID
+    // 内容按固定大小的块流式写入临时文件，接收完整后再rename为对象文件，
+    // 中途失败不会留下或覆盖成残缺的对象
+    int recvObject(int socket, const std::string& fileFolder, const std::string& fileName);
+
+    // 与recvObject相同，但内容只写入临时文件，由调用方在组提交后rename；
+    // 临时文件无法创建时读走内容并返回false
+    bool recvPartial(int socket, const std::string& fileFolder, const std::string& fileName,
+                     int& splitId, uint64_t& size);
+
+    // 发送分片头和fd中[offset, offset + length)的内容，fd保持打开
+    // （对象文件从0开始发送整个文件；打包存储从段文件中的对象位置发送）
+    virtual void sendRange(int socket, int splitId, int fd, off_t offset, size_t length) = 0;
+
+    // 把socket上length字节的对象内容写入fd的offset处，fd保持打开，返回内容的CRC32C
+    virtual uint32_t recvRange(int socket, int fd, off_t offset, size_t length) = 0;
+
+    // 检查fd中[offset, offset + length)的CRC32C；内容映射到内存中计算，不复制到缓冲区，
+    // 读入的页留在页缓存中，随后的sendfile/SPLICE直接使用。direct为true时fd已设置O_DIRECT，
+    // 改为经对齐缓冲区读取（这类对象GET时要从磁盘读两遍）
+    bool verifyRange(int fd, off_t offset, size_t length, uint32_t checksum, bool direct);
+
+    // 代替校验失败的对象发送的分片头
+    static void sendCorrupt(int socket, int splitId, const std::string& objectName);
+    // 对象文件扩展属性中的CRC32C；校验和功能之前写入的对象或文件系统不支持扩展属性时返回false
+    static bool readChecksum(int fd, uint32_t& checksum);
+
+    // 读走并丢弃socket上的length字节，用于写入失败时保持协议同步
+    void discard(int socket, size_t length);
+
+    // directThreshold为0时不使用直接I/O
+    static std::unique_ptr<ObjectIoBackend> create(DfsIoBackend type, uint64_t directThreshold = 0);
+
+    // 每个线程各自持有一个后端实例（io_uring实例不能跨线程共享）
+    static ObjectIoBackend& forThread(DfsIoBackend type, uint64_t directThreshold = 0);
+
+    static std::string objectPath(const std::string& fileFolder, const std::string& fileName, int splitId);
+    // PUT接收过程中使用的临时文件名；后缀不是数字，LIST/GET会忽略它
+    static std::string partialPath(const std::string& objectFile);
+
+    bool useDirect(uint64_t size) const { return directThreshold_ > 0 && size >= directThreshold_; }
+
+protected:
+    explicit ObjectIoBackend(size_t bufferSize) : buffer_(bufferSize), directThreshold_(0) {}
+
+    // 把接收完整的临时文件替换为对象文件
+    static void commitPartial(const std::string& objectFile);
+
+    // 直接I/O路径：fd以O_DIRECT打开，buffer是DIRECT_IO_BUFFER_SIZE大小的对齐缓冲区
+    // 文件读写的长度向上对齐到DIRECT_IO_ALIGNMENT，PUT写入的末尾填充由调用方截掉
+    virtual void sendDirect(int socket, int splitId, int fd, size_t length, unsigned char* buffer) = 0;
+    virtual uint32_t recvDirect(int socket, int fd, size_t length, unsigned char* buffer) = 0;
+
+    std::vector<unsigned char> buffer_;
+    uint64_t directThreshold_;
+};
+
+// 阻塞路径：GET用sendfile零拷贝发送对象文件，PUT以BLOCKING_IO_CHUNK_SIZE为单位recv/write
+class BlockingObjectIo : public ObjectIoBackend {
+public:
+    BlockingObjectIo();
+
+    const char* name() const override { return "blocking"; }
+    void sendRange(int socket, int splitId, int fd, off_t offset, size_t length) override;
+    uint32_t recvRange(int socket, int fd, off_t offset, size_t length) override;
+
+protected:
+    void sendDirect(int socket, int splitId, int fd, size_t length, unsigned char* buffer) override;
+    uint32_t recvDirect(int socket, int fd, size_t length, unsigned char* buffer) override;
+};
+
+// io_uring路径：socket收发和文件读写作为链接的SQE批量提交
+// GET: SEND(头) -> SPLICE(文件->管道) -> SPLICE(管道->socket) ...
+//      数据只在内核中以页引用的形式移动；管道不可用时退化为READ -> SEND
+// PUT: RECV -> WRITE -> RECV -> WRITE ...（落盘由WAL的组提交统一完成）
+//      一批中的各块接收到缓冲区的不同位置，批次完成后对整批内容计算CRC32C
+// 直接I/O的对象不能SPLICE（页缓存之外没有页可以引用），GET使用对齐缓冲区READ -> SEND
+// 所有数据块复用一个固定大小的缓冲区，每个连接的内存占用与对象大小无关
+// 批量只在单个对象之内：每批（最多URING_MAX_CHAIN_CHUNKS块）提交后等待整条链完成，再处理下一批或下一个对象，
+// 不同对象的链不会同时在途。页缓存命中时SPLICE在提交的io_uring_enter中就已完成，等待不增加系统调用；
+// 让多个对象的链同时在途（IOSQE_IO_DRAIN保序、异步取完成事件）在bench-io中反而更慢，
+// 因为在途的链要复制文件描述符并按序排空，见README中的数据
+class UringObjectIo : public ObjectIoBackend {
+public:
+    UringObjectIo();
+    ~UringObjectIo() override;
+
+    bool isAvailable() const { return ring_.isAvailable(); }
+
+    const char* name() const override { return "io_uring"; }
+    void sendRange(int socket, int splitId, int fd, off_t offset, size_t length) override;
+    uint32_t recvRange(int socket, int fd, off_t offset, size_t length) override;
+
+protected:
+    void sendDirect(int socket, int splitId, int fd, size_t length, unsigned char* buffer) override;
+    uint32_t recvDirect(int socket, int fd, size_t length, unsigned char* buffer) override;
+
+private:
+    // GET/PUT的链：zeroCopy时经管道SPLICE，否则经buffer中转；direct时文件读写长度按块对齐
+    void sendChain(int socket, int splitId, int fd, off_t offset, size_t length,
+                   unsigned char* buffer, size_t bufferSize, bool zeroCopy, bool direct);
+    uint32_t recvChain(int socket, int fd, off_t offset, size_t length,
+                       unsigned char* buffer, size_t bufferSize, bool direct);
+    // 提交当前链并等待全部完成（每个对象逐批调用，不跨对象保留在途的链）；任何一个请求失败或被取消都会抛出异常
+    void submitChain(unsigned count, const char* what);
+    void linkSqe(struct io_uring_sqe* sqe);
+    // 创建（或在链失败后重建）GET使用的中转管道，失败时pipeFds_为-1
+    void resetPipe();
+    void closePipe();
+
+    IoUring ring_;
+    int pipeFds_[2];
+    size_t pipeSize_;
+};
+
+#endif // OBJECT_IO_HPP
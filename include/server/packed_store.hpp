@@ -0,0 +1,147 @@
+#ifndef PACKED_STORE_HPP
+#define PACKED_STORE_HPP
+
+#include "object_io.hpp"
+#include <sys/types.h>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+constexpr const char* PACKED_STORE_DIR = ".dfs.store";   // 服务器目录下存放段文件的子目录
+constexpr const char PACKED_SEGMENT_MAGIC[8] = {'D', 'F', 'S', 'S', 'E', 'G', '0', '1'};
+constexpr const char PACKED_HINT_MAGIC[8] = {'D', 'F', 'S', 'H', 'N', 'T', '0', '2'};
+constexpr uint64_t PACKED_SEGMENT_SIZE = 64ULL * 1024 * 1024;   // 活动段超过该大小后封存，之后的对象写入新段
+constexpr double PACKED_COMPACT_GARBAGE_RATIO = 0.5;            // 封存段中被覆盖的字节超过该比例时压缩
+constexpr int PACKED_COMPACT_INTERVAL_SECONDS = 30;             // 后台压缩进程的检查间隔
+
+// 日志结构的打包对象存储：对象不再各占一个隐藏文件，而是顺序追加到大的段文件中
+//
+// 段文件 <服务器目录>/.dfs.store/<8位编号>.seg：
+//   8字节魔数 | 记录...
+//   记录：u32 魔数 | u8 状态 | u8 0 | u16 键长 | u64 序号 | u64 数据长度 | u32 数据的CRC32C | 键 | 数据
+//   （校验和功能之前写入的记录使用另一个魔数，没有CRC32C字段，GET时不校验）
+// 键是对象文件相对服务器目录的路径（例如 Bob/docs/.a.txt.0），与文件存储一一对应。
+// PUT在段锁下预留一条状态为R的记录，释放锁后把socket上的数据直接写入预留的位置，
+// 写完后填入接收时算出的CRC32C，再把状态改为C（失败时改为A），多个连接的PUT可以同时接收数据。
+// GET先按记录中的CRC32C校验数据，校验失败时只发送损坏标记，客户端改从其他服务器读取。
+// 同一个键以序号最大的已提交记录为准；序号在预留时分配，压缩复制记录时保留原序号。
+//
+// 每个进程在内存中保存 键 -> (段, 偏移, 长度) 的索引，GET只需一次定位读取；
+// 其他进程追加的记录按段末尾增量读取。封存且全部记录都已提交的段由压缩进程写出
+// 提示文件 <编号>.hint（只含已提交记录的键和位置），启动时读提示文件而不必扫描整个段。
+//
+// 压缩在后台进程中进行：封存段中被覆盖的字节超过PACKED_COMPACT_GARBAGE_RATIO时，
+// 把仍然有效的记录复制到活动段末尾后删除该段。写入进程崩溃留下的R记录
+// （记录上没有OFD锁）由压缩进程标记为A。
+class PackedStore {
+public:
+    explicit PackedStore(const std::string& rootPath, uint64_t segmentSize = PACKED_SEGMENT_SIZE);
+
+    // 进程内按服务器目录共享的存储实例
+    static PackedStore& forRoot(const std::string& rootPath);
+    // 路径所在服务器目录已经打开的存储，没有时返回nullptr（用于重建目录索引）
+    static PackedStore* containing(const std::string& path);
+    // fork一个后台进程周期性压缩，父进程退出时随之退出
+    static pid_t startCompactor(const std::string& rootPath);
+
+    // PUT中已接收、尚未提交的对象：记录仍是R状态，writeFd在记录首字节上持有OFD写锁，
+    // 在finish之前压缩进程不会把它当作崩溃遗留的记录回收
+    struct Pending {
+        std::string key;
+        uint64_t seq;
+        uint64_t length;
+        uint32_t segment;
+        uint64_t record;        // 记录起始偏移
+        uint32_t checksum;      // 数据的CRC32C
+        int writeFd;
+    };
+
+    // PUT：接收9字节分片头和内容，写入活动段中预留的记录；存储失败时读走内容并返回false
+    // 记录在markCommitted之后才对GET可见，之后必须调用finish
+    bool receive(int socket, ObjectIoBackend& objectIo, const std::string& fileFolder,
+                 const std::string& fileName, int& splitId, Pending& pending);
+    // 把R记录标记为C（由WAL组提交的领导者调用，记录可能是其他进程预留的）；记录已被放弃时返回false
+    bool markCommitted(uint32_t segment, uint64_t record);
+    // 结束预留并释放OFD锁：committed时（记录已标记为C）更新内存索引，否则把记录标记为A
+    void finish(Pending& pending, bool committed);
+    // 接收并立即提交，不经过WAL
+    bool recvObject(int socket, ObjectIoBackend& objectIo, const std::string& fileFolder,
+                    const std::string& fileName, int& splitId, uint64_t& size);
+    // GET：从段文件中发送对象，对象不在存储中时返回false（调用方回退到对象文件）
+    bool sendObject(int socket, ObjectIoBackend& objectIo, int splitId, const std::string& objectFile);
+    bool contains(const std::string& objectFile);
+    bool readObject(const std::string& objectFile, std::vector<unsigned char>& data);
+    // folderPath目录下的对象（不含子目录）：文件名 -> (对象ID -> 大小)
+    void listFolder(const std::string& folderPath, std::map<std::string, std::map<int, uint64_t>>& files);
+
+    // 读取其他进程追加的记录
+    void refresh();
+    // 压缩垃圾超过阈值的封存段，并为封存段写入提示文件，返回删除的段数
+    size_t compact();
+
+    struct Stats {
+        size_t segments;
+        size_t objects;
+        uint64_t liveBytes;     // 有效记录占用的字节
+        uint64_t totalBytes;    // 段文件中全部记录占用的字节
+    };
+    Stats stats();
+
+private:
+    // 段文件的读描述符，GET发送期间即使段被压缩删除也保持可读
+    struct SegmentFd {
+        explicit SegmentFd(int descriptor) : fd(descriptor) {}
+        ~SegmentFd();
+        int fd;
+    };
+
+    struct Segment {
+        std::shared_ptr<SegmentFd> file;
+        uint64_t end;           // 记录链的末尾，下一条记录的偏移
+        uint64_t stable;        // 此前的记录都已提交或放弃
+        uint64_t liveBytes;
+        size_t liveObjects;
+        bool hinted;            // 已有提示文件
+    };
+
+    struct Location {
+        uint32_t segment;
+        uint64_t seq;
+        uint64_t record;        // 记录起始偏移
+        uint64_t length;        // 数据长度
+        uint64_t recordSize;
+        bool checksummed;       // 旧格式的记录没有校验和
+        uint32_t checksum;
+    };
+
+    std::string keyFor(const std::string& objectFile) const;
+    std::string segmentPath(uint32_t id, const char* suffix) const;
+
+    // 以下在持有mutex_时调用；带Locked后缀的还要求持有段目录的flock
+    void loadIndex();
+    // 读取新段和活动段新追加的记录；reap为true时（持有flock）把写入进程已退出的R记录标记为A
+    void refreshIndex(bool reap);
+    bool openSegment(uint32_t id);
+    void scanSegment(uint32_t id, Segment& segment, bool reap);
+    bool loadHint(uint32_t id, Segment& segment);
+    void writeHintLocked(uint32_t id, Segment& segment);
+    void apply(const std::string& key, const Location& location);
+    bool reserveLocked(Pending& pending);
+    void createSegmentLocked(uint32_t id);
+    bool compactSegmentLocked(uint32_t id);
+
+    std::string rootPath_;
+    std::string storePath_;
+    uint64_t segmentSize_;
+    std::mutex mutex_;
+    bool loaded_;
+    uint64_t maxSeq_;
+    std::map<uint32_t, Segment> segments_;
+    std::unordered_map<std::string, Location> objects_;
+};
+
+#endif // PACKED_STORE_HPP
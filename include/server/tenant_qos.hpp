@@ -0,0 +1,124 @@
+#ifndef TENANT_QOS_HPP
+#define TENANT_QOS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+constexpr size_t TENANT_QOS_MAX_TENANTS = 1024;         // 共享表中最多的限速用户数
+constexpr size_t TENANT_QOS_NAME_MAX = 64;              // 更长的用户名不限速
+constexpr uint64_t TENANT_BYTES_BURST_MS = 250;         // 字节桶的容量：按限速折算的毫秒数
+constexpr uint64_t TENANT_MIN_BYTES_BURST = 1024 * 1024;
+constexpr uint64_t TENANT_OPS_BURST_MS = 1000;          // 命令桶的容量：按限速折算的毫秒数
+
+// 一个用户的限速，0表示不限
+struct TenantLimits {
+    uint64_t bytesPerSecond;    // GET发送和PUT接收的对象字节
+    uint32_t opsPerSecond;      // LIST/GET/PUT/MKDIR命令数
+
+    TenantLimits() : bytesPerSecond(0), opsPerSecond(0) {}
+    bool limited() const { return bytesPerSecond > 0 || opsPerSecond > 0; }
+};
+
+// 按用户（租户）的令牌桶限速：一个用户的大量PUT不会占满磁盘和网络，拖慢其他用户的GET/LIST
+//
+// 每个限速用户有一个字节桶和一个命令桶，放在启动时（fork任何子进程和创建线程之前）映射的匿名共享内存中，
+// 同一用户在fork模式的多个连接进程、epoll/分片模式的多个线程上的请求共用一组桶。
+// 取令牌时允许透支：调用方先扣除令牌，再睡眠到透支的部分按速率补回为止，
+// 因此大于桶容量的数据块也能通过，同一用户的多个连接按先后顺序分摊速率。
+// 命令执行期间用Scope把用户记在线程局部变量中，对象I/O的收发循环在每个数据块之前调用charge，
+// 不需要把用户逐层传给各I/O后端；没有限速的用户不在表中，charge直接返回。
+// fork模式在连接进程中睡眠，单次传输也按数据块匀速进行；事件循环用Deferral把等待推迟到命令之间，
+// 不阻塞同一线程上的其他用户。因此epoll/分片模式只在命令边界限速：一条命令内的传输全速进行，
+// 例如限速10MB/s的用户GET 1GB时以线速发送完，然后连接被挂起约100秒才读取下一条命令。
+class TenantQos {
+public:
+    struct Stats {
+        std::string username;
+        TenantLimits limits;
+        uint64_t bytes;             // 计入限速的字节数
+        uint64_t ops;
+        uint64_t throttledUs;       // 因限速而等待的总时间
+    };
+
+    // 当前线程正在执行的命令所属的用户：构造时按命令桶限速，析构前本线程的charge按该用户的字节桶限速
+    class Scope {
+    public:
+        explicit Scope(const std::string& username);
+        ~Scope();
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        int32_t previous_;
+        bool previousBytesLimited_;
+    };
+
+    // 事件循环（epoll/分片模式）执行命令时线程不能睡眠：作用域内Scope和charge不等待，
+    // 只记录令牌补回的时间，命令结束后由事件循环把连接挂起到那时再读取它的下一条命令。
+    // 命令内部不让出线程，所以这些模式的限速只作用在命令之间，不在单条命令的传输内匀速
+    class Deferral {
+    public:
+        Deferral();
+        ~Deferral();
+        Deferral(const Deferral&) = delete;
+        Deferral& operator=(const Deferral&) = delete;
+
+        // 距离令牌补回还需等待的微秒数，取出后清零
+        uint64_t takeUs();
+
+    private:
+        bool previous_;
+        uint64_t previousUntilNs_;
+    };
+
+    // 映射可容纳capacity个用户的共享表；映射失败时isAvailable()为false
+    explicit TenantQos(size_t capacity);
+    ~TenantQos();
+    TenantQos(const TenantQos&) = delete;
+    TenantQos& operator=(const TenantQos&) = delete;
+
+    bool isAvailable() const { return header_ != nullptr; }
+
+    // 启动时按dfs.conf中的限速创建服务器共享的表（为之后新增的用户留出空间）
+    static void createShared(const std::unordered_map<std::string, TenantLimits>& limits);
+    // 服务器共享的表，没有时返回nullptr
+    static TenantQos* shared();
+
+    // 设置用户的限速；改为不限速的用户保留在表中但不再等待。表已满或用户名过长时返回false
+    bool configure(const std::string& username, const TenantLimits& limits);
+    // 用户在表中的位置，不在表中时返回-1
+    int32_t find(const std::string& username);
+
+    // 从用户的桶中取出令牌，返回需要等待的微秒数
+    uint64_t acquireOps(int32_t tenant, uint32_t ops);
+    uint64_t acquireBytes(int32_t tenant, uint64_t bytes);
+
+    std::vector<Stats> stats();
+
+    // 对象I/O每发送或接收一个数据块调用一次，当前命令的用户有字节限速时等待
+    static void charge(size_t bytes);
+    // 当前线程的命令是否受字节限速（sendfile等一次发送整个对象的路径据此改为分块发送）
+    static bool throttled();
+
+    // 解析dfs.conf用户行末尾的一项限速：bandwidth=<字节/秒，可带K/M/G后缀>或ops=<命令/秒>
+    static bool parseLimit(const std::string& token, TenantLimits& limits);
+
+private:
+    struct Header;
+    struct Entry;
+
+    void lock();
+    void unlock();
+    int32_t findLocked(const std::string& username, bool insert);
+    bool bytesLimited(int32_t tenant);
+
+    void* map_;
+    size_t mapSize_;
+    Header* header_;
+    Entry* entries_;
+};
+
+#endif // TENANT_QOS_HPP
@@ -0,0 +1,89 @@
+#ifndef WAL_HPP
+#define WAL_HPP
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+constexpr const char* WAL_FILE = ".dfs.wal";            // 服务器目录下的预写日志
+constexpr const char WAL_MAGIC[8] = {'D', 'F', 'S', 'W', 'A', 'L', '0', '1'};
+constexpr uint64_t WAL_HEADER_SIZE = 4096;               // 第一页是各进程共享映射的日志头
+constexpr uint64_t WAL_CHECKPOINT_BYTES = 1024 * 1024;   // 已生效并落盘的记录超过该大小时释放其空间
+
+// PUT的预写日志和组提交：对象数据写入后不再逐个fsync，而是追加一条记录，
+// 由同一时间窗口内的全部PUT共享一次同步，同步完成后才向客户端确认
+//
+// 日志文件 <服务器目录>/.dfs.wal：
+//   第一页：8字节魔数 | u64 检查点 | 运行时共享状态（追加位置、已同步位置、失败标志）
+//   记录：u32 魔数 | u32 负载长度 | u32 校验和 | 负载
+//   负载：u32 对象数 | 对象...
+//   对象：u8 类型(F/P) | u8 0 | u16 目录长度 | u16 文件名长度 | i32 对象ID | u64 大小 |
+//         u32 段编号 | u64 记录偏移 | 目录（相对服务器目录） | 文件名
+// 一次PUT的全部对象写成一条记录。对象在日志同步之前还没有生效：文件存储的对象留在.part临时文件中，
+// 打包存储的记录保持R状态；同步后由领导者rename临时文件（或把记录标记为C）并写入目录索引。
+//
+// 组提交：追加记录后尝试获取同步锁（进程内互斥量 + 日志头上的OFD锁，fork模式的子进程之间同样有效）。
+// 拿到锁的PUT成为领导者，等待提交窗口让其他PUT追加记录，用一次syncfs把这期间全部对象的数据、
+// 临时文件和日志记录落盘，让这一批对象生效后通过日志头上的futex一次唤醒所有等待者；
+// 没拿到锁的PUT在futex上睡眠，醒来后记录已被覆盖则返回，否则再竞争下一轮的领导者。
+// 生效操作本身在下一次同步时落盘；崩溃后启动时重做检查点之后的全部记录（重做是幂等的）。
+class WriteAheadLog {
+public:
+    // 一个等待组提交的对象
+    struct Entry {
+        std::string folder;     // 对象所在目录的完整路径（与目录索引使用的路径相同）
+        std::string fileName;
+        int objectId;
+        uint64_t size;
+        bool packed;            // 打包存储中的记录，否则为.part临时文件
+        uint32_t segment;
+        uint64_t record;
+    };
+
+    explicit WriteAheadLog(const std::string& rootPath, uint64_t checkpointBytes = WAL_CHECKPOINT_BYTES);
+    ~WriteAheadLog();
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    // 进程内按服务器目录共享的日志实例（fork出的子进程重新打开，各自持有OFD锁）
+    static WriteAheadLog& forRoot(const std::string& rootPath);
+
+    // 追加一条记录并等待组提交，返回true时对象已落盘并生效
+    // windowUs为成为领导者后等待其他PUT加入的时间；同步失败后的全部提交都返回false
+    bool commit(const std::vector<Entry>& entries, int windowUs);
+
+    // 启动时（只有一个进程）重做检查点之后的记录并清空日志，返回重做的记录数
+    size_t recover();
+
+    struct Stats {
+        uint64_t commits;       // 本实例追加的记录数
+        uint64_t syncs;         // 本实例作为领导者执行的同步次数
+    };
+    Stats stats();
+
+private:
+    struct Header;
+
+    bool appendRecord(const std::vector<unsigned char>& record, uint64_t& end);
+    bool waitDurable(uint64_t end, int windowUs);
+    // 以下在持有同步锁时调用
+    // 领导者：等待提交窗口后同步，让这一批记录生效并唤醒等待的PUT
+    void syncLocked(int windowUs);
+    // 解析[start, end)中的记录并逐条生效，返回完整记录的末尾
+    uint64_t applyRecords(uint64_t start, uint64_t end, size_t& records);
+    void applyEntry(const Entry& entry);
+    void checkpointLocked(uint64_t applied);
+
+    std::string rootPath_;
+    std::string walPath_;
+    uint64_t checkpointBytes_;
+    int fd_;
+    Header* header_;
+    std::mutex appendMutex_;
+    std::mutex syncMutex_;
+    uint64_t commits_;
+    uint64_t syncs_;
+};
+
+#endif // WAL_HPP
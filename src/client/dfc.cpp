@@ -29,9 +29,6 @@ int main(int argc, char** argv) {
             break;
         }
         
-        // 初始化连接向量
-        DfcUtils::setupConnections(connFds, conf);
-        
         if (buffer.substr(0, 4) == "LIST") {
             std::string cmdArgs = buffer.substr(4);
             DEBUGSS("Command Sent is LIST", cmdArgs.c_str());
@@ -55,11 +52,11 @@ int main(int argc, char** argv) {
             DEBUGSS("Invalid Command", buffer.c_str());
             std::cout << "<<< Invalid command. Available commands: LIST, GET, PUT, MKDIR, EXIT/QUIT" << std::endl;
         }
-        
-        // 清理连接
-        DfcUtils::tearDownConnections(connFds, conf);
     }
     
+    // 会话连接在整个交互过程中复用，退出时才关闭
+    DfcUtils::tearDownConnections(connFds, conf);
+    
     DfcUtils::freeDfcConf(conf);
     return 0;
 }
\ No newline at end of file
@@ -50,8 +50,6 @@ int runInteractiveMode(const std::string& confFile) {
             continue;
         }
         
-        DfcUtils::setupConnections(connFds, conf);
-        
         if (buffer.substr(0, 4) == "LIST") {
             std::string cmdArgs = buffer.substr(4);
             DEBUGSS("Command Sent is LIST", cmdArgs.c_str());
@@ -75,10 +73,10 @@ int runInteractiveMode(const std::string& confFile) {
             DEBUGSS("Invalid Command", buffer.c_str());
             std::cout << "<<< Invalid command. Type HELP for available commands." << std::endl;
         }
-        
-        DfcUtils::tearDownConnections(connFds, conf);
     }
     
+    DfcUtils::tearDownConnections(connFds, conf);
+    
     DfcUtils::freeDfcConf(conf);
     return 0;
 }
@@ -16,11 +16,17 @@ DfsClientSession::DfsClientSession(const UserInfo& user, const DfcConfig& config
     : user_(user), connected_(false), bytesTransferred_(0) {
     config_.server_count = config.server_count;
     config_.encryption_type = config.encryption_type;
+    config_.placement_type = config.placement_type;
+    config_.replication_factor = config.replication_factor;
+    config_.erasure_data = config.erasure_data;
+    config_.erasure_parity = config.erasure_parity;
+    config_.placement = config.placement;
     if (config.user) {
         config_.user = std::make_unique<User>();
         config_.user->username = config.user->username;
         config_.user->password = config.user->password;
     }
+    config_.servers.resize(config.server_count);
     for (int i = 0; i < config.server_count; i++) {
         if (config.servers[i]) {
             config_.servers[i] = std::make_unique<DfcServer>();
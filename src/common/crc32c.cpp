@@ -0,0 +1,160 @@
+#include "crc32c.hpp"
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define CRC32C_X86 1
+#endif
+
+namespace {
+
+constexpr uint32_t CRC32C_POLY = 0x82F63B78;    // Castagnoli多项式的反射表示
+constexpr size_t LONG_STRIPE = 8192;            // 三路交错时每一路的长度
+constexpr size_t SHORT_STRIPE = 256;            // 不足3 * LONG_STRIPE的数据用短的交错段
+
+// x^n模多项式（反射表示，最高位是x^0的系数）
+uint32_t xPowMod(uint64_t n) {
+    uint32_t p = 0x80000000u;
+    while (n-- > 0) {
+        p = (p & 1) ? (p >> 1) ^ CRC32C_POLY : p >> 1;
+    }
+    return p;
+}
+
+struct Tables {
+    uint32_t slice[8][256];     // slice[k][b]：字节b后面再跟k个0字节的CRC
+    uint64_t longShift;         // 把一段的CRC向后移过LONG_STRIPE字节的乘数
+    uint64_t shortShift;
+    bool hardware;
+
+    Tables() {
+        for (uint32_t b = 0; b < 256; b++) {
+            uint32_t crc = b;
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc & 1) ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+            }
+            slice[0][b] = crc;
+        }
+        for (uint32_t b = 0; b < 256; b++) {
+            for (int k = 1; k < 8; k++) {
+                slice[k][b] = (slice[k - 1][b] >> 8) ^ slice[0][slice[k - 1][b] & 0xFF];
+            }
+        }
+        // 32位a与b的无进位乘积再经crc32指令归约得到 a * b * x^33，乘数取 x^(8n - 33)
+        longShift = xPowMod(8 * LONG_STRIPE - 33);
+        shortShift = xPowMod(8 * SHORT_STRIPE - 33);
+#ifdef CRC32C_X86
+        hardware = __builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("pclmul");
+#else
+        hardware = false;
+#endif
+    }
+};
+
+const Tables& tables() {
+    static const Tables instance;
+    return instance;
+}
+
+uint64_t load64(const unsigned char* p) {
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+// 以下函数的crc是未取反的内部状态
+uint32_t extendTable(const Tables& t, uint32_t crc, const unsigned char* p, size_t length) {
+    while (length > 0 && (reinterpret_cast<uintptr_t>(p) & 7) != 0) {
+        crc = t.slice[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+        length--;
+    }
+    while (length >= 8) {
+        uint64_t word = load64(p) ^ crc;
+        crc = t.slice[7][word & 0xFF] ^ t.slice[6][(word >> 8) & 0xFF] ^
+              t.slice[5][(word >> 16) & 0xFF] ^ t.slice[4][(word >> 24) & 0xFF] ^
+              t.slice[3][(word >> 32) & 0xFF] ^ t.slice[2][(word >> 40) & 0xFF] ^
+              t.slice[1][(word >> 48) & 0xFF] ^ t.slice[0][word >> 56];
+        p += 8;
+        length -= 8;
+    }
+    while (length > 0) {
+        crc = t.slice[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+        length--;
+    }
+    return crc;
+}
+
+#ifdef CRC32C_X86
+
+__attribute__((target("sse4.2,pclmul")))
+uint64_t shift(uint64_t crc, uint64_t multiplier) {
+    __m128i product = _mm_clmulepi64_si128(_mm_cvtsi64_si128(static_cast<long long>(crc)),
+                                           _mm_cvtsi64_si128(static_cast<long long>(multiplier)), 0);
+    return _mm_crc32_u64(0, static_cast<uint64_t>(_mm_cvtsi128_si64(product)));
+}
+
+// 三路交错处理length中所有完整的3 * stripe字节，返回处理后的状态
+__attribute__((target("sse4.2,pclmul")))
+uint64_t extendStripes(uint64_t crc0, const unsigned char*& p, size_t& length, size_t stripe, uint64_t multiplier) {
+    while (length >= 3 * stripe) {
+        uint64_t crc1 = 0;
+        uint64_t crc2 = 0;
+        const unsigned char* end = p + stripe;
+        do {
+            crc0 = _mm_crc32_u64(crc0, load64(p));
+            crc1 = _mm_crc32_u64(crc1, load64(p + stripe));
+            crc2 = _mm_crc32_u64(crc2, load64(p + 2 * stripe));
+            p += 8;
+        } while (p < end);
+        // 状态是线性的：crc(A || B) = crc(A) * x^(8|B|) ^ crc0(B)
+        crc0 = shift(crc0, multiplier) ^ crc1;
+        crc0 = shift(crc0, multiplier) ^ crc2;
+        p += 2 * stripe;
+        length -= 3 * stripe;
+    }
+    return crc0;
+}
+
+__attribute__((target("sse4.2,pclmul")))
+uint32_t extendHardware(const Tables& t, uint32_t crc, const unsigned char* p, size_t length) {
+    uint64_t state = crc;
+    while (length > 0 && (reinterpret_cast<uintptr_t>(p) & 7) != 0) {
+        state = _mm_crc32_u8(static_cast<uint32_t>(state), *p++);
+        length--;
+    }
+    state = extendStripes(state, p, length, LONG_STRIPE, t.longShift);
+    state = extendStripes(state, p, length, SHORT_STRIPE, t.shortShift);
+    while (length >= 8) {
+        state = _mm_crc32_u64(state, load64(p));
+        p += 8;
+        length -= 8;
+    }
+    while (length > 0) {
+        state = _mm_crc32_u8(static_cast<uint32_t>(state), *p++);
+        length--;
+    }
+    return static_cast<uint32_t>(state);
+}
+
+#endif
+
+} // namespace
+
+uint32_t Crc32c::extend(uint32_t crc, const void* data, size_t length) {
+    const Tables& t = tables();
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+#ifdef CRC32C_X86
+    if (t.hardware) {
+        return ~extendHardware(t, ~crc, p, length);
+    }
+#endif
+    return ~extendTable(t, ~crc, p, length);
+}
+
+uint32_t Crc32c::extendPortable(uint32_t crc, const void* data, size_t length) {
+    return ~extendTable(tables(), ~crc, static_cast<const unsigned char*>(data), length);
+}
+
+bool Crc32c::hardwareAccelerated() {
+    return tables().hardware;
+}
@@ -1,5 +1,6 @@
 #include "dfcutils.hpp"
 #include "thread_pool.hpp"
+#include "wire_protocol.hpp"
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
@@ -10,36 +11,140 @@
 #include <sys/time.h>
 #include <fstream>
 #include <sys/stat.h>
+#include <algorithm>
 #include <set>
 #include <sstream>
 #include <thread>
+#include <chrono>
 #include <mutex>
 #include <future>
 #include <atomic>
 
 namespace {
-    constexpr size_t PARALLEL_THRESHOLD = 256 * 1024;
+    // GET中并行读取的对象（纠删码时为分段），按ID存放；
+    // 每个对象只由领取它的流写入，所有流结束后再读取，不需要加锁
+    enum class ObjectState { PENDING, FETCHED, MISSING, CORRUPT };
     
-    bool shouldUseParallel(size_t fileSize) {
-        return fileSize >= PARALLEL_THRESHOLD;
+    struct StreamedObjects {
+        std::vector<std::unique_ptr<Split>> fetched;
+        std::vector<ObjectState> states;
+        std::vector<int> sources;
+        std::vector<std::atomic<bool>> claimed;
+        
+        explicit StreamedObjects(size_t count)
+            : fetched(count), states(count, ObjectState::PENDING), sources(count, -1), claimed(count) {}
+    };
+    
+    // 一个服务器的流：按顺序领取ids中还没有被其他流领取的对象，每个对象用一个窗口请求读取。
+    // 服务器对不存在的对象回复长度为0的分片，记为缺失，之后改从其他副本读取。
+    // 文本协议的连接（本系列之前的服务器）不认识窗口请求，逐个请求对象，每个对象之后发送RESET_SIG
+    void streamObjects(int socket, int serverIdx, const std::vector<int>& ids, StreamedObjects& objects) {
+        bool windowed = WireProtocol::connectionVersion(socket) == WIRE_VERSION_BINARY;
+        size_t cursor = 0;
+        auto claimNext = [&]() {
+            while (cursor < ids.size()) {
+                int id = ids[cursor++];
+                if (!objects.claimed[id].exchange(true)) {
+                    return id;
+                }
+            }
+            return -1;
+        };
+        auto request = [&](int id) {
+            if (!windowed) {
+                NetUtils::sendIntValueSocket(socket, id);
+                return;
+            }
+            std::vector<unsigned char> frame;
+            std::vector<unsigned char> intBuffer(INT_SIZE);
+            for (int value : {GET_WINDOW_REQUEST, id, 1}) {
+                NetUtils::encodeIntToUchar(intBuffer, value);
+                frame.insert(frame.end(), intBuffer.begin(), intBuffer.end());
+            }
+            NetUtils::sendToSocket(socket, frame);
+        };
+        
+        int current = claimNext();
+        if (current >= 0) {
+            request(current);
+        }
+        while (current >= 0) {
+            // 读取当前对象之前先请求下一个，服务器发送时不必等待往返
+            int next = claimNext();
+            if (next >= 0 && windowed) {
+                request(next);
+            }
+            auto split = std::make_unique<Split>();
+            NetUtils::writeSplitFromSocketAsStream(socket, *split);
+            if (!windowed) {
+                std::vector<unsigned char> resetSignal(1, RESET_SIG);
+                NetUtils::sendToSocket(socket, resetSignal);
+                if (next >= 0) {
+                    request(next);
+                }
+            }
+            if (split->id != current) {
+                throw std::runtime_error("Unexpected object id " + std::to_string(split->id) + 
+                                         " in GET stream, expected " + std::to_string(current));
+            }
+            objects.sources[current] = serverIdx;
+            if (split->corrupt) {
+                // 服务器上的副本未通过校验，并行读取结束后改从其他副本读取
+                DEBUGSN("Object failed checksum verification on the server", current);
+                objects.states[current] = ObjectState::CORRUPT;
+            } else if (split->content_length == 0) {
+                // 该服务器的副本不完整
+                objects.states[current] = ObjectState::MISSING;
+            } else {
+                objects.fetched[current] = std::move(split);
+                objects.states[current] = ObjectState::FETCHED;
+            }
+            current = next;
+        }
+    }
+    
+    // 每个持有文件的服务器一个并行的流，读取idsByServer中放在该服务器上的对象
+    void streamFromHolders(const std::vector<int>& connFds, const std::vector<int>& holders,
+                           const std::vector<std::vector<int>>& idsByServer, StreamedObjects& objects) {
+        if (holders.size() == 1) {
+            streamObjects(connFds[holders[0]], holders[0], idsByServer[holders[0]], objects);
+            return;
+        }
+        auto& pool = ThreadPool::getInstance();
+        std::vector<std::future<void>> streams;
+        for (int serverIdx : holders) {
+            streams.push_back(pool.enqueue([&connFds, &idsByServer, &objects, serverIdx]() {
+                streamObjects(connFds[serverIdx], serverIdx, idsByServer[serverIdx], objects);
+            }));
+        }
+        for (auto& stream : streams) {
+            stream.wait();
+        }
+        // 任一服务器的连接出错时协议状态未知，与其他命令一样向上抛出
+        for (auto& stream : streams) {
+            stream.get();
+        }
+    }
+    
+    // 通知所有服务器结束本次GET
+    void endGet(const std::vector<int>& connFds, int connCount) {
+        for (int serverIdx = 0; serverIdx < connCount; serverIdx++) {
+            if (connFds[serverIdx] != -1) {
+                NetUtils::sendIntValueSocket(connFds[serverIdx], GET_END_REQUEST);
+            }
+        }
     }
 }
 
-const int DfcUtils::filePiecesMapping[4][4][2] = {
-    { { 1, 2 }, { 2, 3 }, { 3, 4 }, { 4, 1 } },
-    { { 4, 1 }, { 1, 2 }, { 2, 3 }, { 3, 4 } },
-    { { 3, 4 }, { 4, 1 }, { 1, 2 }, { 2, 3 } },
-    { { 2, 3 }, { 3, 4 }, { 4, 1 }, { 1, 2 } }
-};
-
 void DfcUtils::setupConnections(std::vector<int>& connFds, const DfcConfig& conf) {
-    connFds.resize(conf.server_count, -1);
     createConnections(connFds, conf);
 }
 
 void DfcUtils::tearDownConnections(std::vector<int>& connFds, const DfcConfig& conf) {
-    for (int i = 0; i < conf.server_count; i++) {
+    (void)conf;
+    for (size_t i = 0; i < connFds.size(); i++) {
         if (connFds[i] != -1) {
+            WireProtocol::forgetConnection(connFds[i]);
             close(connFds[i]);
             connFds[i] = -1;
         }
@@ -51,10 +156,29 @@ bool DfcUtils::createConnections(std::vector<int>& connFds, const DfcConfig& con
     auto& pool = ThreadPool::getInstance();
     std::vector<std::future<void>> futures;
     
+    if (static_cast<int>(connFds.size()) < conf.server_count) {
+        connFds.resize(conf.server_count, -1);
+    }
+    
     for (int i = 0; i < conf.server_count; i++) {
+        if (connFds[i] != -1) {
+            // 已建立的会话直接复用，不再重新连接和认证
+            connectionFlag = true;
+            continue;
+        }
         if (conf.servers[i]) {
             futures.push_back(pool.enqueue([&connFds, &conf, i, &connectionFlag]() {
-                int fd = getDfcSocket(*conf.servers[i]);
+                DfcServer& server = *conf.servers[i];
+                int fd = connectServer(server);
+                if (fd != -1 && !server.per_command_auth && !authConnection(fd, *conf.user, server)) {
+                    WireProtocol::forgetConnection(fd);
+                    close(fd);
+                    fd = -1;
+                    if (server.per_command_auth) {
+                        // 旧服务器拒绝AUTH后已关闭连接：重新连接，命令的文本模板中带有凭据
+                        fd = connectServer(server);
+                    }
+                }
                 connFds[i] = fd;
                 if (fd != -1) {
                     connectionFlag = true;
@@ -106,7 +230,36 @@ int DfcUtils::getDfcSocket(const DfcServer& server) {
     return sockfd;
 }
 
-bool DfcUtils::commandBuilder(std::string& buffer, const std::string& format, 
+int DfcUtils::connectServer(const DfcServer& server) {
+    int fd;
+    if (!server.per_command_auth) {
+        fd = getDfcSocket(server);
+        if (fd == -1) {
+            return -1;
+        }
+        
+        try {
+            WireProtocol::sendHello(fd, WIRE_VERSION_MAX);
+            uint8_t version = WireProtocol::recvHello(fd);
+            WireProtocol::setConnectionVersion(fd, std::min(version, WIRE_VERSION_MAX));
+            DEBUGSN("Negotiated wire protocol version", static_cast<int>(version));
+            return fd;
+        } catch (const std::exception& e) {
+            // 旧服务器把HELLO当作非法的命令长度并关闭连接，或者一直不回复
+            DEBUGSS("Server does not support binary framing, falling back to text protocol", e.what());
+            close(fd);
+        }
+    }
+    
+    // 已知不支持AUTH的旧服务器也不支持HELLO，直接使用文本协议
+    fd = getDfcSocket(server);
+    if (fd != -1) {
+        WireProtocol::setConnectionVersion(fd, WIRE_VERSION_TEXT);
+    }
+    return fd;
+}
+
+bool DfcUtils::commandBuilder(DfcCommand& command, const std::string& format, 
                              const FileAttribute& fileAttr, const User& user, int flag) {
     std::string fileFolder = fileAttr.remote_file_folder;
     std::string fileName = fileAttr.remote_file_name;
@@ -149,20 +302,32 @@ bool DfcUtils::commandBuilder(std::string& buffer, const std::string& format,
         // 不需要检查fileName，因为我们已经在commandValidator中设置了dummy值
     }
     
-    char tempBuffer[512];
-    snprintf(tempBuffer, sizeof(tempBuffer), format.c_str(), flag, 
+    // 文本命令按实际长度格式化：二进制帧允许的长名字在回退到文本协议时不能被截断
+    int textSize = snprintf(nullptr, 0, format.c_str(), flag, 
+                            user.username.c_str(), user.password.c_str(), 
+                            fileFolder.c_str(), fileName.c_str());
+    if (textSize < 0) {
+        return false;
+    }
+    std::vector<char> tempBuffer(static_cast<size_t>(textSize) + 1);
+    snprintf(tempBuffer.data(), tempBuffer.size(), format.c_str(), flag, 
              user.username.c_str(), user.password.c_str(), 
              fileFolder.c_str(), fileName.c_str());
     
-    buffer = std::string(tempBuffer);
-    DEBUGSS("Command Built", buffer.c_str());
+    command.text = std::string(tempBuffer.data(), static_cast<size_t>(textSize));
+    DEBUGSS("Command Built", command.text.c_str());
+    
+    // 二进制帧不携带凭据（由会话的AUTH提供），空文件名直接编码为空串
+    command.request_id = WireProtocol::nextRequestId();
+    WireProtocol::encodeCommand(command.frame, flag, command.request_id, fileFolder, 
+                                fileName == "NULL" ? std::string() : fileName);
     return true;
 }
 
 void DfcUtils::commandHandler(std::vector<int>& connFds, int flag, 
                              const std::string& buffer, DfcConfig& conf) {
     FileAttribute fileAttr;
-    std::string bufferToSend;
+    DfcCommand commandToSend;
     bool builderFlag = false, connectionFlag;
     
     DEBUGS("Validating the command input");
@@ -180,7 +345,7 @@ void DfcUtils::commandHandler(std::vector<int>& connFds, int flag,
             else if (flag == GET_FLAG) templateStr = GET_TEMPLATE;
             else if (flag == PUT_FLAG) templateStr = PUT_TEMPLATE;
             else if (flag == MKDIR_FLAG) templateStr = MKDIR_TEMPLATE;
-            builderFlag = commandBuilder(bufferToSend, templateStr, fileAttr, *conf.user, flag);
+            builderFlag = commandBuilder(commandToSend, templateStr, fileAttr, *conf.user, flag);
         }
         
         if (!builderFlag) {
@@ -190,9 +355,24 @@ void DfcUtils::commandHandler(std::vector<int>& connFds, int flag,
             connectionFlag = createConnections(connFds, conf);
             if (connectionFlag) {
                 DEBUGS("Executing the command on remote servers");
-                commandExec(connFds, bufferToSend, conf.server_count, fileAttr, flag, conf);
-                DEBUGS("Tearing down connections");
-                tearDownConnections(connFds, conf);
+                // 命令执行期间，返回错误的服务器会从副本中移除，但它的会话仍然可用
+                std::vector<int> commandFds(connFds);
+                try {
+                    commandExec(commandFds, commandToSend, conf.server_count, fileAttr, flag, conf);
+                } catch (const std::exception& e) {
+                    std::cout << "<<< Connection error: " << e.what() << std::endl;
+                    // 协议状态未知，关闭所有会话，下一条命令重新建立
+                    DEBUGS("Tearing down connections");
+                    tearDownConnections(connFds, conf);
+                }
+                // 旧服务器每条命令后关闭连接，下一条命令重新连接
+                for (int i = 0; i < conf.server_count; i++) {
+                    if (connFds[i] != -1 && conf.servers[i] && conf.servers[i]->per_command_auth) {
+                        WireProtocol::forgetConnection(connFds[i]);
+                        close(connFds[i]);
+                        connFds[i] = -1;
+                    }
+                }
             } else {
                 std::cout << "<<< Unable to Connect to any server" << std::endl;
             }
@@ -312,44 +492,200 @@ bool DfcUtils::commandValidator(const std::string& buffer, int flag, FileAttribu
     return true;
 }
 
-bool DfcUtils::sendCommand(const std::vector<int>& connFds, const std::string& bufferToSend, 
+bool DfcUtils::sendCommand(const std::vector<int>& connFds, const DfcCommand& command, 
                            int connCount) {
     bool sendFlag = true;
     
     for (int i = 0; i < connCount; i++) {
         if (connFds[i] == -1) continue;
         
-        int payloadSize = bufferToSend.size();
+        if (WireProtocol::connectionVersion(connFds[i]) == WIRE_VERSION_BINARY) {
+            WireProtocol::setLastRequestId(connFds[i], command.request_id);
+            WireProtocol::sendFrame(connFds[i], command.frame);
+            continue;
+        }
+        
+        int payloadSize = command.text.size();
         NetUtils::sendIntValueSocket(connFds[i], payloadSize);
-        std::vector<unsigned char> payload(bufferToSend.begin(), bufferToSend.end());
+        std::vector<unsigned char> payload(command.text.begin(), command.text.end());
         NetUtils::sendToSocket(connFds[i], payload);
     }
     
     return sendFlag;
 }
 
-void DfcUtils::sendFileSplits(int socket, const FileSplit& fileSplit, int mod, int serverIdx) {
-    (void)mod;  // Mark as intentionally unused
-    (void)serverIdx;  // Mark as intentionally unused
-    int objectCount = fileSplit.object_count;
+int DfcUtils::recvCommandStatus(int socket, const DfcCommand& command) {
+    int status;
+    NetUtils::recvIntValueSocket(socket, status);
+    for (int attempt = 0; status == SERVER_BUSY_STATUS; attempt++) {
+        int retryAfterMs;
+        NetUtils::recvIntValueSocket(socket, retryAfterMs);
+        if (attempt >= MAX_BUSY_RETRIES) {
+            break;
+        }
+        DEBUGSN("Server busy, retrying command after ms", retryAfterMs);
+        std::this_thread::sleep_for(std::chrono::milliseconds(retryAfterMs));
+        // 服务器没有执行命令，会话连接仍然同步，原样重发即可
+        sendCommand(std::vector<int>{socket}, command, 1);
+        NetUtils::recvIntValueSocket(socket, status);
+    }
+    return status;
+}
+
+std::shared_ptr<const Placement> DfcUtils::buildPlacement(const DfcConfig& conf) {
+    std::vector<std::string> names;
+    for (int i = 0; i < conf.server_count; i++) {
+        // 按名字而不是地址放置：服务器换了地址，对象仍然留在原处
+        names.push_back(conf.servers[i] ? conf.servers[i]->name : std::string());
+    }
+    // 纠删码时每个对象的k + m个分段各放在一个服务器上，Replicas不再起作用
+    int replicas = conf.erasure_data > 0 ? conf.erasure_data + conf.erasure_parity : conf.replication_factor;
+    return Placement::create(conf.placement_type, names, replicas);
+}
+
+std::string DfcUtils::placementPath(const FileAttribute& attr) {
+    return attr.remote_file_folder + attr.remote_file_name;
+}
+
+bool DfcUtils::streamFileSplits(const std::vector<int>& connFds, int connCount, const std::string& filePath,
+                                const std::string& path, const DfcConfig& conf, FileSplit& fileSplit) {
+    fileSplit.file_name = filePath;
+    fileSplit.file_size = 0;
+    fileSplit.object_count = 0;
     
-    NetUtils::sendIntValueSocket(socket, objectCount);
+    // 与splitFileToObjects相同的对象划分，但只在这里确定大小和数量，内容由流水线逐个读取
+    std::ifstream file(filePath, std::ios::binary | std::ios::ate);
+    if (!file.is_open()) {
+        std::cerr << "Unable to open file: " << filePath << std::endl;
+    } else {
+        fileSplit.file_size = static_cast<size_t>(file.tellg());
+        file.seekg(0, std::ios::beg);
+        fileSplit.object_size = std::min(std::max(Utils::calculateOptimalObjectSize(fileSplit.file_size),
+                                                  MIN_OBJECT_SIZE), MAX_OBJECT_SIZE);
+        int objectCount = Utils::calculateObjectCount(fileSplit.file_size, fileSplit.object_size);
+        if (objectCount > MAX_OBJECTS_PER_FILE) {
+            std::cerr << "Too many objects: " << objectCount << " (max: " << MAX_OBJECTS_PER_FILE << ")" << std::endl;
+        } else {
+            fileSplit.object_count = objectCount;
+        }
+    }
     
-    for (int i = 0; i < objectCount; i++) {
-        if (i < static_cast<int>(fileSplit.objects.size()) && fileSplit.objects[i]) {
-            NetUtils::sendIntValueSocket(socket, fileSplit.objects[i]->id);
-            NetUtils::writeSplitToSocketAsStream(socket, *fileSplit.objects[i]);
+    // 不可达服务器上的副本或分段按放置顺序改放到后面的在线服务器上（GET在副本服务器上找不到时向它们请求）
+    std::vector<bool> live(connCount);
+    for (int serverIdx = 0; serverIdx < connCount; serverIdx++) {
+        live[serverIdx] = connFds[serverIdx] != -1;
+    }
+    std::unique_ptr<ErasureCode> code;
+    std::vector<std::vector<int>> piecesByServer;
+    if (conf.erasure_data > 0) {
+        // 纠删码：发送的是各对象的分段，对象本身不再发送
+        code = std::make_unique<ErasureCode>(conf.erasure_data, conf.erasure_parity);
+        conf.placement->liveFragmentsByServer(path, fileSplit.object_count, code->totalFragments(), live,
+                                              piecesByServer);
+    } else {
+        conf.placement->liveObjectsByServer(path, fileSplit.object_count, live, piecesByServer);
+    }
+    // 对象数放在元数据对象中，GET据此准确地读取这么多对象，不需要试探文件在哪里结束；
+    // 它很小，保存在该ID的每个副本服务器上（纠删码时为k + m个），比对象本身更能容忍服务器故障
+    std::vector<int> manifestServers;
+    conf.placement->liveReplicas(Placement::objectKey(path, FILE_MANIFEST_ID), live, manifestServers);
+
+    // 在线服务器不够时不上传：每个对象至少要有一个副本（纠删码时k个分段）能保存下来，否则文件无法读回
+    int fragmentCount = code ? code->totalFragments() : 1;
+    int needed = code ? code->dataFragments() : 1;
+    std::vector<int> placed(fileSplit.object_count, 0);
+    for (const std::vector<int>& ids : piecesByServer) {
+        for (int id : ids) {
+            placed[id / fragmentCount]++;
         }
     }
+    std::string shortage;
+    for (int objId = 0; objId < fileSplit.object_count && shortage.empty(); objId++) {
+        if (placed[objId] < needed) {
+            shortage = "Object " + std::to_string(objId) + " cannot be stored: only " +
+                       std::to_string(placed[objId]) + " of the " + std::to_string(needed) +
+                       " servers it needs are up";
+        }
+    }
+    if (shortage.empty() && manifestServers.empty()) {
+        shortage = "The object count of the file cannot be stored: every server for it is down";
+    }
+    if (!shortage.empty()) {
+        // 仍然结束与在线服务器的这次PUT（0个对象），保持协议同步
+        std::cout << "<<< " << shortage << std::endl;
+        std::vector<unsigned char> endSignal(1, RESET_SIG);
+        for (int serverIdx = 0; serverIdx < connCount; serverIdx++) {
+            if (connFds[serverIdx] != -1) {
+                NetUtils::sendIntValueSocket(connFds[serverIdx], 0);
+                NetUtils::sendToSocket(connFds[serverIdx], endSignal);
+            }
+        }
+        return false;
+    }
+
+    std::vector<unsigned char> countBuffer(INT_SIZE);
+    NetUtils::encodeIntToUchar(countBuffer, fileSplit.object_count);
+    Split manifest(FILE_MANIFEST_ID, 0, countBuffer);
+    for (int serverIdx = 0; serverIdx < connCount; serverIdx++) {
+        if (connFds[serverIdx] == -1) {
+            continue;
+        }
+        bool holdsManifest = std::find(manifestServers.begin(), manifestServers.end(), serverIdx) !=
+                             manifestServers.end();
+        NetUtils::sendIntValueSocket(connFds[serverIdx],
+                                     static_cast<int>(piecesByServer[serverIdx].size()) + (holdsManifest ? 1 : 0));
+        if (holdsManifest) {
+            NetUtils::sendIntValueSocket(connFds[serverIdx], manifest.id);
+            NetUtils::writeSplitToSocketAsStream(connFds[serverIdx], manifest);
+        }
+    }
+    
+    dfs::crypto::EncryptionAlgorithm algo = Utils::cryptoAlgorithm(conf.encryption_type);
+    std::vector<unsigned char> cryptoKey = dfs::crypto::CryptoUtils::generateKeyFromPassword(conf.user->password, algo);
+    size_t objectSize = fileSplit.object_size;
+    size_t fileSize = fileSplit.file_size;
+    
+    PutPipeline pipeline(fileSplit.object_count, code ? code->totalFragments() : 1);
+    pipeline.run(
+        [&file, objectSize, fileSize](int objId, Split& object) {
+            object.id = objId;
+            object.offset = static_cast<size_t>(objId) * objectSize;
+            object.content_length = std::min(objectSize, fileSize - object.offset);
+            object.content.resize(object.content_length);
+            if (!file.read(reinterpret_cast<char*>(object.content.data()), object.content_length)) {
+                throw std::runtime_error("Failed to read object " + std::to_string(objId) + " of the file");
+            }
+        },
+        [&code, algo, &cryptoKey](Split& object, std::vector<std::unique_ptr<Split>>& pieces) {
+            if (!Utils::encryptDecryptSplit(object, algo, cryptoKey, true)) {
+                std::cerr << "Encryption/decryption failed for object " << object.id << std::endl;
+            }
+            if (code) {
+                encodeErasureObject(object, *code, pieces);
+            } else {
+                pieces[0] = std::make_unique<Split>(std::move(object));
+            }
+        },
+        [&connFds](int serverIdx, const Split& piece) {
+            NetUtils::sendIntValueSocket(connFds[serverIdx], piece.id);
+            NetUtils::writeSplitToSocketAsStream(connFds[serverIdx], piece);
+        },
+        piecesByServer);
     
     std::vector<unsigned char> endSignal(1, RESET_SIG);
-    NetUtils::sendToSocket(socket, endSignal);
+    for (int serverIdx = 0; serverIdx < connCount; serverIdx++) {
+        if (connFds[serverIdx] != -1) {
+            NetUtils::sendToSocket(connFds[serverIdx], endSignal);
+        }
+    }
+    DEBUGSN("Peak objects in flight", pipeline.peakInFlight());
+    return true;
 }
 
-int DfcUtils::fetchRemoteFileInfo(const std::vector<int>& connFds, int connCount, 
-                                  ServerChunksCollate& serverChunksCollate) {
+void DfcUtils::fetchRemoteFileInfo(std::vector<int>& connFds, int connCount, 
+                                   ServerChunksCollate& serverChunksCollate, std::vector<int>& holders) {
     DEBUGSS("fetchRemoteFileInfo called with connCount", std::to_string(connCount).c_str());
-    int mod = -1; // 明确声明并初始化 mod 变量
+    std::set<std::string> errors;
 
     // 接收所有服务器的文件信息
     for (int i = 0; i < connCount; i++) {
@@ -362,137 +698,528 @@ int DfcUtils::fetchRemoteFileInfo(const std::vector<int>& connFds, int connCount
         NetUtils::recvIntValueSocket(connFds[i], hasData);
         DEBUGSS("Received hasData from server", (std::to_string(i) + ": " + std::to_string(hasData)).c_str());
 
-        // 接收 payloadSize（即使没有数据也要接收以保持同步）
-        int payloadSize;
-        NetUtils::recvIntValueSocket(connFds[i], payloadSize);
-        DEBUGSS("Received payloadSize from server", (std::to_string(i) + ": " + std::to_string(payloadSize)).c_str());
-
-        // 验证 payloadSize 的有效性
-        if (payloadSize < 0 || payloadSize > MAX_SEG_SIZE) {
-            DEBUGSS("Invalid payload size from server", std::to_string(i).c_str());
-            // 接收占位符数据以保持通信同步
-            std::vector<unsigned char> dummyPayload(payloadSize);
-            if (payloadSize > 0) {
-                NetUtils::recvFromSocket(connFds[i], dummyPayload);
-            }
+        if (hasData < 0) {
+            // 服务器返回错误（随后是错误信息），该服务器已结束本条命令
+            std::string message;
+            NetUtils::fetchError(connFds[i], message);
+            errors.insert(message);
+            connFds[i] = -1;
             continue;
         }
 
-        // 接收实际负载数据
-        std::vector<unsigned char> payload(payloadSize);
-        NetUtils::recvFromSocket(connFds[i], payload);
+        ServerChunksInfo serverChunksInfo;
+        recvChunksInfo(connFds[i], serverChunksInfo);
 
         // 只有当有数据时才处理
         if (hasData > 0) {
-            ServerChunksInfo serverChunksInfo;
-            NetUtils::decodeServerChunksInfoFromBuffer(payload, serverChunksInfo);
             DEBUGSS("Received server chunks info from server", std::to_string(i).c_str());
 
             // 将信息插入聚合结构
             Utils::insertToServerChunksCollate(serverChunksCollate, serverChunksInfo);
+            if (!serverChunksInfo.chunk_info.empty()) {
+                holders.push_back(i);
+            }
+        }
+        // hasData == 0时chunks为0，不需要插入到聚合结构中
+    }
 
-            if (mod == -1 && !serverChunksInfo.chunk_info.empty()) {
-                const auto& chunkInfo = serverChunksInfo.chunk_info[0];
-                if (chunkInfo.chunks.size() >= 1) {
-                    DEBUGSS("Trying to find mod for chunks", 
-                           (std::to_string(chunkInfo.chunks[0]) + ", size=" + std::to_string(chunkInfo.chunks.size())).c_str());
-                    for (int j = 0; j < 4; j++) {
-                        if (chunkInfo.chunks.size() >= 2) {
-                            if ((filePiecesMapping[j][i][0] == chunkInfo.chunks[0] && 
-                                 filePiecesMapping[j][i][1] == chunkInfo.chunks[1]) ||
-                                (filePiecesMapping[j][i][0] == chunkInfo.chunks[1] && 
-                                 filePiecesMapping[j][i][1] == chunkInfo.chunks[0])) {
-                                mod = j;
-                                DEBUGSS("Found matching mod:", std::to_string(mod).c_str());
-                                break;
-                            }
-                        } else {
-                            if (filePiecesMapping[j][i][0] == chunkInfo.chunks[0] ||
-                                filePiecesMapping[j][i][1] == chunkInfo.chunks[0]) {
-                                mod = j;
-                                DEBUGSS("Found matching mod (single chunk):", std::to_string(mod).c_str());
-                                break;
-                            }
-                        }
-                    }
-                }
+    for (const auto& error : errors) {
+        std::cout << "<<< Error Message: " << error << std::endl;
+    }
+}
+
+void DfcUtils::fetchRemoteFileList(std::vector<int>& connFds, int connCount, int fragmentCount, int dataFragments) {
+    // 每个服务器按文件名升序分页返回，记录各自已收到的最后一个名字
+    struct ListCursor {
+        bool more;
+        std::string cursor;
+        std::string last;
+    };
+    std::vector<ListCursor> cursors(connCount, ListCursor{false, "", ""});
+    ServerChunksCollate pending;
+    std::set<std::string> errors;
+    
+    auto recvPage = [&](int i) {
+        ServerChunksInfo page;
+        recvListPage(connFds[i], page, cursors[i].more, cursors[i].cursor);
+        if (!page.chunk_info.empty()) {
+            cursors[i].last = page.chunk_info.back().file_name;
+        }
+        Utils::insertToServerChunksCollate(pending, page);
+    };
+    
+    for (int i = 0; i < connCount; i++) {
+        if (connFds[i] == -1) continue;
+        
+        int hasData;
+        NetUtils::recvIntValueSocket(connFds[i], hasData);
+        if (hasData < 0) {
+            // 服务器返回错误（随后是错误信息），该服务器已结束本条命令
+            std::string message;
+            NetUtils::fetchError(connFds[i], message);
+            errors.insert(message);
+            connFds[i] = -1;
+            continue;
+        }
+        recvPage(i);
+    }
+    
+    int pages = 0;
+    while (true) {
+        // 水位线：仍有后续页的服务器中最小的"最后一个名字"。不大于水位线的名字
+        // 不会再从任何服务器出现，可以输出并从聚合表中移除，聚合表最多保留每个服务器一页
+        bool bounded = false;
+        std::string watermark;
+        for (int i = 0; i < connCount; i++) {
+            if (connFds[i] != -1 && cursors[i].more && (!bounded || cursors[i].last < watermark)) {
+                watermark = cursors[i].last;
+                bounded = true;
+            }
+        }
+        
+        ServerChunksCollate ready;
+        for (auto it = pending.files.begin(); it != pending.files.end();) {
+            if (!bounded || it->first <= watermark) {
+                ready.files.insert(std::move(*it));
+                it = pending.files.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        getOutputListCommand(ready, fragmentCount, dataFragments);
+        
+        if (!bounded) {
+            break;
+        }
+        
+        // 只推进停在水位线上的服务器，其余服务器已收到的页还不能输出
+        for (int i = 0; i < connCount; i++) {
+            if (connFds[i] != -1 && cursors[i].more && cursors[i].last == watermark) {
+                std::vector<unsigned char> frame;
+                WireProtocol::encodeListNext(frame, WireProtocol::lastRequestId(connFds[i]), cursors[i].cursor);
+                WireProtocol::sendFrame(connFds[i], frame);
+                recvPage(i);
+                pages++;
             }
-        } else {
-            // hasData == 0, 但仍然需要解码payload以获取chunks=0的信息
-            ServerChunksInfo serverChunksInfo;
-            NetUtils::decodeServerChunksInfoFromBuffer(payload, serverChunksInfo);
-            // 当chunks=0时，不需要插入到聚合结构中
         }
     }
+    DEBUGSN("LIST pages requested after the first", pages);
+    
+    for (const auto& error : errors) {
+        std::cout << "<<< Error Message: " << error << std::endl;
+    }
+}
 
-    // 如果无法确定mod，返回-1（调用者需要处理这种情况）
-    return mod;
+void DfcUtils::recvListPage(int socket, ServerChunksInfo& page, bool& more, std::string& cursor) {
+    if (WireProtocol::connectionVersion(socket) != WIRE_VERSION_BINARY) {
+        // 文本协议一次返回全部文件
+        recvChunksInfo(socket, page);
+        more = false;
+        cursor.clear();
+        return;
+    }
+    
+    std::vector<unsigned char> body;
+    uint64_t requestId;
+    WireProtocol::recvFrame(socket, body);
+    WireProtocol::decodeListPage(body, requestId, page, more, cursor);
+    if (requestId != WireProtocol::lastRequestId(socket)) {
+        throw std::runtime_error("LIST page for request " + std::to_string(requestId) + 
+                                 ", expected " + std::to_string(WireProtocol::lastRequestId(socket)));
+    }
+    if (more && page.chunk_info.empty()) {
+        throw std::runtime_error("Empty LIST page with more pages pending");
+    }
 }
 
-void DfcUtils::fetchRemoteSplits(std::vector<int>& connFds, int connCount, 
-                                 FileSplit& fileSplit, int mod, size_t fileSize) {
-    (void)mod;  // Mark as intentionally unused
-    int estimatedObjectCount = 1;
-    if (fileSize > 0) {
-        estimatedObjectCount = Utils::calculateObjectCount(fileSize, DEFAULT_OBJECT_SIZE);
+void DfcUtils::recvChunksInfo(int socket, ServerChunksInfo& serverChunksInfo) {
+    if (WireProtocol::connectionVersion(socket) == WIRE_VERSION_BINARY) {
+        std::vector<unsigned char> body;
+        uint64_t requestId;
+        WireProtocol::recvFrame(socket, body);
+        WireProtocol::decodeServerChunksInfo(body, requestId, serverChunksInfo);
+        if (requestId != WireProtocol::lastRequestId(socket)) {
+            throw std::runtime_error("CHUNK_INFO reply for request " + std::to_string(requestId) + 
+                                     ", expected " + std::to_string(WireProtocol::lastRequestId(socket)));
+        }
+        return;
     }
     
-    int maxObjects = std::max(estimatedObjectCount, 16);
+    // 接收 payloadSize（即使没有数据也要接收以保持同步）
+    int payloadSize;
+    NetUtils::recvIntValueSocket(socket, payloadSize);
+    DEBUGSN("Received payloadSize from server", payloadSize);
     
+    // 验证 payloadSize 的有效性；无法跳过非法长度的负载，连接已失去同步
+    if (payloadSize < INT_SIZE || payloadSize > MAX_SEG_SIZE) {
+        throw std::runtime_error("Invalid chunk info payload size: " + std::to_string(payloadSize));
+    }
+    
+    std::vector<unsigned char> payload(payloadSize);
+    NetUtils::recvFromSocket(socket, payload);
+    NetUtils::decodeServerChunksInfoFromBuffer(payload, serverChunksInfo);
+}
+
+bool DfcUtils::fetchObjectCount(const std::vector<int>& connFds, int connCount, const std::vector<int>& holders,
+                                const Placement& placement, const std::string& path, int& objectCount,
+                                bool& legacy) {
+    legacy = false;
+    uint64_t key = Placement::objectKey(path, FILE_MANIFEST_ID);
+    std::vector<int> servers;
+    placement.replicas(key, servers);
+    std::vector<int> manifestFds(connCount, -1);
+    bool reachable = false;
+    for (int serverIdx : servers) {
+        if (std::find(holders.begin(), holders.end(), serverIdx) != holders.end()) {
+            manifestFds[serverIdx] = connFds[serverIdx];
+        }
+        reachable = reachable || connFds[serverIdx] != -1;
+    }
+    
+    Split manifest;
+    bool present = false;
+    bool fetched = fetchObjectReplica(manifestFds, connCount, -1, FILE_MANIFEST_ID, manifest, present) ||
+                   fetchHandoffReplica(connFds, connCount, holders, placement, key, FILE_MANIFEST_ID, manifest, present);
+    if (fetched && manifest.content_length == static_cast<size_t>(INT_SIZE)) {
+        NetUtils::decodeIntFromUchar(manifest.content, objectCount);
+        if (objectCount >= 0 && objectCount <= MAX_OBJECTS_PER_FILE) {
+            DEBUGSN("Object count recorded with the file", objectCount);
+            return true;
+        }
+        present = true;
+    }
+    if (!reachable) {
+        std::cout << "<<< The object count of the file is unavailable: every server that stores it is down" << std::endl;
+    } else if (present) {
+        std::cout << "<<< The object count of the file is damaged on every server" << std::endl;
+    } else {
+        // 可达的服务器都没有元数据对象：本系列之前上传的文件
+        DEBUGS("No object count recorded with the file, reading it as a legacy file");
+        legacy = true;
+    }
+    return false;
+}
+
+bool DfcUtils::fetchLegacySplits(std::vector<int>& connFds, int connCount, const std::vector<int>& holders,
+                                 FileSplit& fileSplit) {
+    // 旧客户端把每个对象都发送给所有服务器：与旧版本一样从对象0开始，
+    // 逐个向持有该文件的服务器请求，直到第一个没有任何服务器持有的对象
+    std::vector<int> holderFds(connCount, -1);
+    for (int serverIdx : holders) {
+        holderFds[serverIdx] = connFds[serverIdx];
+    }
+    
+    bool intact = true;
+    for (int objId = 0; objId < MAX_OBJECTS_PER_FILE; objId++) {
+        auto split = std::make_unique<Split>();
+        split->offset = static_cast<size_t>(objId) * DEFAULT_OBJECT_SIZE;
+        bool present = false;
+        if (!fetchObjectReplica(holderFds, connCount, -1, objId, *split, present)) {
+            if (present) {
+                std::cout << "<<< Object " << objId << " failed checksum verification on every server" << std::endl;
+                intact = false;
+            }
+            break;
+        }
+        fileSplit.objects.push_back(std::move(split));
+    }
+    if (intact && fileSplit.objects.empty()) {
+        std::cout << "<<< File is incomplete" << std::endl;
+        intact = false;
+    }
+    if (intact) {
+        fileSplit.object_count = static_cast<int>(fileSplit.objects.size());
+    } else {
+        fileSplit.objects.clear();
+    }
+    
+    endGet(connFds, connCount);
+    
+    DEBUGSS("Legacy objects fetched, count:", std::to_string(fileSplit.object_count).c_str());
+    return intact;
+}
+
+bool DfcUtils::fetchRemoteSplits(std::vector<int>& connFds, int connCount, const std::vector<int>& holders,
+                                 FileSplit& fileSplit, const Placement& placement, const std::string& path) {
     fileSplit.objects.clear();
-    fileSplit.objects.reserve(maxObjects);
     fileSplit.object_count = 0;
     fileSplit.object_size = DEFAULT_OBJECT_SIZE;
     
-    DEBUGS("Fetching remote objects (serial)");
+    int objectCount;
+    bool legacy;
+    if (!fetchObjectCount(connFds, connCount, holders, placement, path, objectCount, legacy)) {
+        if (legacy) {
+            return fetchLegacySplits(connFds, connCount, holders, fileSplit);
+        }
+        endGet(connFds, connCount);
+        return false;
+    }
+    fileSplit.objects.reserve(objectCount);
     
-    for (int serverIdx = 0; serverIdx < connCount; serverIdx++) {
-        if (connFds[serverIdx] == -1) continue;
-        
-        int socket = connFds[serverIdx];
-        
-        for (int objId = 0; objId < maxObjects; objId++) {
-            while (objId >= static_cast<int>(fileSplit.objects.size())) {
-                fileSplit.objects.push_back(std::make_unique<Split>());
-            }
-            
-            NetUtils::sendIntValueSocket(socket, objId);
-            NetUtils::writeSplitFromSocketAsStream(socket, *fileSplit.objects[objId]);
-            
-            if (fileSplit.objects[objId]->content_length == 0) {
-                DEBUGSS("Object not found on server, stopping at object", std::to_string(objId).c_str());
-                fileSplit.objects.pop_back();
-                break;
+    DEBUGSN("Fetching remote objects in parallel from servers", static_cast<int>(holders.size()));
+    
+    StreamedObjects streamed(objectCount);
+    std::vector<std::vector<int>> objectsByServer;
+    placement.objectsByServer(path, objectCount, objectsByServer);
+    streamFromHolders(connFds, holders, objectsByServer, streamed);
+    
+    // 没有取到完好副本的对象逐个向它的其他副本请求
+    bool intact = true;
+    std::vector<int> replicas;
+    for (int objId = 0; objId < objectCount && intact; objId++) {
+        if (streamed.states[objId] == ObjectState::FETCHED) {
+            continue;
+        }
+        uint64_t key = Placement::objectKey(path, objId);
+        placement.replicas(key, replicas);
+        std::vector<int> replicaFds(connCount, -1);
+        bool reachable = false;
+        for (int serverIdx : replicas) {
+            if (std::find(holders.begin(), holders.end(), serverIdx) != holders.end()) {
+                replicaFds[serverIdx] = connFds[serverIdx];
             }
-            
-            fileSplit.objects[objId]->offset = static_cast<size_t>(objId) * DEFAULT_OBJECT_SIZE;
-            fileSplit.object_count = objId + 1;
-            
-            std::vector<unsigned char> resetSignal(1, RESET_SIG);
-            NetUtils::sendToSocket(socket, resetSignal);
+            reachable = reachable || connFds[serverIdx] != -1;
+        }
+        auto split = std::make_unique<Split>();
+        bool present = streamed.states[objId] == ObjectState::CORRUPT;
+        bool replicaPresent = false;
+        if (fetchObjectReplica(replicaFds, connCount, streamed.sources[objId], objId, *split, replicaPresent) ||
+            fetchHandoffReplica(connFds, connCount, holders, placement, key, objId, *split, replicaPresent)) {
+            streamed.fetched[objId] = std::move(split);
+            continue;
+        }
+        // 不写出缺少对象的文件
+        if (present || replicaPresent) {
+            std::cout << "<<< Object " << objId << " failed checksum verification on every server" << std::endl;
+        } else if (!reachable) {
+            std::cout << "<<< Object " << objId << " is unavailable: every server that stores it is down" << std::endl;
+        } else {
+            std::cout << "<<< Object " << objId << " is missing on every reachable server" << std::endl;
+        }
+        intact = false;
+    }
+    
+    if (intact) {
+        for (int objId = 0; objId < objectCount; objId++) {
+            streamed.fetched[objId]->offset = static_cast<size_t>(objId) * DEFAULT_OBJECT_SIZE;
+            fileSplit.objects.push_back(std::move(streamed.fetched[objId]));
+        }
+        fileSplit.object_count = objectCount;
+    }
+    
+    endGet(connFds, connCount);
+    
+    DEBUGSS("Objects fetched, count:", std::to_string(fileSplit.object_count).c_str());
+    return intact;
+}
+
+bool DfcUtils::fetchErasureSplits(std::vector<int>& connFds, int connCount, const std::vector<int>& holders,
+                                  FileSplit& fileSplit, const Placement& placement, const std::string& path,
+                                  const ErasureCode& code) {
+    int width = code.totalFragments();
+    int k = code.dataFragments();
+    
+    fileSplit.objects.clear();
+    fileSplit.object_count = 0;
+    fileSplit.object_size = DEFAULT_OBJECT_SIZE;
+    
+    int objectCount;
+    bool legacy;
+    if (!fetchObjectCount(connFds, connCount, holders, placement, path, objectCount, legacy)) {
+        if (legacy) {
+            // 旧文件没有纠删码分段，对象按原样保存
+            return fetchLegacySplits(connFds, connCount, holders, fileSplit);
         }
-        break;
+        endGet(connFds, connCount);
+        return false;
     }
     
-    if (fileSplit.object_count > 0) {
-        DEBUGSS("All objects fetched successfully, count:", std::to_string(fileSplit.object_count).c_str());
+    DEBUGSN("Fetching data fragments in parallel from servers", static_cast<int>(holders.size()));
+    
+    // 并行的流只读取数据分段，没有丢失分段时不需要解码，也不读取校验分段
+    StreamedObjects streamed(static_cast<size_t>(objectCount) * width);
+    std::vector<std::vector<int>> fragmentsByServer;
+    placement.fragmentsByServer(path, objectCount, width, fragmentsByServer);
+    for (std::vector<int>& ids : fragmentsByServer) {
+        ids.erase(std::remove_if(ids.begin(), ids.end(), [width, k](int id) { return id % width >= k; }), ids.end());
+    }
+    streamFromHolders(connFds, holders, fragmentsByServer, streamed);
+    
+    // 逐个对象收集k个完好的分段：先用流取到的数据分段，缺少的再逐个向保存校验分段的服务器请求
+    bool intact = true;
+    std::vector<int> servers;
+    for (int objId = 0; objId < objectCount; objId++) {
+        uint64_t key = Placement::objectKey(path, objId);
+        placement.replicas(key, servers);
+        std::vector<std::vector<uint8_t>> fragments(width);
+        int good = 0, unreachable = 0;
+        for (int j = 0; j < width && good < k; j++) {
+            int id = objId * width + j;
+            int serverIdx = Placement::fragmentServer(servers, j);
+            if (streamed.states[id] == ObjectState::PENDING) {
+                // 校验分段，或者流没有读到的数据分段
+                if (connFds[serverIdx] == -1) {
+                    unreachable++;
+                    continue;
+                }
+                std::vector<int> fragmentFds(connCount, -1);
+                if (std::find(holders.begin(), holders.end(), serverIdx) != holders.end()) {
+                    fragmentFds[serverIdx] = connFds[serverIdx];
+                }
+                auto split = std::make_unique<Split>();
+                bool present = false;
+                if (fetchObjectReplica(fragmentFds, connCount, -1, id, *split, present)) {
+                    streamed.fetched[id] = std::move(split);
+                    streamed.states[id] = ObjectState::FETCHED;
+                } else {
+                    streamed.states[id] = present ? ObjectState::CORRUPT : ObjectState::MISSING;
+                }
+            }
+            if (streamed.states[id] == ObjectState::FETCHED) {
+                fragments[j] = std::move(streamed.fetched[id]->content);
+                good++;
+            }
+        }
+        // 仍不足k个时，服务器不可达或没有的分段再向接替的服务器请求
+        for (int j = 0; j < width && good < k; j++) {
+            int id = objId * width + j;
+            if (streamed.states[id] != ObjectState::PENDING && streamed.states[id] != ObjectState::MISSING) {
+                continue;
+            }
+            auto split = std::make_unique<Split>();
+            bool present = false;
+            if (fetchHandoffReplica(connFds, connCount, holders, placement, key, id, *split, present)) {
+                fragments[j] = std::move(split->content);
+                streamed.states[id] = ObjectState::FETCHED;
+                good++;
+            }
+        }
+        
+        auto split = std::make_unique<Split>();
+        if (good < k || !decodeErasureObject(code, fragments, *split)) {
+            std::cout << "<<< Object " << objId << " cannot be reconstructed: only " << good << " of " << k
+                      << " fragments are available";
+            if (unreachable > 0) {
+                std::cout << " (" << unreachable << " on servers that are down)";
+            }
+            std::cout << std::endl;
+            intact = false;
+            break;
+        }
+        split->id = objId;
+        split->offset = static_cast<size_t>(objId) * DEFAULT_OBJECT_SIZE;
+        fileSplit.objects.push_back(std::move(split));
+    }
+    if (intact) {
+        fileSplit.object_count = objectCount;
     } else {
-        DEBUGS("No objects fetched!");
+        fileSplit.objects.clear();
     }
     
-    DEBUGS("Finished fetching remote objects");
+    endGet(connFds, connCount);
+    
+    DEBUGSS("Erasure coded objects fetched, count:", std::to_string(fileSplit.object_count).c_str());
+    return intact;
+}
+
+void DfcUtils::encodeErasureObject(Split& object, const ErasureCode& code,
+                                   std::vector<std::unique_ptr<Split>>& fragments) {
+    int width = code.totalFragments();
+    // 分段末尾补了0，对象前面记下它的长度
+    std::vector<unsigned char> payload(INT_SIZE);
+    NetUtils::encodeIntToUchar(payload, static_cast<int>(object.content_length));
+    payload.insert(payload.end(), object.content.begin(), object.content.begin() + object.content_length);
+    // 编码后不再需要原来的对象，及早释放
+    std::vector<unsigned char>().swap(object.content);
+    
+    std::vector<std::vector<uint8_t>> encoded;
+    code.encode(payload.data(), payload.size(), encoded);
+    fragments.resize(width);
+    for (int j = 0; j < width; j++) {
+        auto fragment = std::make_unique<Split>();
+        fragment->id = object.id * width + j;
+        fragment->offset = object.offset;
+        fragment->content = std::move(encoded[j]);
+        fragment->content_length = fragment->content.size();
+        fragments[j] = std::move(fragment);
+    }
+}
+
+bool DfcUtils::decodeErasureObject(const ErasureCode& code, const std::vector<std::vector<uint8_t>>& fragments,
+                                   Split& object) {
+    std::vector<uint8_t> data;
+    if (!code.decode(fragments, data) || data.size() < static_cast<size_t>(INT_SIZE)) {
+        return false;
+    }
+    int length;
+    NetUtils::decodeIntFromUchar(std::vector<unsigned char>(data.begin(), data.begin() + INT_SIZE), length);
+    if (length < 0 || static_cast<size_t>(length) > data.size() - INT_SIZE) {
+        return false;
+    }
+    object.content.assign(data.begin() + INT_SIZE, data.begin() + INT_SIZE + length);
+    object.content_length = static_cast<size_t>(length);
+    return true;
+}
+
+bool DfcUtils::fetchObjectReplica(const std::vector<int>& connFds, int connCount, int skipIdx, 
+                                  int objId, Split& split, bool& present) {
+    present = false;
+    for (int serverIdx = 0; serverIdx < connCount; serverIdx++) {
+        if (serverIdx == skipIdx || connFds[serverIdx] == -1) continue;
+        
+        NetUtils::sendIntValueSocket(connFds[serverIdx], objId);
+        Split replica;
+        NetUtils::writeSplitFromSocketAsStream(connFds[serverIdx], replica);
+        std::vector<unsigned char> resetSignal(1, RESET_SIG);
+        NetUtils::sendToSocket(connFds[serverIdx], resetSignal);
+        
+        present = present || replica.corrupt || replica.content_length > 0;
+        if (replica.id == objId && !replica.corrupt && replica.content_length > 0) {
+            DEBUGSN("Object fetched from replica on server", serverIdx);
+            replica.offset = split.offset;
+            split = std::move(replica);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool DfcUtils::fetchHandoffReplica(const std::vector<int>& connFds, int connCount, const std::vector<int>& holders,
+                                   const Placement& placement, uint64_t key, int objId, Split& split, bool& present) {
+    std::vector<int> servers;
+    placement.handoffs(key, servers);
+    std::vector<int> handoffFds(connCount, -1);
+    bool any = false;
+    for (int serverIdx : servers) {
+        if (serverIdx < connCount && std::find(holders.begin(), holders.end(), serverIdx) != holders.end()) {
+            handoffFds[serverIdx] = connFds[serverIdx];
+            any = any || connFds[serverIdx] != -1;
+        }
+    }
+    if (!any) {
+        return false;
+    }
+    bool handoffPresent = false;
+    bool fetched = fetchObjectReplica(handoffFds, connCount, -1, objId, split, handoffPresent);
+    present = present || handoffPresent;
+    return fetched;
 }
 
-void DfcUtils::commandExec(std::vector<int>& connFds, const std::string& bufferToSend, 
+void DfcUtils::commandExec(std::vector<int>& connFds, const DfcCommand& command, 
                           int connCount, FileAttribute& attr, int flag, DfcConfig& conf) {
     bool sendFlag, errorFlag = false;  // 初始化errorFlag为false
     std::string filePath;
-    int mod, c;
+    int c;
     FileSplit fileSplit;
     ServerChunksCollate serverChunksCollate;
+    std::vector<int> holders;
+    
+    if (!conf.placement) {
+        conf.placement = buildPlacement(conf);
+    }
     
     DEBUGS("Sending the command over to the servers");
-    sendFlag = sendCommand(connFds, bufferToSend, connCount);
+    sendFlag = sendCommand(connFds, command, connCount);
     
     if (sendFlag) {
         DEBUGS("Command sent over to the server successfully");
@@ -503,22 +1230,34 @@ void DfcUtils::commandExec(std::vector<int>& connFds, const std::string& bufferT
     
     for (int i = 0; i < connCount; i++) {
         if (connFds[i] == -1) continue;
-        NetUtils::recvIntValueSocket(connFds[i], c);
-        if (c == -1) {
+        c = recvCommandStatus(connFds[i], command);
+        if (c == SERVER_BUSY_STATUS) {
+            // 服务器过载，本条命令不再使用它，由其余服务器完成
+            std::cout << "<<< Server " << (conf.servers[i] ? conf.servers[i]->name : std::to_string(i + 1))
+                      << " is busy, continuing without it" << std::endl;
+            errorFlag = true;
+            connFds[i] = -1;
+        } else if (c == -1) {
             DEBUGS("Some Error has occured");
             errorFlag = true;
             NetUtils::fetchAndPrintError(connFds[i]);
+            // 该服务器已拒绝本条命令，其余服务器已开始执行，需要继续完成以保持同步
+            connFds[i] = -1;
         }
     }
     
-    if (errorFlag) return;
+    if (errorFlag && std::all_of(connFds.begin(), connFds.begin() + connCount, 
+                                 [](int fd) { return fd == -1; })) {
+        return;
+    }
     
     if (flag == LIST_FLAG) {
-        DEBUGS("Fetching remote file(s) info from all the servers");
-        mod = fetchRemoteFileInfo(connFds, connCount, serverChunksCollate);
-        
-        DEBUGS("Printing the file names and folders with status");
-        getOutputListCommand(serverChunksCollate);
+        DEBUGS("Fetching and printing remote file list from all the servers");
+        if (conf.erasure_data > 0) {
+            fetchRemoteFileList(connFds, connCount, conf.erasure_data + conf.erasure_parity, conf.erasure_data);
+        } else {
+            fetchRemoteFileList(connFds, connCount);
+        }
         
         fetchRemoteDirInfo(connFds, connCount);
         
@@ -528,23 +1267,19 @@ void DfcUtils::commandExec(std::vector<int>& connFds, const std::string& bufferT
         
     } else if (flag == GET_FLAG) {
         DEBUGS("Fetching remote file(s) info from all the servers");
-        mod = fetchRemoteFileInfo(connFds, connCount, serverChunksCollate);
+        fetchRemoteFileInfo(connFds, connCount, serverChunksCollate, holders);
         
-        if (mod < 0) {
-            std::string fileName = "/" + attr.remote_file_name;
-            mod = Utils::getMd5SumHashMod(fileName);
-            DEBUGSS("Calculated mod value directly from filename", std::to_string(mod).c_str());
-        }
-        
-        if (serverChunksCollate.num_files == 0) {
+        if (serverChunksCollate.files.empty()) {
             std::cout << "<<< File not found on any server" << std::endl;
             DEBUGS("Sending RESET_SIG to servers");
             NetUtils::sendSignal(connFds, RESET_SIG);
             return;
         }
         
+        // 纠删码文件的分段放在k + m个服务器上，任意k个即可恢复对象；是否可读由fetchErasureSplits
+        // 根据元数据对象中的对象数和可达的分段逐个对象判断，这里不预先检查
         DEBUGS("Checking whether the file is complete");
-        if (!Utils::checkComplete(serverChunksCollate.chunks[0])) {
+        if (conf.erasure_data == 0 && !Utils::checkComplete(serverChunksCollate.files.begin()->second)) {
             std::cout << "<<< File is incomplete" << std::endl;
             DEBUGS("Sending REST_SIG to server");
             NetUtils::sendSignal(connFds, RESET_SIG);
@@ -554,8 +1289,20 @@ void DfcUtils::commandExec(std::vector<int>& connFds, const std::string& bufferT
             NetUtils::sendSignal(connFds, PROCEED_SIG);
             
             DEBUGS("Fetching remote objects from the server");
-            size_t estimatedFileSize = fileSplit.file_size;
-            fetchRemoteSplits(connFds, connCount, fileSplit, mod, estimatedFileSize);
+            bool fetched;
+            if (conf.erasure_data > 0) {
+                ErasureCode code(conf.erasure_data, conf.erasure_parity);
+                fetched = fetchErasureSplits(connFds, connCount, holders, fileSplit, *conf.placement,
+                                             placementPath(attr), code);
+            } else {
+                fetched = fetchRemoteSplits(connFds, connCount, holders, fileSplit, *conf.placement,
+                                            placementPath(attr));
+            }
+            if (!fetched) {
+                // 不写出损坏的文件
+                Utils::freeFileSplit(fileSplit);
+                return;
+            }
             
             DEBUGS("Decrypting the file objects");
             Utils::encryptDecryptFileSplit(fileSplit, conf.user->password, conf.encryption_type, false);
@@ -566,47 +1313,18 @@ void DfcUtils::commandExec(std::vector<int>& connFds, const std::string& bufferT
         }
         
     } else if (flag == PUT_FLAG) {
-        DEBUGS("Getting mod value on file-content");
         filePath = attr.local_file_folder + attr.local_file_name;
-        mod = Utils::getMd5SumHashMod(filePath);
-        
-        DEBUGS("Splitting file into objects (Ceph style)");
-        splitFileToPieces(filePath, fileSplit);
         
+        DEBUGS("Streaming file objects to servers (read, encrypt and send overlapped)");
+        bool stored = streamFileSplits(connFds, connCount, filePath, placementPath(attr), conf, fileSplit);
         size_t fileSize = fileSplit.file_size;
         
         DEBUGSS("File size", std::to_string(fileSize).c_str());
         DEBUGSS("Object count", std::to_string(fileSplit.object_count).c_str());
         DEBUGSS("Object size", std::to_string(fileSplit.object_size).c_str());
-        
-        DEBUGS("Encrypting the file objects");
-        Utils::encryptDecryptFileSplit(fileSplit, conf.user->password, conf.encryption_type, true);
-        
-        if (shouldUseParallel(fileSize)) {
-            DEBUGS("Sending objects to servers (parallel, thread pool)");
-            auto& pool = ThreadPool::getInstance();
-            std::vector<std::future<void>> sendFutures;
-            for (int i = 0; i < connCount; i++) {
-                if (connFds[i] != -1) {
-                    sendFutures.push_back(pool.enqueue([&connFds, &fileSplit, mod, i]() {
-                        sendFileSplits(connFds[i], fileSplit, mod, i);
-                    }));
-                }
-            }
-            for (auto& f : sendFutures) {
-                f.wait();
-            }
-        } else {
-            DEBUGS("Sending objects to servers (serial)");
-            for (int i = 0; i < connCount; i++) {
-                if (connFds[i] != -1) {
-                    sendFileSplits(connFds[i], fileSplit, mod, i);
-                }
-            }
-        }
         DEBUGS("Objects sent to servers");
         
-        std::atomic<bool> putSuccess(true);
+        std::atomic<bool> putSuccess(stored);
         auto& pool = ThreadPool::getInstance();
         std::vector<std::future<void>> recvFutures;
         for (int i = 0; i < connCount; i++) {
@@ -636,8 +1354,22 @@ void DfcUtils::commandExec(std::vector<int>& connFds, const std::string& bufferT
         
         Utils::freeFileSplit(fileSplit);
     } else if (flag == MKDIR_FLAG) {
-        // MKDIR命令处理 - 仅需发送命令，无需额外操作
-        DEBUGS("MKDIR command executed, no additional processing needed");
+        // 每个服务器回复1表示创建成功，-1加错误信息表示失败（例如目录已存在）
+        std::set<std::string> errors;
+        for (int i = 0; i < connCount; i++) {
+            if (connFds[i] == -1) continue;
+            int result;
+            NetUtils::recvIntValueSocket(connFds[i], result);
+            if (result == -1) {
+                std::string message;
+                NetUtils::fetchError(connFds[i], message);
+                errors.insert(message);
+            }
+        }
+        for (const auto& error : errors) {
+            std::cout << "<<< Error Message: " << error << std::endl;
+        }
+        DEBUGS("MKDIR command executed");
     }
 }
 
@@ -682,47 +1414,102 @@ void DfcUtils::fetchRemoteDirInfo(const std::vector<int>& connFds, int connCount
     }
 }
 
-void DfcUtils::getOutputListCommand(const ServerChunksCollate& serverChunksCollate) {
-    for (int i = 0; i < serverChunksCollate.num_files; i++) {
-        std::cout << std::string(serverChunksCollate.file_names[i].data());
-        if (Utils::checkComplete(serverChunksCollate.chunks[i])) {
-            std::cout << std::endl;
+void DfcUtils::getOutputListCommand(const ServerChunksCollate& serverChunksCollate, int fragmentCount,
+                                    int dataFragments) {
+    std::vector<std::string> names;
+    names.reserve(serverChunksCollate.files.size());
+    for (const auto& file : serverChunksCollate.files) {
+        names.push_back(file.first);
+    }
+    std::sort(names.begin(), names.end());
+    
+    for (const auto& name : names) {
+        std::cout << name;
+        if (Utils::checkComplete(serverChunksCollate.files.at(name), fragmentCount, dataFragments)) {
+            std::cout << "\n";
         } else {
-            std::cout << " [INCOMPLETE]" << std::endl;
+            std::cout << " [INCOMPLETE]\n";
         }
     }
+    std::cout.flush();
 }
 
-bool DfcUtils::authConnections(const std::vector<int>& connFds, const DfcConfig& conf) {
-    bool ans = false;
-    std::string buffer, response;
-    
-    int nBytes = NetUtils::encodeUserStruct(buffer, *conf.user);
-    
-    for (int i = 0; i < conf.server_count; i++) {
-        int socket = connFds[i];
+bool DfcUtils::authConnection(int socket, const User& user, DfcServer& server) {
+    std::string& sessionToken = server.session_token;
+    try {
+        bool binary = WireProtocol::connectionVersion(socket) == WIRE_VERSION_BINARY;
+        if (binary && !sessionToken.empty()) {
+            if (resumeConnection(socket, sessionToken)) {
+                recvSessionToken(socket, sessionToken);
+                return true;
+            }
+            // 令牌过期或服务器已重启，改用密码认证
+            DEBUGS("Session token rejected, authenticating with password");
+            sessionToken.clear();
+        }
         
-        if (socket != -1) {
-            ans = true;
+        if (binary) {
+            std::vector<unsigned char> frame;
+            WireProtocol::encodeAuth(frame, WireProtocol::nextRequestId(), user);
+            WireProtocol::sendFrame(socket, frame);
+        } else {
+            // AUTH命令与其他命令使用相同的帧格式：int长度 + 文本命令
+            std::string buffer;
+            NetUtils::encodeUserStruct(buffer, user);
+            NetUtils::sendIntValueSocket(socket, static_cast<int>(buffer.size()));
             std::vector<unsigned char> payload(buffer.begin(), buffer.end());
-            if (NetUtils::sendToSocket(socket, payload) != nBytes) {
-                std::cerr << "Failed to send auth message" << std::endl;
-                return false;
-            }
-            
-            std::vector<unsigned char> respBuffer(MAX_SEG_SIZE);
-            int rBytes = NetUtils::recvFromSocket(socket, respBuffer);
-            if (rBytes <= 0) {
-                std::cerr << "Failed to recv auth message" << std::endl;
-                return false;
-            }
-            
-            response.assign(respBuffer.begin(), respBuffer.begin() + rBytes);
-            if (response != AUTH_OK) return false;
+            NetUtils::sendToSocket(socket, payload);
         }
+        
+        int response;
+        NetUtils::recvIntValueSocket(socket, response);
+        if (response != 0 && !binary) {
+            // 本系列之前的服务器不认识AUTH命令，回复认证失败并关闭连接；
+            // 它们按每条命令携带的凭据认证，之后对该服务器每条命令使用一个新连接
+            std::string message;
+            NetUtils::fetchError(socket, message);
+            DEBUGSS("Server rejected AUTH on text protocol, using per-command credentials", message.c_str());
+            server.per_command_auth = true;
+            return false;
+        }
+        if (response != 0) {
+            NetUtils::fetchAndPrintError(socket);
+            return false;
+        }
+        if (binary) {
+            recvSessionToken(socket, sessionToken);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Failed to authenticate session: " << e.what() << std::endl;
+        return false;
     }
+    return true;
+}
+
+bool DfcUtils::resumeConnection(int socket, const std::string& token) {
+    std::vector<unsigned char> frame;
+    WireProtocol::encodeResume(frame, WireProtocol::nextRequestId(), token);
+    WireProtocol::sendFrame(socket, frame);
     
-    return ans;
+    int response;
+    NetUtils::recvIntValueSocket(socket, response);
+    if (response != 0) {
+        // 错误消息只用于调试，不打印给用户
+        std::string message;
+        NetUtils::fetchError(socket, message);
+        DEBUGSS("RESUME rejected", message.c_str());
+        return false;
+    }
+    return true;
+}
+
+void DfcUtils::recvSessionToken(int socket, std::string& sessionToken) {
+    std::vector<unsigned char> body;
+    uint64_t requestId;
+    int ttlSeconds;
+    WireProtocol::recvFrame(socket, body);
+    WireProtocol::decodeSessionToken(body, requestId, sessionToken, ttlSeconds);
+    DEBUGSN("Received session token, valid for seconds", ttlSeconds);
 }
 
 void DfcUtils::readDfcConf(const std::string& filePath, DfcConfig& conf) {
@@ -738,7 +1525,21 @@ void DfcUtils::readDfcConf(const std::string& filePath, DfcConfig& conf) {
             line.pop_back();
         }
         
-        if (line.find(DFC_SERVER_CONF) != std::string::npos) {
+        if (line.find(DFC_PLACEMENT_CONF) == 0) {
+            std::string typeStr = Utils::getSubstringAfter(line, DFC_PLACEMENT_CONF);
+            if (!Placement::parseType(typeStr, conf.placement_type)) {
+                std::cerr << "DFC => Unknown placement " << typeStr << ", using ring" << std::endl;
+            }
+        } else if (line.find(DFC_REPLICAS_CONF) == 0) {
+            conf.replication_factor = std::max(1, std::atoi(Utils::getSubstringAfter(line, DFC_REPLICAS_CONF).c_str()));
+        } else if (line.find(DFC_ERASURE_CONF) == 0) {
+            std::string codeStr = Utils::getSubstringAfter(line, DFC_ERASURE_CONF);
+            if (!ErasureCode::parse(codeStr, conf.erasure_data, conf.erasure_parity)) {
+                std::cerr << "DFC => Invalid erasure code " << codeStr << ", using replication" << std::endl;
+                conf.erasure_data = 0;
+                conf.erasure_parity = 0;
+            }
+        } else if (line.find(DFC_SERVER_CONF) != std::string::npos) {
             insertServerConf(line, conf);
         } else if (line.find(DFC_USERNAME_CONF) != std::string::npos) {
             insertUserConf(line, conf, DFC_USERNAME_DELIM, USERNAME_FLAG);
@@ -817,6 +1618,16 @@ void DfcUtils::readDfcConf(const std::string& filePath, DfcConfig& conf) {
     }
     
     file.close();
+    // 分段数超过服务器数时同一对象的多个分段会放在同一个服务器上，一个服务器停止就可能丢失超过m个分段
+    if (conf.erasure_data > 0 && conf.erasure_data + conf.erasure_parity > conf.server_count) {
+        std::cerr << "DFC => Erasure code " << conf.erasure_data << "+" << conf.erasure_parity << " needs "
+                  << conf.erasure_data + conf.erasure_parity << " servers but only " << conf.server_count
+                  << " are configured, using replication" << std::endl;
+        conf.erasure_data = 0;
+        conf.erasure_parity = 0;
+    }
+    conf.placement = buildPlacement(conf);
+    DEBUGSN("Object replicas", conf.placement->replicationFactor());
 }
 
 bool DfcUtils::checkServerStruct(std::unique_ptr<DfcServer>& server) {
@@ -835,6 +1646,7 @@ void DfcUtils::insertServerConf(const std::string& line, DfcConfig& conf) {
     std::string portStr = Utils::getSubstringAfter(addressPort, ":");
     
     int i = conf.server_count++;
+    conf.servers.resize(conf.server_count);
     checkServerStruct(conf.servers[i]);
     
     conf.servers[i]->name = name;
@@ -883,10 +1695,9 @@ void DfcUtils::printDfcConf(const DfcConfig& conf) {
 
 void DfcUtils::freeDfcConf(DfcConfig& conf) {
     conf.user.reset();
-    for (int i = 0; i < conf.server_count; i++) {
-        conf.servers[i].reset();
-    }
+    conf.servers.clear();
     conf.server_count = 0;
+    conf.placement.reset();
 }
 
 void DfcUtils::freeDfcServer(DfcServer& server) {
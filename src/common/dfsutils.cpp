@@ -1,16 +1,158 @@
 #include "dfsutils.hpp"
+#include "object_io.hpp"
+#include "dir_index.hpp"
+#include "packed_store.hpp"
+#include "wal.hpp"
+#include "metrics.hpp"
+#include "wire_protocol.hpp"
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <algorithm>
+#include <cerrno>
 #include <cstring>
 #include <cstdlib>
 #include <cstdio>
+#include <ctime>
 #include <unistd.h>
 #include <fstream>
+#include <memory>
 #include <sstream>
 
-int DfsUtils::getDfsSocket(int portNumber) {
+bool DfsUtils::parseServerOptions(int argc, char** argv, DfsServerOptions& options) {
+    if (argc < 3) {
+        return false;
+    }
+    
+    options.server_folder = argv[1];
+    options.port = atoi(argv[2]);
+    
+    for (int i = 3; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--no-debug") {
+            options.debug_enabled = false;
+        } else if (arg == "--mode" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            if (mode == "fork") {
+                options.mode = DfsServerMode::FORK;
+            } else if (mode == "epoll") {
+                options.mode = DfsServerMode::EPOLL;
+            } else if (mode == "sharded") {
+                options.mode = DfsServerMode::SHARDED;
+            } else {
+                std::cerr << "Unknown server mode: " << mode << std::endl;
+                return false;
+            }
+        } else if (arg == "--io" && i + 1 < argc) {
+            std::string backend = argv[++i];
+            if (backend == "blocking") {
+                options.io_backend = DfsIoBackend::BLOCKING;
+            } else if (backend == "uring") {
+                options.io_backend = DfsIoBackend::IO_URING;
+            } else {
+                std::cerr << "Unknown I/O backend: " << backend << std::endl;
+                return false;
+            }
+        } else if (arg == "--store" && i + 1 < argc) {
+            std::string store = argv[++i];
+            if (store == "files") {
+                options.store_type = DfsStoreType::FILES;
+            } else if (store == "packed") {
+                options.store_type = DfsStoreType::PACKED;
+            } else {
+                std::cerr << "Unknown object store: " << store << std::endl;
+                return false;
+            }
+        } else if (arg == "--commit-window" && i + 1 < argc) {
+            options.commit_window_us = atoi(argv[++i]);
+            if (options.commit_window_us < 0) {
+                std::cerr << "Invalid commit window: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--direct-io" && i + 1 < argc) {
+            // 以KB为单位，0表示关闭
+            long long threshold = atoll(argv[++i]);
+            if (threshold < 0) {
+                std::cerr << "Invalid direct I/O threshold: " << argv[i] << std::endl;
+                return false;
+            }
+            options.direct_io_threshold = static_cast<uint64_t>(threshold) * 1024;
+        } else if (arg == "--cache-size" && i + 1 < argc) {
+            // 以MB为单位，0表示关闭
+            long long size = atoll(argv[++i]);
+            if (size < 0) {
+                std::cerr << "Invalid object cache size: " << argv[i] << std::endl;
+                return false;
+            }
+            options.object_cache_bytes = static_cast<uint64_t>(size) * 1024 * 1024;
+        } else if (arg == "--max-connections" && i + 1 < argc) {
+            options.max_connections = atoi(argv[++i]);
+            if (options.max_connections <= 0) {
+                std::cerr << "Invalid connection limit: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--max-requests" && i + 1 < argc) {
+            options.admission.maxRequests = atoi(argv[++i]);
+            if (options.admission.maxRequests <= 0) {
+                std::cerr << "Invalid request limit: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--max-queued" && i + 1 < argc) {
+            options.admission.maxQueued = atoi(argv[++i]);
+            if (options.admission.maxQueued < 0) {
+                std::cerr << "Invalid queue limit: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--queue-timeout" && i + 1 < argc) {
+            options.admission.queueTimeoutMs = atoi(argv[++i]);
+            if (options.admission.queueTimeoutMs < 0) {
+                std::cerr << "Invalid queue timeout: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--inflight-budget" && i + 1 < argc) {
+            // 以MB为单位
+            long long budget = atoll(argv[++i]);
+            if (budget <= 0) {
+                std::cerr << "Invalid in-flight budget: " << argv[i] << std::endl;
+                return false;
+            }
+            options.admission.inflightBytes = static_cast<uint64_t>(budget) * 1024 * 1024;
+        } else if (arg == "--metrics-port" && i + 1 < argc) {
+            options.metrics_port = atoi(argv[++i]);
+            if (options.metrics_port <= 0 || options.metrics_port > 65535) {
+                std::cerr << "Invalid metrics port: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--io-timeout" && i + 1 < argc) {
+            // 以秒为单位，0表示关闭
+            options.io_timeout = atoi(argv[++i]);
+            if (options.io_timeout < 0) {
+                std::cerr << "Invalid I/O timeout: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--workers" && i + 1 < argc) {
+            options.workers = atoi(argv[++i]);
+            if (options.workers <= 0) {
+                std::cerr << "Invalid worker count: " << argv[i] << std::endl;
+                return false;
+            }
+        } else if (arg == "--shards" && i + 1 < argc) {
+            options.shards = atoi(argv[++i]);
+            if (options.shards <= 0) {
+                std::cerr << "Invalid shard count: " << argv[i] << std::endl;
+                return false;
+            }
+        } else {
+            std::cerr << "Unknown option: " << arg << std::endl;
+            return false;
+        }
+    }
+    
+    return options.port > 0;
+}
+
+int DfsUtils::getDfsSocket(int portNumber, bool reusePort) {
     int sockfd;
     struct sockaddr_in sin;
     int yes = 1;
@@ -32,12 +174,18 @@ int DfsUtils::getDfsSocket(int portNumber) {
         exit(1);
     }
     
+    // 多个监听套接字绑定同一端口，由内核按连接哈希分发
+    if (reusePort && setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes)) < 0) {
+        perror("Unable to set so_reuseport:");
+        exit(1);
+    }
+    
     if (bind(sockfd, (struct sockaddr*)&sin, sizeof(sin)) < 0) {
         perror("Unable to bind the socket:");
         exit(1);
     }
     
-    if (listen(sockfd, MAX_CONNECTION) < 0) {
+    if (listen(sockfd, LISTEN_BACKLOG) < 0) {
         perror("Unable to call listen on socket:");
         exit(1);
     }
@@ -46,84 +194,244 @@ int DfsUtils::getDfsSocket(int portNumber) {
 }
 
 bool DfsUtils::authDfsUser(const User& user, const DfsConfig& conf) {
-    for (int i = 0; i < conf.user_count; i++) {
-        if (conf.users[i] && *conf.users[i] == user) {
-            return true;
-        }
+    Metrics::Timer timer(MetricStage::AUTH);
+    bool authenticated = conf.users.authenticate(user);
+    if (!authenticated) {
+        Metrics::add(MetricCounter::AUTH_FAILURES, 1);
     }
-    return false;
+    return authenticated;
+}
+
+bool DfsUtils::authDfsToken(const std::string& token, const DfsConfig& conf, std::string& username) {
+    Metrics::Timer timer(MetricStage::AUTH);
+    // 令牌签发后用户可能已从配置中移除
+    bool authenticated = conf.tokens.verify(token, time(nullptr), username) && conf.users.contains(username);
+    if (!authenticated) {
+        Metrics::add(MetricCounter::AUTH_FAILURES, 1);
+    }
+    return authenticated;
 }
 
 void DfsUtils::dfsCommandAccept(int socket, DfsConfig& conf) {
     log_debug("dfsCommandAccept called");  // 在最开始添加日志
     
-    std::vector<unsigned char> buffer(MAX_SEG_SIZE, 0);
-    std::string tempBuffer(MAX_SEG_SIZE, 0);
-    DfsRecvCommand dfsRecvCommand;
-    
-    // 接收命令
-    int commandSize;
-    NetUtils::recvIntValueSocket(socket, commandSize);
-    
-    std::stringstream ss1;
-    ss1 << "Received command size: " << commandSize;
-    log_debug(ss1.str());
+    // 会话连接上循环处理命令，直到客户端关闭连接或会话结束
+    DfsSession session;
+    while (dfsHandleRequest(socket, conf, session)) {
+    }
+}
+
+bool DfsUtils::dfsHandleRequest(int socket, DfsConfig& conf, DfsSession& session) {
+    // 网络错误以异常形式抛出，这里统一捕获，避免单个连接的异常终止整个服务进程
+    try {
+        DfsRecvCommand dfsRecvCommand;
+        
+        // 接收命令；会话中客户端在两条命令之间关闭连接属于正常结束
+        int commandSize;
+        if (!NetUtils::tryRecvIntValueSocket(socket, commandSize)) {
+            log_debug(session.authenticated ? "Session closed by client" : "Connection closed before command");
+            return false;
+        }
+        
+        if (!session.authenticated && session.wire_version == WIRE_VERSION_TEXT && 
+            WireProtocol::isHello(commandSize)) {
+            // 连接开始时的版本协商：选择双方都支持的最高版本
+            uint8_t clientVersion = WireProtocol::recvHelloVersion(socket);
+            session.wire_version = std::min(clientVersion, WIRE_VERSION_MAX);
+            WireProtocol::sendHello(socket, session.wire_version);
+            log_debug("Negotiated wire protocol version " + std::to_string(session.wire_version));
+            return true;
+        }
+        
+        std::stringstream ss1;
+        ss1 << "Received command size: " << commandSize;
+        log_debug(ss1.str());
+        
+        if (session.wire_version == WIRE_VERSION_BINARY) {
+            std::vector<unsigned char> body;
+            WireCommand command;
+            WireProtocol::recvFrameBody(socket, commandSize, body);
+            WireProtocol::decodeCommand(body, command);
+            
+            dfsRecvCommand.flag = command.flag;
+            dfsRecvCommand.user = command.user;
+            dfsRecvCommand.token = command.token;
+            dfsRecvCommand.folder = command.folder;
+            dfsRecvCommand.file_name = command.file_name;
+            dfsRecvCommand.request_id = command.request_id;
+            dfsRecvCommand.wire_version = WIRE_VERSION_BINARY;
+        } else if (!dfsRecvTextCommand(socket, commandSize, dfsRecvCommand)) {
+            return false;
+        }
+        
+        int flag = dfsRecvCommand.flag;
+        bool authFlag = false;
+        
+        if (flag == RESUME_FLAG && dfsRecvCommand.wire_version == WIRE_VERSION_BINARY) {
+            // 用会话令牌建立会话：只需一次HMAC校验；令牌无效时保持连接，客户端可以改用密码认证
+            User user;
+            if (session.authenticated || !authDfsToken(dfsRecvCommand.token, conf, user.username)) {
+                log_info("Session token rejected");
+                NetUtils::sendIntValueSocket(socket, -1);
+                sendError(socket, AUTH_FAILED);
+                return true;
+            }
+            session.authenticated = true;
+            session.user = user;
+            log_info("Session resumed for user: " + user.username);
+            NetUtils::sendIntValueSocket(socket, 0);
+            sendSessionToken(socket, dfsRecvCommand, conf, user.username);
+            return true;
+        }
+        
+        if (flag == AUTH_FLAG) {
+            // 会话建立：只认证一次，之后的命令沿用会话中的用户
+            const User& user = dfsRecvCommand.user;
+            authFlag = authDfsUser(user, conf);
+            
+            if (!authFlag) {
+                log_info("Session authentication failed for user: " + user.username);
+                NetUtils::sendIntValueSocket(socket, -1);
+                sendError(socket, AUTH_FAILED);
+                return false;
+            }
+            session.authenticated = true;
+            session.user = user;
+            log_info("Session established for user: " + user.username);
+            NetUtils::sendIntValueSocket(socket, 0);
+            sendSessionToken(socket, dfsRecvCommand, conf, user.username);
+            return true;
+        }
+        
+        bool knownCommand = true;
+        MetricCommand command = MetricCommand::LIST;
+        if (flag == LIST_FLAG) {
+            log_info("Command Received is LIST");
+        } else if (flag == GET_FLAG) {
+            log_info("Command Received is GET");
+            command = MetricCommand::GET;
+        } else if (flag == PUT_FLAG) {
+            log_info("Command Received is PUT");
+            command = MetricCommand::PUT;
+        } else if (flag == MKDIR_FLAG) {
+            log_info("Command Received is MKDIR");
+            command = MetricCommand::MKDIR;
+        } else {
+            knownCommand = false;
+        }
+        
+        if (knownCommand && session.authenticated) {
+            // 已认证的会话不再校验命令中携带的凭据
+            dfsRecvCommand.user = session.user;
+            authFlag = true;
+        } else if (knownCommand && dfsRecvCommand.wire_version == WIRE_VERSION_TEXT) {
+            authFlag = authDfsUser(dfsRecvCommand.user, conf);
+        }
+        
+        if (!authFlag) {
+            NetUtils::sendIntValueSocket(socket, -1);
+            sendError(socket, AUTH_FAILED);
+            return false;
+        }
+        
+        // 按用户限速：超出命令速率时先在这里等待（不占用准入槽位），之后本命令收发的对象字节按该用户计费
+        TenantQos::Scope tenant(dfsRecvCommand.user.username);
+
+        // 准入控制：命令在确认之前排队，过载时回复忙，客户端还没有发送命令的后续数据
+        AdmissionControl::Ticket ticket;
+        {
+            Metrics::Timer timer(MetricStage::QUEUE);
+            ticket = AdmissionControl::admitShared();
+        }
+        if (!ticket.admitted()) {
+            log_info("Server busy, rejecting command, retry after " + std::to_string(ticket.retryAfterMs()) + "ms");
+            if (!session.authenticated) {
+                // 旧协议的单命令连接：按普通错误回复后关闭
+                NetUtils::sendIntValueSocket(socket, -1);
+                sendError(socket, SERVER_BUSY);
+                return false;
+            }
+            NetUtils::sendIntValueSocket(socket, SERVER_BUSY_STATUS);
+            NetUtils::sendIntValueSocket(socket, ticket.retryAfterMs());
+            return true;
+        }
+        
+        Metrics::CommandTimer commandTimer(command);
+        NetUtils::sendIntValueSocket(socket, 0);  // 发送成功确认
+        if (dfsCommandExec(socket, dfsRecvCommand, conf, flag, ticket)) {
+            commandTimer.succeeded();
+        }
+        
+        // 未建立会话的连接保持旧行为：一条命令后关闭
+        return session.authenticated;
+    } catch (const std::exception& e) {
+        log_error("Connection aborted: " + std::string(e.what()));
+        return false;
+    }
+}
+
+bool DfsUtils::dfsRecvTextCommand(int socket, int commandSize, DfsRecvCommand& recvCmd) {
+    if (commandSize <= 0 || commandSize > MAX_SEG_SIZE) {
+        log_error("Invalid command size: " + std::to_string(commandSize));
+        return false;
+    }
     
-    buffer.resize(commandSize);
+    // 命令缓冲区按实际命令长度分配，避免每个命令都申请并清零MAX_SEG_SIZE大小的内存
+    std::vector<unsigned char> buffer(commandSize);
     NetUtils::recvFromSocket(socket, buffer);
-    
     log_debug("Received command buffer");
     
-    // 将缓冲区转换为字符串
     std::string commandStr(buffer.begin(), buffer.end());
+    std::string tempBuffer(commandStr.size() + 1, 0);
     
     std::stringstream ss2;
     ss2 << "Command string: " << commandStr;
     log_debug(ss2.str());
     
     // 解析临时模板获取标志
-    int tempFlag;
+    int tempFlag = -1;
     sscanf(commandStr.c_str(), GENERIC_TEMPLATE, &tempFlag, tempBuffer.data());
-    dfsRecvCommand.flag = tempFlag;
-    
-    int flag = dfsRecvCommand.flag;
-    bool authFlag = false;
-    
-    log_debug("Decoding and authentication command");
-    
-    if (flag == LIST_FLAG) {
-        log_info("Command Received is LIST");
-        authFlag = dfsCommandDecodeAndAuth(commandStr, LIST_TEMPLATE, dfsRecvCommand, conf);
-    } else if (flag == GET_FLAG) {
-        log_info("Command Received is GET");
-        authFlag = dfsCommandDecodeAndAuth(commandStr, GET_TEMPLATE, dfsRecvCommand, conf);
-    } else if (flag == PUT_FLAG) {
-        log_info("Command Received is PUT");
-        authFlag = dfsCommandDecodeAndAuth(commandStr, PUT_TEMPLATE, dfsRecvCommand, conf);
-    } else if (flag == MKDIR_FLAG) {
-        log_info("Command Received is MKDIR");
-        authFlag = dfsCommandDecodeAndAuth(commandStr, MKDIR_TEMPLATE, dfsRecvCommand, conf);
-    }
-    
-    if (!authFlag) {
-        NetUtils::sendIntValueSocket(socket, -1);
-        sendError(socket, AUTH_FAILED);
-    } else {
-        NetUtils::sendIntValueSocket(socket, 0);  // 发送成功确认
-        dfsCommandExec(socket, dfsRecvCommand, conf, flag);
+    recvCmd.flag = tempFlag;
+    recvCmd.wire_version = WIRE_VERSION_TEXT;
+    
+    if (tempFlag == AUTH_FLAG) {
+        std::vector<char> username(commandStr.size() + 1, 0), password(commandStr.size() + 1, 0);
+        int authCmdFlag;
+        if (sscanf(commandStr.c_str(), AUTH_TEMPLATE, &authCmdFlag, username.data(), password.data()) == 3) {
+            recvCmd.user.username = username.data();
+            recvCmd.user.password = password.data();
+        }
+    } else if (tempFlag == LIST_FLAG) {
+        dfsCommandDecode(commandStr, LIST_TEMPLATE, recvCmd);
+    } else if (tempFlag == GET_FLAG) {
+        dfsCommandDecode(commandStr, GET_TEMPLATE, recvCmd);
+    } else if (tempFlag == PUT_FLAG) {
+        dfsCommandDecode(commandStr, PUT_TEMPLATE, recvCmd);
+    } else if (tempFlag == MKDIR_FLAG) {
+        dfsCommandDecode(commandStr, MKDIR_TEMPLATE, recvCmd);
     }
+    return true;
 }
 
 bool DfsUtils::dfsCommandDecodeAndAuth(const std::string& buffer, const std::string& format, 
                                       DfsRecvCommand& recvCmd, const DfsConfig& conf) {
-    char username[MAX_CHAR_BUFF], password[MAX_CHAR_BUFF], folder[MAX_CHAR_BUFF], fileName[MAX_CHAR_BUFF];
+    dfsCommandDecode(buffer, format, recvCmd);
+    return authDfsUser(recvCmd.user, conf);
+}
+
+void DfsUtils::dfsCommandDecode(const std::string& buffer, const std::string& format, 
+                                DfsRecvCommand& recvCmd) {
+    // 每个字段最长不会超过整条命令，按命令长度分配，名字不再受MAX_CHAR_BUFF限制
+    size_t fieldSize = buffer.size() + 1;
+    std::vector<char> username(fieldSize, 0), password(fieldSize, 0), folder(fieldSize, 0), fileName(fieldSize, 0);
     
-    sscanf(buffer.c_str(), format.c_str(), &recvCmd.flag, username, password, folder, fileName);
+    sscanf(buffer.c_str(), format.c_str(), &recvCmd.flag, username.data(), password.data(), 
+           folder.data(), fileName.data());
     
-    recvCmd.user.username = std::string(username);
-    recvCmd.user.password = std::string(password);
-    recvCmd.folder = std::string(folder);
-    recvCmd.file_name = std::string(fileName);
+    recvCmd.user.username = std::string(username.data());
+    recvCmd.user.password = std::string(password.data());
+    recvCmd.folder = std::string(folder.data());
+    recvCmd.file_name = std::string(fileName.data());
     
     // 处理在客户端收到"NULL"的情况
     if (Utils::compareString(recvCmd.folder, "NULL")) {
@@ -133,27 +441,25 @@ bool DfsUtils::dfsCommandDecodeAndAuth(const std::string& buffer, const std::str
     if (Utils::compareString(recvCmd.file_name, "NULL")) {
         recvCmd.file_name.clear();
     }
-    
-    return authDfsUser(recvCmd.user, conf);
 }
 
 bool DfsUtils::dfsCommandExec(int socket, const DfsRecvCommand& recvCmd, 
-                             DfsConfig& conf, int flag) {
-    std::string folderPath;
+                             DfsConfig& conf, int flag, AdmissionControl::Ticket& ticket) {
+    std::string folderPath, userPath;
     std::vector<unsigned char> payloadBuffer;
     ServerChunksInfo serverChunksInfo;
-    std::array<Split, 2> splits;
+    ObjectIoBackend& objectIo = ObjectIoBackend::forThread(conf.io_backend, conf.direct_io_threshold);
     int sizeOfPayload, splitId;
     unsigned char signal;
     bool folderPathFlag, fileFlag;
     
     // 创建用户名目录（如果不存在）
-    folderPath = conf.server_name + "/" + recvCmd.user.username;
+    userPath = conf.server_name + "/" + recvCmd.user.username;
     
-    if (!Utils::checkDirectoryExists(folderPath)) {
-        DEBUGSS("Creating user directory:", folderPath.c_str());
-        log_debug("Creating user directory: " + folderPath);
-        createDfsDirectory(folderPath);
+    if (!Utils::checkDirectoryExists(userPath)) {
+        DEBUGSS("Creating user directory:", userPath.c_str());
+        log_debug("Creating user directory: " + userPath);
+        createDfsDirectory(userPath);
     }
     
     // 构建完整路径
@@ -184,7 +490,15 @@ bool DfsUtils::dfsCommandExec(int socket, const DfsRecvCommand& recvCmd,
         }
         
         log_debug("Reading all the files in the folder path from request");
-        Utils::getFilesInFolder(folderPath, serverChunksInfo, "");
+        std::shared_ptr<DirIndex> dirIndex = DirIndex::forDirectory(folderPath);
+        // 二进制协议按页返回，文本协议仍一次返回全部文件
+        bool paged = recvCmd.wire_version == WIRE_VERSION_BINARY;
+        bool morePages = false;
+        if (paged) {
+            morePages = dirIndex->listFilesPage("", LIST_PAGE_ENTRIES, serverChunksInfo);
+        } else {
+            dirIndex->listFiles(serverChunksInfo);
+        }
         
         // 发送hasData标志：1表示有文件数据，0表示无文件数据
         int hasData = (serverChunksInfo.chunks > 0) ? 1 : 0;
@@ -201,53 +515,15 @@ bool DfsUtils::dfsCommandExec(int socket, const DfsRecvCommand& recvCmd,
 
         NetUtils::sendIntValueSocket(socket, hasData);
         
-        // 总是发送payloadSize，即使没有文件数据
-        int sizeOfPayload = INT_SIZE + serverChunksInfo.chunks * CHUNK_INFO_STRUCT_SIZE;
-        
-        // 调试：显示sizeOfPayload的实际字节
-        std::vector<unsigned char> sizeBuffer(INT_SIZE);
-        NetUtils::encodeIntToUchar(sizeBuffer, sizeOfPayload);
-        std::stringstream ss_size;
-        ss_size << "sizeOfPayload bytes: ";
-        for (int i = 0; i < INT_SIZE; i++) {
-            ss_size << (int)sizeBuffer[i] << " ";
-        }
-        log_debug(ss_size.str());
-
-        NetUtils::sendIntValueSocket(socket, sizeOfPayload);
-        
-        if (hasData) {
-            log_debug("Sending files info to the client");
-            std::vector<unsigned char> uCharBuffer(sizeOfPayload);
-            NetUtils::encodeServerChunksInfoToBuffer(uCharBuffer, serverChunksInfo);
-            
-            // 添加缓冲区内容调试
-            std::stringstream ss4;
-            ss4 << "Sending buffer of size " << uCharBuffer.size() << ": ";
-            for (size_t i = 0; i < uCharBuffer.size(); i++) {
-                ss4 << (int)uCharBuffer[i] << " ";
-            }
-            log_debug(ss4.str());
-            
-            NetUtils::sendToSocket(socket, uCharBuffer);
+        if (paged) {
+            sendListPages(socket, recvCmd, *dirIndex, serverChunksInfo, morePages);
         } else {
-            // 发送空的payload
-            std::vector<unsigned char> emptyPayload(sizeOfPayload, 0);
-            
-            // 添加缓冲区内容调试
-            std::stringstream ss5;
-            ss5 << "Sending empty buffer of size " << emptyPayload.size() << ": ";
-            for (size_t i = 0; i < emptyPayload.size(); i++) {
-                ss5 << (int)emptyPayload[i] << " ";
-            }
-            log_debug(ss5.str());
-            
-            NetUtils::sendToSocket(socket, emptyPayload);
+            sendChunksInfo(socket, recvCmd, serverChunksInfo);
         }
         
         // 发送文件夹信息
         std::vector<unsigned char> folderPayload;
-        sizeOfPayload = Utils::getFoldersInFolder(folderPath, folderPayload);
+        sizeOfPayload = dirIndex->listFolders(folderPayload);
         NetUtils::sendIntValueSocket(socket, sizeOfPayload);
         if (sizeOfPayload > 0) {
             NetUtils::sendToSocket(socket, folderPayload);
@@ -268,21 +544,13 @@ bool DfsUtils::dfsCommandExec(int socket, const DfsRecvCommand& recvCmd,
         }
         
         log_debug("Reading given file from folder path from request");
-        fileFlag = Utils::getFilesInFolder(folderPath, serverChunksInfo, recvCmd.file_name);
+        fileFlag = DirIndex::forDirectory(folderPath)->findFile(recvCmd.file_name, serverChunksInfo);
         
         // Modified: Always send response even if file doesn't exist locally
         // This allows client to collect info from all servers and determine correct MOD
-        sizeOfPayload = INT_SIZE + serverChunksInfo.chunks * CHUNK_INFO_STRUCT_SIZE;
-
         NetUtils::sendIntValueSocket(socket, 1);
         log_debug("Sending the file's info to the client");
-
-        // 修复：先发送payloadSize
-        NetUtils::sendIntValueSocket(socket, sizeOfPayload);
-        
-        std::vector<unsigned char> uCharBuffer(sizeOfPayload);
-        NetUtils::encodeServerChunksInfoToBuffer(uCharBuffer, serverChunksInfo);
-        NetUtils::sendToSocket(socket, uCharBuffer);
+        sendChunksInfo(socket, recvCmd, serverChunksInfo);
         
         log_debug("Waiting for signal from client");
         NetUtils::recvSignal(socket, signal);
@@ -291,13 +559,20 @@ bool DfsUtils::dfsCommandExec(int socket, const DfsRecvCommand& recvCmd,
             log_info("Proceeding with sending file split as requested by client");
             while (true) {
                 NetUtils::recvIntValueSocket(socket, splitId);
+                if (splitId == GET_WINDOW_REQUEST || splitId == GET_STREAM_REQUEST) {
+                    // 流水线模式：一次请求连续发送多个分片，中间不等待客户端信号
+                    dfsStreamObjects(socket, conf, objectIo, folderPath, recvCmd.file_name, 
+                                     splitId == GET_STREAM_REQUEST);
+                    continue;
+                }
+                if (splitId < 0) {
+                    // 客户端结束本次GET（会话中连接还要继续使用）
+                    break;
+                }
                 
                 // 修复：正确的分片文件路径应该包含目录分隔符和隐藏文件前缀
-                std::string splitPath = folderPath + "/." + recvCmd.file_name + "." + std::to_string(splitId);
-                splits[0].id = splitId;
-                Utils::readIntoSplitFromFile(splitPath, splits[0]);
-                NetUtils::writeSplitToSocketAsStream(socket, splits[0]);
-                Utils::freeSplit(splits[0]);
+                std::string splitPath = ObjectIoBackend::objectPath(folderPath, recvCmd.file_name, splitId);
+                dfsSendObject(socket, conf, objectIo, splitId, splitPath);
                 
                 // 接收RESET_SIG，然后继续循环处理下一个请求
                 NetUtils::recvSignal(socket, signal);
@@ -318,6 +593,7 @@ bool DfsUtils::dfsCommandExec(int socket, const DfsRecvCommand& recvCmd,
         if (!Utils::checkDirectoryExists(folderPath)) {
             log_debug("Creating directory for PUT: " + folderPath);
             createDfsDirectory(folderPath);
+            DirIndex::recordFolderPath(userPath, folderPath);
         }
         
         int objectCount = 0;
@@ -325,31 +601,90 @@ bool DfsUtils::dfsCommandExec(int socket, const DfsRecvCommand& recvCmd,
         NetUtils::recvIntValueSocket(socket, expectedObjects);
         log_debug("Expecting " + std::to_string(expectedObjects) + " objects for PUT operation");
         
-        while (objectCount < expectedObjects) {
-            log_debug("Waiting for object " + std::to_string(objectCount + 1) + "/" + std::to_string(expectedObjects));
-            try {
+        // 收到的对象先不生效，全部收完后作为一条WAL记录组提交，落盘后才回复客户端
+        std::vector<WriteAheadLog::Entry> entries;
+        std::vector<PackedStore::Pending> pending;
+        auto abandon = [&]() {
+            for (auto& object : pending) {
+                PackedStore::forRoot(conf.server_name).finish(object, false);
+            }
+            for (const auto& entry : entries) {
+                if (!entry.packed) {
+                    unlink(ObjectIoBackend::partialPath(
+                        ObjectIoBackend::objectPath(folderPath, entry.fileName, entry.objectId)).c_str());
+                }
+            }
+        };
+        bool durable = false;
+        int failedObjects = 0;
+        try {
+            while (objectCount < expectedObjects) {
+                log_debug("Waiting for object " + std::to_string(objectCount + 1) + "/" + std::to_string(expectedObjects));
                 int objectId;
                 NetUtils::recvIntValueSocket(socket, objectId);
                 
-                Split tempSplit;
-                tempSplit.id = objectId;
-                NetUtils::writeSplitFromSocketAsStream(socket, tempSplit);
+                // 按对象长度预留在途字节，预算不足时先不读取对象内容，TCP流控让客户端暂停发送
+                int peekId, contentLength;
+                NetUtils::peekSplitHeader(socket, peekId, contentLength);
+                ticket.reserve(contentLength > 0 ? static_cast<uint64_t>(contentLength) : 0);
                 
+                WriteAheadLog::Entry entry{folderPath, recvCmd.file_name, 0, 0, false, 0, 0};
+                bool received;
+                if (conf.store_type == DfsStoreType::PACKED) {
+                    PackedStore::Pending object;
+                    received = PackedStore::forRoot(conf.server_name).receive(socket, objectIo, folderPath,
+                                                                             recvCmd.file_name, splitId, object);
+                    if (received) {
+                        entry.size = object.length;
+                        entry.packed = true;
+                        entry.segment = object.segment;
+                        entry.record = object.record;
+                        pending.push_back(object);
+                    }
+                } else {
+                    // 写入失败时没有临时文件，对象不会生效
+                    received = objectIo.recvPartial(socket, folderPath, recvCmd.file_name, splitId, entry.size);
+                }
+                if (received) {
+                    entry.objectId = splitId;
+                    entries.push_back(entry);
+                } else {
+                    // 内容已读走，继续接收剩余对象保持协议同步，但整个PUT不能再确认成功
+                    failedObjects++;
+                }
+                ticket.reserve(0);
                 log_debug("Received object ID: " + std::to_string(objectId) + 
-                         ", content_length: " + std::to_string(tempSplit.content_length));
-                
-                Utils::writeSplitToFile(tempSplit, folderPath, recvCmd.file_name);
-                Utils::freeSplit(tempSplit);
+                         ", split ID: " + std::to_string(splitId));
                 objectCount++;
-            } catch (const std::exception& e) {
-                log_error("Error receiving object: " + std::string(e.what()));
-                break;
             }
+            
+            unsigned char sig;
+            NetUtils::recvSignal(socket, sig);
+            log_debug("Received end signal: " + std::to_string(sig));
+            
+            durable = failedObjects == 0 &&
+                      (entries.empty() || WriteAheadLog::forRoot(conf.server_name).commit(entries, conf.commit_window_us));
+        } catch (const std::exception& e) {
+            // 分片流已不完整，连接无法再与客户端保持同步，放弃已收到的对象后交由上层关闭连接
+            log_error("Error receiving object: " + std::string(e.what()));
+            abandon();
+            throw;
         }
         
-        unsigned char sig;
-        NetUtils::recvSignal(socket, sig);
-        log_debug("Received end signal: " + std::to_string(sig));
+        if (!durable) {
+            abandon();
+            if (failedObjects > 0) {
+                log_error("PUT of " + recvCmd.file_name + " failed to store " + std::to_string(failedObjects) +
+                          " of " + std::to_string(expectedObjects) + " objects");
+            } else {
+                log_error("PUT of " + recvCmd.file_name + " was not committed");
+            }
+            NetUtils::sendIntValueSocket(socket, -1);
+            return false;
+        }
+        for (auto& object : pending) {
+            PackedStore::forRoot(conf.server_name).finish(object, true);
+        }
         
         log_info("PUT operation completed successfully for file: " + recvCmd.file_name + 
                 ", received " + std::to_string(objectCount) + " objects");
@@ -365,11 +700,125 @@ bool DfsUtils::dfsCommandExec(int socket, const DfsRecvCommand& recvCmd,
         NetUtils::sendIntValueSocket(socket, 1);
         log_info("Creating directory");
         createDfsDirectory(folderPath);
+        DirIndex::recordFolderPath(userPath, folderPath);
     }
     
     return true;
 }
 
+void DfsUtils::sendListPages(int socket, const DfsRecvCommand& recvCmd, DirIndex& dirIndex, 
+                             ServerChunksInfo& page, bool more) {
+    std::vector<unsigned char> frame, body;
+    int pages = 1;
+    while (true) {
+        std::string cursor = more ? page.chunk_info.back().file_name : std::string();
+        WireProtocol::encodeListPage(frame, recvCmd.request_id, page, more, cursor);
+        WireProtocol::sendFrame(socket, frame);
+        if (!more) {
+            break;
+        }
+        
+        // 客户端按自己的节奏带回游标请求下一页，服务器不为LIST保留任何状态
+        uint64_t requestId;
+        WireProtocol::recvFrame(socket, body);
+        WireProtocol::decodeListNext(body, requestId, cursor);
+        if (requestId != recvCmd.request_id) {
+            throw std::runtime_error("LIST_NEXT for request " + std::to_string(requestId) + 
+                                     ", expected " + std::to_string(recvCmd.request_id));
+        }
+        more = dirIndex.listFilesPage(cursor, LIST_PAGE_ENTRIES, page);
+        pages++;
+    }
+    log_debug("LIST sent in " + std::to_string(pages) + " page(s)");
+}
+
+void DfsUtils::sendSessionToken(int socket, const DfsRecvCommand& recvCmd, const DfsConfig& conf,
+                                const std::string& username) {
+    // 文本协议的AUTH回复保持只有状态int，令牌只在二进制协议下签发
+    if (recvCmd.wire_version != WIRE_VERSION_BINARY) {
+        return;
+    }
+    std::vector<unsigned char> frame;
+    WireProtocol::encodeSessionToken(frame, recvCmd.request_id, conf.tokens.issue(username, time(nullptr)),
+                                     SESSION_TOKEN_TTL_SECONDS);
+    WireProtocol::sendFrame(socket, frame);
+}
+
+void DfsUtils::sendChunksInfo(int socket, const DfsRecvCommand& recvCmd, 
+                              const ServerChunksInfo& serverChunksInfo) {
+    if (recvCmd.wire_version == WIRE_VERSION_BINARY) {
+        // 二进制协议：CHUNK_INFO帧自带长度，名字按实际长度编码
+        std::vector<unsigned char> frame;
+        WireProtocol::encodeServerChunksInfo(frame, recvCmd.request_id, serverChunksInfo);
+        log_debug("Sending CHUNK_INFO frame of " + std::to_string(frame.size()) + " bytes");
+        WireProtocol::sendFrame(socket, frame);
+        return;
+    }
+    
+    // 文本协议：先发送payloadSize，再发送固定大小的ChunkInfo记录（没有文件时只有4字节的数量）
+    int sizeOfPayload = INT_SIZE + serverChunksInfo.chunks * CHUNK_INFO_STRUCT_SIZE;
+    NetUtils::sendIntValueSocket(socket, sizeOfPayload);
+    
+    std::vector<unsigned char> uCharBuffer(sizeOfPayload);
+    NetUtils::encodeServerChunksInfoToBuffer(uCharBuffer, serverChunksInfo);
+    
+    std::stringstream ss;
+    ss << "Sending buffer of size " << uCharBuffer.size() << ": ";
+    for (size_t i = 0; i < uCharBuffer.size(); i++) {
+        ss << (int)uCharBuffer[i] << " ";
+    }
+    log_debug(ss.str());
+    
+    NetUtils::sendToSocket(socket, uCharBuffer);
+}
+
+void DfsUtils::dfsStreamObjects(int socket, const DfsConfig& conf, ObjectIoBackend& objectIo, 
+                                const std::string& folderPath, const std::string& fileName, bool untilMissing) {
+    int firstId, count = MAX_OBJECTS_PER_FILE;
+    NetUtils::recvIntValueSocket(socket, firstId);
+    if (!untilMissing) {
+        NetUtils::recvIntValueSocket(socket, count);
+    }
+    
+    if (firstId < 0 || count < 0 || count > MAX_OBJECTS_PER_FILE) {
+        throw std::runtime_error("Invalid pipelined GET request: first=" + std::to_string(firstId) + 
+                                 ", count=" + std::to_string(count));
+    }
+    log_debug("Streaming objects from " + std::to_string(firstId) + 
+              (untilMissing ? " until end of file" : ", count " + std::to_string(count)));
+    
+    for (int splitId = firstId; splitId < firstId + count; splitId++) {
+        std::string splitPath = ObjectIoBackend::objectPath(folderPath, fileName, splitId);
+        if (untilMissing && !dfsObjectExists(conf, splitPath)) {
+            break;
+        }
+        dfsSendObject(socket, conf, objectIo, splitId, splitPath);
+    }
+    
+    if (untilMissing) {
+        // 长度为0的分片表示文件结束
+        std::vector<unsigned char> header;
+        NetUtils::encodeSplitHeader(header, -1, 0);
+        NetUtils::sendToSocket(socket, header);
+    }
+}
+
+void DfsUtils::dfsSendObject(int socket, const DfsConfig& conf, ObjectIoBackend& objectIo, int splitId, 
+                             const std::string& objectFile) {
+    if (conf.store_type == DfsStoreType::PACKED && 
+        PackedStore::forRoot(conf.server_name).sendObject(socket, objectIo, splitId, objectFile)) {
+        return;
+    }
+    objectIo.sendObject(socket, splitId, objectFile);
+}
+
+bool DfsUtils::dfsObjectExists(const DfsConfig& conf, const std::string& objectFile) {
+    if (conf.store_type == DfsStoreType::PACKED && PackedStore::forRoot(conf.server_name).contains(objectFile)) {
+        return true;
+    }
+    return access(objectFile.c_str(), F_OK) == 0;
+}
+
 void DfsUtils::sendErrorHelper(int socket, const std::string& message) {
     int payloadSize = message.length();
     std::vector<unsigned char> payload(payloadSize);
@@ -393,6 +842,9 @@ void DfsUtils::sendError(int socket, int flag) {
         case AUTH_FAILED:
             sendErrorHelper(socket, AUTH_FAILED_ERROR);
             break;
+        case SERVER_BUSY:
+            sendErrorHelper(socket, SERVER_BUSY_ERROR);
+            break;
         default:
             DEBUGS("Unknown Error Flag");
             break;
@@ -400,10 +852,64 @@ void DfsUtils::sendError(int socket, int flag) {
 }
 
 void DfsUtils::readDfsConf(const std::string& filePath, DfsConfig& conf) {
+    auto users = std::make_shared<UserTable>();
+    conf.tenant_limits.clear();
+    if (!loadDfsUsers(filePath, *users, conf.tenant_limits)) {
+        perror("DFC => Error in opening config file: ");
+    }
+    conf.users.publish(users);
+}
+
+bool DfsUtils::reloadDfsConf(const std::string& filePath, DfsConfig& conf) {
+    // 新表在旁边完整构建，发布之前认证一直使用旧表
+    auto users = std::make_shared<UserTable>();
+    std::unordered_map<std::string, TenantLimits> limits;
+    if (!loadDfsUsers(filePath, *users, limits)) {
+        log_error("Unable to reload " + filePath + ": " + strerror(errno) + ", keeping current users");
+        return false;
+    }
+    if (users->size() == 0) {
+        log_error("No users in " + filePath + ", keeping current users");
+        return false;
+    }
+
+    std::shared_ptr<const UserTable> previous = conf.users.snapshot();
+    size_t added = 0;
+    for (const std::string& username : users->usernames()) {
+        if (!previous->contains(username)) {
+            // 新用户的目录在发布之前创建，认证通过的第一条命令就可以使用
+            createDfsDirectory(conf.server_name + "/" + username);
+            added++;
+        }
+    }
+    conf.users.publish(users);
+
+    // 限速改变的用户保留桶中已有的令牌；不再限速的用户设为不限速
+    if (TenantQos* qos = TenantQos::shared()) {
+        for (const auto& entry : limits) {
+            if (!qos->configure(entry.first, entry.second)) {
+                log_error("Unable to apply limits for " + entry.first);
+            }
+        }
+        for (const auto& entry : conf.tenant_limits) {
+            if (limits.find(entry.first) == limits.end()) {
+                qos->configure(entry.first, TenantLimits());
+            }
+        }
+    }
+    size_t removed = previous->size() + added - users->size();
+    conf.tenant_limits = std::move(limits);
+
+    log_info("Reloaded " + filePath + ": " + std::to_string(users->size()) + " users (" +
+             std::to_string(added) + " added, " + std::to_string(removed) + " removed)");
+    return true;
+}
+
+bool DfsUtils::loadDfsUsers(const std::string& filePath, UserTable& users,
+                            std::unordered_map<std::string, TenantLimits>& limits) {
     std::ifstream file(filePath);
     if (!file.is_open()) {
-        perror("DFC => Error in opening config file: ");
-        return;
+        return false;
     }
     
     std::string line;
@@ -411,22 +917,37 @@ void DfsUtils::readDfsConf(const std::string& filePath, DfsConfig& conf) {
         if (!line.empty() && line.back() == '\n') {
             line.pop_back();
         }
-        insertDfsUserConf(line, conf);
+        insertDfsUserConf(line, users, limits);
     }
     
     file.close();
+    return true;
 }
 
-void DfsUtils::insertDfsUserConf(const std::string& line, DfsConfig& conf) {
+void DfsUtils::insertDfsUserConf(const std::string& line, UserTable& users,
+                                 std::unordered_map<std::string, TenantLimits>& limits) {
     size_t spacePos = line.find(' ');
     if (spacePos != std::string::npos) {
         std::string username = line.substr(0, spacePos);
         std::string password = line.substr(spacePos + 1);
+
+        // 行末的 bandwidth=20M ops=100 是该用户的限速，其余部分是密码
+        TenantLimits userLimits;
+        size_t lastSpace = password.rfind(' ');
+        while (lastSpace != std::string::npos && TenantQos::parseLimit(password.substr(lastSpace + 1), userLimits)) {
+            password.erase(lastSpace);
+            lastSpace = password.rfind(' ');
+        }
+        if (userLimits.limited()) {
+            limits[username] = userLimits;
+        } else {
+            limits.erase(username);
+        }
         
-        int i = conf.user_count++;
-        conf.users[i] = std::make_unique<User>();
-        conf.users[i]->username = username;
-        conf.users[i]->password = password;
+        User user;
+        user.username = username;
+        user.password = password;
+        users.add(user);
     }
 }
 
@@ -472,26 +993,19 @@ void DfsUtils::createDfsDirectory(const std::string& path) {
 
 void DfsUtils::dfsDirectoryCreator(const std::string& serverName, DfsConfig& conf) {
     createDfsDirectory(serverName);
-    for (int i = 0; i < conf.user_count; i++) {
-        if (conf.users[i]) {
-            std::string filePath = serverName + "/" + conf.users[i]->username;
-            createDfsDirectory(filePath);
-        }
+    for (const std::string& username : conf.users.usernames()) {
+        std::string filePath = serverName + "/" + username;
+        createDfsDirectory(filePath);
     }
 }
 
 void DfsUtils::printDfsConf(const DfsConfig& conf) {
-    for (int i = 0; i < conf.user_count; i++) {
-        if (conf.users[i]) {
-            std::cerr << "Username: " << conf.users[i]->username 
-                      << " & Password: " << conf.users[i]->password << std::endl;
-        }
+    // 用户表只保存密码摘要
+    for (const std::string& username : conf.users.usernames()) {
+        std::cerr << "Username: " << username << std::endl;
     }
 }
 
 void DfsUtils::freeDfsConf(DfsConfig& conf) {
-    for (int i = 0; i < conf.user_count; i++) {
-        conf.users[i].reset();
-    }
-    conf.user_count = 0;
+    conf.users.clear();
 }
\ No newline at end of file
@@ -0,0 +1,356 @@
+#include "erasure_code.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define GF256_X86 1
+#endif
+
+namespace {
+
+constexpr unsigned GF256_POLY = 0x11D;
+constexpr size_t ENCODE_BLOCK = 16 * 1024;   // 分块编码，校验分段的当前块在各数据分段之间留在L1缓存中
+
+struct Tables {
+    uint8_t exp[512];           // exp[i] = 2^i，长度加倍后乘法不需要取模
+    uint8_t log[256];
+    uint8_t mul[256][256];
+    alignas(16) uint8_t low[256][16];    // low[c][x] = c * x
+    alignas(16) uint8_t high[256][16];   // high[c][x] = c * (x << 4)
+    Gf256::Kernel kernel;
+
+    Tables() {
+        unsigned value = 1;
+        for (int i = 0; i < 255; i++) {
+            exp[i] = static_cast<uint8_t>(value);
+            log[value] = static_cast<uint8_t>(i);
+            value <<= 1;
+            if (value & 0x100) {
+                value ^= GF256_POLY;
+            }
+        }
+        for (int i = 255; i < 512; i++) {
+            exp[i] = exp[i - 255];
+        }
+        log[0] = 0;
+        for (int a = 0; a < 256; a++) {
+            for (int b = 0; b < 256; b++) {
+                mul[a][b] = (a == 0 || b == 0) ? 0 : exp[log[a] + log[b]];
+            }
+        }
+        for (int c = 0; c < 256; c++) {
+            for (int x = 0; x < 16; x++) {
+                low[c][x] = mul[c][x];
+                high[c][x] = mul[c][x << 4];
+            }
+        }
+#ifdef GF256_X86
+        if (__builtin_cpu_supports("avx2")) {
+            kernel = Gf256::Kernel::AVX2;
+        } else if (__builtin_cpu_supports("ssse3")) {
+            kernel = Gf256::Kernel::SSSE3;
+        } else {
+            kernel = Gf256::Kernel::PORTABLE;
+        }
+#else
+        kernel = Gf256::Kernel::PORTABLE;
+#endif
+    }
+};
+
+const Tables& tables() {
+    static const Tables instance;
+    return instance;
+}
+
+void mulAddTable(const Tables& t, uint8_t c, const uint8_t* src, uint8_t* dst, size_t length) {
+    const uint8_t* row = t.mul[c];
+    for (size_t i = 0; i < length; i++) {
+        dst[i] ^= row[src[i]];
+    }
+}
+
+#ifdef GF256_X86
+
+// 每个字节拆成高低两个4位，分别在c的两张乘积表中查表再异或：c * x = c * (x & 0xF) ^ c * (x & 0xF0)
+__attribute__((target("ssse3")))
+void mulAddSsse3(const Tables& t, uint8_t c, const uint8_t* src, uint8_t* dst, size_t length) {
+    const __m128i low = _mm_load_si128(reinterpret_cast<const __m128i*>(t.low[c]));
+    const __m128i high = _mm_load_si128(reinterpret_cast<const __m128i*>(t.high[c]));
+    const __m128i mask = _mm_set1_epi8(0x0F);
+    size_t i = 0;
+    for (; i + 16 <= length; i += 16) {
+        __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i product = _mm_xor_si128(_mm_shuffle_epi8(low, _mm_and_si128(value, mask)),
+                                        _mm_shuffle_epi8(high, _mm_and_si128(_mm_srli_epi64(value, 4), mask)));
+        __m128i* out = reinterpret_cast<__m128i*>(dst + i);
+        _mm_storeu_si128(out, _mm_xor_si128(_mm_loadu_si128(out), product));
+    }
+    mulAddTable(t, c, src + i, dst + i, length - i);
+}
+
+__attribute__((target("avx2")))
+void mulAddAvx2(const Tables& t, uint8_t c, const uint8_t* src, uint8_t* dst, size_t length) {
+    // vpshufb在每个128位的半边内查表，两个半边放同一张表
+    const __m256i low = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(t.low[c])));
+    const __m256i high = _mm256_broadcastsi128_si256(_mm_load_si128(reinterpret_cast<const __m128i*>(t.high[c])));
+    const __m256i mask = _mm256_set1_epi8(0x0F);
+    size_t i = 0;
+    // 每次处理两个寄存器，两条查表链互不依赖
+    for (; i + 64 <= length; i += 64) {
+        __m256i value0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        __m256i value1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 32));
+        __m256i product0 = _mm256_xor_si256(
+            _mm256_shuffle_epi8(low, _mm256_and_si256(value0, mask)),
+            _mm256_shuffle_epi8(high, _mm256_and_si256(_mm256_srli_epi64(value0, 4), mask)));
+        __m256i product1 = _mm256_xor_si256(
+            _mm256_shuffle_epi8(low, _mm256_and_si256(value1, mask)),
+            _mm256_shuffle_epi8(high, _mm256_and_si256(_mm256_srli_epi64(value1, 4), mask)));
+        __m256i* out0 = reinterpret_cast<__m256i*>(dst + i);
+        __m256i* out1 = reinterpret_cast<__m256i*>(dst + i + 32);
+        _mm256_storeu_si256(out0, _mm256_xor_si256(_mm256_loadu_si256(out0), product0));
+        _mm256_storeu_si256(out1, _mm256_xor_si256(_mm256_loadu_si256(out1), product1));
+    }
+    for (; i + 32 <= length; i += 32) {
+        __m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        __m256i product = _mm256_xor_si256(
+            _mm256_shuffle_epi8(low, _mm256_and_si256(value, mask)),
+            _mm256_shuffle_epi8(high, _mm256_and_si256(_mm256_srli_epi64(value, 4), mask)));
+        __m256i* out = reinterpret_cast<__m256i*>(dst + i);
+        _mm256_storeu_si256(out, _mm256_xor_si256(_mm256_loadu_si256(out), product));
+    }
+    mulAddTable(t, c, src + i, dst + i, length - i);
+}
+
+#endif
+
+void mulAddKernel(const Tables& t, Gf256::Kernel kernel, uint8_t c, const uint8_t* src, uint8_t* dst,
+                  size_t length) {
+    if (c == 0) {
+        return;
+    }
+#ifdef GF256_X86
+    if (kernel == Gf256::Kernel::AVX2) {
+        mulAddAvx2(t, c, src, dst, length);
+        return;
+    }
+    if (kernel == Gf256::Kernel::SSSE3) {
+        mulAddSsse3(t, c, src, dst, length);
+        return;
+    }
+#else
+    (void)kernel;
+#endif
+    mulAddTable(t, c, src, dst, length);
+}
+
+} // namespace
+
+uint8_t Gf256::mul(uint8_t a, uint8_t b) {
+    return tables().mul[a][b];
+}
+
+uint8_t Gf256::div(uint8_t a, uint8_t b) {
+    const Tables& t = tables();
+    if (a == 0) {
+        return 0;
+    }
+    return t.exp[t.log[a] + 255 - t.log[b]];
+}
+
+uint8_t Gf256::inv(uint8_t a) {
+    return div(1, a);
+}
+
+void Gf256::mulAdd(uint8_t c, const uint8_t* src, uint8_t* dst, size_t length) {
+    const Tables& t = tables();
+    mulAddKernel(t, t.kernel, c, src, dst, length);
+}
+
+void Gf256::mulAddPortable(uint8_t c, const uint8_t* src, uint8_t* dst, size_t length) {
+    mulAddTable(tables(), c, src, dst, length);
+}
+
+void Gf256::mulAddWith(Kernel kernel, uint8_t c, const uint8_t* src, uint8_t* dst, size_t length) {
+    const Tables& t = tables();
+    // 不能使用比检测到的更高的指令集
+    if (static_cast<int>(kernel) > static_cast<int>(t.kernel)) {
+        kernel = Kernel::PORTABLE;
+    }
+    mulAddKernel(t, kernel, c, src, dst, length);
+}
+
+Gf256::Kernel Gf256::kernel() {
+    return tables().kernel;
+}
+
+const char* Gf256::kernelName(Kernel kernel) {
+    switch (kernel) {
+        case Kernel::AVX2:
+            return "AVX2";
+        case Kernel::SSSE3:
+            return "SSSE3";
+        default:
+            return "table";
+    }
+}
+
+ErasureCode::ErasureCode(int dataFragments, int parityFragments) : k_(dataFragments), m_(parityFragments) {
+    if (k_ < 1 || m_ < 0 || k_ + m_ > MAX_ERASURE_FRAGMENTS) {
+        throw std::runtime_error("Invalid erasure code " + std::to_string(k_) + "+" + std::to_string(m_));
+    }
+    matrix_.assign(static_cast<size_t>((k_ + m_) * k_), 0);
+    for (int i = 0; i < k_; i++) {
+        matrix_[i * k_ + i] = 1;
+    }
+    for (int i = 0; i < m_; i++) {
+        for (int j = 0; j < k_; j++) {
+            matrix_[(k_ + i) * k_ + j] = Gf256::inv(static_cast<uint8_t>((k_ + i) ^ j));
+        }
+    }
+}
+
+size_t ErasureCode::fragmentSize(size_t length) const {
+    size_t size = (length + k_ - 1) / k_;
+    size = (size + ERASURE_FRAGMENT_ALIGN - 1) / ERASURE_FRAGMENT_ALIGN * ERASURE_FRAGMENT_ALIGN;
+    return std::max(size, ERASURE_FRAGMENT_ALIGN);
+}
+
+void ErasureCode::encode(const uint8_t* data, size_t length, std::vector<std::vector<uint8_t>>& fragments) const {
+    size_t size = fragmentSize(length);
+    fragments.assign(k_ + m_, std::vector<uint8_t>(size, 0));
+    for (int j = 0; j < k_; j++) {
+        size_t offset = static_cast<size_t>(j) * size;
+        if (offset < length) {
+            memcpy(fragments[j].data(), data + offset, std::min(size, length - offset));
+        }
+    }
+
+    for (size_t block = 0; block < size; block += ENCODE_BLOCK) {
+        size_t blockLength = std::min(ENCODE_BLOCK, size - block);
+        for (int i = 0; i < m_; i++) {
+            uint8_t* parity = fragments[k_ + i].data() + block;
+            for (int j = 0; j < k_; j++) {
+                Gf256::mulAdd(matrix_[(k_ + i) * k_ + j], fragments[j].data() + block, parity, blockLength);
+            }
+        }
+    }
+}
+
+bool ErasureCode::decode(const std::vector<std::vector<uint8_t>>& fragments, std::vector<uint8_t>& data) const {
+    // 所有分段长度相同，以第一个出现的分段为准，长度不同的分段视为缺失
+    size_t size = 0;
+    for (const std::vector<uint8_t>& fragment : fragments) {
+        if (!fragment.empty()) {
+            size = fragment.size();
+            break;
+        }
+    }
+    std::vector<int> rows;
+    bool dataComplete = true;
+    for (int i = 0; i < k_ + m_ && i < static_cast<int>(fragments.size()); i++) {
+        bool present = size > 0 && fragments[i].size() == size;
+        if (present && static_cast<int>(rows.size()) < k_) {
+            rows.push_back(i);
+        }
+        dataComplete = dataComplete && (i >= k_ || present);
+    }
+    if (static_cast<int>(rows.size()) < k_) {
+        return false;
+    }
+
+    data.assign(static_cast<size_t>(k_) * size, 0);
+    if (dataComplete) {
+        for (int j = 0; j < k_; j++) {
+            memcpy(data.data() + static_cast<size_t>(j) * size, fragments[j].data(), size);
+        }
+        return true;
+    }
+
+    std::vector<uint8_t> inverse;
+    if (!invertRows(rows, inverse)) {
+        return false;
+    }
+    // 数据分段j = 逆矩阵第j行与取到的k个分段的线性组合；仍在的数据分段直接复制
+    for (int j = 0; j < k_; j++) {
+        uint8_t* out = data.data() + static_cast<size_t>(j) * size;
+        if (fragments[j].size() == size) {
+            memcpy(out, fragments[j].data(), size);
+            continue;
+        }
+        for (size_t block = 0; block < size; block += ENCODE_BLOCK) {
+            size_t blockLength = std::min(ENCODE_BLOCK, size - block);
+            for (int r = 0; r < k_; r++) {
+                Gf256::mulAdd(inverse[j * k_ + r], fragments[rows[r]].data() + block, out + block, blockLength);
+            }
+        }
+    }
+    return true;
+}
+
+bool ErasureCode::invertRows(const std::vector<int>& rows, std::vector<uint8_t>& inverse) const {
+    // 高斯-约当消元：[A | I] -> [I | A^-1]
+    std::vector<uint8_t> a(static_cast<size_t>(k_ * k_));
+    for (int r = 0; r < k_; r++) {
+        std::copy(matrix_.begin() + rows[r] * k_, matrix_.begin() + (rows[r] + 1) * k_, a.begin() + r * k_);
+    }
+    inverse.assign(static_cast<size_t>(k_ * k_), 0);
+    for (int i = 0; i < k_; i++) {
+        inverse[i * k_ + i] = 1;
+    }
+    for (int col = 0; col < k_; col++) {
+        int pivot = col;
+        while (pivot < k_ && a[pivot * k_ + col] == 0) {
+            pivot++;
+        }
+        if (pivot == k_) {
+            return false;
+        }
+        if (pivot != col) {
+            std::swap_ranges(a.begin() + pivot * k_, a.begin() + (pivot + 1) * k_, a.begin() + col * k_);
+            std::swap_ranges(inverse.begin() + pivot * k_, inverse.begin() + (pivot + 1) * k_,
+                             inverse.begin() + col * k_);
+        }
+        uint8_t scale = Gf256::inv(a[col * k_ + col]);
+        for (int j = 0; j < k_; j++) {
+            a[col * k_ + j] = Gf256::mul(a[col * k_ + j], scale);
+            inverse[col * k_ + j] = Gf256::mul(inverse[col * k_ + j], scale);
+        }
+        for (int r = 0; r < k_; r++) {
+            uint8_t factor = a[r * k_ + col];
+            if (r == col || factor == 0) {
+                continue;
+            }
+            for (int j = 0; j < k_; j++) {
+                a[r * k_ + j] ^= Gf256::mul(factor, a[col * k_ + j]);
+                inverse[r * k_ + j] ^= Gf256::mul(factor, inverse[col * k_ + j]);
+            }
+        }
+    }
+    return true;
+}
+
+bool ErasureCode::parse(const std::string& spec, int& dataFragments, int& parityFragments) {
+    size_t plus = spec.find('+');
+    if (plus == std::string::npos || plus == 0 || plus + 1 >= spec.size()) {
+        return false;
+    }
+    std::string data = spec.substr(0, plus);
+    std::string parity = spec.substr(plus + 1);
+    auto digits = [](const std::string& text) {
+        return text.size() <= 2 && std::all_of(text.begin(), text.end(), [](char c) { return c >= '0' && c <= '9'; });
+    };
+    if (!digits(data) || !digits(parity)) {
+        return false;
+    }
+    int k = std::stoi(data);
+    int m = std::stoi(parity);
+    if (k < 1 || m < 0 || k + m > MAX_ERASURE_FRAGMENTS) {
+        return false;
+    }
+    dataFragments = k;
+    parityFragments = m;
+    return true;
+}
@@ -0,0 +1,211 @@
+#include "placement.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+Placement::Placement(const std::vector<std::string>& serverNames, int replicationFactor)
+    : serverNames_(serverNames),
+      replicationFactor_(std::min(replicationFactor, static_cast<int>(serverNames.size()))) {}
+
+void Placement::handoffs(uint64_t key, std::vector<int>& servers) const {
+    preferenceList(key, serverCount(), servers);
+    servers.erase(servers.begin(), servers.begin() + std::min(replicationFactor_, static_cast<int>(servers.size())));
+}
+
+void Placement::liveReplicas(uint64_t key, const std::vector<bool>& live, std::vector<int>& servers) const {
+    std::vector<int> order;
+    replicas(key, order);
+    auto isLive = [&live](int serverIdx) { return serverIdx < static_cast<int>(live.size()) && live[serverIdx]; };
+    if (std::all_of(order.begin(), order.end(), isLive)) {
+        servers = order;
+        return;
+    }
+    // 只有副本服务器不可达时才需要完整的优先顺序
+    preferenceList(key, serverCount(), order);
+    servers.clear();
+    size_t next = static_cast<size_t>(replicationFactor_);
+    for (int i = 0; i < replicationFactor_; i++) {
+        if (isLive(order[i])) {
+            servers.push_back(order[i]);
+            continue;
+        }
+        while (next < order.size() && !isLive(order[next])) {
+            next++;
+        }
+        if (next < order.size()) {
+            servers.push_back(order[next++]);
+        }
+    }
+}
+
+void Placement::liveObjectsByServer(const std::string& path, int objectCount, const std::vector<bool>& live,
+                                    std::vector<std::vector<int>>& objects) const {
+    objects.assign(serverNames_.size(), std::vector<int>());
+    std::vector<int> servers;
+    for (int objId = 0; objId < objectCount; objId++) {
+        liveReplicas(objectKey(path, objId), live, servers);
+        for (int serverIdx : servers) {
+            objects[serverIdx].push_back(objId);
+        }
+    }
+}
+
+void Placement::liveFragmentsByServer(const std::string& path, int objectCount, int fragmentCount,
+                                      const std::vector<bool>& live, std::vector<std::vector<int>>& fragments) const {
+    fragments.assign(serverNames_.size(), std::vector<int>());
+    auto isLive = [&live](int serverIdx) { return serverIdx < static_cast<int>(live.size()) && live[serverIdx]; };
+    std::vector<int> order;
+    for (int objId = 0; objId < objectCount; objId++) {
+        preferenceList(objectKey(path, objId), serverCount(), order);
+        if (order.empty()) {
+            return;
+        }
+        std::vector<int> servers(order.begin(), order.begin() + replicationFactor_);
+        // 接替的服务器不在servers中，没有保存该对象的其他分段，每个只接替一个分段
+        size_t next = static_cast<size_t>(replicationFactor_);
+        for (int fragment = 0; fragment < fragmentCount; fragment++) {
+            int serverIdx = fragmentServer(servers, fragment);
+            if (!isLive(serverIdx)) {
+                while (next < order.size() && !isLive(order[next])) {
+                    next++;
+                }
+                if (next == order.size()) {
+                    continue;
+                }
+                serverIdx = order[next++];
+            }
+            fragments[serverIdx].push_back(objId * fragmentCount + fragment);
+        }
+    }
+    // 接替的分段追加在后面，恢复每个服务器的ID升序
+    for (std::vector<int>& ids : fragments) {
+        std::sort(ids.begin(), ids.end());
+    }
+}
+
+bool Placement::stores(uint64_t key, int serverIdx) const {
+    std::vector<int> servers;
+    replicas(key, servers);
+    return std::find(servers.begin(), servers.end(), serverIdx) != servers.end();
+}
+
+void Placement::objectsByServer(const std::string& path, int objectCount,
+                                std::vector<std::vector<int>>& objects) const {
+    objects.assign(serverNames_.size(), std::vector<int>());
+    std::vector<int> servers;
+    for (int objId = 0; objId < objectCount; objId++) {
+        replicas(objectKey(path, objId), servers);
+        for (int serverIdx : servers) {
+            objects[serverIdx].push_back(objId);
+        }
+    }
+}
+
+void Placement::fragmentsByServer(const std::string& path, int objectCount, int fragmentCount,
+                                  std::vector<std::vector<int>>& fragments) const {
+    fragments.assign(serverNames_.size(), std::vector<int>());
+    std::vector<int> servers;
+    for (int objId = 0; objId < objectCount; objId++) {
+        replicas(objectKey(path, objId), servers);
+        if (servers.empty()) {
+            return;
+        }
+        for (int fragment = 0; fragment < fragmentCount; fragment++) {
+            fragments[fragmentServer(servers, fragment)].push_back(objId * fragmentCount + fragment);
+        }
+    }
+}
+
+std::unique_ptr<Placement> Placement::create(PlacementType type, const std::vector<std::string>& serverNames,
+                                             int replicationFactor) {
+    if (replicationFactor < 1) {
+        throw std::runtime_error("Replication factor must be at least 1, got " + std::to_string(replicationFactor));
+    }
+    if (type == PlacementType::RENDEZVOUS) {
+        return std::make_unique<RendezvousPlacement>(serverNames, replicationFactor);
+    }
+    return std::make_unique<HashRingPlacement>(serverNames, replicationFactor);
+}
+
+bool Placement::parseType(const std::string& name, PlacementType& type) {
+    if (name == "ring" || name == "consistent") {
+        type = PlacementType::RING;
+    } else if (name == "rendezvous" || name == "hrw") {
+        type = PlacementType::RENDEZVOUS;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+uint64_t Placement::objectKey(const std::string& path, int objId) {
+    // 黄金比例常数把相邻的对象ID拉开，再混合一次，相邻对象落在环上互不相关的位置
+    return mix(hash(path) + static_cast<uint64_t>(objId) * 0x9E3779B97F4A7C15ULL);
+}
+
+uint64_t Placement::hash(const std::string& data) {
+    uint64_t value = 14695981039346656037ULL;
+    for (unsigned char c : data) {
+        value = (value ^ c) * 1099511628211ULL;
+    }
+    // FNV-1a的低位和相近输入的结果分布较差，混合后才能直接在环上比较大小
+    return mix(value);
+}
+
+uint64_t Placement::mix(uint64_t value) {
+    value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    value = (value ^ (value >> 27)) * 0x94D049BB133111EBULL;
+    return value ^ (value >> 31);
+}
+
+HashRingPlacement::HashRingPlacement(const std::vector<std::string>& serverNames, int replicationFactor,
+                                     int virtualNodes)
+    : Placement(serverNames, replicationFactor) {
+    ring_.reserve(serverNames.size() * static_cast<size_t>(virtualNodes));
+    for (size_t serverIdx = 0; serverIdx < serverNames.size(); serverIdx++) {
+        for (int node = 0; node < virtualNodes; node++) {
+            ring_.emplace_back(hash(serverNames[serverIdx] + "#" + std::to_string(node)), static_cast<int>(serverIdx));
+        }
+    }
+    std::sort(ring_.begin(), ring_.end());
+}
+
+void HashRingPlacement::preferenceList(uint64_t key, int count, std::vector<int>& servers) const {
+    servers.clear();
+    if (ring_.empty()) {
+        return;
+    }
+    count = std::min(count, serverCount());
+    auto start = std::lower_bound(ring_.begin(), ring_.end(), std::make_pair(key, 0));
+    size_t first = static_cast<size_t>(start - ring_.begin());
+    for (size_t i = 0; i < ring_.size() && static_cast<int>(servers.size()) < count; i++) {
+        int serverIdx = ring_[(first + i) % ring_.size()].second;
+        if (std::find(servers.begin(), servers.end(), serverIdx) == servers.end()) {
+            servers.push_back(serverIdx);
+        }
+    }
+}
+
+RendezvousPlacement::RendezvousPlacement(const std::vector<std::string>& serverNames, int replicationFactor)
+    : Placement(serverNames, replicationFactor) {
+    serverHashes_.reserve(serverNames.size());
+    for (const std::string& name : serverNames) {
+        serverHashes_.push_back(hash(name));
+    }
+}
+
+void RendezvousPlacement::preferenceList(uint64_t key, int count, std::vector<int>& servers) const {
+    count = std::min(count, serverCount());
+    std::vector<std::pair<uint64_t, int>> scores;
+    scores.reserve(serverHashes_.size());
+    for (size_t serverIdx = 0; serverIdx < serverHashes_.size(); serverIdx++) {
+        scores.emplace_back(mix(key ^ serverHashes_[serverIdx]), static_cast<int>(serverIdx));
+    }
+    std::partial_sort(scores.begin(), scores.begin() + count, scores.end(),
+                      [](const std::pair<uint64_t, int>& a, const std::pair<uint64_t, int>& b) {
+                          return a.first > b.first;
+                      });
+    servers.clear();
+    for (int i = 0; i < count; i++) {
+        servers.push_back(scores[i].second);
+    }
+}
@@ -0,0 +1,154 @@
+#include "put_pipeline.hpp"
+#include "thread_pool.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+PutPipeline::PutPipeline(int objectCount, int width, int depth)
+    : objectCount_(objectCount), width_(width), depth_(std::max(depth, 1)),
+      inFlight_(0), peakInFlight_(0), encoding_(0) {
+    if (objectCount < 0 || width < 1) {
+        throw std::runtime_error("Invalid PUT pipeline shape: " + std::to_string(objectCount) + " objects of " +
+                                 std::to_string(width) + " pieces");
+    }
+}
+
+void PutPipeline::run(const ReadStage& read, const EncodeStage& encode, const SendStage& send,
+                      const std::vector<std::vector<int>>& piecesByServer) {
+    pieces_.clear();
+    pieces_.resize(static_cast<size_t>(objectCount_) * width_);
+    ready_.assign(objectCount_, false);
+    remaining_.assign(objectCount_, 0);
+    for (const std::vector<int>& ids : piecesByServer) {
+        for (int id : ids) {
+            remaining_[id / width_]++;
+        }
+    }
+    inFlight_ = 0;
+    peakInFlight_ = 0;
+    encoding_ = 0;
+    error_ = nullptr;
+
+    // 发送线程阻塞等待编码结果，不能占用只有几个线程的共享线程池，否则编码任务可能排不上队
+    std::vector<std::thread> senders;
+    for (size_t serverIdx = 0; serverIdx < piecesByServer.size(); serverIdx++) {
+        if (!piecesByServer[serverIdx].empty()) {
+            senders.emplace_back([this, &send, &piecesByServer, serverIdx]() {
+                sendTo(static_cast<int>(serverIdx), piecesByServer[serverIdx], send);
+            });
+        }
+    }
+
+    auto& pool = ThreadPool::getInstance();
+    for (int objId = 0; objId < objectCount_; objId++) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            changed_.wait(lock, [this]() { return inFlight_ < depth_ || error_; });
+            if (error_) {
+                break;
+            }
+            inFlight_++;
+            peakInFlight_ = std::max(peakInFlight_, inFlight_);
+            encoding_++;
+        }
+        auto object = std::make_shared<Split>();
+        try {
+            read(objId, *object);
+        } catch (...) {
+            fail(std::current_exception());
+            std::lock_guard<std::mutex> lock(mutex_);
+            encoding_--;
+            break;
+        }
+        pool.enqueue([this, object, objId, &encode]() {
+            encodeObject(objId, *object, encode);
+        });
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        changed_.wait(lock, [this]() { return encoding_ == 0; });
+    }
+    for (std::thread& sender : senders) {
+        sender.join();
+    }
+    pieces_.clear();
+    if (error_) {
+        std::rethrow_exception(error_);
+    }
+}
+
+void PutPipeline::encodeObject(int objId, Split& object, const EncodeStage& encode) {
+    std::vector<std::unique_ptr<Split>> pieces(width_);
+    try {
+        encode(object, pieces);
+        for (const std::unique_ptr<Split>& piece : pieces) {
+            if (!piece) {
+                throw std::runtime_error("Object " + std::to_string(objId) + " was not encoded into " +
+                                         std::to_string(width_) + " pieces");
+            }
+        }
+    } catch (...) {
+        fail(std::current_exception());
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (int j = 0; j < width_; j++) {
+            pieces_[static_cast<size_t>(objId) * width_ + j] = std::move(pieces[j]);
+        }
+        ready_[objId] = true;
+        // 所有目标服务器都已停止的对象不需要发送
+        if (remaining_[objId] == 0) {
+            release(objId);
+        }
+        encoding_--;
+    }
+    changed_.notify_all();
+}
+
+void PutPipeline::sendTo(int serverIdx, const std::vector<int>& ids, const SendStage& send) {
+    for (int id : ids) {
+        int objId = id / width_;
+        const Split* piece;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            changed_.wait(lock, [this, objId]() { return ready_[objId] || error_; });
+            if (error_) {
+                return;
+            }
+            // 本线程发送完之前该对象不会被释放，发送时不需要持有锁
+            piece = pieces_[id].get();
+        }
+        try {
+            send(serverIdx, *piece);
+        } catch (...) {
+            fail(std::current_exception());
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--remaining_[objId] == 0) {
+                release(objId);
+            }
+        }
+        changed_.notify_all();
+    }
+}
+
+void PutPipeline::fail(std::exception_ptr error) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!error_) {
+            error_ = error;
+        }
+    }
+    changed_.notify_all();
+}
+
+void PutPipeline::release(int objId) {
+    for (int j = 0; j < width_; j++) {
+        pieces_[static_cast<size_t>(objId) * width_ + j].reset();
+    }
+    inFlight_--;
+}
@@ -239,73 +239,66 @@ void Utils::writeSplitToFile(const Split& split, const std::string& fileFolder,
     log_debug("Successfully wrote " + std::to_string(split.content_length) + " bytes to " + filePath);
 }
 
-void Utils::encryptDecryptFileSplit(FileSplit& fileSplit, const std::string& key, 
-                                 EncryptionType encryptionType, bool isEncrypt) {
-    std::cerr << "[DEBUG] encryptDecryptFileSplit called, encryptionType=" << static_cast<int>(encryptionType) 
-              << ", isEncrypt=" << isEncrypt << std::endl;
-    dfs::crypto::EncryptionAlgorithm algo;
+dfs::crypto::EncryptionAlgorithm Utils::cryptoAlgorithm(EncryptionType encryptionType) {
     switch (encryptionType) {
         case EncryptionType::AES_256_GCM:
-            algo = dfs::crypto::EncryptionAlgorithm::AES_256_GCM;
-            break;
+            return dfs::crypto::EncryptionAlgorithm::AES_256_GCM;
         case EncryptionType::AES_256_ECB:
-            algo = dfs::crypto::EncryptionAlgorithm::AES_256_ECB;
-            break;
+            return dfs::crypto::EncryptionAlgorithm::AES_256_ECB;
         case EncryptionType::AES_256_CBC:
-            algo = dfs::crypto::EncryptionAlgorithm::AES_256_CBC;
-            break;
+            return dfs::crypto::EncryptionAlgorithm::AES_256_CBC;
         case EncryptionType::AES_256_CFB:
-            algo = dfs::crypto::EncryptionAlgorithm::AES_256_CFB;
-            break;
+            return dfs::crypto::EncryptionAlgorithm::AES_256_CFB;
         case EncryptionType::AES_256_OFB:
-            algo = dfs::crypto::EncryptionAlgorithm::AES_256_OFB;
-            break;
+            return dfs::crypto::EncryptionAlgorithm::AES_256_OFB;
         case EncryptionType::AES_256_CTR:
-            algo = dfs::crypto::EncryptionAlgorithm::AES_256_CTR;
-            break;
+            return dfs::crypto::EncryptionAlgorithm::AES_256_CTR;
         case EncryptionType::SM4_ECB:
-            algo = dfs::crypto::EncryptionAlgorithm::SM4_ECB;
-            break;
+            return dfs::crypto::EncryptionAlgorithm::SM4_ECB;
         case EncryptionType::SM4_CBC:
-            algo = dfs::crypto::EncryptionAlgorithm::SM4_CBC;
-            break;
+            return dfs::crypto::EncryptionAlgorithm::SM4_CBC;
         case EncryptionType::SM4_CTR:
-            algo = dfs::crypto::EncryptionAlgorithm::SM4_CTR;
-            break;
+            return dfs::crypto::EncryptionAlgorithm::SM4_CTR;
         case EncryptionType::RSA_OAEP:
-            algo = dfs::crypto::EncryptionAlgorithm::RSA_OAEP;
-            break;
+            return dfs::crypto::EncryptionAlgorithm::RSA_OAEP;
         case EncryptionType::AES_256_FPGA:
-            algo = dfs::crypto::EncryptionAlgorithm::AES_256_FPGA;
             std::cerr << "[DEBUG] Using AES_256_FPGA algorithm" << std::endl;
-            break;
+            return dfs::crypto::EncryptionAlgorithm::AES_256_FPGA;
         default:
-            algo = dfs::crypto::EncryptionAlgorithm::AES_256_GCM;
             std::cerr << "[DEBUG] Using default AES_256_GCM algorithm" << std::endl;
-            break;
+            return dfs::crypto::EncryptionAlgorithm::AES_256_GCM;
+    }
+}
+
+bool Utils::encryptDecryptSplit(Split& split, dfs::crypto::EncryptionAlgorithm algo,
+                                const std::vector<unsigned char>& cryptoKey, bool isEncrypt) {
+    std::vector<unsigned char> output_data;
+    bool success;
+    if (isEncrypt) {
+        success = dfs::crypto::CryptoUtils::encryptData(split.content, output_data, algo, cryptoKey);
+    } else {
+        success = dfs::crypto::CryptoUtils::decryptData(split.content, output_data, algo, cryptoKey);
+    }
+    
+    if (success) {
+        split.content = std::move(output_data);
+        split.content_length = split.content.size();
     }
+    return success;
+}
+
+void Utils::encryptDecryptFileSplit(FileSplit& fileSplit, const std::string& key, 
+                                 EncryptionType encryptionType, bool isEncrypt) {
+    std::cerr << "[DEBUG] encryptDecryptFileSplit called, encryptionType=" << static_cast<int>(encryptionType) 
+              << ", isEncrypt=" << isEncrypt << std::endl;
+    dfs::crypto::EncryptionAlgorithm algo = cryptoAlgorithm(encryptionType);
     
     std::cerr << "[DEBUG] Encryption algorithm mapped to: " << static_cast<int>(algo) << std::endl;
     std::vector<unsigned char> crypto_key = dfs::crypto::CryptoUtils::generateKeyFromPassword(key, algo);
     
     for (int i = 0; i < fileSplit.object_count && i < static_cast<int>(fileSplit.objects.size()); i++) {
-        if (fileSplit.objects[i]) {
-            std::vector<unsigned char> input_data = fileSplit.objects[i]->content;
-            std::vector<unsigned char> output_data;
-            
-            bool success;
-            if (isEncrypt) {
-                success = dfs::crypto::CryptoUtils::encryptData(input_data, output_data, algo, crypto_key);
-            } else {
-                success = dfs::crypto::CryptoUtils::decryptData(input_data, output_data, algo, crypto_key);
-            }
-            
-            if (success) {
-                fileSplit.objects[i]->content = output_data;
-                fileSplit.objects[i]->content_length = output_data.size();
-            } else {
-                std::cerr << "Encryption/decryption failed for object " << i << std::endl;
-            }
+        if (fileSplit.objects[i] && !encryptDecryptSplit(*fileSplit.objects[i], algo, crypto_key, isEncrypt)) {
+            std::cerr << "Encryption/decryption failed for object " << i << std::endl;
         }
     }
 }
@@ -399,12 +392,12 @@ void Utils::printSplit(const Split& split) {
 
 void Utils::printServerChunksCollate(const ServerChunksCollate& serverChunksCollate) {
     DEBUGS("Printing Server Chunks Collate Struct");
-    DEBUGSN("Num File", serverChunksCollate.num_files);
-    for (int i = 0; i < serverChunksCollate.num_files; i++) {
-        DEBUGSS("File name", std::string(serverChunksCollate.file_names[i].data()).c_str());
-        for (int j = 0; j < NUM_SERVER; j++) {
-            DEBUGSN("Chunk", j + 1);
-            DEBUGSN("Present", serverChunksCollate.chunks[i][j]);
+    DEBUGSN("Num File", static_cast<int>(serverChunksCollate.files.size()));
+    for (const auto& file : serverChunksCollate.files) {
+        DEBUGSS("File name", file.first.c_str());
+        DEBUGSN("Object count", file.second.object_count);
+        for (int objectId : file.second.objects) {
+            DEBUGSN("Object", objectId);
         }
     }
 }
@@ -460,45 +453,48 @@ void Utils::extractFileNameAndFolder(const std::string& buffer, FileAttribute& f
     }
 }
 
-int Utils::checkFileNameExist(const std::array<std::array<char, MAX_CHAR_BUFF>, MAX_NUM_FILES>& fileNames, 
-                             const std::string& fileName, int n) {
-    for (int i = 0; i < n; i++) {
-        if (compareString(std::string(fileNames[i].data()), fileName)) {
-            return i;
-        }
-    }
-    return -1;
-}
-
 void Utils::insertToServerChunksCollate(ServerChunksCollate& serverChunksCollate, 
                                       const ServerChunksInfo& serverChunksInfo) {
     for (int i = 0; i < serverChunksInfo.chunks; i++) {
         const auto& chunkInfo = serverChunksInfo.chunk_info[i];
-        int j = checkFileNameExist(serverChunksCollate.file_names, 
-                                  chunkInfo.file_name, serverChunksCollate.num_files);
+        auto& file = serverChunksCollate.files[chunkInfo.file_name];
         
-        if (j < 0) {
-            serverChunksCollate.num_files++;
-            j = serverChunksCollate.num_files - 1;
-            strncpy(serverChunksCollate.file_names[j].data(), 
-                   chunkInfo.file_name.c_str(), MAX_CHAR_BUFF - 1);
-        }
-        
-        for (int k = 0; k < CHUNKS_PER_SERVER; k++) {
-            int chunkNum = chunkInfo.chunks[k];
-            if (chunkNum >= 0 && chunkNum < NUM_SERVER) {
-                serverChunksCollate.chunks[j][chunkNum] = true;
+        if (!chunkInfo.objects.empty()) {
+            file.objects.insert(chunkInfo.objects.begin(), chunkInfo.objects.end());
+        } else {
+            // 文本协议只带前两个对象ID
+            file.text_protocol = file.text_protocol || chunkInfo.object_count < 0;
+            for (int k = 0; k < CHUNKS_PER_SERVER; k++) {
+                if (chunkInfo.chunks[k] >= 0 && chunkInfo.chunks[k] != FILE_MANIFEST_ID) {
+                    file.objects.insert(chunkInfo.chunks[k]);
+                }
             }
         }
+        // 元数据对象的各副本记录的是同一次PUT的对象数；被覆盖到一半时取较大的，缺少的对象会显示为不完整
+        file.object_count = std::max(file.object_count, chunkInfo.object_count);
     }
 }
 
-bool Utils::checkComplete(const std::array<bool, NUM_SERVER>& flagArray) {
-    int sum = 0;
-    for (int i = 0; i < NUM_SERVER; i++) {
-        sum += flagArray[i] ? 1 : 0;
+bool Utils::checkComplete(const FileObjects& file, int fragmentCount, int dataFragments) {
+    if (file.object_count < 0) {
+        // 没有元数据对象：本系列之前上传的文件（或元数据对象所在的服务器都不可达），与旧版本一样
+        // 按从0开始连续的对象ID判断。文本协议每个服务器只报告两个对象ID，无法判断连续，有对象即可
+        if (file.objects.empty()) {
+            return false;
+        }
+        return file.text_protocol ||
+               (*file.objects.begin() == 0 && *file.objects.rbegin() == static_cast<int>(file.objects.size()) - 1);
     }
-    return sum >= 1;
+    for (int objId = 0; objId < file.object_count; objId++) {
+        int present = 0;
+        for (int j = 0; j < fragmentCount && present < dataFragments; j++) {
+            present += file.objects.count(objId * fragmentCount + j) > 0 ? 1 : 0;
+        }
+        if (present < dataFragments) {
+            return false;
+        }
+    }
+    return true;
 }
 
 int Utils::calculateObjectCount(size_t fileSize, size_t objectSize) {
@@ -607,7 +603,8 @@ bool Utils::splitFileToObjects(const std::string& filePath, FileSplit& fileSplit
 }
 
 bool Utils::combineFileFromObjects(const std::string& outputPath, const FileSplit& fileSplit) {
-    if (fileSplit.object_count == 0 || fileSplit.objects.empty()) {
+    // 空文件没有对象，写出长度为0的文件
+    if (fileSplit.object_count > 0 && fileSplit.objects.empty()) {
         std::cerr << "No objects to combine" << std::endl;
         return false;
     }
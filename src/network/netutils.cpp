@@ -1,21 +1,31 @@
 #include "netutils.hpp"
 #include "logger.hpp"
+#include <algorithm>
 #include <cstring>
 #include <cstdio>
 #include <sys/socket.h>
+#include <sys/sendfile.h>
 #include <unistd.h>
 #include <stdexcept>
 #include <arpa/inet.h>  // 添加网络字节序函数头文件
 
 void NetUtils::fetchAndPrintError(int socket) {
+    std::string message;
+    fetchError(socket, message);
+    std::cout << "<<< Error Message: " << message << std::endl;
+}
+
+void NetUtils::fetchError(int socket, std::string& message) {
     int payloadSize;
     recvIntValueSocket(socket, payloadSize);
+    if (payloadSize < 0 || payloadSize > MAX_SEG_SIZE) {
+        throw std::runtime_error("Invalid error message size: " + std::to_string(payloadSize));
+    }
     
-    std::vector<unsigned char> payload(payloadSize + 1);
+    // 只读取消息本身的长度，连接在会话中还要继续使用
+    std::vector<unsigned char> payload(payloadSize);
     recvFromSocket(socket, payload);
-    payload[payloadSize] = '\0';
-    
-    std::cout << "<<< Error Message: " << reinterpret_cast<char*>(payload.data()) << std::endl;
+    message.assign(payload.begin(), payload.end());
 }
 
 void NetUtils::sendIntValueSocket(int socket, int value) {
@@ -30,6 +40,27 @@ void NetUtils::recvIntValueSocket(int socket, int& value) {
     decodeIntFromUchar(payload, value);
 }
 
+bool NetUtils::tryRecvIntValueSocket(int socket, int& value) {
+    std::vector<unsigned char> payload(INT_SIZE, 0);
+    int result;
+    do {
+        result = recv(socket, payload.data(), 1, 0);
+    } while (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR));
+    
+    if (result == 0) {
+        return false;
+    }
+    if (result < 0) {
+        throw std::runtime_error("Unable to receive entire payload via socket");
+    }
+    
+    std::vector<unsigned char> rest(INT_SIZE - 1);
+    recvFromSocket(socket, rest);
+    std::copy(rest.begin(), rest.end(), payload.begin() + 1);
+    decodeIntFromUchar(payload, value);
+    return true;
+}
+
 void NetUtils::encodeIntToUchar(std::vector<unsigned char>& buffer, int n) {
     if (buffer.size() < INT_SIZE) {
         buffer.resize(INT_SIZE);
@@ -53,15 +84,16 @@ void NetUtils::decodeIntFromUchar(const std::vector<unsigned char>& buffer, int&
 }
 
 int NetUtils::encodeUserStruct(std::string& buffer, const User& user) {
-    char tempBuffer[256];
-    int nBytes = sprintf(tempBuffer, AUTH_TEMPLATE, AUTH_FLAG, 
-                        user.username.c_str(), user.password.c_str());
-    buffer = std::string(tempBuffer);
-    
+    int nBytes = snprintf(nullptr, 0, AUTH_TEMPLATE, AUTH_FLAG, 
+                          user.username.c_str(), user.password.c_str());
     if (nBytes < 0) {
         perror("Failed to Encode User Struct");
         exit(1);
     }
+    std::vector<char> tempBuffer(static_cast<size_t>(nBytes) + 1);
+    snprintf(tempBuffer.data(), tempBuffer.size(), AUTH_TEMPLATE, AUTH_FLAG, 
+             user.username.c_str(), user.password.c_str());
+    buffer = std::string(tempBuffer.data(), static_cast<size_t>(nBytes));
     return nBytes;
 }
 
@@ -84,21 +116,77 @@ void NetUtils::decodeUserStruct(const std::string& buffer, User& user) {
 }
 
 int NetUtils::sendToSocket(int socket, const std::vector<unsigned char>& payload) {
-    int sBytes = 0;
-    int sizeOfPayload = payload.size();
+    return static_cast<int>(sendBytesToSocket(socket, payload.data(), payload.size()));
+}
+
+size_t NetUtils::sendBytesToSocket(int socket, const unsigned char* data, size_t length, int flags) {
+    size_t sBytes = 0;
     
-    while (sBytes != sizeOfPayload) {
-        int result = send(socket, payload.data() + sBytes, sizeOfPayload - sBytes, 0);
+    while (sBytes != length) {
+        // MSG_NOSIGNAL：对端关闭时返回EPIPE而不是触发SIGPIPE，由调用方决定如何处理
+        ssize_t result = send(socket, data + sBytes, length - sBytes, MSG_NOSIGNAL | flags);
         if (result < 0) {
-            perror("Unable to send entire payload via socket");
-            exit(1);
+            if (errno == EINTR) {
+                continue;
+            }
+            DEBUGSS("Unable to send entire payload via socket", strerror(errno));
+            throw std::runtime_error("Unable to send entire payload via socket");
         }
-        sBytes += result;
+        sBytes += static_cast<size_t>(result);
     }
     
     return sBytes;
 }
 
+void NetUtils::sendFileToSocket(int socket, int fileFd, size_t length, off_t offset) {
+    off_t end = offset + static_cast<off_t>(length);
+    
+    while (offset < end) {
+        ssize_t result = sendfile(socket, fileFd, &offset, static_cast<size_t>(end - offset));
+        if (result < 0) {
+            if (errno == EINTR || errno == EAGAIN) {
+                continue;
+            }
+            DEBUGSS("Unable to sendfile entire object via socket", strerror(errno));
+            throw std::runtime_error("Unable to sendfile entire object via socket: " + std::string(strerror(errno)));
+        }
+        if (result == 0) {
+            // 文件在发送过程中被截断，已发出的头部长度无法再兑现
+            throw std::runtime_error("Object file truncated while sending");
+        }
+    }
+}
+
+void NetUtils::recvBytesFromSocket(int socket, unsigned char* data, size_t length) {
+    size_t rBytes = 0;
+    
+    while (rBytes != length) {
+        ssize_t result = recv(socket, data + rBytes, length - rBytes, 0);
+        if (result < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                continue;
+            }
+            DEBUGSS("Unable to receive entire payload via socket", strerror(errno));
+            throw std::runtime_error("Unable to receive entire payload via socket");
+        }
+        if (result == 0) {
+            DEBUGSS("Connection closed by peer before receiving complete payload", "");
+            throw std::runtime_error("Connection closed by peer before receiving complete payload");
+        }
+        rBytes += static_cast<size_t>(result);
+    }
+}
+
+void NetUtils::discardFromSocket(int socket, size_t length, std::vector<unsigned char>& buffer) {
+    size_t remaining = length;
+    
+    while (remaining > 0) {
+        size_t chunk = std::min(remaining, buffer.size());
+        recvBytesFromSocket(socket, buffer.data(), chunk);
+        remaining -= chunk;
+    }
+}
+
 int NetUtils::recvFromSocket(int socket, std::vector<unsigned char>& payload) {
     int rBytes = 0;
     int sizeOfPayload = payload.size();
@@ -110,12 +198,12 @@ int NetUtils::recvFromSocket(int socket, std::vector<unsigned char>& payload) {
         int result = recv(socket, payload.data() + rBytes, sizeOfPayload - rBytes, 0);
         if (result < 0) {
             // 处理超时错误（EAGAIN/EWOULDBLOCK），继续重试
-            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
                 // 继续循环，稍后重试
                 continue;
             }
             DEBUGSS("Unable to receive entire payload via socket", strerror(errno));
-            exit(1);
+            throw std::runtime_error("Unable to receive entire payload via socket");
         }
         
         if (result == 0) {
@@ -126,7 +214,7 @@ int NetUtils::recvFromSocket(int socket, std::vector<unsigned char>& payload) {
             } else {
                 // 无法接收完整数据
                 DEBUGSS("Connection closed by peer before receiving complete payload", "");
-                exit(1);
+                throw std::runtime_error("Connection closed by peer before receiving complete payload");
             }
         }
         rBytes += result;
@@ -206,70 +294,103 @@ void NetUtils::decodeChunkInfoFromBuffer(const std::vector<unsigned char>& buffe
     }
 }
 
-void NetUtils::writeSplitToSocketAsStream(int socket, const Split& split) {
-    // 1字节标志，4字节split_id，4字节content_length
-    std::vector<unsigned char> headerBuffer(9, 0);
-    
-    headerBuffer[0] = INITIAL_WRITE_FLAG;
+void NetUtils::encodeSplitHeader(std::vector<unsigned char>& header, int splitId, int contentLength,
+                                 unsigned char flag) {
+    header.assign(SPLIT_HEADER_SIZE, 0);
+    header[0] = flag;
     
     std::vector<unsigned char> idBuffer(INT_SIZE);
-    encodeIntToUchar(idBuffer, split.id);
-    std::copy(idBuffer.begin(), idBuffer.end(), headerBuffer.begin() + 1);
+    encodeIntToUchar(idBuffer, splitId);
+    std::copy(idBuffer.begin(), idBuffer.end(), header.begin() + 1);
     
     std::vector<unsigned char> lengthBuffer(INT_SIZE);
-    encodeIntToUchar(lengthBuffer, static_cast<int>(split.content_length));
-    std::copy(lengthBuffer.begin(), lengthBuffer.end(), headerBuffer.begin() + 5);
-    
-    // 先发送9字节头部
-    sendToSocket(socket, headerBuffer);
-    
-    // 然后发送内容
-    if (split.content_length > 0) {
-        std::vector<unsigned char> contentBuffer(split.content.begin(), split.content.end());
-        sendToSocket(socket, contentBuffer);
+    encodeIntToUchar(lengthBuffer, contentLength);
+    std::copy(lengthBuffer.begin(), lengthBuffer.end(), header.begin() + 5);
+}
+
+void NetUtils::recvSplitHeader(int socket, int& splitId, int& contentLength) {
+    unsigned char flag;
+    recvSplitHeader(socket, flag, splitId, contentLength);
+    if (flag != INITIAL_WRITE_FLAG) {
+        log_error("Invalid flag received: " + std::to_string(flag) + 
+                 ", expected: " + std::to_string(INITIAL_WRITE_FLAG));
+        throw std::runtime_error("Invalid flag in split header");
     }
-    
-    std::cout << "DEBUG CLIENT: Sending split ID: " << split.id << ", Content length: " << split.content_length << std::endl;
 }
 
-void NetUtils::writeSplitFromSocketAsStream(int socket, Split& split) {
-    log_debug("Starting writeSplitFromSocketAsStream - waiting for 9-byte header");
+void NetUtils::peekSplitHeader(int socket, int& splitId, int& contentLength) {
+    unsigned char header[SPLIT_HEADER_SIZE];
+    ssize_t received;
+    do {
+        received = recv(socket, header, sizeof(header), MSG_PEEK | MSG_WAITALL);
+    } while (received < 0 && errno == EINTR);
+    if (received != SPLIT_HEADER_SIZE) {
+        throw std::runtime_error("Connection closed by peer before receiving complete payload");
+    }
+    // 与recvSplitHeader使用相同的整数编码
+    decodeIntFromUchar(std::vector<unsigned char>(header + 1, header + 5), splitId);
+    decodeIntFromUchar(std::vector<unsigned char>(header + 5, header + 9), contentLength);
+}
+
+void NetUtils::recvSplitHeader(int socket, unsigned char& flag, int& splitId, int& contentLength) {
+    log_debug("Waiting for 9-byte split header");
     
     // 使用向量接收9字节头部：1字节标志 + 4字节分片ID + 4字节内容长度
-    std::vector<unsigned char> headerBuffer(9);
+    std::vector<unsigned char> headerBuffer(SPLIT_HEADER_SIZE);
     int bytesReceived = recvFromSocket(socket, headerBuffer);
     log_debug("Received " + std::to_string(bytesReceived) + " bytes for header");
     
-    if (bytesReceived != 9) {
+    if (bytesReceived != SPLIT_HEADER_SIZE) {
         log_error("Failed to receive complete header. Expected 9 bytes, got " + 
                  std::to_string(bytesReceived));
         throw std::runtime_error("Connection closed by peer before receiving complete payload");
     }
     
     // 解析头部
-    unsigned char flag = headerBuffer[0];
+    flag = headerBuffer[0];
     log_debug("Received flag: " + std::to_string(flag));
     
-    if (flag != INITIAL_WRITE_FLAG) {
+    if (flag != INITIAL_WRITE_FLAG && flag != CORRUPT_OBJECT_FLAG) {
         log_error("Invalid flag received: " + std::to_string(flag) + 
                  ", expected: " + std::to_string(INITIAL_WRITE_FLAG));
         throw std::runtime_error("Invalid flag in split header");
     }
     
     // 解析分片ID（4字节）
-    int splitId;
     decodeIntFromUchar(std::vector<unsigned char>(headerBuffer.begin() + 1, headerBuffer.begin() + 5), splitId);
     log_debug("Received split ID: " + std::to_string(splitId));
     
     // 解析内容长度（4字节）
-    int contentLength;
     decodeIntFromUchar(std::vector<unsigned char>(headerBuffer.begin() + 5, headerBuffer.begin() + 9), contentLength);
     log_debug("Received content length: " + std::to_string(contentLength));
     
-    if (contentLength < 0 || contentLength > MAX_SEG_SIZE) {
+    if (contentLength < 0 || contentLength > MAX_SEG_SIZE || (flag == CORRUPT_OBJECT_FLAG && contentLength != 0)) {
         log_error("Invalid content length: " + std::to_string(contentLength));
         throw std::runtime_error("Invalid content length in split header");
     }
+}
+
+void NetUtils::writeSplitToSocketAsStream(int socket, const Split& split) {
+    std::vector<unsigned char> headerBuffer;
+    encodeSplitHeader(headerBuffer, split.id, static_cast<int>(split.content_length));
+    
+    // 先发送9字节头部
+    sendToSocket(socket, headerBuffer);
+    
+    // 然后直接发送分片内容，不再复制到临时缓冲区
+    if (split.content_length > 0) {
+        sendBytesToSocket(socket, split.content.data(), split.content_length);
+    }
+    
+    std::cout << "DEBUG CLIENT: Sending split ID: " << split.id << ", Content length: " << split.content_length << std::endl;
+}
+
+void NetUtils::writeSplitFromSocketAsStream(int socket, Split& split) {
+    log_debug("Starting writeSplitFromSocketAsStream - waiting for 9-byte header");
+    
+    unsigned char flag;
+    int splitId, contentLength;
+    recvSplitHeader(socket, flag, splitId, contentLength);
     
     // 接收内容
     log_debug("Preparing to receive " + std::to_string(contentLength) + " bytes of content");
@@ -287,6 +408,7 @@ void NetUtils::writeSplitFromSocketAsStream(int socket, Split& split) {
     
     split.id = splitId;
     split.content_length = contentLength;
+    split.corrupt = flag == CORRUPT_OBJECT_FLAG;
     log_debug("Successfully received split with ID " + std::to_string(splitId) + 
              " and length " + std::to_string(contentLength));
 }
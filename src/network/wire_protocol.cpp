@@ -0,0 +1,392 @@
+#include "wire_protocol.hpp"
+#include "netutils.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <poll.h>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace {
+
+struct WireConnectionState {
+    uint8_t version;
+    uint64_t last_request_id;
+
+    WireConnectionState() : version(WIRE_VERSION_TEXT), last_request_id(0) {}
+};
+
+std::mutex g_connectionsMutex;
+std::unordered_map<int, WireConnectionState> g_connections;
+
+constexpr size_t VARINT_MAX_BYTES = 10;
+
+int opcodeToFlag(uint8_t opcode) {
+    switch (static_cast<WireOpcode>(opcode)) {
+        case WireOpcode::AUTH: return AUTH_FLAG;
+        case WireOpcode::LIST: return LIST_FLAG;
+        case WireOpcode::GET: return GET_FLAG;
+        case WireOpcode::PUT: return PUT_FLAG;
+        case WireOpcode::MKDIR: return MKDIR_FLAG;
+        case WireOpcode::RESUME: return RESUME_FLAG;
+        default: return -1;
+    }
+}
+
+WireOpcode flagToOpcode(int flag) {
+    switch (flag) {
+        case LIST_FLAG: return WireOpcode::LIST;
+        case GET_FLAG: return WireOpcode::GET;
+        case PUT_FLAG: return WireOpcode::PUT;
+        case MKDIR_FLAG: return WireOpcode::MKDIR;
+        default: throw std::invalid_argument("No wire opcode for command flag " + std::to_string(flag));
+    }
+}
+
+void putChunksInfo(WireWriter& writer, const ServerChunksInfo& serverChunksInfo) {
+    writer.putVarint(static_cast<uint64_t>(serverChunksInfo.chunks));
+    for (int i = 0; i < serverChunksInfo.chunks; i++) {
+        const ChunkInfo& chunkInfo = serverChunksInfo.chunk_info[i];
+        writer.putBytes(chunkInfo.file_name);
+        // 带上全部对象ID时，只认识前两个ID的解析方仍按原样读取前两个
+        if (chunkInfo.objects.empty()) {
+            writer.putVarint(chunkInfo.chunks.size());
+            for (int chunk : chunkInfo.chunks) {
+                writer.putSigned(chunk);
+            }
+        } else {
+            writer.putVarint(chunkInfo.objects.size());
+            for (int object : chunkInfo.objects) {
+                writer.putSigned(object);
+            }
+        }
+    }
+}
+
+// 各文件的对象数追加在分页字段之后，不认识它的解析方读到分页字段就停止
+void putObjectCounts(WireWriter& writer, const ServerChunksInfo& serverChunksInfo) {
+    writer.putVarint(static_cast<uint64_t>(serverChunksInfo.chunks));
+    for (int i = 0; i < serverChunksInfo.chunks; i++) {
+        writer.putSigned(serverChunksInfo.chunk_info[i].object_count);
+    }
+}
+
+void getObjectCounts(WireReader& reader, ServerChunksInfo& serverChunksInfo) {
+    if (reader.atEnd()) {
+        return;
+    }
+    uint64_t count = reader.getVarint();
+    if (count != serverChunksInfo.chunk_info.size()) {
+        throw std::runtime_error("Object counts do not match the files in wire frame");
+    }
+    for (auto& chunkInfo : serverChunksInfo.chunk_info) {
+        chunkInfo.object_count = static_cast<int>(reader.getSigned());
+    }
+}
+
+WireReader chunksInfoReader(const std::vector<unsigned char>& body, uint64_t& requestId) {
+    if (body.empty() || body[0] != static_cast<unsigned char>(WireOpcode::CHUNK_INFO)) {
+        throw std::runtime_error("Expected CHUNK_INFO frame from server");
+    }
+    WireReader reader(body.data() + 1, body.size() - 1);
+    requestId = reader.getVarint();
+    return reader;
+}
+
+void getChunksInfo(WireReader& reader, size_t bodySize, ServerChunksInfo& serverChunksInfo) {
+    uint64_t count = reader.getVarint();
+    // 每项至少占2字节，按帧体长度限制数量，避免恶意的count导致巨大的分配
+    if (count > bodySize / 2) {
+        throw std::runtime_error("Invalid chunk info count in wire frame");
+    }
+    serverChunksInfo.chunks = static_cast<int>(count);
+    serverChunksInfo.chunk_info.assign(static_cast<size_t>(count), ChunkInfo());
+    for (auto& chunkInfo : serverChunksInfo.chunk_info) {
+        chunkInfo.file_name = std::string(reader.getBytes());
+        uint64_t chunkCount = reader.getVarint();
+        for (uint64_t j = 0; j < chunkCount; j++) {
+            int chunk = static_cast<int>(reader.getSigned());
+            if (j < chunkInfo.chunks.size()) {
+                chunkInfo.chunks[j] = chunk;
+            }
+            chunkInfo.objects.push_back(chunk);
+        }
+    }
+}
+
+} // namespace
+
+WireWriter::WireWriter(WireOpcode opcode, uint64_t requestId) {
+    frame_.reserve(64);
+    frame_.resize(INT_SIZE);
+    frame_.push_back(static_cast<unsigned char>(opcode));
+    putVarint(requestId);
+}
+
+void WireWriter::putVarint(uint64_t value) {
+    while (value >= 0x80) {
+        frame_.push_back(static_cast<unsigned char>(value | 0x80));
+        value >>= 7;
+    }
+    frame_.push_back(static_cast<unsigned char>(value));
+}
+
+void WireWriter::putSigned(int64_t value) {
+    // zigzag：小的负数也只占一两个字节
+    putVarint((static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63));
+}
+
+void WireWriter::putBytes(std::string_view bytes) {
+    putVarint(bytes.size());
+    frame_.insert(frame_.end(), bytes.begin(), bytes.end());
+}
+
+const std::vector<unsigned char>& WireWriter::finish() {
+    std::vector<unsigned char> length(INT_SIZE);
+    NetUtils::encodeIntToUchar(length, static_cast<int>(frame_.size() - INT_SIZE));
+    std::copy(length.begin(), length.end(), frame_.begin());
+    return frame_;
+}
+
+WireReader::WireReader(const unsigned char* data, size_t size) : data_(data), size_(size), pos_(0) {}
+
+uint64_t WireReader::getVarint() {
+    uint64_t value = 0;
+    for (size_t i = 0; i < VARINT_MAX_BYTES; i++) {
+        if (pos_ >= size_) {
+            throw std::runtime_error("Truncated varint in wire frame");
+        }
+        unsigned char byte = data_[pos_++];
+        value |= static_cast<uint64_t>(byte & 0x7F) << (7 * i);
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+    throw std::runtime_error("Varint too long in wire frame");
+}
+
+int64_t WireReader::getSigned() {
+    uint64_t raw = getVarint();
+    return static_cast<int64_t>((raw >> 1) ^ (~(raw & 1) + 1));
+}
+
+std::string_view WireReader::getBytes(size_t maxSize) {
+    uint64_t length = getVarint();
+    if (length > maxSize || length > size_ - pos_) {
+        throw std::runtime_error("Invalid field length " + std::to_string(length) + " in wire frame");
+    }
+    std::string_view bytes(reinterpret_cast<const char*>(data_ + pos_), static_cast<size_t>(length));
+    pos_ += static_cast<size_t>(length);
+    return bytes;
+}
+
+bool WireProtocol::isHello(int firstValue) {
+    std::vector<unsigned char> bytes(INT_SIZE);
+    NetUtils::encodeIntToUchar(bytes, firstValue);
+    return memcmp(bytes.data(), WIRE_MAGIC, sizeof(WIRE_MAGIC)) == 0;
+}
+
+void WireProtocol::sendHello(int socket, uint8_t version) {
+    std::vector<unsigned char> hello(WIRE_MAGIC, WIRE_MAGIC + sizeof(WIRE_MAGIC));
+    hello.push_back(version);
+    NetUtils::sendToSocket(socket, hello);
+}
+
+uint8_t WireProtocol::recvHelloVersion(int socket) {
+    std::vector<unsigned char> version(1);
+    NetUtils::recvFromSocket(socket, version);
+    return version[0];
+}
+
+uint8_t WireProtocol::recvHello(int socket) {
+    // recvFromSocket在接收超时后会一直重试，等不到回复的旧服务器会让连接永远挂起
+    struct pollfd pfd;
+    pfd.fd = socket;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    int ready;
+    do {
+        ready = poll(&pfd, 1, WIRE_HELLO_TIMEOUT_MS);
+    } while (ready < 0 && errno == EINTR);
+    if (ready <= 0) {
+        throw std::runtime_error("No HELLO reply from server");
+    }
+    
+    std::vector<unsigned char> hello(WIRE_HELLO_SIZE);
+    NetUtils::recvFromSocket(socket, hello);
+    if (memcmp(hello.data(), WIRE_MAGIC, sizeof(WIRE_MAGIC)) != 0) {
+        throw std::runtime_error("Invalid HELLO reply from server");
+    }
+    return hello[sizeof(WIRE_MAGIC)];
+}
+
+void WireProtocol::sendFrame(int socket, const std::vector<unsigned char>& frame) {
+    NetUtils::sendToSocket(socket, frame);
+}
+
+void WireProtocol::recvFrameBody(int socket, int frameSize, std::vector<unsigned char>& body) {
+    // 帧体至少包含操作码和请求ID
+    if (frameSize < 2 || static_cast<size_t>(frameSize) > WIRE_MAX_FRAME_SIZE) {
+        throw std::runtime_error("Invalid wire frame size: " + std::to_string(frameSize));
+    }
+    body.resize(static_cast<size_t>(frameSize));
+    NetUtils::recvBytesFromSocket(socket, body.data(), body.size());
+}
+
+void WireProtocol::recvFrame(int socket, std::vector<unsigned char>& body) {
+    int frameSize;
+    NetUtils::recvIntValueSocket(socket, frameSize);
+    recvFrameBody(socket, frameSize, body);
+}
+
+void WireProtocol::encodeCommand(std::vector<unsigned char>& frame, int flag, uint64_t requestId,
+                                 const std::string& folder, const std::string& fileName) {
+    WireWriter writer(flagToOpcode(flag), requestId);
+    writer.putBytes(folder);
+    writer.putBytes(fileName);
+    frame = writer.finish();
+}
+
+void WireProtocol::encodeAuth(std::vector<unsigned char>& frame, uint64_t requestId, const User& user) {
+    WireWriter writer(WireOpcode::AUTH, requestId);
+    writer.putBytes(user.username);
+    writer.putBytes(user.password);
+    frame = writer.finish();
+}
+
+void WireProtocol::encodeResume(std::vector<unsigned char>& frame, uint64_t requestId, const std::string& token) {
+    WireWriter writer(WireOpcode::RESUME, requestId);
+    writer.putBytes(token);
+    frame = writer.finish();
+}
+
+void WireProtocol::decodeCommand(const std::vector<unsigned char>& body, WireCommand& command) {
+    if (body.empty()) {
+        throw std::runtime_error("Empty wire frame");
+    }
+    WireReader reader(body.data() + 1, body.size() - 1);
+    command.flag = opcodeToFlag(body[0]);
+    if (command.flag < 0) {
+        throw std::runtime_error("Unknown wire opcode: " + std::to_string(body[0]));
+    }
+    command.request_id = reader.getVarint();
+
+    // 同一版本内允许在帧末尾追加新字段，旧的解析方忽略多余的字节
+    if (command.flag == AUTH_FLAG) {
+        command.user.username = std::string(reader.getBytes());
+        command.user.password = std::string(reader.getBytes());
+    } else if (command.flag == RESUME_FLAG) {
+        command.token = std::string(reader.getBytes());
+    } else {
+        command.folder = std::string(reader.getBytes());
+        command.file_name = std::string(reader.getBytes());
+    }
+}
+
+void WireProtocol::encodeServerChunksInfo(std::vector<unsigned char>& frame, uint64_t requestId,
+                                          const ServerChunksInfo& serverChunksInfo) {
+    // 与最后一页的编码相同，对象数跟在分页字段之后
+    encodeListPage(frame, requestId, serverChunksInfo, false, std::string());
+}
+
+void WireProtocol::decodeServerChunksInfo(const std::vector<unsigned char>& body, uint64_t& requestId,
+                                          ServerChunksInfo& serverChunksInfo) {
+    bool more;
+    std::string cursor;
+    decodeListPage(body, requestId, serverChunksInfo, more, cursor);
+}
+
+void WireProtocol::encodeListPage(std::vector<unsigned char>& frame, uint64_t requestId,
+                                  const ServerChunksInfo& page, bool more, const std::string& cursor) {
+    WireWriter writer(WireOpcode::CHUNK_INFO, requestId);
+    putChunksInfo(writer, page);
+    writer.putVarint(more ? 1 : 0);
+    writer.putBytes(cursor);
+    putObjectCounts(writer, page);
+    frame = writer.finish();
+}
+
+void WireProtocol::decodeListPage(const std::vector<unsigned char>& body, uint64_t& requestId,
+                                  ServerChunksInfo& page, bool& more, std::string& cursor) {
+    WireReader reader = chunksInfoReader(body, requestId);
+    getChunksInfo(reader, body.size(), page);
+    // 不带分页字段的CHUNK_INFO就是完整的一页
+    more = false;
+    cursor.clear();
+    if (!reader.atEnd()) {
+        more = reader.getVarint() != 0;
+        cursor = std::string(reader.getBytes());
+        getObjectCounts(reader, page);
+    }
+    if (!more) {
+        cursor.clear();
+    }
+}
+
+void WireProtocol::encodeListNext(std::vector<unsigned char>& frame, uint64_t requestId, const std::string& cursor) {
+    WireWriter writer(WireOpcode::LIST_NEXT, requestId);
+    writer.putBytes(cursor);
+    frame = writer.finish();
+}
+
+void WireProtocol::decodeListNext(const std::vector<unsigned char>& body, uint64_t& requestId, std::string& cursor) {
+    if (body.empty() || body[0] != static_cast<unsigned char>(WireOpcode::LIST_NEXT)) {
+        throw std::runtime_error("Expected LIST_NEXT frame from client");
+    }
+    WireReader reader(body.data() + 1, body.size() - 1);
+    requestId = reader.getVarint();
+    cursor = std::string(reader.getBytes());
+}
+
+void WireProtocol::encodeSessionToken(std::vector<unsigned char>& frame, uint64_t requestId,
+                                      const std::string& token, int ttlSeconds) {
+    WireWriter writer(WireOpcode::SESSION_TOKEN, requestId);
+    writer.putBytes(token);
+    writer.putVarint(static_cast<uint64_t>(ttlSeconds));
+    frame = writer.finish();
+}
+
+void WireProtocol::decodeSessionToken(const std::vector<unsigned char>& body, uint64_t& requestId,
+                                      std::string& token, int& ttlSeconds) {
+    if (body.empty() || body[0] != static_cast<unsigned char>(WireOpcode::SESSION_TOKEN)) {
+        throw std::runtime_error("Expected SESSION_TOKEN frame from server");
+    }
+    WireReader reader(body.data() + 1, body.size() - 1);
+    requestId = reader.getVarint();
+    token = std::string(reader.getBytes());
+    ttlSeconds = static_cast<int>(std::min<uint64_t>(reader.getVarint(), INT32_MAX));
+}
+
+uint64_t WireProtocol::nextRequestId() {
+    static std::atomic<uint64_t> nextId(1);
+    return nextId.fetch_add(1, std::memory_order_relaxed);
+}
+
+void WireProtocol::setConnectionVersion(int socket, uint8_t version) {
+    std::lock_guard<std::mutex> lock(g_connectionsMutex);
+    g_connections[socket].version = version;
+}
+
+uint8_t WireProtocol::connectionVersion(int socket) {
+    std::lock_guard<std::mutex> lock(g_connectionsMutex);
+    auto it = g_connections.find(socket);
+    return it == g_connections.end() ? WIRE_VERSION_TEXT : it->second.version;
+}
+
+void WireProtocol::setLastRequestId(int socket, uint64_t requestId) {
+    std::lock_guard<std::mutex> lock(g_connectionsMutex);
+    g_connections[socket].last_request_id = requestId;
+}
+
+uint64_t WireProtocol::lastRequestId(int socket) {
+    std::lock_guard<std::mutex> lock(g_connectionsMutex);
+    auto it = g_connections.find(socket);
+    return it == g_connections.end() ? 0 : it->second.last_request_id;
+}
+
+void WireProtocol::forgetConnection(int socket) {
+    std::lock_guard<std::mutex> lock(g_connectionsMutex);
+    g_connections.erase(socket);
+}
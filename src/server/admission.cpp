@@ -0,0 +1,301 @@
+#include "admission.hpp"
+#include "logger.hpp"
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <string>
+
+namespace {
+
+constexpr uint64_t RECLAIM_INTERVAL_US = 500 * 1000;    // 两次扫描槽位持有者之间的最短间隔
+
+uint64_t nowUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000ULL + static_cast<uint64_t>(ts.tv_nsec) / 1000;
+}
+
+size_t alignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+std::unique_ptr<AdmissionControl> g_shared;
+
+} // namespace
+
+struct AdmissionControl::Header {
+    pthread_mutex_t mutex;      // PTHREAD_PROCESS_SHARED | PTHREAD_MUTEX_ROBUST
+    uint32_t generation;        // 每次释放槽位或字节加1，排队的命令在这个futex上睡眠
+    uint32_t slotCount;         // 等于maxRequests
+    uint32_t maxQueued;
+    int32_t queueTimeoutMs;
+    uint64_t budget;
+    uint32_t active;
+    uint32_t waiting;
+    uint64_t inflight;
+    uint64_t admitted;
+    uint64_t queued;
+    uint64_t rejected;
+    uint64_t serviceUs;         // 命令执行时间的指数移动平均，用于估计重试间隔
+    uint64_t lastReclaimUs;
+};
+
+struct AdmissionControl::Slot {
+    pid_t owner;                // 0表示空闲
+    uint64_t bytes;             // 为正在接收的对象预留的字节数
+    uint64_t startUs;
+};
+
+AdmissionControl::Ticket::Ticket(Ticket&& other) noexcept
+    : control_(other.control_), slot_(other.slot_), admitted_(other.admitted_), retryAfterMs_(other.retryAfterMs_) {
+    other.control_ = nullptr;
+    other.slot_ = -1;
+}
+
+AdmissionControl::Ticket& AdmissionControl::Ticket::operator=(Ticket&& other) noexcept {
+    if (this != &other) {
+        if (control_ != nullptr && slot_ >= 0) {
+            control_->release(slot_);
+        }
+        control_ = other.control_;
+        slot_ = other.slot_;
+        admitted_ = other.admitted_;
+        retryAfterMs_ = other.retryAfterMs_;
+        other.control_ = nullptr;
+        other.slot_ = -1;
+    }
+    return *this;
+}
+
+AdmissionControl::Ticket::~Ticket() {
+    if (control_ != nullptr && slot_ >= 0) {
+        control_->release(slot_);
+    }
+}
+
+void AdmissionControl::Ticket::reserve(uint64_t bytes) {
+    if (control_ != nullptr && slot_ >= 0) {
+        control_->reserve(slot_, bytes);
+    }
+}
+
+AdmissionControl::AdmissionControl(const Limits& limits)
+    : map_(MAP_FAILED), mapSize_(0), header_(nullptr), slots_(nullptr) {
+    if (limits.maxRequests <= 0 || limits.maxQueued < 0 || limits.queueTimeoutMs < 0 || limits.inflightBytes == 0) {
+        log_error("Invalid admission limits");
+        return;
+    }
+    size_t slotsOffset = alignUp(sizeof(Header), alignof(Slot));
+    mapSize_ = slotsOffset + static_cast<size_t>(limits.maxRequests) * sizeof(Slot);
+
+    // 匿名共享映射由fork出的子进程继承，初始内容全为0（所有槽位空闲）
+    map_ = mmap(nullptr, mapSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (map_ == MAP_FAILED) {
+        log_error("Unable to map admission control state: " + std::string(strerror(errno)));
+        return;
+    }
+    unsigned char* base = static_cast<unsigned char*>(map_);
+    header_ = reinterpret_cast<Header*>(base);
+    slots_ = reinterpret_cast<Slot*>(base + slotsOffset);
+
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&header_->mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    header_->slotCount = static_cast<uint32_t>(limits.maxRequests);
+    header_->maxQueued = static_cast<uint32_t>(limits.maxQueued);
+    header_->queueTimeoutMs = limits.queueTimeoutMs;
+    header_->budget = limits.inflightBytes;
+}
+
+AdmissionControl::~AdmissionControl() {
+    if (map_ != MAP_FAILED) {
+        munmap(map_, mapSize_);
+    }
+}
+
+void AdmissionControl::createShared(const Limits& limits) {
+    g_shared = std::make_unique<AdmissionControl>(limits);
+    if (!g_shared->isAvailable()) {
+        g_shared.reset();
+        return;
+    }
+    log_info("Admission control: " + std::to_string(limits.maxRequests) + " concurrent commands, " +
+             std::to_string(limits.maxQueued) + " queued for up to " + std::to_string(limits.queueTimeoutMs) +
+             "ms, " + std::to_string(limits.inflightBytes / (1024 * 1024)) + "MB of PUT objects in flight");
+}
+
+AdmissionControl* AdmissionControl::shared() {
+    return g_shared.get();
+}
+
+AdmissionControl::Ticket AdmissionControl::admitShared() {
+    return g_shared ? g_shared->admit() : Ticket();
+}
+
+void AdmissionControl::lock() {
+    int ret = pthread_mutex_lock(&header_->mutex);
+    if (ret == EOWNERDEAD) {
+        // 持锁的进程在临界区中被杀死；它持有的槽位稍后由reclaimLocked回收
+        pthread_mutex_consistent(&header_->mutex);
+    }
+}
+
+void AdmissionControl::unlock() {
+    pthread_mutex_unlock(&header_->mutex);
+}
+
+void AdmissionControl::waitLocked(int timeoutMs) {
+    uint32_t generation = __atomic_load_n(&header_->generation, __ATOMIC_ACQUIRE);
+    unlock();
+    struct timespec timeout = {timeoutMs / 1000, static_cast<long>(timeoutMs % 1000) * 1000000L};
+    syscall(SYS_futex, &header_->generation, FUTEX_WAIT, generation, &timeout, nullptr, 0);
+    lock();
+}
+
+void AdmissionControl::wakeLocked() {
+    __atomic_add_fetch(&header_->generation, 1, __ATOMIC_RELEASE);
+    syscall(SYS_futex, &header_->generation, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+int32_t AdmissionControl::takeSlotLocked() {
+    if (header_->active >= header_->slotCount) {
+        return -1;
+    }
+    for (uint32_t i = 0; i < header_->slotCount; i++) {
+        Slot& slot = slots_[i];
+        if (slot.owner == 0) {
+            slot.owner = getpid();
+            slot.bytes = 0;
+            slot.startUs = nowUs();
+            header_->active++;
+            header_->admitted++;
+            return static_cast<int32_t>(i);
+        }
+    }
+    return -1;
+}
+
+int AdmissionControl::reclaimLocked() {
+    uint64_t now = nowUs();
+    if (now - header_->lastReclaimUs < RECLAIM_INTERVAL_US) {
+        return 0;
+    }
+    header_->lastReclaimUs = now;
+
+    int reclaimed = 0;
+    for (uint32_t i = 0; i < header_->slotCount; i++) {
+        Slot& slot = slots_[i];
+        if (slot.owner != 0 && kill(slot.owner, 0) < 0 && errno == ESRCH) {
+            header_->inflight -= slot.bytes;
+            header_->active--;
+            slot = Slot();
+            reclaimed++;
+        }
+    }
+    if (reclaimed > 0) {
+        log_info("Reclaimed " + std::to_string(reclaimed) + " admission slot(s) held by exited processes");
+        wakeLocked();
+    }
+    return reclaimed;
+}
+
+int AdmissionControl::retryAfterLocked() const {
+    // 排在前面的命令按当前的并发数和平均执行时间完成之后再来
+    uint64_t serviceUs = header_->serviceUs > 0 ? header_->serviceUs : ADMISSION_MIN_RETRY_AFTER_MS * 1000ULL;
+    uint64_t retryMs = serviceUs * (header_->waiting + 1) / header_->slotCount / 1000;
+    return static_cast<int>(std::min<uint64_t>(std::max<uint64_t>(retryMs, ADMISSION_MIN_RETRY_AFTER_MS),
+                                                ADMISSION_MAX_RETRY_AFTER_MS));
+}
+
+AdmissionControl::Ticket AdmissionControl::admit() {
+    lock();
+    // 已经有命令在排队时新命令也要排队，不能抢在它们前面
+    int32_t slot = header_->waiting == 0 ? takeSlotLocked() : -1;
+    if (slot < 0 && header_->waiting >= header_->maxQueued) {
+        header_->rejected++;
+        int retryAfterMs = retryAfterLocked();
+        unlock();
+        return Ticket(nullptr, -1, false, retryAfterMs);
+    }
+
+    if (slot < 0) {
+        header_->waiting++;
+        header_->queued++;
+        uint64_t deadline = nowUs() + static_cast<uint64_t>(header_->queueTimeoutMs) * 1000;
+        for (uint64_t now = nowUs(); slot < 0 && now < deadline; now = nowUs()) {
+            int sliceMs = static_cast<int>(std::min<uint64_t>(ADMISSION_WAIT_SLICE_MS, (deadline - now + 999) / 1000));
+            waitLocked(sliceMs);
+            slot = takeSlotLocked();
+            if (slot < 0 && reclaimLocked() > 0) {
+                slot = takeSlotLocked();
+            }
+        }
+        header_->waiting--;
+    }
+
+    if (slot < 0) {
+        header_->rejected++;
+        int retryAfterMs = retryAfterLocked();
+        unlock();
+        return Ticket(nullptr, -1, false, retryAfterMs);
+    }
+    unlock();
+    return Ticket(this, slot, true, 0);
+}
+
+void AdmissionControl::reserve(int32_t index, uint64_t bytes) {
+    lock();
+    Slot& slot = slots_[index];
+    if (slot.bytes > 0) {
+        header_->inflight -= slot.bytes;
+        slot.bytes = 0;
+        wakeLocked();
+    }
+    // 比整个预算还大的对象在没有其他对象接收时单独放行
+    bytes = std::min(bytes, header_->budget);
+    if (bytes > 0 && header_->inflight > 0 && header_->inflight + bytes > header_->budget) {
+        log_debug("Waiting for " + std::to_string(bytes) + " bytes of in-flight budget");
+        while (header_->inflight > 0 && header_->inflight + bytes > header_->budget) {
+            waitLocked(ADMISSION_WAIT_SLICE_MS);
+            reclaimLocked();
+        }
+    }
+    slot.bytes = bytes;
+    header_->inflight += bytes;
+    unlock();
+}
+
+void AdmissionControl::release(int32_t index) {
+    lock();
+    Slot& slot = slots_[index];
+    if (slot.owner != 0) {
+        uint64_t elapsedUs = nowUs() - slot.startUs;
+        header_->serviceUs = header_->serviceUs == 0 ? elapsedUs : (header_->serviceUs * 7 + elapsedUs) / 8;
+        header_->inflight -= slot.bytes;
+        header_->active--;
+        slot = Slot();
+    }
+    wakeLocked();
+    unlock();
+}
+
+AdmissionControl::Stats AdmissionControl::stats() {
+    lock();
+    Stats stats = {header_->admitted, header_->queued, header_->rejected, header_->active, header_->waiting,
+                   header_->inflight};
+    unlock();
+    return stats;
+}
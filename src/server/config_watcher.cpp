@@ -0,0 +1,116 @@
+#include "config_watcher.hpp"
+#include "logger.hpp"
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/signalfd.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+namespace {
+
+constexpr size_t INOTIFY_BUFFER_SIZE = 4096;
+
+void closeIfOpen(int& fd) {
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+}
+
+} // namespace
+
+ConfigWatcher::ConfigWatcher(const std::string& path) : epollFd_(-1), inotifyFd_(-1), signalFd_(-1) {
+    size_t slash = path.rfind('/');
+    std::string directory = slash == std::string::npos ? "." : path.substr(0, slash);
+    fileName_ = slash == std::string::npos ? path : path.substr(slash + 1);
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGHUP);
+    signalFd_ = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    inotifyFd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyFd_ >= 0 && inotify_add_watch(inotifyFd_, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        log_error("Unable to watch " + directory + " for configuration changes: " + strerror(errno));
+        closeIfOpen(inotifyFd_);
+    }
+
+    epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd_ < 0) {
+        closeIfOpen(inotifyFd_);
+        closeIfOpen(signalFd_);
+        return;
+    }
+    for (int watched : {inotifyFd_, signalFd_}) {
+        if (watched < 0) {
+            continue;
+        }
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN;
+        event.data.fd = watched;
+        epoll_ctl(epollFd_, EPOLL_CTL_ADD, watched, &event);
+    }
+    if (inotifyFd_ < 0 && signalFd_ < 0) {
+        closeIfOpen(epollFd_);
+    }
+}
+
+ConfigWatcher::~ConfigWatcher() {
+    closeIfOpen(epollFd_);
+    closeIfOpen(inotifyFd_);
+    closeIfOpen(signalFd_);
+}
+
+bool ConfigWatcher::consume() {
+    bool reload = false;
+
+    if (signalFd_ >= 0) {
+        struct signalfd_siginfo info;
+        while (read(signalFd_, &info, sizeof(info)) == static_cast<ssize_t>(sizeof(info))) {
+            reload = true;
+        }
+    }
+
+    if (inotifyFd_ >= 0) {
+        alignas(struct inotify_event) char buffer[INOTIFY_BUFFER_SIZE];
+        ssize_t length;
+        while ((length = read(inotifyFd_, buffer, sizeof(buffer))) > 0) {
+            for (ssize_t offset = 0; offset < length;) {
+                const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(buffer + offset);
+                // 同一目录下其他文件的变化不需要重新加载
+                if (event->len > 0 && fileName_ == event->name) {
+                    reload = true;
+                }
+                if (event->mask & IN_Q_OVERFLOW) {
+                    reload = true;
+                }
+                offset += static_cast<ssize_t>(sizeof(struct inotify_event) + event->len);
+            }
+        }
+    }
+    return reload;
+}
+
+bool ConfigWatcher::wait(int timeoutMs) {
+    if (epollFd_ < 0) {
+        return false;
+    }
+    struct pollfd pfd;
+    pfd.fd = epollFd_;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, timeoutMs) <= 0) {
+        return false;
+    }
+    return consume();
+}
+
+void ConfigWatcher::blockReloadSignal() {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGHUP);
+    sigprocmask(SIG_BLOCK, &mask, nullptr);
+}
@@ -1,67 +1,116 @@
 #include "dfsutils.hpp"
+#include "dfs_reactor.hpp"
+#include "dfs_sharded.hpp"
+#include "packed_store.hpp"
+#include "object_cache.hpp"
+#include "wal.hpp"
+#include "metrics.hpp"
+#include "config_watcher.hpp"
 #include "logger.hpp"
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <poll.h>
 #include <unistd.h>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
 #include <cstdlib>
 #include <iostream>
+#include <thread>
+#include <unordered_set>
 
-int main(int argc, char** argv) {
+// SIGCHLD只用于打断poll和accept，让父进程及时回收退出的连接子进程
+static void onChildExit(int) {
+}
+
+// epoll/分片模式下由单独的线程等待dfs.conf变化并重新加载，工作线程在下一次认证时看到新的用户表
+static void startConfigReloader(const std::string& fileName, DfsConfig& conf, const DfsServerOptions& options) {
+    std::thread([fileName, &conf, options]() {
+        init_logger(options.port);
+        Logger::set_debug_enabled(options.debug_enabled);
+        ConfigWatcher watcher(fileName);
+        if (!watcher.isAvailable()) {
+            return;
+        }
+        while (true) {
+            if (watcher.wait(-1)) {
+                DfsUtils::reloadDfsConf(fileName, conf);
+            }
+        }
+    }).detach();
+}
+
+static void runForkServer(int listenFd, DfsConfig& conf, const DfsServerOptions& options, const std::string& fileName) {
     pid_t pid;
-    DfsConfig conf;
-    std::string serverFolder, fileName = "conf/dfs.conf";
-    int portNumber, listenFd, connFd, status;
+    int connFd, status;
     struct sockaddr_in remoteAddress;
     socklen_t addrSize = sizeof(struct sockaddr_in);
-    bool debug_enabled = true;
-    
-    if (argc < 3 || argc > 4) {
-        std::cerr << "USAGE: dfs <folder> <port> [--no-debug]" << std::endl;
-        exit(1);
-    }
-    
-    serverFolder = argv[1];
-    portNumber = atoi(argv[2]);
-    
-    if (argc == 4 && std::string(argv[3]) == "--no-debug") {
-        debug_enabled = false;
-    }
-    
-    // 初始化对应端口的日志文件
-    init_logger(portNumber);
-    
-    // 设置debug输出
-    Logger::set_debug_enabled(debug_enabled);
-    
-    DfsUtils::readDfsConf(fileName, conf);
-    // 如果serverFolder以'/'开头，则去掉它，否则直接使用
-    if (!serverFolder.empty() && serverFolder[0] == '/') {
-        conf.server_name = serverFolder.substr(1);
-    } else {
-        conf.server_name = serverFolder;
-    }
-    
-    // 创建DFS目录（如果需要的话）
-    DfsUtils::dfsDirectoryCreator(conf.server_name, conf);
-    
-    listenFd = DfsUtils::getDfsSocket(portNumber);
-    
+    std::unordered_set<pid_t> children;
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = onChildExit;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGCHLD, &action, nullptr);
+
+    // fork模式在accept之前同时等待配置变化：父进程重新加载后fork的连接子进程使用新的用户表，
+    // 已经在运行的子进程继续使用fork时的副本，连接不受影响
+    ConfigWatcher watcher(fileName);
+
     while (true) {
-        DEBUGSS("Waiting to Accept Connection", serverFolder.c_str());
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            children.erase(pid);
+        }
+        if (static_cast<int>(children.size()) >= options.max_connections) {
+            // 连接子进程达到上限：暂停accept，新连接留在内核的listen队列中，等有子进程退出
+            log_info("Connection limit of " + std::to_string(options.max_connections) + " reached, pausing accept");
+            if ((pid = waitpid(-1, &status, 0)) > 0) {
+                children.erase(pid);
+            }
+            continue;
+        }
+
+        DEBUGSS("Waiting to Accept Connection", options.server_folder.c_str());
+        struct pollfd pfds[2];
+        pfds[0].fd = listenFd;
+        pfds[0].events = POLLIN;
+        pfds[0].revents = 0;
+        pfds[1].fd = watcher.fd();
+        pfds[1].events = POLLIN;
+        pfds[1].revents = 0;
+        if (poll(pfds, 2, -1) <= 0) {
+            continue;
+        }
+        if ((pfds[1].revents & POLLIN) && watcher.consume()) {
+            DfsUtils::reloadDfsConf(fileName, conf);
+        }
+        if (!(pfds[0].revents & POLLIN)) {
+            continue;
+        }
         if ((connFd = accept(listenFd, (struct sockaddr*)&remoteAddress, &addrSize)) <= 0) {
-            perror("Error Accepting Connection");
+            if (errno != EINTR) {
+                perror("Error Accepting Connection");
+            }
             continue;
         }
-        
+
+        if (conf.store_type == DfsStoreType::PACKED) {
+            // 子进程继承父进程的段索引，只需读取之后追加的记录
+            PackedStore::forRoot(conf.server_name).refresh();
+        }
         pid = fork();
-        if (pid != 0) {
+        if (pid < 0) {
+            perror("Error forking connection process");
+            close(connFd);
+        } else if (pid != 0) {
             close(connFd);
-            waitpid(-1, &status, WNOHANG);
+            children.insert(pid);
         } else {
+            signal(SIGCHLD, SIG_DFL);
             // 子进程中也需要初始化日志
-            init_logger(portNumber);
+            init_logger(options.port);
             // 子进程中也设置相同的debug选项
-            Logger::set_debug_enabled(debug_enabled);
+            Logger::set_debug_enabled(options.debug_enabled);
             DEBUGSN("In Child process", getpid());
             DfsUtils::dfsCommandAccept(connFd, conf);
             close(connFd);
@@ -69,7 +118,95 @@ int main(int argc, char** argv) {
         }
         DEBUGS("Closed Connection, waiting to accept next");
     }
-    
+}
+
+int main(int argc, char** argv) {
+    DfsConfig conf;
+    DfsServerOptions options;
+    std::string fileName = "conf/dfs.conf";
+    int listenFd;
+
+    if (!DfsUtils::parseServerOptions(argc, argv, options)) {
+        std::cerr << "USAGE: dfs <folder> <port> [--no-debug] [--mode fork|epoll|sharded] [--workers N] [--shards N] [--io blocking|uring] [--store files|packed] [--commit-window US] [--direct-io KB] [--cache-size MB] [--max-connections N] [--max-requests N] [--max-queued N] [--queue-timeout MS] [--inflight-budget MB] [--metrics-port PORT] [--io-timeout SEC]" << std::endl;
+        exit(1);
+    }
+
+    // 对端断开时由send返回错误，而不是让SIGPIPE终止进程
+    signal(SIGPIPE, SIG_IGN);
+    // SIGHUP触发重新读取dfs.conf，在fork任何进程之前屏蔽，由ConfigWatcher读取
+    ConfigWatcher::blockReloadSignal();
+
+    // 初始化对应端口的日志文件
+    init_logger(options.port);
+
+    // 设置debug输出
+    Logger::set_debug_enabled(options.debug_enabled);
+
+    DfsUtils::readDfsConf(fileName, conf);
+    conf.io_backend = options.io_backend;
+    conf.store_type = options.store_type;
+    conf.commit_window_us = options.commit_window_us;
+    conf.direct_io_threshold = options.direct_io_threshold;
+    // 如果serverFolder以'/'开头，则去掉它，否则直接使用
+    if (!options.server_folder.empty() && options.server_folder[0] == '/') {
+        conf.server_name = options.server_folder.substr(1);
+    } else {
+        conf.server_name = options.server_folder;
+    }
+
+    // 创建DFS目录（如果需要的话）
+    DfsUtils::dfsDirectoryCreator(conf.server_name, conf);
+
+    // 重做上次退出前已同步但尚未确认生效的PUT，必须在压缩进程回收R记录之前完成
+    size_t replayed = WriteAheadLog(conf.server_name).recover();
+    if (replayed > 0) {
+        log_info("Replayed " + std::to_string(replayed) + " write-ahead log record(s)");
+    }
+
+    // 共享内存缓存必须在fork连接子进程、创建工作线程之前映射
+    ObjectCache::createShared(options.object_cache_bytes);
+    // 准入控制的计数同样由所有连接进程和线程共享
+    AdmissionControl::createShared(options.admission);
+    // 按用户限速的令牌桶也是
+    TenantQos::createShared(conf.tenant_limits);
+    // 计数和延迟直方图也是
+    Metrics::createShared();
+
+    if (conf.store_type == DfsStoreType::PACKED) {
+        // 压缩进程在创建任何工作线程之前fork
+        PackedStore::startCompactor(conf.server_name);
+        PackedStore::forRoot(conf.server_name).refresh();
+        log_info("Using packed object store in " + conf.server_name + "/" + PACKED_STORE_DIR);
+    }
+
+    if (options.metrics_port > 0) {
+        // 导出进程同样在创建任何工作线程之前fork
+        Metrics::startExporter(options.metrics_port);
+    }
+
+    if (options.mode != DfsServerMode::FORK) {
+        startConfigReloader(fileName, conf, options);
+    }
+
+    if (options.mode == DfsServerMode::SHARDED) {
+        // 每个分片自己创建SO_REUSEPORT监听套接字
+        DfsShardedServer server(conf, options);
+        server.run();
+        DfsUtils::freeDfsConf(conf);
+        return 0;
+    }
+
+    listenFd = DfsUtils::getDfsSocket(options.port);
+
+    if (options.mode == DfsServerMode::EPOLL) {
+        log_info("Starting server in epoll mode with " + std::to_string(options.workers) + " workers");
+        DfsReactor reactor(listenFd, conf, options.port, options.workers, options.max_connections,
+                           options.io_timeout);
+        reactor.run();
+    } else {
+        runForkServer(listenFd, conf, options, fileName);
+    }
+
     DfsUtils::freeDfsConf(conf);
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,127 @@
+#include "dfs_auth.hpp"
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+constexpr size_t TOKEN_EXPIRY_SIZE = 8;
+
+template <size_t N>
+void fillRandom(std::array<unsigned char, N>& bytes) {
+    if (RAND_bytes(bytes.data(), static_cast<int>(bytes.size())) != 1) {
+        throw std::runtime_error("Unable to generate random bytes for authentication");
+    }
+}
+
+} // namespace
+
+UserTable::UserTable() {
+    fillRandom(salt_);
+}
+
+AuthDigest UserTable::digest(const std::string& password) const {
+    AuthDigest result;
+    unsigned int size = 0;
+    EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+    bool ok = ctx != nullptr &&
+              EVP_DigestInit_ex(ctx, EVP_sha256(), nullptr) == 1 &&
+              EVP_DigestUpdate(ctx, salt_.data(), salt_.size()) == 1 &&
+              EVP_DigestUpdate(ctx, password.data(), password.size()) == 1 &&
+              EVP_DigestFinal_ex(ctx, result.data(), &size) == 1;
+    EVP_MD_CTX_free(ctx);
+    if (!ok || size != result.size()) {
+        throw std::runtime_error("Unable to hash password");
+    }
+    return result;
+}
+
+void UserTable::add(const User& user) {
+    digests_[user.username] = digest(user.password);
+}
+
+bool UserTable::authenticate(const User& user) const {
+    auto it = digests_.find(user.username);
+    if (it == digests_.end()) {
+        return false;
+    }
+    AuthDigest presented = digest(user.password);
+    return CRYPTO_memcmp(presented.data(), it->second.data(), presented.size()) == 0;
+}
+
+bool UserTable::contains(const std::string& username) const {
+    return digests_.find(username) != digests_.end();
+}
+
+std::vector<std::string> UserTable::usernames() const {
+    std::vector<std::string> names;
+    names.reserve(digests_.size());
+    for (const auto& entry : digests_) {
+        names.push_back(entry.first);
+    }
+    return names;
+}
+
+LiveUserTable::LiveUserTable() : table_(std::make_shared<const UserTable>()) {
+}
+
+std::shared_ptr<const UserTable> LiveUserTable::snapshot() const {
+    return std::atomic_load(&table_);
+}
+
+void LiveUserTable::publish(std::shared_ptr<const UserTable> table) {
+    std::atomic_store(&table_, std::move(table));
+}
+
+SessionTokens::SessionTokens() {
+    fillRandom(key_);
+}
+
+AuthDigest SessionTokens::sign(const unsigned char* data, size_t size) const {
+    AuthDigest mac;
+    unsigned int macSize = 0;
+    if (HMAC(EVP_sha256(), key_.data(), static_cast<int>(key_.size()), data, size,
+             mac.data(), &macSize) == nullptr || macSize != mac.size()) {
+        throw std::runtime_error("Unable to sign session token");
+    }
+    return mac;
+}
+
+std::string SessionTokens::issue(const std::string& username, time_t now) const {
+    uint64_t expiry = static_cast<uint64_t>(now) + SESSION_TOKEN_TTL_SECONDS;
+    std::string token(TOKEN_EXPIRY_SIZE, '\0');
+    for (size_t i = 0; i < TOKEN_EXPIRY_SIZE; i++) {
+        token[i] = static_cast<char>((expiry >> (8 * i)) & 0xFF);
+    }
+    token += username;
+    AuthDigest mac = sign(reinterpret_cast<const unsigned char*>(token.data()), token.size());
+    token.append(reinterpret_cast<const char*>(mac.data()), mac.size());
+    return token;
+}
+
+bool SessionTokens::verify(const std::string& token, time_t now, std::string& username) const {
+    if (token.size() <= TOKEN_EXPIRY_SIZE + AUTH_DIGEST_SIZE) {
+        return false;
+    }
+    size_t signedSize = token.size() - AUTH_DIGEST_SIZE;
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(token.data());
+    AuthDigest mac = sign(data, signedSize);
+    if (CRYPTO_memcmp(mac.data(), data + signedSize, mac.size()) != 0) {
+        return false;
+    }
+
+    uint64_t expiry = 0;
+    for (size_t i = 0; i < TOKEN_EXPIRY_SIZE; i++) {
+        expiry |= static_cast<uint64_t>(data[i]) << (8 * i);
+    }
+    if (expiry <= static_cast<uint64_t>(now)) {
+        return false;
+    }
+    username = token.substr(TOKEN_EXPIRY_SIZE, signedSize - TOKEN_EXPIRY_SIZE);
+    return true;
+}
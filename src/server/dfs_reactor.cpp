@@ -0,0 +1,422 @@
+#include "dfs_reactor.hpp"
+#include "logger.hpp"
+#include "tenant_qos.hpp"
+#include "wire_protocol.hpp"
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <linux/tcp.h>
+#include <netinet/in.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+uint64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+// 连接上已被对端确认的发送字节数与已接收的字节数之和，命令有进展时增加
+uint64_t transferredBytes(int fd) {
+    struct tcp_info info;
+    memset(&info, 0, sizeof(info));
+    socklen_t length = sizeof(info);
+    if (getsockopt(fd, IPPROTO_TCP, TCP_INFO, &info, &length) < 0) {
+        return 0;
+    }
+    return info.tcpi_bytes_acked + info.tcpi_bytes_received;
+}
+
+} // namespace
+
+DfsReactor::DfsReactor(int listenFd, DfsConfig& conf, int port, int workers, int maxConnections, int ioTimeoutSec)
+    : listenFd_(listenFd), epollFd_(-1), conf_(conf), port_(port), inline_(workers == 0),
+      maxConnections_(static_cast<size_t>(maxConnections)), activeConnections_(0), acceptPaused_(false),
+      ioTimeoutNs_(static_cast<uint64_t>(ioTimeoutSec) * 1000000000ULL), stopping_(false),
+      workers_(static_cast<size_t>(workers), [port]() {
+          // 日志实例是线程局部的，每个工作线程需要单独初始化
+          init_logger(port);
+      }) {
+    // 监听套接字设为非阻塞，便于在一次事件中accept所有挂起的连接
+    int flags = fcntl(listenFd_, F_GETFL, 0);
+    if (flags < 0 || fcntl(listenFd_, F_SETFL, flags | O_NONBLOCK) < 0) {
+        throw std::runtime_error("Unable to set listen socket non-blocking");
+    }
+
+    epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epollFd_ < 0) {
+        throw std::runtime_error("Unable to create epoll instance");
+    }
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr;  // 监听套接字没有连接状态
+    if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, listenFd_, &ev) < 0) {
+        throw std::runtime_error("Unable to register listen socket with epoll");
+    }
+
+    timer_.fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_.fd < 0) {
+        throw std::runtime_error("Unable to create reactor timer");
+    }
+    ev.events = EPOLLIN;
+    ev.data.ptr = &timer_;
+    if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, timer_.fd, &ev) < 0) {
+        throw std::runtime_error("Unable to register reactor timer with epoll");
+    }
+
+    if (ioTimeoutNs_ > 0) {
+        watchdog_ = std::thread(&DfsReactor::runWatchdog, this);
+    }
+}
+
+DfsReactor::~DfsReactor() {
+    if (watchdog_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(watchMutex_);
+            stopping_ = true;
+        }
+        watchCv_.notify_all();
+        watchdog_.join();
+    }
+    if (timer_.fd != -1) {
+        close(timer_.fd);
+    }
+    if (epollFd_ != -1) {
+        close(epollFd_);
+    }
+}
+
+void DfsReactor::run() {
+    std::vector<struct epoll_event> events(REACTOR_MAX_EVENTS);
+    log_info("Reactor started on port " + std::to_string(port_));
+
+    while (true) {
+        int n = epoll_wait(epollFd_, events.data(), REACTOR_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            log_error("epoll_wait failed: " + std::string(strerror(errno)));
+            return;
+        }
+
+        for (int i = 0; i < n; i++) {
+            Connection* conn = static_cast<Connection*>(events[i].data.ptr);
+            if (conn == nullptr) {
+                acceptConnections();
+            } else if (conn == &timer_) {
+                resumeParked();
+            } else if (events[i].events & EPOLLIN) {
+                // 可读（包括对端关闭时的EOF），命令帧到齐后交给工作线程处理
+                onReadable(conn, events[i].events);
+            } else {
+                // 仅有EPOLLHUP/EPOLLERR，没有待读取的数据
+                closeConnection(conn);
+            }
+        }
+    }
+}
+
+void DfsReactor::acceptConnections() {
+    while (true) {
+        if (activeConnections_ >= maxConnections_) {
+            // 达到连接上限：停止监听事件，等closeConnection恢复
+            log_info("Connection limit of " + std::to_string(maxConnections_) + " reached, pausing accept");
+            acceptPaused_ = true;
+            setAccepting(false);
+            // 暂停之前可能已有连接关闭而没有看到acceptPaused_
+            if (activeConnections_ < maxConnections_ && acceptPaused_.exchange(false)) {
+                setAccepting(true);
+            }
+            return;
+        }
+        // 连接套接字保持阻塞模式：事件循环用非阻塞的MSG_PEEK确认命令帧完整后才派发，
+        // 工作线程用现有的阻塞式收发流程完成整个命令，卡住的收发由看门狗中止
+        int connFd = accept4(listenFd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (connFd < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return;
+            }
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            int acceptErrno = errno;
+            log_error("Error Accepting Connection: " + std::string(strerror(acceptErrno)));
+            if (acceptErrno == EMFILE || acceptErrno == ENFILE || acceptErrno == ENOBUFS || acceptErrno == ENOMEM) {
+                // 挂起的连接仍在listen队列中，水平触发的监听事件会立即再次就绪，
+                // 因此与达到连接上限时一样暂停accept，等连接关闭或重试时间到期后恢复
+                acceptPaused_ = true;
+                setAccepting(false);
+                parkConnection(nullptr, ACCEPT_RETRY_MS * 1000);
+            }
+            return;
+        }
+
+        Connection* conn = new Connection();
+        conn->fd = connFd;
+        conn->lowat = 1;
+
+        struct epoll_event ev;
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+        ev.data.ptr = conn;
+        if (epoll_ctl(epollFd_, EPOLL_CTL_ADD, connFd, &ev) < 0) {
+            log_error("Unable to register connection with epoll: " + std::string(strerror(errno)));
+            close(connFd);
+            delete conn;
+            continue;
+        }
+        activeConnections_++;
+        DEBUGSN("Accepted connection, active connections", static_cast<int>(activeConnections_));
+    }
+}
+
+void DfsReactor::onReadable(Connection* conn, uint32_t events) {
+    FrameState state = pollFrame(conn, events);
+    if (state == FrameState::IDLE) {
+        rearmConnection(conn);
+        return;
+    }
+    if (state == FrameState::PARTIAL) {
+        // 命令帧的到期时间从第一次看到不完整的帧开始计算，不因后续到达的字节推迟
+        watch(conn, false);
+        rearmConnection(conn);
+        return;
+    }
+    unwatch(conn);
+    if (state == FrameState::CLOSED) {
+        log_debug(conn->session.authenticated ? "Session closed by client" : "Connection closed before command");
+        closeConnection(conn);
+        return;
+    }
+    // 处理流程按命令逐段阻塞接收，不能再要求一次到达多个字节
+    setLowat(conn, 1);
+    dispatch(conn);
+}
+
+DfsReactor::FrameState DfsReactor::pollFrame(Connection* conn, uint32_t events) {
+    unsigned char head[WIRE_HELLO_SIZE];
+    ssize_t received = recv(conn->fd, head, sizeof(head), MSG_PEEK | MSG_DONTWAIT);
+    if (received == 0) {
+        return FrameState::CLOSED;
+    }
+    if (received < 0) {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? FrameState::IDLE : FrameState::CLOSED;
+    }
+
+    // 每个请求以4字节长度开头：连接开始时的HELLO后跟1字节版本，文本命令和二进制帧后跟相应长度的内容
+    size_t need = INT_SIZE;
+    if (static_cast<size_t>(received) >= INT_SIZE) {
+        int size;
+        NetUtils::decodeIntFromUchar(std::vector<unsigned char>(head, head + INT_SIZE), size);
+        if (!conn->session.authenticated && conn->session.wire_version == WIRE_VERSION_TEXT &&
+            WireProtocol::isHello(size)) {
+            need = WIRE_HELLO_SIZE;
+        } else if (size <= 0 || static_cast<size_t>(size) > REACTOR_MAX_GATED_FRAME - INT_SIZE) {
+            // 长度非法时由处理流程报告；过长的帧无法保证整帧放进接收缓冲区，直接派发
+            return FrameState::READY;
+        } else {
+            need = INT_SIZE + static_cast<size_t>(size);
+        }
+    }
+
+    int available = static_cast<int>(received);
+    if (static_cast<size_t>(available) < need && ioctl(conn->fd, FIONREAD, &available) < 0) {
+        return FrameState::CLOSED;
+    }
+    if (static_cast<size_t>(available) >= need) {
+        return FrameState::READY;
+    }
+    if (events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+        // 对端不会再发送剩余的字节
+        return FrameState::CLOSED;
+    }
+    // 接收缓冲区中的字节达到need之前epoll不再报告可读
+    setLowat(conn, static_cast<int>(need));
+    return FrameState::PARTIAL;
+}
+
+void DfsReactor::setLowat(Connection* conn, int lowat) {
+    if (conn->lowat == lowat) {
+        return;
+    }
+    if (setsockopt(conn->fd, SOL_SOCKET, SO_RCVLOWAT, &lowat, sizeof(lowat)) < 0) {
+        log_error("Unable to set receive low watermark: " + std::string(strerror(errno)));
+        return;
+    }
+    conn->lowat = lowat;
+}
+
+void DfsReactor::watch(Connection* conn, bool progress) {
+    if (ioTimeoutNs_ == 0) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(watchMutex_);
+    if (!progress && watched_.count(conn) > 0) {
+        return;
+    }
+    watched_[conn] = Watch{nowNs() + ioTimeoutNs_, progress ? transferredBytes(conn->fd) : 0, progress};
+}
+
+void DfsReactor::unwatch(Connection* conn) {
+    if (ioTimeoutNs_ == 0) {
+        return;
+    }
+    // 之后连接可能被关闭、fd被复用，看门狗不能再操作它
+    std::lock_guard<std::mutex> lock(watchMutex_);
+    watched_.erase(conn);
+}
+
+void DfsReactor::runWatchdog() {
+    init_logger(port_);
+    // 检查间隔不超过超时时间的1/4，中止最多比到期时间晚1/4
+    auto interval = std::chrono::nanoseconds(std::min<uint64_t>(ioTimeoutNs_ / 4, 1000000000ULL));
+    std::unique_lock<std::mutex> lock(watchMutex_);
+    while (!stopping_) {
+        watchCv_.wait_for(lock, interval);
+        uint64_t now = nowNs();
+        for (auto& entry : watched_) {
+            Watch& w = entry.second;
+            if (w.progress) {
+                uint64_t bytes = transferredBytes(entry.first->fd);
+                if (bytes != w.bytes) {
+                    w.bytes = bytes;
+                    w.deadline = now + ioTimeoutNs_;
+                }
+            }
+            if (now < w.deadline) {
+                continue;
+            }
+            log_error(std::string(w.progress ? "Command moved no data" : "Incomplete command frame") + " for " +
+                      std::to_string(ioTimeoutNs_ / 1000000000ULL) + "s on port " + std::to_string(port_) +
+                      ", closing connection");
+            // 阻塞在该连接上的收发立即返回错误，事件循环随后看到EOF并关闭连接
+            shutdown(entry.first->fd, SHUT_RDWR);
+            w.deadline = UINT64_MAX;
+        }
+    }
+}
+
+void DfsReactor::dispatch(Connection* conn) {
+    if (inline_) {
+        // 分片模式：在事件循环线程中直接执行命令，不跨线程传递连接
+        handleRequest(conn);
+        return;
+    }
+    // EPOLLONESHOT保证同一连接在处理期间不会被重复派发
+    workers_.enqueue([this, conn]() {
+        handleRequest(conn);
+    });
+}
+
+void DfsReactor::handleRequest(Connection* conn) {
+    // 每次只处理一条命令，会话中的空闲连接不占用工作线程
+    TenantQos::Deferral throttle;
+    watch(conn, true);
+    bool keep = DfsUtils::dfsHandleRequest(conn->fd, conf_, conn->session);
+    unwatch(conn);
+    uint64_t waitUs = throttle.takeUs();
+    if (!keep) {
+        // 欠下的令牌留在该用户共享的桶中，由它的其他连接等待
+        closeConnection(conn);
+    } else if (waitUs > 0) {
+        parkConnection(conn, waitUs);
+    } else {
+        rearmConnection(conn);
+    }
+}
+
+void DfsReactor::parkConnection(Connection* conn, uint64_t us) {
+    uint64_t deadline = nowNs() + us * 1000;
+    std::lock_guard<std::mutex> lock(parkedMutex_);
+    auto it = parked_.emplace(deadline, conn);
+    if (it != parked_.begin()) {
+        return;
+    }
+    // 新的最早到期时间
+    armTimer(deadline);
+}
+
+void DfsReactor::armTimer(uint64_t deadline) {
+    // 绝对时间即使已经过去，timerfd也会立即触发
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = static_cast<time_t>(deadline / 1000000000ULL);
+    spec.it_value.tv_nsec = static_cast<long>(deadline % 1000000000ULL);
+    if (timerfd_settime(timer_.fd, TFD_TIMER_ABSTIME, &spec, nullptr) < 0) {
+        log_error("Unable to arm reactor timer: " + std::string(strerror(errno)));
+    }
+}
+
+void DfsReactor::resumeParked() {
+    uint64_t expirations;
+    if (read(timer_.fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN) {
+        log_error("Unable to read reactor timer: " + std::string(strerror(errno)));
+    }
+    std::vector<Connection*> due;
+    {
+        std::lock_guard<std::mutex> lock(parkedMutex_);
+        uint64_t now = nowNs();
+        while (!parked_.empty() && parked_.begin()->first <= now) {
+            due.push_back(parked_.begin()->second);
+            parked_.erase(parked_.begin());
+        }
+        if (!parked_.empty()) {
+            armTimer(parked_.begin()->first);
+        }
+    }
+    for (Connection* conn : due) {
+        if (conn == nullptr) {
+            // accept的重试时间到期
+            if (acceptPaused_.exchange(false)) {
+                setAccepting(true);
+            }
+        } else {
+            rearmConnection(conn);
+        }
+    }
+}
+
+void DfsReactor::rearmConnection(Connection* conn) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT;
+    ev.data.ptr = conn;
+    if (epoll_ctl(epollFd_, EPOLL_CTL_MOD, conn->fd, &ev) < 0) {
+        log_error("Unable to re-arm session connection: " + std::string(strerror(errno)));
+        closeConnection(conn);
+    }
+}
+
+void DfsReactor::closeConnection(Connection* conn) {
+    unwatch(conn);
+    epoll_ctl(epollFd_, EPOLL_CTL_DEL, conn->fd, nullptr);
+    close(conn->fd);
+    delete conn;
+    activeConnections_--;
+    if (acceptPaused_.exchange(false)) {
+        setAccepting(true);
+    }
+}
+
+void DfsReactor::setAccepting(bool accepting) {
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = accepting ? static_cast<uint32_t>(EPOLLIN) : 0;
+    ev.data.ptr = nullptr;
+    if (epoll_ctl(epollFd_, EPOLL_CTL_MOD, listenFd_, &ev) < 0) {
+        log_error("Unable to update listen socket events: " + std::string(strerror(errno)));
+    }
+}
@@ -0,0 +1,78 @@
+#include "dfs_sharded.hpp"
+#include "dfs_reactor.hpp"
+#include "logger.hpp"
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <thread>
+
+DfsShardedServer::DfsShardedServer(DfsConfig& conf, const DfsServerOptions& options)
+    : conf_(conf), options_(options) {
+    std::vector<int> cpus = availableCpus();
+    size_t shardCount = options_.shards > 0 ? static_cast<size_t>(options_.shards) : cpus.size();
+
+    // 分片数超过可用核数时轮流复用各核
+    for (size_t i = 0; i < shardCount; i++) {
+        cpus_.push_back(cpus[i % cpus.size()]);
+    }
+}
+
+std::vector<int> DfsShardedServer::availableCpus() {
+    std::vector<int> cpus;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    if (cpus.empty()) {
+        cpus.push_back(0);
+    }
+    return cpus;
+}
+
+void DfsShardedServer::run() {
+    log_info("Starting server in sharded mode with " + std::to_string(cpus_.size()) + " shards");
+
+    std::vector<std::thread> shards;
+    for (size_t i = 0; i < cpus_.size(); i++) {
+        shards.emplace_back(&DfsShardedServer::runShard, this, static_cast<int>(i), cpus_[i]);
+    }
+    for (auto& shard : shards) {
+        shard.join();
+    }
+}
+
+void DfsShardedServer::runShard(int shardId, int cpu) {
+    // 日志实例是线程局部的，每个分片单独初始化
+    init_logger(options_.port);
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (ret != 0) {
+        log_error("Shard " + std::to_string(shardId) + " unable to pin to CPU " + std::to_string(cpu) +
+                  ": " + strerror(ret));
+    }
+
+    int listenFd = DfsUtils::getDfsSocket(options_.port, true);
+    log_info("Shard " + std::to_string(shardId) + " listening on port " + std::to_string(options_.port) +
+             ", pinned to CPU " + std::to_string(cpu));
+
+    try {
+        // 连接上限在各分片之间平均分配；命令在分片线程内阻塞执行，卡住的命令由看门狗中止
+        int maxConnections = std::max(1, options_.max_connections / static_cast<int>(cpus_.size()));
+        DfsReactor reactor(listenFd, conf_, options_.port, 0, maxConnections, options_.io_timeout);
+        reactor.run();
+    } catch (const std::exception& e) {
+        log_error("Shard " + std::to_string(shardId) + " stopped: " + e.what());
+    }
+    close(listenFd);
+}
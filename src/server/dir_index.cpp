@@ -0,0 +1,549 @@
+#include "dir_index.hpp"
+#include "logger.hpp"
+#include "netutils.hpp"
+#include "object_io.hpp"
+#include "packed_store.hpp"
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <limits>
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+namespace {
+
+constexpr unsigned char RECORD_OBJECT = 'O';
+constexpr unsigned char RECORD_FOLDER = 'D';
+constexpr size_t RECORD_NAME_MAX = 64 * 1024;
+constexpr size_t RECORD_PREFIX_SIZE = 1 + sizeof(uint32_t);
+constexpr size_t RECORD_OBJECT_TAIL_SIZE = sizeof(int32_t) + sizeof(uint64_t);
+constexpr int OBJECT_ID_MAX_DIGITS = 10;    // 含FILE_MANIFEST_ID
+
+// 目录索引的LRU缓存：链表头部是最近使用的目录
+struct CachedIndex {
+    std::shared_ptr<DirIndex> index;
+    std::list<std::string>::iterator lruPos;
+};
+
+std::mutex g_indexesMutex;
+std::unordered_map<std::string, CachedIndex> g_indexes;
+std::list<std::string> g_indexesLru;
+
+// 目录上的flock排它锁：同一目录的索引追加、重建和压缩在进程之间串行执行
+class DirLock {
+public:
+    explicit DirLock(const std::string& folderPath)
+        : fd_(open(folderPath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)) {
+        if (fd_ >= 0) {
+            while (flock(fd_, LOCK_EX) < 0 && errno == EINTR) {
+            }
+        }
+    }
+    ~DirLock() {
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+    }
+    DirLock(const DirLock&) = delete;
+    DirLock& operator=(const DirLock&) = delete;
+
+private:
+    int fd_;
+};
+
+template <typename T>
+void appendValue(std::vector<unsigned char>& buffer, T value) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&value);
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+template <typename T>
+T readValue(const unsigned char* data) {
+    T value;
+    memcpy(&value, data, sizeof(T));
+    return value;
+}
+
+void encodeRecordPrefix(std::vector<unsigned char>& buffer, unsigned char type, const std::string& name) {
+    buffer.push_back(type);
+    appendValue<uint32_t>(buffer, static_cast<uint32_t>(name.size()));
+    buffer.insert(buffer.end(), name.begin(), name.end());
+}
+
+void encodeObjectRecord(std::vector<unsigned char>& buffer, const std::string& fileName, int objectId,
+                        uint64_t size) {
+    encodeRecordPrefix(buffer, RECORD_OBJECT, fileName);
+    appendValue<int32_t>(buffer, objectId);
+    appendValue<uint64_t>(buffer, size);
+}
+
+void encodeFolderRecord(std::vector<unsigned char>& buffer, const std::string& folderName) {
+    encodeRecordPrefix(buffer, RECORD_FOLDER, folderName);
+}
+
+// 与旧的glob扫描相同的对象文件名规则：[.]名字.数字
+bool parseObjectFileName(const std::string& entryName, std::string& fileName, int& objectId) {
+    if (entryName.length() < 3) {
+        return false;
+    }
+    size_t dotPos = entryName.rfind('.');
+    if (dotPos == std::string::npos || dotPos == entryName.length() - 1) {
+        return false;
+    }
+    std::string idStr = entryName.substr(dotPos + 1);
+    if (idStr.length() > OBJECT_ID_MAX_DIGITS) {
+        return false;
+    }
+    for (char c : idStr) {
+        if (!std::isdigit(static_cast<unsigned char>(c))) {
+            return false;
+        }
+    }
+    fileName = entryName.substr(0, dotPos);
+    if (!fileName.empty() && fileName[0] == '.') {
+        fileName = fileName.substr(1);
+    }
+    long long id = std::stoll(idStr);
+    if (id > std::numeric_limits<int>::max()) {
+        return false;
+    }
+    objectId = static_cast<int>(id);
+    return true;
+}
+
+} // namespace
+
+DirIndex::DirIndex(const std::string& folderPath)
+    : folderPath_(folderPath), indexPath_(folderPath + "/" + DIR_INDEX_FILE),
+      inode_(0), loadedSize_(0), records_(0), objects_(0) {}
+
+std::shared_ptr<DirIndex> DirIndex::forDirectory(const std::string& folderPath) {
+    std::lock_guard<std::mutex> lock(g_indexesMutex);
+    auto it = g_indexes.find(folderPath);
+    if (it != g_indexes.end()) {
+        g_indexesLru.splice(g_indexesLru.begin(), g_indexesLru, it->second.lruPos);
+        return it->second.index;
+    }
+    
+    // 淘汰最久未用的目录；正在使用它的命令持有引用，实例在命令结束后释放
+    if (g_indexes.size() >= DIR_INDEX_CACHE_MAX) {
+        g_indexes.erase(g_indexesLru.back());
+        g_indexesLru.pop_back();
+    }
+    g_indexesLru.push_front(folderPath);
+    CachedIndex& cached = g_indexes[folderPath];
+    cached.index = std::make_shared<DirIndex>(folderPath);
+    cached.lruPos = g_indexesLru.begin();
+    return cached.index;
+}
+
+size_t DirIndex::cachedDirectories() {
+    std::lock_guard<std::mutex> lock(g_indexesMutex);
+    return g_indexes.size();
+}
+
+void DirIndex::recordFolderPath(const std::string& rootPath, const std::string& folderPath) {
+    if (folderPath.compare(0, rootPath.size(), rootPath) != 0 || folderPath.size() <= rootPath.size() ||
+        folderPath[rootPath.size()] != '/') {
+        return;
+    }
+    std::string parent = rootPath;
+    size_t pos = rootPath.size() + 1;
+    while (pos < folderPath.size()) {
+        size_t next = folderPath.find('/', pos);
+        if (next == std::string::npos) {
+            next = folderPath.size();
+        }
+        if (next > pos) {
+            std::string name = folderPath.substr(pos, next - pos);
+            forDirectory(parent)->recordFolder(name);
+            parent += "/" + name;
+        }
+        pos = next + 1;
+    }
+}
+
+void DirIndex::recordObject(const std::string& fileName, int objectId, uint64_t size) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    DirLock dirLock(folderPath_);
+    refreshLocked(true);
+
+    // 元数据对象大小总是相同，每次覆盖都追加记录，使各进程缓存的对象数失效
+    auto it = files_.find(fileName);
+    if (it != files_.end() && objectId != FILE_MANIFEST_ID) {
+        auto object = it->second.objects.find(objectId);
+        if (object != it->second.objects.end() && object->second == size) {
+            return;
+        }
+    }
+
+    std::vector<unsigned char> record;
+    encodeObjectRecord(record, fileName, objectId, size);
+    appendLocked(record);
+    if (records_ > DIR_INDEX_COMPACT_MIN_RECORDS && records_ > 2 * (objects_ + folders_.size())) {
+        compactLocked();
+    }
+}
+
+void DirIndex::recordFolder(const std::string& folderName) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    refreshLocked(false);
+    if (folders_.count(folderName)) {
+        return;
+    }
+
+    DirLock dirLock(folderPath_);
+    refreshLocked(true);
+    if (folders_.count(folderName)) {
+        return;
+    }
+    std::vector<unsigned char> record;
+    encodeFolderRecord(record, folderName);
+    appendLocked(record);
+}
+
+void DirIndex::listFiles(ServerChunksInfo& serverChunks) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    refreshLocked(false);
+
+    serverChunks.chunks = static_cast<int>(files_.size());
+    serverChunks.chunk_info.assign(files_.size(), ChunkInfo());
+    size_t idx = 0;
+    for (auto& file : files_) {
+        fillChunkInfo(file.first, file.second, serverChunks.chunk_info[idx++]);
+    }
+}
+
+bool DirIndex::listFilesPage(const std::string& after, size_t limit, ServerChunksInfo& page) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    refreshLocked(false);
+
+    // 游标是上一页最后一个文件名，两页之间新增的文件只要排在游标之后就会出现在后续页中
+    auto it = after.empty() ? files_.begin() : files_.upper_bound(after);
+    page.chunk_info.clear();
+    for (; it != files_.end() && page.chunk_info.size() < limit; ++it) {
+        page.chunk_info.emplace_back();
+        fillChunkInfo(it->first, it->second, page.chunk_info.back());
+    }
+    page.chunks = static_cast<int>(page.chunk_info.size());
+    return it != files_.end();
+}
+
+bool DirIndex::findFile(const std::string& fileName, ServerChunksInfo& serverChunks) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    refreshLocked(false);
+
+    auto it = files_.find(fileName);
+    if (it == files_.end()) {
+        serverChunks.chunks = 0;
+        serverChunks.chunk_info.clear();
+        return false;
+    }
+    serverChunks.chunks = 1;
+    serverChunks.chunk_info.assign(1, ChunkInfo());
+    fillChunkInfo(it->first, it->second, serverChunks.chunk_info[0]);
+    return true;
+}
+
+int DirIndex::listFolders(std::vector<unsigned char>& payload) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    refreshLocked(false);
+
+    std::string buffer;
+    for (const std::string& folder : folders_) {
+        buffer += folder + "/\n";
+    }
+    payload.assign(buffer.begin(), buffer.end());
+    return static_cast<int>(payload.size());
+}
+
+void DirIndex::fillChunkInfo(const std::string& fileName, FileEntry& entry, ChunkInfo& chunkInfo) {
+    chunkInfo.file_name = fileName;
+    chunkInfo.objects.clear();
+    size_t i = 0;
+    for (const auto& object : entry.objects) {
+        if (object.first == FILE_MANIFEST_ID) {
+            continue;
+        }
+        if (i < chunkInfo.chunks.size()) {
+            chunkInfo.chunks[i++] = object.first;
+        }
+        chunkInfo.objects.push_back(object.first);
+    }
+    if (!entry.countLoaded) {
+        entry.objectCount = entry.objects.count(FILE_MANIFEST_ID) ? readObjectCount(fileName) : -1;
+        entry.countLoaded = true;
+    }
+    chunkInfo.object_count = entry.objectCount;
+}
+
+int DirIndex::readObjectCount(const std::string& fileName) const {
+    std::string objectFile = ObjectIoBackend::objectPath(folderPath_, fileName, FILE_MANIFEST_ID);
+    std::vector<unsigned char> data;
+    PackedStore* store = PackedStore::containing(folderPath_);
+    if (!store || !store->readObject(objectFile, data)) {
+        data.assign(INT_SIZE + 1, 0);
+        int fd = open(objectFile.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return -1;
+        }
+        ssize_t n = pread(fd, data.data(), data.size(), 0);
+        close(fd);
+        data.resize(n > 0 ? static_cast<size_t>(n) : 0);
+    }
+    if (data.size() != static_cast<size_t>(INT_SIZE)) {
+        log_error("Object count of " + objectFile + " is damaged");
+        return -1;
+    }
+    int objectCount;
+    NetUtils::decodeIntFromUchar(data, objectCount);
+    return objectCount >= 0 && objectCount <= MAX_OBJECTS_PER_FILE ? objectCount : -1;
+}
+
+void DirIndex::refreshLocked(bool dirLocked) {
+    int fd = open(indexPath_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno != ENOENT) {
+            log_error("Unable to open directory index " + indexPath_ + ": " + strerror(errno));
+            return;
+        }
+        if (dirLocked) {
+            rebuildLocked();
+        } else {
+            // 其他进程可能正在重建，拿到锁后再确认一次
+            DirLock dirLock(folderPath_);
+            refreshLocked(true);
+        }
+        return;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return;
+    }
+    if (st.st_ino != inode_ || st.st_size < loadedSize_) {
+        // 索引被重建或压缩过，从头加载
+        clearEntries();
+        inode_ = st.st_ino;
+    }
+
+    if (loadedSize_ == 0) {
+        char magic[sizeof(DIR_INDEX_MAGIC)];
+        if (pread(fd, magic, sizeof(magic), 0) != static_cast<ssize_t>(sizeof(magic)) ||
+            memcmp(magic, DIR_INDEX_MAGIC, sizeof(magic)) != 0) {
+            close(fd);
+            log_error("Directory index " + indexPath_ + " is damaged, rebuilding");
+            if (dirLocked) {
+                rebuildLocked();
+            } else {
+                DirLock dirLock(folderPath_);
+                rebuildLocked();
+            }
+            return;
+        }
+        loadedSize_ = sizeof(DIR_INDEX_MAGIC);
+    }
+
+    if (st.st_size > loadedSize_) {
+        std::vector<unsigned char> tail(static_cast<size_t>(st.st_size - loadedSize_));
+        size_t got = 0;
+        while (got < tail.size()) {
+            ssize_t n = pread(fd, tail.data() + got, tail.size() - got, loadedSize_ + static_cast<off_t>(got));
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            got += static_cast<size_t>(n);
+        }
+        loadedSize_ += static_cast<off_t>(applyRecords(tail.data(), got));
+    }
+    close(fd);
+}
+
+size_t DirIndex::applyRecords(const unsigned char* data, size_t size) {
+    size_t pos = 0;
+    while (size - pos >= RECORD_PREFIX_SIZE) {
+        unsigned char type = data[pos];
+        size_t nameLength = readValue<uint32_t>(data + pos + 1);
+        if ((type != RECORD_OBJECT && type != RECORD_FOLDER) || nameLength > RECORD_NAME_MAX) {
+            // 无法识别的字节：停在这里，追加时会截掉
+            break;
+        }
+        size_t recordSize = RECORD_PREFIX_SIZE + nameLength + (type == RECORD_OBJECT ? RECORD_OBJECT_TAIL_SIZE : 0);
+        if (size - pos < recordSize) {
+            // 不完整的记录（正在追加或写入中断），下次再读
+            break;
+        }
+
+        std::string name(reinterpret_cast<const char*>(data + pos + RECORD_PREFIX_SIZE), nameLength);
+        if (type == RECORD_OBJECT) {
+            const unsigned char* tail = data + pos + RECORD_PREFIX_SIZE + nameLength;
+            int objectId = readValue<int32_t>(tail);
+            uint64_t objectSize = readValue<uint64_t>(tail + sizeof(int32_t));
+            FileEntry& entry = files_[name];
+            auto& objects = entry.objects;
+            if (objectId == FILE_MANIFEST_ID) {
+                entry.countLoaded = false;
+            }
+            if (objects.find(objectId) == objects.end()) {
+                objects_++;
+            }
+            objects[objectId] = objectSize;
+        } else {
+            folders_.insert(name);
+        }
+        records_++;
+        pos += recordSize;
+    }
+    return pos;
+}
+
+void DirIndex::clearEntries() {
+    files_.clear();
+    folders_.clear();
+    loadedSize_ = 0;
+    records_ = 0;
+    objects_ = 0;
+}
+
+void DirIndex::appendLocked(const std::vector<unsigned char>& record) {
+    int fd = open(indexPath_.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+    if (fd < 0) {
+        log_error("Unable to append to directory index " + indexPath_ + ": " + strerror(errno));
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > loadedSize_) {
+        // 持有锁时仍有未解析的字节，说明之前的追加被中断，截掉残缺的记录
+        log_error("Truncating incomplete record in directory index " + indexPath_);
+        if (ftruncate(fd, loadedSize_) < 0) {
+            log_error("Unable to truncate directory index " + indexPath_ + ": " + strerror(errno));
+        }
+    }
+
+    size_t written = 0;
+    while (written < record.size()) {
+        ssize_t n = write(fd, record.data() + written, record.size() - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            log_error("Unable to write directory index " + indexPath_ + ": " + strerror(errno));
+            break;
+        }
+        written += static_cast<size_t>(n);
+    }
+    close(fd);
+
+    if (written == record.size()) {
+        loadedSize_ += static_cast<off_t>(applyRecords(record.data(), record.size()));
+    }
+}
+
+void DirIndex::rebuildLocked() {
+    DIR* dp = opendir(folderPath_.c_str());
+    if (!dp) {
+        log_error("Unable to scan directory " + folderPath_ + ": " + strerror(errno));
+        return;
+    }
+
+    std::vector<unsigned char> contents(DIR_INDEX_MAGIC, DIR_INDEX_MAGIC + sizeof(DIR_INDEX_MAGIC));
+    size_t entries = 0;
+    struct dirent* ep;
+    while ((ep = readdir(dp)) != nullptr) {
+        std::string entryName(ep->d_name);
+        if (entryName == "." || entryName == "..") {
+            continue;
+        }
+        struct stat st;
+        if (fstatat(dirfd(dp), ep->d_name, &st, 0) < 0) {
+            continue;
+        }
+        if (S_ISDIR(st.st_mode)) {
+            encodeFolderRecord(contents, entryName);
+            entries++;
+            continue;
+        }
+        std::string fileName;
+        int objectId;
+        if (S_ISREG(st.st_mode) && parseObjectFileName(entryName, fileName, objectId)) {
+            encodeObjectRecord(contents, fileName, objectId, static_cast<uint64_t>(st.st_size));
+            entries++;
+        }
+    }
+    closedir(dp);
+
+    // 打包存储中的对象没有单独的文件，从存储的内存索引中补上
+    if (PackedStore* store = PackedStore::containing(folderPath_)) {
+        std::map<std::string, std::map<int, uint64_t>> packed;
+        store->listFolder(folderPath_, packed);
+        for (const auto& file : packed) {
+            for (const auto& object : file.second) {
+                encodeObjectRecord(contents, file.first, object.first, object.second);
+                entries++;
+            }
+        }
+    }
+
+    log_info("Rebuilt directory index " + indexPath_ + " with " + std::to_string(entries) + " entries");
+    writeIndexFile(contents);
+}
+
+void DirIndex::compactLocked() {
+    std::vector<unsigned char> contents(DIR_INDEX_MAGIC, DIR_INDEX_MAGIC + sizeof(DIR_INDEX_MAGIC));
+    for (const std::string& folder : folders_) {
+        encodeFolderRecord(contents, folder);
+    }
+    for (const auto& file : files_) {
+        for (const auto& object : file.second.objects) {
+            encodeObjectRecord(contents, file.first, object.first, object.second);
+        }
+    }
+    log_debug("Compacting directory index " + indexPath_ + " from " + std::to_string(records_) + " records");
+    writeIndexFile(contents);
+}
+
+void DirIndex::writeIndexFile(const std::vector<unsigned char>& contents) {
+    // 写临时文件后rename替换，读取方要么看到旧索引，要么看到完整的新索引
+    std::string tmpPath = indexPath_ + ".tmp";
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        log_error("Unable to create directory index " + tmpPath + ": " + strerror(errno));
+        return;
+    }
+    size_t written = 0;
+    while (written < contents.size()) {
+        ssize_t n = write(fd, contents.data() + written, contents.size() - written);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        written += static_cast<size_t>(n);
+    }
+    struct stat st;
+    bool ok = written == contents.size() && fstat(fd, &st) == 0;
+    close(fd);
+    if (!ok || rename(tmpPath.c_str(), indexPath_.c_str()) < 0) {
+        // 索引写不进去时仍使用这次扫描的结果，下次访问会重新扫描
+        log_error("Unable to write directory index " + indexPath_ + ": " + strerror(errno));
+        unlink(tmpPath.c_str());
+        st.st_ino = 0;
+    }
+
+    clearEntries();
+    inode_ = st.st_ino;
+    loadedSize_ = sizeof(DIR_INDEX_MAGIC);
+    loadedSize_ += static_cast<off_t>(applyRecords(contents.data() + sizeof(DIR_INDEX_MAGIC),
+                                                   contents.size() - sizeof(DIR_INDEX_MAGIC)));
+}
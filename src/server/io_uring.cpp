@@ -0,0 +1,173 @@
+#include "io_uring.hpp"
+#include "logger.hpp"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+namespace {
+    int sysIoUringSetup(unsigned entries, struct io_uring_params* params) {
+        return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+    }
+
+    int sysIoUringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags) {
+        return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+    }
+
+    template <typename T>
+    T* ringField(void* base, uint32_t offset) {
+        return reinterpret_cast<T*>(static_cast<char*>(base) + offset);
+    }
+}
+
+IoUring::IoUring(unsigned entries)
+    : ringFd_(-1), sqRingPtr_(MAP_FAILED), sqRingSize_(0), cqRingPtr_(MAP_FAILED), cqRingSize_(0),
+      sqes_(static_cast<struct io_uring_sqe*>(MAP_FAILED)), sqesSize_(0),
+      sqHead_(nullptr), sqTail_(nullptr), sqRingMask_(nullptr), sqRingEntries_(nullptr), sqArray_(nullptr),
+      sqeHead_(0), sqeTail_(0),
+      cqHead_(nullptr), cqTail_(nullptr), cqRingMask_(nullptr), cqes_(nullptr) {
+    if (!setup(entries)) {
+        teardown();
+    }
+}
+
+IoUring::~IoUring() {
+    teardown();
+}
+
+bool IoUring::setup(unsigned entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    ringFd_ = sysIoUringSetup(entries, &params);
+    if (ringFd_ < 0) {
+        log_debug("io_uring_setup failed: " + std::string(strerror(errno)));
+        ringFd_ = -1;
+        return false;
+    }
+
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    // 新内核的SQ和CQ环共享同一块映射
+    bool singleMmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMmap && cqRingSize_ > sqRingSize_) {
+        sqRingSize_ = cqRingSize_;
+    }
+
+    sqRingPtr_ = mmap(nullptr, sqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ringFd_, IORING_OFF_SQ_RING);
+    if (sqRingPtr_ == MAP_FAILED) {
+        return false;
+    }
+
+    if (singleMmap) {
+        cqRingPtr_ = sqRingPtr_;
+        cqRingSize_ = 0;
+    } else {
+        cqRingPtr_ = mmap(nullptr, cqRingSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          ringFd_, IORING_OFF_CQ_RING);
+        if (cqRingPtr_ == MAP_FAILED) {
+            return false;
+        }
+    }
+
+    sqesSize_ = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ringFd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        return false;
+    }
+    sqes_ = static_cast<struct io_uring_sqe*>(sqes);
+
+    sqHead_ = ringField<unsigned>(sqRingPtr_, params.sq_off.head);
+    sqTail_ = ringField<unsigned>(sqRingPtr_, params.sq_off.tail);
+    sqRingMask_ = ringField<unsigned>(sqRingPtr_, params.sq_off.ring_mask);
+    sqRingEntries_ = ringField<unsigned>(sqRingPtr_, params.sq_off.ring_entries);
+    sqArray_ = ringField<unsigned>(sqRingPtr_, params.sq_off.array);
+
+    cqHead_ = ringField<unsigned>(cqRingPtr_, params.cq_off.head);
+    cqTail_ = ringField<unsigned>(cqRingPtr_, params.cq_off.tail);
+    cqRingMask_ = ringField<unsigned>(cqRingPtr_, params.cq_off.ring_mask);
+    cqes_ = ringField<struct io_uring_cqe>(cqRingPtr_, params.cq_off.cqes);
+
+    sqeHead_ = sqeTail_ = *sqTail_;
+    return true;
+}
+
+void IoUring::teardown() {
+    if (sqes_ != MAP_FAILED) {
+        munmap(sqes_, sqesSize_);
+        sqes_ = static_cast<struct io_uring_sqe*>(MAP_FAILED);
+    }
+    if (cqRingPtr_ != MAP_FAILED && cqRingPtr_ != sqRingPtr_) {
+        munmap(cqRingPtr_, cqRingSize_);
+    }
+    cqRingPtr_ = MAP_FAILED;
+    if (sqRingPtr_ != MAP_FAILED) {
+        munmap(sqRingPtr_, sqRingSize_);
+        sqRingPtr_ = MAP_FAILED;
+    }
+    if (ringFd_ >= 0) {
+        close(ringFd_);
+        ringFd_ = -1;
+    }
+}
+
+unsigned IoUring::getFreeSqes() const {
+    if (!isAvailable()) {
+        return 0;
+    }
+    unsigned head = __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE);
+    return *sqRingEntries_ - (sqeTail_ - head);
+}
+
+struct io_uring_sqe* IoUring::getSqe() {
+    if (getFreeSqes() == 0) {
+        return nullptr;
+    }
+    struct io_uring_sqe* sqe = &sqes_[sqeTail_ & *sqRingMask_];
+    sqeTail_++;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+int IoUring::submitAndWait(unsigned waitNr) {
+    unsigned toSubmit = sqeTail_ - sqeHead_;
+    unsigned tail = *sqTail_;
+    for (unsigned i = 0; i < toSubmit; i++) {
+        sqArray_[tail & *sqRingMask_] = sqeHead_ & *sqRingMask_;
+        tail++;
+        sqeHead_++;
+    }
+    // 内核读取tail之前，SQE和array的写入必须可见
+    __atomic_store_n(sqTail_, tail, __ATOMIC_RELEASE);
+
+    unsigned flags = waitNr > 0 ? IORING_ENTER_GETEVENTS : 0;
+    while (true) {
+        int ret = sysIoUringEnter(ringFd_, toSubmit, waitNr, flags);
+        if (ret >= 0) {
+            return ret;
+        }
+        if (errno != EINTR) {
+            return -errno;
+        }
+        // 被信号中断时SQE可能已被部分消费，只需继续等待完成事件
+        toSubmit = 0;
+    }
+}
+
+bool IoUring::popCqe(uint64_t& userData, int& res) {
+    unsigned head = *cqHead_;
+    unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    if (head == tail) {
+        return false;
+    }
+    const struct io_uring_cqe& cqe = cqes_[head & *cqRingMask_];
+    userData = cqe.user_data;
+    res = cqe.res;
+    __atomic_store_n(cqHead_, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
@@ -0,0 +1,442 @@
+#include "metrics.hpp"
+#include "admission.hpp"
+#include "object_cache.hpp"
+#include "tenant_qos.hpp"
+#include "netutils.hpp"
+#include "logger.hpp"
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <vector>
+
+namespace {
+
+const char* const COMMAND_NAMES[] = {"LIST", "GET", "PUT", "MKDIR"};
+const char* const STAGE_NAMES[] = {"auth", "queue", "disk_read", "disk_write", "disk_sync", "net_send", "net_recv"};
+static_assert(sizeof(COMMAND_NAMES) / sizeof(COMMAND_NAMES[0]) == static_cast<size_t>(MetricCommand::COUNT),
+              "every command needs a name");
+static_assert(sizeof(STAGE_NAMES) / sizeof(STAGE_NAMES[0]) == static_cast<size_t>(MetricStage::COUNT),
+              "every stage needs a name");
+
+// 导出的直方图桶边界（微秒），由HDR桶汇总得到
+const uint64_t EXPORT_BOUNDS_US[] = {100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000,
+                                     500000, 1000000, 2500000, 5000000, 10000000, 30000000};
+const double EXPORT_QUANTILES[] = {0.5, 0.9, 0.99, 0.999};
+
+uint64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+uint64_t load(const uint64_t& value) {
+    return __atomic_load_n(&value, __ATOMIC_RELAXED);
+}
+
+std::string seconds(uint64_t us) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%.6f", static_cast<double>(us) / 1e6);
+    return buffer;
+}
+
+std::string boundLabel(uint64_t us) {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%g", static_cast<double>(us) / 1e6);
+    return buffer;
+}
+
+void family(std::string& out, const std::string& name, const char* type, const std::string& help) {
+    out += "# HELP " + name + " " + help + "\n";
+    out += "# TYPE " + name + " " + type + "\n";
+}
+
+void sample(std::string& out, const std::string& name, const std::string& labels, const std::string& value) {
+    out += name;
+    if (!labels.empty()) {
+        out += "{" + labels + "}";
+    }
+    out += " " + value + "\n";
+}
+
+void sample(std::string& out, const std::string& name, const std::string& labels, uint64_t value) {
+    sample(out, name, labels, std::to_string(value));
+}
+
+// 一组直方图（每个标签值一个）：Prometheus的histogram，再加上按HDR精度计算的分位数和最大值
+void histograms(std::string& out, const std::string& name, const std::string& help, const std::string& label,
+                const char* const* values, const LatencyHistogram* const* histogramsByValue, size_t count) {
+    family(out, name, "histogram", help);
+    for (size_t i = 0; i < count; i++) {
+        const LatencyHistogram& histogram = *histogramsByValue[i];
+        std::string labels = label + "=\"" + values[i] + "\"";
+        for (uint64_t bound : EXPORT_BOUNDS_US) {
+            sample(out, name + "_bucket", labels + ",le=\"" + boundLabel(bound) + "\"", histogram.countAtOrBelow(bound));
+        }
+        sample(out, name + "_bucket", labels + ",le=\"+Inf\"", histogram.count());
+        sample(out, name + "_sum", labels, seconds(histogram.sumUs()));
+        sample(out, name + "_count", labels, histogram.count());
+    }
+
+    family(out, name + "_quantile", "gauge", help + " Quantiles at HDR precision.");
+    for (size_t i = 0; i < count; i++) {
+        const LatencyHistogram& histogram = *histogramsByValue[i];
+        for (double quantile : EXPORT_QUANTILES) {
+            char q[16];
+            snprintf(q, sizeof(q), "%g", quantile);
+            sample(out, name + "_quantile", label + "=\"" + values[i] + "\",quantile=\"" + q + "\"",
+                   seconds(histogram.valueAtQuantile(quantile)));
+        }
+    }
+    family(out, name + "_max", "gauge", help + " Largest value recorded.");
+    for (size_t i = 0; i < count; i++) {
+        sample(out, name + "_max", label + "=\"" + values[i] + "\"", seconds(histogramsByValue[i]->maxUs()));
+    }
+}
+
+std::unique_ptr<Metrics> g_shared;
+
+} // namespace
+
+struct Metrics::State {
+    uint64_t counters[static_cast<size_t>(MetricCounter::COUNT)];
+    uint64_t commands[static_cast<size_t>(MetricCommand::COUNT)][2];   // [命令][0失败/1成功]
+    LatencyHistogram commandLatency[static_cast<size_t>(MetricCommand::COUNT)];
+    LatencyHistogram stageLatency[static_cast<size_t>(MetricStage::COUNT)];
+};
+
+size_t LatencyHistogram::bucketIndex(uint64_t us) {
+    if (us < HISTOGRAM_SUB_BUCKETS) {
+        return static_cast<size_t>(us);
+    }
+    // 最高位之后保留HISTOGRAM_SUB_BUCKET_BITS - 1位
+    int msb = 63 - __builtin_clzll(us);
+    int shift = msb - HISTOGRAM_SUB_BUCKET_BITS + 1;
+    size_t half = HISTOGRAM_SUB_BUCKETS / 2;
+    size_t sub = static_cast<size_t>(us >> shift);
+    return HISTOGRAM_SUB_BUCKETS + static_cast<size_t>(shift - 1) * half + (sub - half);
+}
+
+uint64_t LatencyHistogram::bucketLow(size_t index) {
+    if (index < HISTOGRAM_SUB_BUCKETS) {
+        return index;
+    }
+    size_t half = HISTOGRAM_SUB_BUCKETS / 2;
+    size_t offset = index - HISTOGRAM_SUB_BUCKETS;
+    int shift = static_cast<int>(offset / half) + 1;
+    return static_cast<uint64_t>(offset % half + half) << shift;
+}
+
+uint64_t LatencyHistogram::bucketHigh(size_t index) {
+    if (index < HISTOGRAM_SUB_BUCKETS) {
+        return index;
+    }
+    size_t half = HISTOGRAM_SUB_BUCKETS / 2;
+    size_t offset = index - HISTOGRAM_SUB_BUCKETS;
+    int shift = static_cast<int>(offset / half) + 1;
+    // 最后一个桶的上界超出64位，回绕后减1正好是最大值
+    return (static_cast<uint64_t>(offset % half + half + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(uint64_t us) {
+    __atomic_add_fetch(&buckets_[bucketIndex(us)], 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&count_, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&sumUs_, us, __ATOMIC_RELAXED);
+    uint64_t max = __atomic_load_n(&maxUs_, __ATOMIC_RELAXED);
+    while (us > max && !__atomic_compare_exchange_n(&maxUs_, &max, us, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+uint64_t LatencyHistogram::count() const {
+    return load(count_);
+}
+
+uint64_t LatencyHistogram::sumUs() const {
+    return load(sumUs_);
+}
+
+uint64_t LatencyHistogram::maxUs() const {
+    return load(maxUs_);
+}
+
+uint64_t LatencyHistogram::countAtOrBelow(uint64_t limitUs) const {
+    uint64_t total = 0;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS && bucketLow(i) <= limitUs; i++) {
+        total += load(buckets_[i]);
+    }
+    return total;
+}
+
+uint64_t LatencyHistogram::valueAtQuantile(double q) const {
+    // 各桶是分别读取的，记录并发进行时总数以桶的和为准
+    uint64_t total = 0;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        total += load(buckets_[i]);
+    }
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(std::ceil(q * static_cast<double>(total)));
+    rank = std::max<uint64_t>(1, std::min(rank, total));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += load(buckets_[i]);
+        if (seen >= rank) {
+            return std::min(bucketHigh(i), maxUs());
+        }
+    }
+    return maxUs();
+}
+
+Metrics::Timer::Timer(MetricStage stage) : stage_(stage), startNs_(g_shared ? nowNs() : 0) {}
+
+Metrics::Timer::~Timer() {
+    if (g_shared) {
+        recordStage(stage_, (nowNs() - startNs_) / 1000);
+    }
+}
+
+Metrics::CommandTimer::CommandTimer(MetricCommand command)
+    : command_(command), startNs_(g_shared ? nowNs() : 0), ok_(false) {}
+
+Metrics::CommandTimer::~CommandTimer() {
+    if (g_shared) {
+        recordCommand(command_, (nowNs() - startNs_) / 1000, ok_);
+    }
+}
+
+Metrics::Metrics() : state_(nullptr) {
+    // 匿名共享映射由fork出的子进程继承，初始内容全为0
+    void* map = mmap(nullptr, sizeof(State), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) {
+        log_error("Unable to map metrics: " + std::string(strerror(errno)));
+        return;
+    }
+    state_ = static_cast<State*>(map);
+}
+
+Metrics::~Metrics() {
+    if (state_ != nullptr) {
+        munmap(state_, sizeof(State));
+    }
+}
+
+void Metrics::createShared() {
+    g_shared = std::make_unique<Metrics>();
+    if (!g_shared->isAvailable()) {
+        g_shared.reset();
+    }
+}
+
+Metrics* Metrics::shared() {
+    return g_shared.get();
+}
+
+void Metrics::add(MetricCounter counter, uint64_t value) {
+    if (g_shared) {
+        __atomic_add_fetch(&g_shared->state_->counters[static_cast<size_t>(counter)], value, __ATOMIC_RELAXED);
+    }
+}
+
+void Metrics::recordStage(MetricStage stage, uint64_t us) {
+    if (g_shared) {
+        g_shared->state_->stageLatency[static_cast<size_t>(stage)].record(us);
+    }
+}
+
+void Metrics::recordCommand(MetricCommand command, uint64_t us, bool ok) {
+    if (g_shared) {
+        size_t index = static_cast<size_t>(command);
+        __atomic_add_fetch(&g_shared->state_->commands[index][ok ? 1 : 0], 1, __ATOMIC_RELAXED);
+        g_shared->state_->commandLatency[index].record(us);
+    }
+}
+
+uint64_t Metrics::counter(MetricCounter counter) const {
+    return load(state_->counters[static_cast<size_t>(counter)]);
+}
+
+uint64_t Metrics::commands(MetricCommand command, bool ok) const {
+    return load(state_->commands[static_cast<size_t>(command)][ok ? 1 : 0]);
+}
+
+const LatencyHistogram& Metrics::commandLatency(MetricCommand command) const {
+    return state_->commandLatency[static_cast<size_t>(command)];
+}
+
+const LatencyHistogram& Metrics::stageLatency(MetricStage stage) const {
+    return state_->stageLatency[static_cast<size_t>(stage)];
+}
+
+std::string Metrics::render() const {
+    std::string out;
+
+    family(out, "dfs_commands_total", "counter", "Commands executed after admission.");
+    for (size_t i = 0; i < static_cast<size_t>(MetricCommand::COUNT); i++) {
+        std::string command = std::string("command=\"") + COMMAND_NAMES[i] + "\"";
+        sample(out, "dfs_commands_total", command + ",result=\"ok\"", commands(static_cast<MetricCommand>(i), true));
+        sample(out, "dfs_commands_total", command + ",result=\"error\"", commands(static_cast<MetricCommand>(i), false));
+    }
+
+    const LatencyHistogram* byCommand[static_cast<size_t>(MetricCommand::COUNT)];
+    for (size_t i = 0; i < static_cast<size_t>(MetricCommand::COUNT); i++) {
+        byCommand[i] = &state_->commandLatency[i];
+    }
+    histograms(out, "dfs_command_duration_seconds", "Time to execute a command after admission.", "command",
+               COMMAND_NAMES, byCommand, static_cast<size_t>(MetricCommand::COUNT));
+
+    const LatencyHistogram* byStage[static_cast<size_t>(MetricStage::COUNT)];
+    for (size_t i = 0; i < static_cast<size_t>(MetricStage::COUNT); i++) {
+        byStage[i] = &state_->stageLatency[i];
+    }
+    histograms(out, "dfs_stage_duration_seconds", "Time spent in one call of a command stage.", "stage",
+               STAGE_NAMES, byStage, static_cast<size_t>(MetricStage::COUNT));
+
+    family(out, "dfs_received_bytes_total", "counter", "Object bytes received by PUT.");
+    sample(out, "dfs_received_bytes_total", "", counter(MetricCounter::BYTES_IN));
+    family(out, "dfs_sent_bytes_total", "counter", "Object bytes sent by GET.");
+    sample(out, "dfs_sent_bytes_total", "", counter(MetricCounter::BYTES_OUT));
+    family(out, "dfs_auth_failures_total", "counter", "Rejected passwords and session tokens.");
+    sample(out, "dfs_auth_failures_total", "", counter(MetricCounter::AUTH_FAILURES));
+
+    if (AdmissionControl* admission = AdmissionControl::shared()) {
+        AdmissionControl::Stats stats = admission->stats();
+        family(out, "dfs_admission_admitted_total", "counter", "Commands admitted.");
+        sample(out, "dfs_admission_admitted_total", "", stats.admitted);
+        family(out, "dfs_admission_queued_total", "counter", "Commands that waited for a slot.");
+        sample(out, "dfs_admission_queued_total", "", stats.queued);
+        family(out, "dfs_admission_rejected_total", "counter", "Commands rejected as busy.");
+        sample(out, "dfs_admission_rejected_total", "", stats.rejected);
+        family(out, "dfs_admission_active", "gauge", "Commands holding a slot.");
+        sample(out, "dfs_admission_active", "", stats.active);
+        family(out, "dfs_admission_waiting", "gauge", "Commands waiting for a slot.");
+        sample(out, "dfs_admission_waiting", "", stats.waiting);
+        family(out, "dfs_admission_inflight_bytes", "gauge", "PUT object bytes reserved from the in-flight budget.");
+        sample(out, "dfs_admission_inflight_bytes", "", stats.inflightBytes);
+    }
+
+    if (ObjectCache* cache = ObjectCache::shared()) {
+        ObjectCache::Stats stats = cache->stats();
+        family(out, "dfs_cache_hits_total", "counter", "Object cache hits.");
+        sample(out, "dfs_cache_hits_total", "", stats.hits);
+        family(out, "dfs_cache_misses_total", "counter", "Object cache misses.");
+        sample(out, "dfs_cache_misses_total", "", stats.misses);
+        family(out, "dfs_cache_insertions_total", "counter", "Objects loaded into the cache.");
+        sample(out, "dfs_cache_insertions_total", "", stats.insertions);
+        family(out, "dfs_cache_evictions_total", "counter", "Objects evicted from the cache.");
+        sample(out, "dfs_cache_evictions_total", "", stats.evictions);
+        family(out, "dfs_cache_objects", "gauge", "Objects in the cache.");
+        sample(out, "dfs_cache_objects", "", stats.objects);
+        family(out, "dfs_cache_bytes", "gauge", "Object bytes in the cache.");
+        sample(out, "dfs_cache_bytes", "", stats.bytes);
+        family(out, "dfs_cache_capacity_bytes", "gauge", "Size of the cache.");
+        sample(out, "dfs_cache_capacity_bytes", "", stats.capacity);
+    }
+
+    if (TenantQos* qos = TenantQos::shared()) {
+        std::vector<TenantQos::Stats> tenants = qos->stats();
+        family(out, "dfs_tenant_bytes_total", "counter", "Object bytes charged to a rate-limited user.");
+        for (const TenantQos::Stats& tenant : tenants) {
+            sample(out, "dfs_tenant_bytes_total", "user=\"" + tenant.username + "\"", tenant.bytes);
+        }
+        family(out, "dfs_tenant_commands_total", "counter", "Commands of a rate-limited user.");
+        for (const TenantQos::Stats& tenant : tenants) {
+            sample(out, "dfs_tenant_commands_total", "user=\"" + tenant.username + "\"", tenant.ops);
+        }
+        family(out, "dfs_tenant_throttled_seconds_total", "counter", "Time a rate-limited user was throttled.");
+        for (const TenantQos::Stats& tenant : tenants) {
+            sample(out, "dfs_tenant_throttled_seconds_total", "user=\"" + tenant.username + "\"",
+                   seconds(tenant.throttledUs));
+        }
+    }
+    return out;
+}
+
+namespace {
+
+// 读取一个HTTP请求的头部，回复/metrics；连接每次只处理一个请求
+void serveMetrics(int socket, const Metrics& metrics) {
+    struct timeval timeout = {METRICS_HTTP_TIMEOUT_MS / 1000, (METRICS_HTTP_TIMEOUT_MS % 1000) * 1000};
+    setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(socket, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    std::string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == std::string::npos && request.size() < METRICS_HTTP_REQUEST_MAX) {
+        ssize_t received = recv(socket, buffer, sizeof(buffer), 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            return;
+        }
+        request.append(buffer, static_cast<size_t>(received));
+    }
+
+    std::string status = "200 OK";
+    std::string body;
+    if (request.compare(0, 13, "GET /metrics ") == 0 || request.compare(0, 13, "GET /metrics?") == 0) {
+        body = metrics.render();
+    } else {
+        status = "404 Not Found";
+        body = "Not found\n";
+    }
+    std::string response = "HTTP/1.1 " + status + "\r\n"
+                           "Content-Type: text/plain; version=0.0.4\r\n"
+                           "Content-Length: " + std::to_string(body.size()) + "\r\n"
+                           "Connection: close\r\n\r\n" + body;
+    try {
+        NetUtils::sendBytesToSocket(socket, reinterpret_cast<const unsigned char*>(response.data()), response.size());
+    } catch (const std::exception& e) {
+        log_debug("Unable to send metrics: " + std::string(e.what()));
+    }
+}
+
+} // namespace
+
+pid_t Metrics::startExporter(int port) {
+    if (!g_shared) {
+        return -1;
+    }
+    pid_t pid = fork();
+    if (pid != 0) {
+        if (pid < 0) {
+            log_error("Unable to start metrics exporter: " + std::string(strerror(errno)));
+        }
+        return pid;
+    }
+
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    int enable = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    if (listenFd < 0 || bind(listenFd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) < 0 ||
+        listen(listenFd, 16) < 0) {
+        log_error("Unable to listen for metrics on port " + std::to_string(port) + ": " + strerror(errno));
+        _exit(1);
+    }
+    log_info("Serving metrics on port " + std::to_string(port));
+
+    while (true) {
+        int connFd = accept(listenFd, nullptr, nullptr);
+        if (connFd < 0) {
+            continue;
+        }
+        serveMetrics(connFd, *g_shared);
+        close(connFd);
+    }
+}
@@ -0,0 +1,511 @@
+#include "object_cache.hpp"
+#include "netutils.hpp"
+#include "crc32c.hpp"
+#include "tenant_qos.hpp"
+#include "metrics.hpp"
+#include "logger.hpp"
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+constexpr int32_t NONE = -1;
+constexpr size_t MAX_IOVECS = IOV_MAX < 256 ? IOV_MAX : 256;   // 每次preadv/sendmsg最多的块数
+
+enum EntryState : uint8_t {
+    ENTRY_FREE = 0,
+    ENTRY_LOADING = 1,     // 正在被loader进程载入，其他请求不可读取
+    ENTRY_READY = 2
+};
+
+uint64_t hashKey(const std::string& key) {
+    // FNV-1a
+    uint64_t hash = 1469598103934665603ULL;
+    for (unsigned char c : key) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+size_t alignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+std::unique_ptr<ObjectCache> g_shared;
+
+} // namespace
+
+struct ObjectCache::Header {
+    pthread_mutex_t mutex;      // PTHREAD_PROCESS_SHARED | PTHREAD_MUTEX_ROBUST
+    uint32_t blockCount;
+    uint32_t entryCount;        // 每个对象至少占一个块，条目数等于块数时条目不会先于块用完
+    uint32_t bucketCount;       // 2的幂
+    uint32_t clockHand;
+    int32_t freeBlock;
+    int32_t freeEntry;
+    uint32_t freeBlocks;
+    uint64_t objects;
+    uint64_t bytes;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t insertions;
+    uint64_t evictions;
+};
+
+struct ObjectCache::Entry {
+    uint64_t hash;
+    Version version;
+    int32_t firstBlock;
+    int32_t next;               // 同一哈希桶中的下一个条目，空闲时为空闲链表中的下一个条目
+    uint32_t pins;              // 正在发送该条目的请求数
+    pid_t loader;
+    uint8_t state;
+    uint8_t referenced;         // CLOCK访问位
+    uint16_t keyLength;
+    char key[OBJECT_CACHE_KEY_MAX];
+};
+
+ObjectCache::ObjectCache(uint64_t budgetBytes)
+    : map_(MAP_FAILED), mapSize_(0), header_(nullptr), buckets_(nullptr), entries_(nullptr),
+      nextBlock_(nullptr), data_(nullptr) {
+    uint64_t blocks = budgetBytes / OBJECT_CACHE_BLOCK_SIZE;
+    if (blocks == 0 || blocks > static_cast<uint64_t>(INT32_MAX)) {
+        log_error("Invalid object cache size: " + std::to_string(budgetBytes) + " bytes");
+        return;
+    }
+    uint32_t bucketCount = 1;
+    while (bucketCount < blocks) {
+        bucketCount <<= 1;
+    }
+
+    size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t bucketsOffset = alignUp(sizeof(Header), alignof(int32_t));
+    size_t entriesOffset = alignUp(bucketsOffset + bucketCount * sizeof(int32_t), alignof(Entry));
+    size_t nextOffset = alignUp(entriesOffset + blocks * sizeof(Entry), alignof(int32_t));
+    size_t dataOffset = alignUp(nextOffset + blocks * sizeof(int32_t), pageSize);
+    mapSize_ = dataOffset + blocks * OBJECT_CACHE_BLOCK_SIZE;
+
+    // 匿名共享映射由fork出的子进程继承；页面在首次写入时才分配，空闲的预算不占内存
+    map_ = mmap(nullptr, mapSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (map_ == MAP_FAILED) {
+        log_error("Unable to map object cache: " + std::string(strerror(errno)));
+        return;
+    }
+    unsigned char* base = static_cast<unsigned char*>(map_);
+    header_ = reinterpret_cast<Header*>(base);
+    buckets_ = reinterpret_cast<int32_t*>(base + bucketsOffset);
+    entries_ = reinterpret_cast<Entry*>(base + entriesOffset);
+    nextBlock_ = reinterpret_cast<int32_t*>(base + nextOffset);
+    data_ = base + dataOffset;
+
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&header_->mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    header_->blockCount = static_cast<uint32_t>(blocks);
+    header_->entryCount = static_cast<uint32_t>(blocks);
+    header_->bucketCount = bucketCount;
+    header_->clockHand = 0;
+    std::fill(buckets_, buckets_ + bucketCount, NONE);
+    for (uint32_t i = 0; i < blocks; i++) {
+        nextBlock_[i] = i + 1 < blocks ? static_cast<int32_t>(i + 1) : NONE;
+        entries_[i].state = ENTRY_FREE;
+        entries_[i].next = i + 1 < blocks ? static_cast<int32_t>(i + 1) : NONE;
+    }
+    header_->freeBlock = 0;
+    header_->freeEntry = 0;
+    header_->freeBlocks = static_cast<uint32_t>(blocks);
+}
+
+ObjectCache::~ObjectCache() {
+    if (map_ != MAP_FAILED) {
+        munmap(map_, mapSize_);
+    }
+}
+
+void ObjectCache::createShared(uint64_t budgetBytes) {
+    if (budgetBytes == 0) {
+        g_shared.reset();
+        return;
+    }
+    g_shared = std::make_unique<ObjectCache>(budgetBytes);
+    if (!g_shared->isAvailable()) {
+        g_shared.reset();
+        return;
+    }
+    log_info("Object cache enabled with " + std::to_string(budgetBytes / (1024 * 1024)) + "MB of shared memory");
+}
+
+ObjectCache* ObjectCache::shared() {
+    return g_shared.get();
+}
+
+void ObjectCache::lock() {
+    int ret = pthread_mutex_lock(&header_->mutex);
+    if (ret == EOWNERDEAD) {
+        // 持锁的进程在临界区中被杀死；临界区内只修改链表和计数，每一步都保持结构可用
+        pthread_mutex_consistent(&header_->mutex);
+    }
+}
+
+void ObjectCache::unlock() {
+    pthread_mutex_unlock(&header_->mutex);
+}
+
+unsigned char* ObjectCache::block(int32_t index) const {
+    return data_ + static_cast<size_t>(index) * OBJECT_CACHE_BLOCK_SIZE;
+}
+
+int32_t ObjectCache::findLocked(uint64_t hash, const std::string& key) {
+    for (int32_t i = buckets_[hash & (header_->bucketCount - 1)]; i != NONE; i = entries_[i].next) {
+        const Entry& entry = entries_[i];
+        if (entry.hash == hash && entry.keyLength == key.size() && memcmp(entry.key, key.data(), key.size()) == 0) {
+            return i;
+        }
+    }
+    return NONE;
+}
+
+void ObjectCache::removeLocked(int32_t index) {
+    Entry& entry = entries_[index];
+    int32_t* link = &buckets_[entry.hash & (header_->bucketCount - 1)];
+    while (*link != index) {
+        link = &entries_[*link].next;
+    }
+    *link = entry.next;
+
+    // 整串块归还空闲链表
+    uint32_t blocks = 0;
+    int32_t last = entry.firstBlock;
+    for (int32_t b = entry.firstBlock; b != NONE; b = nextBlock_[b]) {
+        last = b;
+        blocks++;
+    }
+    if (last != NONE) {
+        nextBlock_[last] = header_->freeBlock;
+        header_->freeBlock = entry.firstBlock;
+        header_->freeBlocks += blocks;
+    }
+    if (entry.state == ENTRY_READY) {
+        header_->objects--;
+        header_->bytes -= entry.version.length;
+    }
+
+    entry.state = ENTRY_FREE;
+    entry.next = header_->freeEntry;
+    header_->freeEntry = index;
+}
+
+bool ObjectCache::evictOneLocked() {
+    // 每个条目最多被扫过两次：第一次清除访问位，第二次淘汰
+    for (uint64_t scanned = 0; scanned < 2ULL * header_->entryCount; scanned++) {
+        int32_t index = static_cast<int32_t>(header_->clockHand);
+        header_->clockHand = (header_->clockHand + 1) % header_->entryCount;
+        Entry& entry = entries_[index];
+        if (entry.state == ENTRY_FREE) {
+            continue;
+        }
+        if (entry.state == ENTRY_LOADING) {
+            // 载入中的进程已经退出，条目不会再变为可用
+            if (kill(entry.loader, 0) < 0 && errno == ESRCH) {
+                removeLocked(index);
+                return true;
+            }
+            continue;
+        }
+        if (entry.pins > 0) {
+            continue;
+        }
+        if (entry.referenced) {
+            entry.referenced = 0;
+            continue;
+        }
+        removeLocked(index);
+        header_->evictions++;
+        return true;
+    }
+    return false;
+}
+
+int32_t ObjectCache::allocateLocked(uint64_t hash, const std::string& key, const Version& version, size_t length) {
+    uint32_t needed = static_cast<uint32_t>((length + OBJECT_CACHE_BLOCK_SIZE - 1) / OBJECT_CACHE_BLOCK_SIZE);
+    while (header_->freeBlocks < needed) {
+        if (!evictOneLocked()) {
+            return NONE;
+        }
+    }
+
+    int32_t index = header_->freeEntry;
+    Entry& entry = entries_[index];
+    header_->freeEntry = entry.next;
+
+    entry.firstBlock = header_->freeBlock;
+    int32_t last = NONE;
+    for (uint32_t i = 0; i < needed; i++) {
+        last = header_->freeBlock;
+        header_->freeBlock = nextBlock_[last];
+    }
+    nextBlock_[last] = NONE;
+    header_->freeBlocks -= needed;
+
+    entry.hash = hash;
+    entry.version = version;
+    entry.pins = 1;
+    entry.loader = getpid();
+    entry.state = ENTRY_LOADING;
+    entry.referenced = 0;
+    entry.keyLength = static_cast<uint16_t>(key.size());
+    memcpy(entry.key, key.data(), key.size());
+
+    int32_t* bucket = &buckets_[hash & (header_->bucketCount - 1)];
+    entry.next = *bucket;
+    *bucket = index;
+    return index;
+}
+
+void ObjectCache::unpin(int32_t index) {
+    lock();
+    entries_[index].pins--;
+    unlock();
+}
+
+bool ObjectCache::loadBlocks(const Entry& entry, int fd, off_t offset) {
+    size_t length = entry.version.length;
+    size_t loaded = 0;
+    int32_t current = entry.firstBlock;
+    struct iovec iov[MAX_IOVECS];
+    while (loaded < length) {
+        // 一次preadv读入一批块；块在共享内存中不连续
+        size_t count = 0;
+        size_t batch = 0;
+        for (int32_t b = current; b != NONE && count < MAX_IOVECS; b = nextBlock_[b]) {
+            iov[count].iov_base = block(b);
+            iov[count].iov_len = std::min(OBJECT_CACHE_BLOCK_SIZE, length - loaded - batch);
+            batch += iov[count].iov_len;
+            count++;
+        }
+        ssize_t result;
+        {
+            Metrics::Timer timer(MetricStage::DISK_READ);
+            result = preadv(fd, iov, static_cast<int>(count), offset + static_cast<off_t>(loaded));
+        }
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0) {
+            log_error("Unable to load object into cache: " +
+                      std::string(result < 0 ? strerror(errno) : "unexpected end of file"));
+            return false;
+        }
+        // 只前进完整读入的块，读了一部分的块下次从块首重读
+        size_t blocks = static_cast<size_t>(result) / OBJECT_CACHE_BLOCK_SIZE;
+        if (static_cast<size_t>(result) == batch) {
+            blocks = count;
+        }
+        for (size_t i = 0; i < blocks; i++) {
+            loaded += iov[i].iov_len;
+            current = nextBlock_[current];
+        }
+    }
+    return true;
+}
+
+uint32_t ObjectCache::checksumBlocks(const Entry& entry) {
+    uint32_t checksum = 0;
+    size_t remaining = entry.version.length;
+    for (int32_t b = entry.firstBlock; b != NONE && remaining > 0; b = nextBlock_[b]) {
+        size_t chunk = std::min(OBJECT_CACHE_BLOCK_SIZE, remaining);
+        checksum = Crc32c::extend(checksum, block(b), chunk);
+        remaining -= chunk;
+    }
+    return checksum;
+}
+
+void ObjectCache::sendBlocks(int socket, int splitId, const Entry& entry) {
+    size_t length = entry.version.length;
+    std::vector<unsigned char> header;
+    NetUtils::encodeSplitHeader(header, splitId, static_cast<int>(length));
+    NetUtils::sendBytesToSocket(socket, header.data(), header.size(), MSG_MORE);
+
+    size_t sent = 0;
+    size_t skip = 0;        // 当前块中已经发送的字节
+    int32_t current = entry.firstBlock;
+    struct iovec iov[MAX_IOVECS];
+    while (sent < length) {
+        size_t count = 0;
+        size_t batch = 0;
+        for (int32_t b = current; b != NONE && count < MAX_IOVECS; b = nextBlock_[b]) {
+            size_t offset = count == 0 ? skip : 0;
+            iov[count].iov_base = block(b) + offset;
+            iov[count].iov_len = std::min(OBJECT_CACHE_BLOCK_SIZE - offset, length - sent - batch);
+            batch += iov[count].iov_len;
+            count++;
+        }
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = count;
+        ssize_t result;
+        {
+            Metrics::Timer timer(MetricStage::NET_SEND);
+            result = sendmsg(socket, &msg, MSG_NOSIGNAL | (sent + batch < length ? MSG_MORE : 0));
+        }
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("Unable to send cached object: " + std::string(strerror(errno)));
+        }
+        // sendmsg可能只发送一部分，按实际发送的字节数计入用户的限速
+        TenantQos::charge(static_cast<size_t>(result));
+        Metrics::add(MetricCounter::BYTES_OUT, static_cast<uint64_t>(result));
+        // 按实际发送的字节数前进到对应的块和块内偏移
+        size_t remaining = static_cast<size_t>(result);
+        sent += remaining;
+        for (size_t i = 0; i < count && remaining > 0; i++) {
+            if (remaining < iov[i].iov_len) {
+                skip = (i == 0 ? skip : 0) + remaining;
+                break;
+            }
+            remaining -= iov[i].iov_len;
+            current = nextBlock_[current];
+            skip = 0;
+        }
+    }
+}
+
+bool ObjectCache::sendObject(int socket, int splitId, const std::string& key, const Version& version,
+                             int fd, off_t offset, size_t length, const uint32_t* checksum) {
+    if (header_ == nullptr || length == 0 || key.size() > OBJECT_CACHE_KEY_MAX ||
+        length > static_cast<uint64_t>(header_->blockCount) * OBJECT_CACHE_BLOCK_SIZE / OBJECT_CACHE_MAX_FRACTION) {
+        return false;
+    }
+    uint64_t hash = hashKey(key);
+
+    lock();
+    int32_t index = findLocked(hash, key);
+    if (index != NONE && entries_[index].state == ENTRY_READY && entries_[index].version == version) {
+        Entry& entry = entries_[index];
+        entry.referenced = 1;
+        entry.pins++;
+        header_->hits++;
+        bool report = (header_->hits + header_->misses) % OBJECT_CACHE_STATS_INTERVAL == 0;
+        unlock();
+        if (report) {
+            logStats(stats());
+        }
+
+        try {
+            sendBlocks(socket, splitId, entry);
+        } catch (...) {
+            unpin(index);
+            throw;
+        }
+        unpin(index);
+        return true;
+    }
+
+    header_->misses++;
+    bool report = (header_->hits + header_->misses) % OBJECT_CACHE_STATS_INTERVAL == 0;
+    if (index != NONE) {
+        // 其他请求正在载入或发送旧版本时不等待，这次从磁盘读取
+        if (entries_[index].pins > 0) {
+            unlock();
+            return false;
+        }
+        removeLocked(index);
+    }
+    index = allocateLocked(hash, key, version, length);
+    unlock();
+    if (report) {
+        logStats(stats());
+    }
+    if (index == NONE) {
+        return false;
+    }
+
+    Entry& entry = entries_[index];
+    bool loaded = loadBlocks(entry, fd, offset);
+    if (loaded && checksum != nullptr && checksumBlocks(entry) != *checksum) {
+        log_error("Object " + key + " failed checksum verification while loading into the cache");
+        loaded = false;
+    }
+    lock();
+    if (!loaded) {
+        removeLocked(index);
+        unlock();
+        return false;
+    }
+    entry.state = ENTRY_READY;
+    header_->objects++;
+    header_->bytes += length;
+    header_->insertions++;
+    unlock();
+    // 对象已在缓存中，页缓存里的副本不再需要
+    posix_fadvise(fd, offset, static_cast<off_t>(length), POSIX_FADV_DONTNEED);
+
+    try {
+        sendBlocks(socket, splitId, entry);
+    } catch (...) {
+        unpin(index);
+        throw;
+    }
+    unpin(index);
+    return true;
+}
+
+bool ObjectCache::readObject(const std::string& key, const Version& version, std::string& data) {
+    if (header_ == nullptr || key.size() > OBJECT_CACHE_KEY_MAX) {
+        return false;
+    }
+    lock();
+    int32_t index = findLocked(hashKey(key), key);
+    if (index == NONE || entries_[index].state != ENTRY_READY || !(entries_[index].version == version)) {
+        unlock();
+        return false;
+    }
+    const Entry& entry = entries_[index];
+    data.clear();
+    data.reserve(entry.version.length);
+    for (int32_t b = entry.firstBlock; b != NONE; b = nextBlock_[b]) {
+        size_t chunk = std::min(OBJECT_CACHE_BLOCK_SIZE, static_cast<size_t>(entry.version.length) - data.size());
+        data.append(reinterpret_cast<const char*>(block(b)), chunk);
+    }
+    unlock();
+    return true;
+}
+
+ObjectCache::Stats ObjectCache::stats() {
+    if (header_ == nullptr) {
+        return Stats{0, 0, 0, 0, 0, 0, 0};
+    }
+    lock();
+    Stats stats{header_->hits, header_->misses, header_->insertions, header_->evictions, header_->objects,
+                header_->bytes, static_cast<uint64_t>(header_->blockCount) * OBJECT_CACHE_BLOCK_SIZE};
+    unlock();
+    return stats;
+}
+
+void ObjectCache::logStats(const Stats& stats) {
+    uint64_t lookups = stats.hits + stats.misses;
+    log_info("Object cache: " + std::to_string(stats.hits) + " hits, " + std::to_string(stats.misses) +
+             " misses (" + std::to_string(lookups > 0 ? stats.hits * 100 / lookups : 0) + "% hit), " +
+             std::to_string(stats.objects) + " objects, " + std::to_string(stats.bytes / 1024) + "KB of " +
+             std::to_string(stats.capacity / 1024) + "KB, " + std::to_string(stats.evictions) + " evictions");
+}
@@ -0,0 +1,688 @@
+#include "object_io.hpp"
+#include "object_cache.hpp"
+#include "crc32c.hpp"
+#include "tenant_qos.hpp"
+#include "metrics.hpp"
+#include "logger.hpp"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/xattr.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+namespace {
+
+size_t alignUp(size_t length) {
+    return (length + DIRECT_IO_ALIGNMENT - 1) / DIRECT_IO_ALIGNMENT * DIRECT_IO_ALIGNMENT;
+}
+
+void writeFull(int fd, const unsigned char* data, size_t length, off_t offset) {
+    size_t written = 0;
+    while (written < length) {
+        ssize_t result = pwrite(fd, data + written, length - written, offset + static_cast<off_t>(written));
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error("Unable to write object file: " + std::string(strerror(errno)));
+        }
+        written += static_cast<size_t>(result);
+    }
+}
+
+// 读取fd中offset处的chunk字节；direct时按对齐长度读，文件末尾返回实际剩余的字节数
+void readChunk(int fd, unsigned char* buffer, size_t chunk, off_t offset, bool direct) {
+    size_t got = 0;
+    while (got < chunk) {
+        ssize_t result = pread(fd, buffer + got, direct ? alignUp(chunk) : chunk - got, offset + static_cast<off_t>(got));
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result <= 0 || (direct && static_cast<size_t>(result) < chunk)) {
+            std::string reason = result < 0 ? strerror(errno) : "short read";
+            throw std::runtime_error("Unable to read object file: " + reason);
+        }
+        got += static_cast<size_t>(result);
+    }
+}
+
+} // namespace
+
+AlignedBufferPool::Buffer::~Buffer() {
+    if (data_ != nullptr) {
+        pool_->release(data_);
+    }
+}
+
+AlignedBufferPool::~AlignedBufferPool() {
+    for (unsigned char* data : idle_) {
+        free(data);
+    }
+}
+
+AlignedBufferPool& AlignedBufferPool::instance() {
+    static AlignedBufferPool pool;
+    return pool;
+}
+
+AlignedBufferPool::Buffer AlignedBufferPool::acquire() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!idle_.empty()) {
+            unsigned char* data = idle_.back();
+            idle_.pop_back();
+            return Buffer(*this, data);
+        }
+        allocated_++;
+    }
+    void* data = nullptr;
+    if (posix_memalign(&data, DIRECT_IO_ALIGNMENT, DIRECT_IO_BUFFER_SIZE) != 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        allocated_--;
+        throw std::bad_alloc();
+    }
+    return Buffer(*this, static_cast<unsigned char*>(data));
+}
+
+void AlignedBufferPool::release(unsigned char* data) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (idle_.size() < DIRECT_IO_POOL_BUFFERS) {
+        idle_.push_back(data);
+        return;
+    }
+    allocated_--;
+    free(data);
+}
+
+AlignedBufferPool::Stats AlignedBufferPool::stats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return Stats{allocated_, idle_.size()};
+}
+
+std::string ObjectIoBackend::objectPath(const std::string& fileFolder, const std::string& fileName, int splitId) {
+    return fileFolder + "/." + fileName + "." + std::to_string(splitId);
+}
+
+std::string ObjectIoBackend::partialPath(const std::string& objectFile) {
+    return objectFile + ".part";
+}
+
+void ObjectIoBackend::commitPartial(const std::string& objectFile) {
+    if (rename(partialPath(objectFile).c_str(), objectFile.c_str()) < 0) {
+        int err = errno;
+        unlink(partialPath(objectFile).c_str());
+        throw std::runtime_error("Unable to commit object file " + objectFile + ": " + strerror(err));
+    }
+}
+
+std::unique_ptr<ObjectIoBackend> ObjectIoBackend::create(DfsIoBackend type, uint64_t directThreshold) {
+    std::unique_ptr<ObjectIoBackend> backend;
+    if (type == DfsIoBackend::IO_URING) {
+        auto uring = std::make_unique<UringObjectIo>();
+        if (uring->isAvailable()) {
+            backend = std::move(uring);
+        } else {
+            log_error("io_uring is not available on this kernel, falling back to blocking I/O");
+        }
+    }
+    if (!backend) {
+        backend = std::make_unique<BlockingObjectIo>();
+    }
+    backend->directThreshold_ = directThreshold;
+    return backend;
+}
+
+ObjectIoBackend& ObjectIoBackend::forThread(DfsIoBackend type, uint64_t directThreshold) {
+    thread_local std::unique_ptr<ObjectIoBackend> backend;
+    thread_local DfsIoBackend backendType = DfsIoBackend::BLOCKING;
+    if (!backend || backendType != type) {
+        backend = create(type);
+        backendType = type;
+    }
+    backend->directThreshold_ = directThreshold;
+    return *backend;
+}
+
+void ObjectIoBackend::sendObject(int socket, int splitId, const std::string& filePath) {
+    int fd = open(filePath.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        // 对象不存在时返回长度为0的分片
+        std::vector<unsigned char> header;
+        NetUtils::encodeSplitHeader(header, splitId, 0);
+        NetUtils::sendToSocket(socket, header);
+        return;
+    }
+    
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        throw std::runtime_error("Unable to stat object file: " + filePath);
+    }
+    
+    size_t length = static_cast<size_t>(st.st_size);
+    uint32_t checksum = 0;
+    bool checksummed = readChecksum(fd, checksum);
+    try {
+        // PUT总是rename出新的对象文件，inode和修改时间不变时缓存中的内容仍然有效
+        ObjectCache* cache = ObjectCache::shared();
+        ObjectCache::Version version{static_cast<uint64_t>(st.st_ino),
+                                     static_cast<uint64_t>(st.st_mtim.tv_sec) * 1000000000ULL +
+                                         static_cast<uint64_t>(st.st_mtim.tv_nsec),
+                                     static_cast<uint64_t>(length)};
+        if (cache != nullptr && cache->sendObject(socket, splitId, filePath, version, fd, 0, length,
+                                                  checksummed ? &checksum : nullptr)) {
+            close(fd);
+            return;
+        }
+        // 大对象在发送前切换为O_DIRECT，文件系统不支持时fcntl失败，仍走页缓存
+        bool direct = useDirect(length) && fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_DIRECT) == 0;
+        if (checksummed && !verifyRange(fd, 0, length, checksum, direct)) {
+            sendCorrupt(socket, splitId, filePath);
+        } else if (direct) {
+            AlignedBufferPool::Buffer buffer = AlignedBufferPool::instance().acquire();
+            sendDirect(socket, splitId, fd, length, buffer.data());
+        } else {
+            sendRange(socket, splitId, fd, 0, length);
+        }
+    } catch (...) {
+        close(fd);
+        throw;
+    }
+    close(fd);
+}
+
+bool ObjectIoBackend::verifyRange(int fd, off_t offset, size_t length, uint32_t checksum, bool direct) {
+    uint32_t crc = 0;
+    if (!direct && length > 0) {
+        // 对象文件只会被rename替换，段文件只追加，映射期间不会被截短
+        off_t pageSize = static_cast<off_t>(sysconf(_SC_PAGESIZE));
+        off_t start = offset / pageSize * pageSize;
+        size_t mapLength = length + static_cast<size_t>(offset - start);
+        void* map = mmap(nullptr, mapLength, PROT_READ, MAP_SHARED | MAP_POPULATE, fd, start);
+        if (map != MAP_FAILED) {
+            crc = Crc32c::compute(static_cast<unsigned char*>(map) + (offset - start), length);
+            munmap(map, mapLength);
+            return crc == checksum;
+        }
+    }
+
+    // 直接I/O的对象或不能映射的文件经缓冲区读取
+    std::unique_ptr<AlignedBufferPool::Buffer> aligned;
+    unsigned char* buffer = buffer_.data();
+    size_t bufferSize = buffer_.size();
+    if (direct) {
+        aligned = std::make_unique<AlignedBufferPool::Buffer>(AlignedBufferPool::instance().acquire());
+        buffer = aligned->data();
+        bufferSize = aligned->size();
+    }
+    for (size_t done = 0; done < length; ) {
+        size_t chunk = std::min(bufferSize, length - done);
+        readChunk(fd, buffer, chunk, offset + static_cast<off_t>(done), direct);
+        crc = Crc32c::extend(crc, buffer, chunk);
+        done += chunk;
+    }
+    return crc == checksum;
+}
+
+void ObjectIoBackend::sendCorrupt(int socket, int splitId, const std::string& objectName) {
+    log_error("Object " + objectName + " failed checksum verification, the client will read another replica");
+    std::vector<unsigned char> header;
+    NetUtils::encodeSplitHeader(header, splitId, 0, CORRUPT_OBJECT_FLAG);
+    NetUtils::sendToSocket(socket, header);
+}
+
+bool ObjectIoBackend::readChecksum(int fd, uint32_t& checksum) {
+    return fgetxattr(fd, OBJECT_CHECKSUM_XATTR, &checksum, sizeof(checksum)) == static_cast<ssize_t>(sizeof(checksum));
+}
+
+int ObjectIoBackend::recvObject(int socket, const std::string& fileFolder, const std::string& fileName) {
+    int splitId;
+    uint64_t size;
+    if (recvPartial(socket, fileFolder, fileName, splitId, size)) {
+        commitPartial(objectPath(fileFolder, fileName, splitId));
+    }
+    return splitId;
+}
+
+bool ObjectIoBackend::recvPartial(int socket, const std::string& fileFolder, const std::string& fileName,
+                                  int& splitId, uint64_t& size) {
+    int contentLength;
+    NetUtils::recvSplitHeader(socket, splitId, contentLength);
+    size = static_cast<uint64_t>(contentLength);
+
+    std::string filePath = objectPath(fileFolder, fileName, splitId);
+    log_debug("File written at: " + filePath);
+
+    int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+    bool direct = useDirect(size);
+    int fd = open(partialPath(filePath).c_str(), flags | (direct ? O_DIRECT : 0), 0644);
+    if (fd < 0 && direct && errno == EINVAL) {
+        log_debug("O_DIRECT is not supported for " + filePath + ", writing through the page cache");
+        direct = false;
+        fd = open(partialPath(filePath).c_str(), flags, 0644);
+    }
+    if (fd < 0) {
+        // 写文件失败只记录错误，但仍需读走内容保持协议同步
+        log_error("Error in opening file to write: " + filePath);
+        discard(socket, size);
+        return false;
+    }
+
+    uint32_t checksum;
+    try {
+        if (direct) {
+            AlignedBufferPool::Buffer buffer = AlignedBufferPool::instance().acquire();
+            checksum = recvDirect(socket, fd, size, buffer.data());
+            // 最后一块按对齐长度写入，截掉末尾的填充
+            if (ftruncate(fd, static_cast<off_t>(size)) < 0) {
+                throw std::runtime_error("Unable to truncate object file: " + std::string(strerror(errno)));
+            }
+        } else {
+            checksum = recvRange(socket, fd, 0, size);
+        }
+    } catch (...) {
+        close(fd);
+        unlink(partialPath(filePath).c_str());
+        throw;
+    }
+    // 校验和随临时文件一起rename，与内容同时生效；文件系统不支持扩展属性时对象不带校验和
+    if (fsetxattr(fd, OBJECT_CHECKSUM_XATTR, &checksum, sizeof(checksum), 0) < 0) {
+        log_debug("Unable to store checksum of " + filePath + ": " + strerror(errno));
+        fremovexattr(fd, OBJECT_CHECKSUM_XATTR);
+    }
+    close(fd);
+
+    log_debug("Successfully wrote " + std::to_string(contentLength) + " bytes to " + partialPath(filePath));
+    return true;
+}
+
+void ObjectIoBackend::discard(int socket, size_t length) {
+    NetUtils::discardFromSocket(socket, length, buffer_);
+}
+
+BlockingObjectIo::BlockingObjectIo() : ObjectIoBackend(BLOCKING_IO_CHUNK_SIZE) {}
+
+void BlockingObjectIo::sendRange(int socket, int splitId, int fd, off_t offset, size_t length) {
+    // 零拷贝：头部用MSG_MORE与随后的数据合并，内容由sendfile从页缓存直接发送
+    std::vector<unsigned char> header;
+    NetUtils::encodeSplitHeader(header, splitId, static_cast<int>(length));
+    NetUtils::sendBytesToSocket(socket, header.data(), header.size(), length > 0 ? MSG_MORE : 0);
+    Metrics::add(MetricCounter::BYTES_OUT, length);
+    if (!TenantQos::throttled()) {
+        Metrics::Timer timer(MetricStage::NET_SEND);
+        NetUtils::sendFileToSocket(socket, fd, length, offset);
+        return;
+    }
+    // 限速的用户分块发送，每块之前按字节桶等待
+    for (size_t sent = 0; sent < length; ) {
+        size_t chunk = std::min(buffer_.size(), length - sent);
+        TenantQos::charge(chunk);
+        Metrics::Timer timer(MetricStage::NET_SEND);
+        NetUtils::sendFileToSocket(socket, fd, chunk, offset + static_cast<off_t>(sent));
+        sent += chunk;
+    }
+}
+
+uint32_t BlockingObjectIo::recvRange(int socket, int fd, off_t offset, size_t length) {
+    // 以buffer_大小为单位接收并写入，内存占用与对象大小无关；校验和趁数据还在缓存中时计算
+    uint32_t checksum = 0;
+    for (size_t received = 0; received < length; ) {
+        size_t chunk = std::min(buffer_.size(), length - received);
+        TenantQos::charge(chunk);
+        {
+            Metrics::Timer timer(MetricStage::NET_RECV);
+            NetUtils::recvBytesFromSocket(socket, buffer_.data(), chunk);
+        }
+        checksum = Crc32c::extend(checksum, buffer_.data(), chunk);
+        {
+            Metrics::Timer timer(MetricStage::DISK_WRITE);
+            writeFull(fd, buffer_.data(), chunk, offset + static_cast<off_t>(received));
+        }
+        received += chunk;
+    }
+    Metrics::add(MetricCounter::BYTES_IN, length);
+    return checksum;
+}
+
+void BlockingObjectIo::sendDirect(int socket, int splitId, int fd, size_t length, unsigned char* buffer) {
+    std::vector<unsigned char> header;
+    NetUtils::encodeSplitHeader(header, splitId, static_cast<int>(length));
+    NetUtils::sendBytesToSocket(socket, header.data(), header.size(), length > 0 ? MSG_MORE : 0);
+
+    for (size_t sent = 0; sent < length; ) {
+        size_t chunk = std::min(DIRECT_IO_BUFFER_SIZE, length - sent);
+        // 对齐长度的读在文件末尾返回实际剩余的字节数
+        ssize_t result;
+        {
+            Metrics::Timer timer(MetricStage::DISK_READ);
+            result = pread(fd, buffer, alignUp(chunk), static_cast<off_t>(sent));
+        }
+        if (result < 0 && errno == EINTR) {
+            continue;
+        }
+        if (result < static_cast<ssize_t>(chunk)) {
+            std::string reason = result < 0 ? strerror(errno) : "short read";
+            throw std::runtime_error("Unable to read object file: " + reason);
+        }
+        TenantQos::charge(chunk);
+        {
+            Metrics::Timer timer(MetricStage::NET_SEND);
+            NetUtils::sendBytesToSocket(socket, buffer, chunk, sent + chunk < length ? MSG_MORE : 0);
+        }
+        sent += chunk;
+    }
+    Metrics::add(MetricCounter::BYTES_OUT, length);
+}
+
+uint32_t BlockingObjectIo::recvDirect(int socket, int fd, size_t length, unsigned char* buffer) {
+    uint32_t checksum = 0;
+    for (size_t received = 0; received < length; ) {
+        size_t chunk = std::min(DIRECT_IO_BUFFER_SIZE, length - received);
+        TenantQos::charge(chunk);
+        {
+            Metrics::Timer timer(MetricStage::NET_RECV);
+            NetUtils::recvBytesFromSocket(socket, buffer, chunk);
+        }
+        checksum = Crc32c::extend(checksum, buffer, chunk);
+        size_t aligned = alignUp(chunk);
+        ssize_t result;
+        {
+            Metrics::Timer timer(MetricStage::DISK_WRITE);
+            do {
+                result = pwrite(fd, buffer, aligned, static_cast<off_t>(received));
+            } while (result < 0 && errno == EINTR);
+        }
+        if (result != static_cast<ssize_t>(aligned)) {
+            std::string reason = result < 0 ? strerror(errno) : "short write";
+            throw std::runtime_error("Unable to write object file: " + reason);
+        }
+        received += chunk;
+    }
+    Metrics::add(MetricCounter::BYTES_IN, length);
+    return checksum;
+}
+
+UringObjectIo::UringObjectIo() : ObjectIoBackend(URING_IO_CHUNK_SIZE), ring_(IO_URING_QUEUE_DEPTH), pipeFds_{-1, -1}, pipeSize_(0) {
+    resetPipe();
+}
+
+UringObjectIo::~UringObjectIo() {
+    closePipe();
+}
+
+void UringObjectIo::closePipe() {
+    for (int& fd : pipeFds_) {
+        if (fd != -1) {
+            close(fd);
+            fd = -1;
+        }
+    }
+    pipeSize_ = 0;
+}
+
+void UringObjectIo::resetPipe() {
+    closePipe();
+    if (pipe2(pipeFds_, O_CLOEXEC) < 0) {
+        pipeFds_[0] = pipeFds_[1] = -1;
+        log_debug("Unable to create splice pipe, GET falls back to READ/SEND: " + std::string(strerror(errno)));
+        return;
+    }
+    // 管道容量决定每个SPLICE能搬运的字节数；超过pipe-max-size时保留内核给出的大小
+    fcntl(pipeFds_[1], F_SETPIPE_SZ, static_cast<int>(URING_IO_CHUNK_SIZE));
+    int size = fcntl(pipeFds_[1], F_GETPIPE_SZ);
+    if (size <= 0) {
+        closePipe();
+        return;
+    }
+    pipeSize_ = std::min(static_cast<size_t>(size), URING_IO_CHUNK_SIZE);
+}
+
+void UringObjectIo::linkSqe(struct io_uring_sqe* sqe) {
+    sqe->flags |= IOSQE_IO_LINK;
+}
+
+void UringObjectIo::submitChain(unsigned count, const char* what) {
+    int ret = ring_.submitAndWait(count);
+    if (ret < 0) {
+        throw std::runtime_error(std::string("io_uring_enter failed: ") + strerror(-ret));
+    }
+
+    // user_data中保存的是期望的结果（传输的字节数），
+    // 链中任何一个请求短读写或失败，后续请求都会以-ECANCELED完成
+    bool failed = false;
+    int firstError = 0;
+    for (unsigned done = 0; done < count; ) {
+        uint64_t expected;
+        int res;
+        if (!ring_.popCqe(expected, res)) {
+            ret = ring_.submitAndWait(count - done);
+            if (ret < 0) {
+                throw std::runtime_error(std::string("io_uring_enter failed: ") + strerror(-ret));
+            }
+            continue;
+        }
+        done++;
+        if (res < 0 || static_cast<uint64_t>(res) != expected) {
+            if (!failed) {
+                firstError = res;
+            }
+            failed = true;
+        }
+    }
+
+    if (failed) {
+        std::string reason = firstError < 0 ? strerror(-firstError) : "short transfer";
+        throw std::runtime_error(std::string(what) + " failed in io_uring chain: " + reason);
+    }
+}
+
+void UringObjectIo::sendRange(int socket, int splitId, int fd, off_t offset, size_t length) {
+    sendChain(socket, splitId, fd, offset, length, buffer_.data(), buffer_.size(), pipeFds_[0] != -1, false);
+}
+
+uint32_t UringObjectIo::recvRange(int socket, int fd, off_t offset, size_t length) {
+    return recvChain(socket, fd, offset, length, buffer_.data(), buffer_.size(), false);
+}
+
+void UringObjectIo::sendDirect(int socket, int splitId, int fd, size_t length, unsigned char* buffer) {
+    sendChain(socket, splitId, fd, 0, length, buffer, DIRECT_IO_BUFFER_SIZE, false, true);
+}
+
+uint32_t UringObjectIo::recvDirect(int socket, int fd, size_t length, unsigned char* buffer) {
+    return recvChain(socket, fd, 0, length, buffer, DIRECT_IO_BUFFER_SIZE, true);
+}
+
+void UringObjectIo::sendChain(int socket, int splitId, int fd, off_t offset, size_t length,
+                              unsigned char* buffer, size_t bufferSize, bool zeroCopy, bool direct) {
+    std::vector<unsigned char> header;
+    NetUtils::encodeSplitHeader(header, splitId, static_cast<int>(length));
+
+    // 直接I/O读到文件末尾时按对齐长度读、只返回剩余字节，链接的请求会把它当作短读而取消后续请求，
+    // 因此链只覆盖对齐的部分，末尾不足一块的部分单独读取和发送
+    size_t chainLength = direct ? length / DIRECT_IO_ALIGNMENT * DIRECT_IO_ALIGNMENT : length;
+    size_t sent = 0;
+    bool headerQueued = false;
+    try {
+        while (!headerQueued || sent < chainLength) {
+            unsigned count = 0;
+            size_t batchStart = sent;
+            struct io_uring_sqe* lastSqe = nullptr;
+
+            if (!headerQueued) {
+                struct io_uring_sqe* sqe = ring_.getSqe();
+                sqe->opcode = IORING_OP_SEND;
+                sqe->fd = socket;
+                sqe->addr = reinterpret_cast<uint64_t>(header.data());
+                sqe->len = SPLIT_HEADER_SIZE;
+                sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL | (length > 0 ? MSG_MORE : 0);
+                sqe->user_data = SPLIT_HEADER_SIZE;
+                linkSqe(sqe);
+                lastSqe = sqe;
+                count++;
+                headerQueued = true;
+            }
+
+            for (unsigned chunk = 0; chunk < URING_MAX_CHAIN_CHUNKS && sent < chainLength; chunk++) {
+                uint64_t fileOffset = static_cast<uint64_t>(offset) + sent;
+                if (zeroCopy) {
+                    // 管道按页计容量：起点不在页边界时（段文件中的对象）少搬一页的零头，避免短传输
+                    size_t span = pipeSize_ - fileOffset % static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+                    unsigned len = static_cast<unsigned>(std::min(span, length - sent));
+
+                    // 文件页引用进入管道，再从管道交给socket，不经过用户态缓冲区
+                    struct io_uring_sqe* inSqe = ring_.getSqe();
+                    inSqe->opcode = IORING_OP_SPLICE;
+                    inSqe->splice_fd_in = fd;
+                    inSqe->splice_off_in = fileOffset;
+                    inSqe->fd = pipeFds_[1];
+                    inSqe->off = static_cast<uint64_t>(-1);
+                    inSqe->len = len;
+                    inSqe->user_data = len;
+                    linkSqe(inSqe);
+
+                    struct io_uring_sqe* outSqe = ring_.getSqe();
+                    outSqe->opcode = IORING_OP_SPLICE;
+                    outSqe->splice_fd_in = pipeFds_[0];
+                    outSqe->splice_off_in = static_cast<uint64_t>(-1);
+                    outSqe->fd = socket;
+                    outSqe->off = static_cast<uint64_t>(-1);
+                    outSqe->len = len;
+                    outSqe->splice_flags = sent + len < length ? SPLICE_F_MORE : 0;
+                    outSqe->user_data = len;
+                    linkSqe(outSqe);
+                    lastSqe = outSqe;
+
+                    sent += len;
+                    count += 2;
+                    continue;
+                }
+
+                unsigned len = static_cast<unsigned>(std::min(bufferSize, chainLength - sent));
+
+                struct io_uring_sqe* readSqe = ring_.getSqe();
+                readSqe->opcode = IORING_OP_READ;
+                readSqe->fd = fd;
+                readSqe->addr = reinterpret_cast<uint64_t>(buffer);
+                readSqe->len = len;
+                readSqe->off = fileOffset;
+                readSqe->user_data = len;
+                linkSqe(readSqe);
+
+                struct io_uring_sqe* sendSqe = ring_.getSqe();
+                sendSqe->opcode = IORING_OP_SEND;
+                sendSqe->fd = socket;
+                sendSqe->addr = reinterpret_cast<uint64_t>(buffer);
+                sendSqe->len = len;
+                sendSqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+                sendSqe->user_data = len;
+                linkSqe(sendSqe);
+                lastSqe = sendSqe;
+
+                sent += len;
+                count += 2;
+            }
+
+            // 链在本批次末尾结束，下一批次重新开始
+            lastSqe->flags &= ~IOSQE_IO_LINK;
+            TenantQos::charge(sent - batchStart);
+            // 链中的读盘和发送无法分开计时，整批计为发送
+            Metrics::Timer timer(MetricStage::NET_SEND);
+            submitChain(count, "GET");
+        }
+
+        if (sent < length) {
+            unsigned len = static_cast<unsigned>(length - sent);
+            TenantQos::charge(len);
+
+            struct io_uring_sqe* readSqe = ring_.getSqe();
+            readSqe->opcode = IORING_OP_READ;
+            readSqe->fd = fd;
+            readSqe->addr = reinterpret_cast<uint64_t>(buffer);
+            readSqe->len = static_cast<unsigned>(alignUp(len));
+            readSqe->off = static_cast<uint64_t>(offset) + sent;
+            readSqe->user_data = len;
+            {
+                Metrics::Timer timer(MetricStage::DISK_READ);
+                submitChain(1, "GET");
+            }
+
+            struct io_uring_sqe* sendSqe = ring_.getSqe();
+            sendSqe->opcode = IORING_OP_SEND;
+            sendSqe->fd = socket;
+            sendSqe->addr = reinterpret_cast<uint64_t>(buffer);
+            sendSqe->len = len;
+            sendSqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+            sendSqe->user_data = len;
+            Metrics::Timer timer(MetricStage::NET_SEND);
+            submitChain(1, "GET");
+        }
+        Metrics::add(MetricCounter::BYTES_OUT, length);
+    } catch (...) {
+        if (zeroCopy) {
+            // 失败的链可能在管道中留下数据，重建管道以免污染下一个对象
+            resetPipe();
+        }
+        throw;
+    }
+}
+
+uint32_t UringObjectIo::recvChain(int socket, int fd, off_t offset, size_t length,
+                                  unsigned char* buffer, size_t bufferSize, bool direct) {
+    // 一批中的各块接收到缓冲区中相邻的位置，批次完成后整批内容仍在缓冲区中，可以计算校验和
+    size_t sliceSize = bufferSize / URING_MAX_CHAIN_CHUNKS;
+    uint32_t checksum = 0;
+    size_t received = 0;
+    while (received < length) {
+        unsigned count = 0;
+        size_t batch = 0;
+        struct io_uring_sqe* lastSqe = nullptr;
+
+        for (unsigned chunk = 0; chunk < URING_MAX_CHAIN_CHUNKS && received + batch < length; chunk++) {
+            unsigned len = static_cast<unsigned>(std::min(sliceSize, length - received - batch));
+            // 直接I/O的最后一块连同填充按对齐长度写入
+            unsigned writeLen = direct ? static_cast<unsigned>(alignUp(len)) : len;
+            unsigned char* slice = buffer + batch;
+
+            struct io_uring_sqe* recvSqe = ring_.getSqe();
+            recvSqe->opcode = IORING_OP_RECV;
+            recvSqe->fd = socket;
+            recvSqe->addr = reinterpret_cast<uint64_t>(slice);
+            recvSqe->len = len;
+            recvSqe->msg_flags = MSG_WAITALL;
+            recvSqe->user_data = len;
+            linkSqe(recvSqe);
+
+            struct io_uring_sqe* writeSqe = ring_.getSqe();
+            writeSqe->opcode = IORING_OP_WRITE;
+            writeSqe->fd = fd;
+            writeSqe->addr = reinterpret_cast<uint64_t>(slice);
+            writeSqe->len = writeLen;
+            writeSqe->off = static_cast<uint64_t>(offset) + received + batch;
+            writeSqe->user_data = writeLen;
+            linkSqe(writeSqe);
+            lastSqe = writeSqe;
+
+            batch += len;
+            count += 2;
+        }
+        lastSqe->flags &= ~IOSQE_IO_LINK;
+
+        TenantQos::charge(batch);
+        {
+            // 链中的接收和写盘无法分开计时，整批计为接收
+            Metrics::Timer timer(MetricStage::NET_RECV);
+            submitChain(count, "PUT");
+        }
+        checksum = Crc32c::extend(checksum, buffer, batch);
+        received += batch;
+    }
+    Metrics::add(MetricCounter::BYTES_IN, length);
+    return checksum;
+}
@@ -0,0 +1,952 @@
+#include "packed_store.hpp"
+#include "object_cache.hpp"
+#include "logger.hpp"
+#include <sys/file.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+constexpr uint32_t RECORD_MAGIC = 0x4F534644;           // "DFSO"，没有校验和的旧格式记录
+constexpr uint32_t RECORD_MAGIC_CHECKSUM = 0x43534644;  // "DFSC"，记录头末尾带数据的CRC32C
+constexpr size_t RECORD_HEADER_SIZE = 24;
+constexpr size_t RECORD_CHECKSUM_HEADER_SIZE = RECORD_HEADER_SIZE + sizeof(uint32_t);
+constexpr size_t RECORD_STATE_OFFSET = 4;
+constexpr size_t RECORD_CHECKSUM_OFFSET = RECORD_HEADER_SIZE;
+constexpr size_t RECORD_KEY_MAX = 4096;
+constexpr uint64_t SEGMENT_HEADER_SIZE = sizeof(PACKED_SEGMENT_MAGIC);
+constexpr const char LEGACY_HINT_MAGIC[8] = {'D', 'F', 'S', 'H', 'N', 'T', '0', '1'};
+constexpr size_t HINT_ENTRY_SIZE = sizeof(uint16_t) + 3 * sizeof(uint64_t) + sizeof(uint8_t) + sizeof(uint32_t);
+constexpr size_t COPY_CHUNK_SIZE = 1024 * 1024;
+constexpr int OBJECT_ID_MAX_DIGITS = 10;    // 含FILE_MANIFEST_ID
+
+constexpr unsigned char STATE_RESERVED = 'R';
+constexpr unsigned char STATE_COMMITTED = 'C';
+constexpr unsigned char STATE_ABORTED = 'A';
+
+std::mutex g_storesMutex;
+std::map<std::string, std::unique_ptr<PackedStore>> g_stores;
+
+// 段目录上的flock排它锁：预留记录、创建段和压缩在进程之间串行执行
+class StoreLock {
+public:
+    explicit StoreLock(const std::string& storePath)
+        : fd_(open(storePath.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)) {
+        if (fd_ >= 0) {
+            while (flock(fd_, LOCK_EX) < 0 && errno == EINTR) {
+            }
+        }
+    }
+    ~StoreLock() {
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+    }
+    StoreLock(const StoreLock&) = delete;
+    StoreLock& operator=(const StoreLock&) = delete;
+
+    bool held() const { return fd_ >= 0; }
+
+private:
+    int fd_;
+};
+
+template <typename T>
+void appendValue(std::vector<unsigned char>& buffer, T value) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&value);
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+template <typename T>
+T readValue(const unsigned char* data) {
+    T value;
+    memcpy(&value, data, sizeof(T));
+    return value;
+}
+
+bool preadFull(int fd, unsigned char* data, size_t length, uint64_t offset) {
+    size_t got = 0;
+    while (got < length) {
+        ssize_t n = pread(fd, data + got, length - got, static_cast<off_t>(offset + got));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        got += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool pwriteFull(int fd, const unsigned char* data, size_t length, uint64_t offset) {
+    size_t written = 0;
+    while (written < length) {
+        ssize_t n = pwrite(fd, data + written, length - written, static_cast<off_t>(offset + written));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        written += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+size_t recordHeaderSize(bool checksummed) {
+    return checksummed ? RECORD_CHECKSUM_HEADER_SIZE : RECORD_HEADER_SIZE;
+}
+
+bool writeMagic(int fd, uint64_t record, bool checksummed) {
+    std::vector<unsigned char> magic;
+    appendValue<uint32_t>(magic, checksummed ? RECORD_MAGIC_CHECKSUM : RECORD_MAGIC);
+    return pwriteFull(fd, magic.data(), magic.size(), record);
+}
+
+// 记录头和键；魔数先写0，等头部完整落盘后再单独写入，不加锁的读取方不会看到半条记录头
+// 压缩复制旧格式的记录时checksummed为false，记录大小保持不变
+void encodeRecordHeader(std::vector<unsigned char>& buffer, unsigned char state, const std::string& key,
+                        uint64_t seq, uint64_t length, bool checksummed, uint32_t checksum) {
+    buffer.clear();
+    appendValue<uint32_t>(buffer, 0);
+    buffer.push_back(state);
+    buffer.push_back(0);
+    appendValue<uint16_t>(buffer, static_cast<uint16_t>(key.size()));
+    appendValue<uint64_t>(buffer, seq);
+    appendValue<uint64_t>(buffer, length);
+    if (checksummed) {
+        appendValue<uint32_t>(buffer, checksum);
+    }
+    buffer.insert(buffer.end(), key.begin(), key.end());
+}
+
+// 写入方在记录首字节上持有OFD写锁；没有锁的R记录说明写入进程已经退出
+bool recordLocked(int fd, uint64_t record) {
+    struct flock lock;
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+    lock.l_start = static_cast<off_t>(record);
+    lock.l_len = 1;
+    if (fcntl(fd, F_OFD_GETLK, &lock) < 0) {
+        return true;
+    }
+    return lock.l_type != F_UNLCK;
+}
+
+bool copyRange(int srcFd, uint64_t srcOffset, int dstFd, uint64_t dstOffset, uint64_t length) {
+    loff_t in = static_cast<loff_t>(srcOffset);
+    loff_t out = static_cast<loff_t>(dstOffset);
+    uint64_t remaining = length;
+    while (remaining > 0) {
+        ssize_t n = copy_file_range(srcFd, &in, dstFd, &out, std::min<uint64_t>(remaining, COPY_CHUNK_SIZE), 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        remaining -= static_cast<uint64_t>(n);
+    }
+    if (remaining == 0) {
+        return true;
+    }
+
+    // 文件系统不支持copy_file_range时退化为pread/pwrite
+    std::vector<unsigned char> buffer(std::min<uint64_t>(remaining, COPY_CHUNK_SIZE));
+    while (remaining > 0) {
+        size_t chunk = static_cast<size_t>(std::min<uint64_t>(remaining, buffer.size()));
+        if (!preadFull(srcFd, buffer.data(), chunk, static_cast<uint64_t>(in)) ||
+            !pwriteFull(dstFd, buffer.data(), chunk, static_cast<uint64_t>(out))) {
+            return false;
+        }
+        in += static_cast<loff_t>(chunk);
+        out += static_cast<loff_t>(chunk);
+        remaining -= chunk;
+    }
+    return true;
+}
+
+bool parseSegmentName(const std::string& entryName, uint32_t& id) {
+    const std::string suffix = ".seg";
+    if (entryName.size() != 8 + suffix.size() || entryName.compare(8, suffix.size(), suffix) != 0) {
+        return false;
+    }
+    for (size_t i = 0; i < 8; i++) {
+        if (!std::isdigit(static_cast<unsigned char>(entryName[i]))) {
+            return false;
+        }
+    }
+    id = static_cast<uint32_t>(std::stoul(entryName.substr(0, 8)));
+    return id > 0;
+}
+
+// 与对象文件名相同的规则：.名字.数字
+bool parseObjectName(const std::string& entryName, std::string& fileName, int& objectId) {
+    size_t dotPos = entryName.rfind('.');
+    if (entryName.size() < 3 || entryName[0] != '.' || dotPos == 0 || dotPos == entryName.size() - 1 ||
+        entryName.size() - dotPos - 1 > OBJECT_ID_MAX_DIGITS) {
+        return false;
+    }
+    for (size_t i = dotPos + 1; i < entryName.size(); i++) {
+        if (!std::isdigit(static_cast<unsigned char>(entryName[i]))) {
+            return false;
+        }
+    }
+    long long id = std::stoll(entryName.substr(dotPos + 1));
+    if (id > std::numeric_limits<int>::max()) {
+        return false;
+    }
+    fileName = entryName.substr(1, dotPos - 1);
+    objectId = static_cast<int>(id);
+    return true;
+}
+
+} // namespace
+
+PackedStore::SegmentFd::~SegmentFd() {
+    if (fd >= 0) {
+        close(fd);
+    }
+}
+
+PackedStore::PackedStore(const std::string& rootPath, uint64_t segmentSize)
+    : rootPath_(rootPath), storePath_(rootPath + "/" + PACKED_STORE_DIR), segmentSize_(segmentSize),
+      loaded_(false), maxSeq_(0) {
+    if (mkdir(storePath_.c_str(), 0755) < 0 && errno != EEXIST) {
+        log_error("Unable to create packed store " + storePath_ + ": " + strerror(errno));
+    }
+}
+
+PackedStore& PackedStore::forRoot(const std::string& rootPath) {
+    std::lock_guard<std::mutex> lock(g_storesMutex);
+    auto& store = g_stores[rootPath];
+    if (!store) {
+        store = std::make_unique<PackedStore>(rootPath);
+    }
+    return *store;
+}
+
+PackedStore* PackedStore::containing(const std::string& path) {
+    std::lock_guard<std::mutex> lock(g_storesMutex);
+    for (auto& store : g_stores) {
+        const std::string& root = store.first;
+        if (path.compare(0, root.size(), root) == 0 && (path.size() == root.size() || path[root.size()] == '/')) {
+            return store.second.get();
+        }
+    }
+    return nullptr;
+}
+
+pid_t PackedStore::startCompactor(const std::string& rootPath) {
+    pid_t pid = fork();
+    if (pid != 0) {
+        if (pid < 0) {
+            log_error("Unable to start packed store compactor: " + std::string(strerror(errno)));
+        }
+        return pid;
+    }
+
+    prctl(PR_SET_PDEATHSIG, SIGTERM);
+    PackedStore store(rootPath);
+    while (true) {
+        sleep(PACKED_COMPACT_INTERVAL_SECONDS);
+        try {
+            size_t removed = store.compact();
+            if (removed > 0) {
+                log_info("Packed store compaction removed " + std::to_string(removed) + " segment(s)");
+            }
+        } catch (const std::exception& e) {
+            log_error("Packed store compaction failed: " + std::string(e.what()));
+        }
+    }
+}
+
+std::string PackedStore::keyFor(const std::string& objectFile) const {
+    if (objectFile.size() > rootPath_.size() && objectFile.compare(0, rootPath_.size(), rootPath_) == 0 &&
+        objectFile[rootPath_.size()] == '/') {
+        return objectFile.substr(rootPath_.size() + 1);
+    }
+    return objectFile;
+}
+
+std::string PackedStore::segmentPath(uint32_t id, const char* suffix) const {
+    char name[16];
+    snprintf(name, sizeof(name), "%08u", id);
+    return storePath_ + "/" + name + suffix;
+}
+
+bool PackedStore::receive(int socket, ObjectIoBackend& objectIo, const std::string& fileFolder,
+                          const std::string& fileName, int& splitId, Pending& pending) {
+    int contentLength;
+    NetUtils::recvSplitHeader(socket, splitId, contentLength);
+    pending.key = keyFor(ObjectIoBackend::objectPath(fileFolder, fileName, splitId));
+    pending.length = static_cast<uint64_t>(contentLength);
+    pending.writeFd = -1;
+
+    bool reserved = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        StoreLock storeLock(storePath_);
+        if (storeLock.held()) {
+            refreshIndex(false);
+            pending.seq = maxSeq_ + 1;
+            reserved = reserveLocked(pending);
+        }
+    }
+    if (!reserved) {
+        // 与文件存储一致：写入失败只记录错误，但仍需读走内容保持协议同步
+        log_error("Unable to reserve space for " + pending.key + " in packed store " + storePath_);
+        objectIo.discard(socket, pending.length);
+        return false;
+    }
+
+    uint64_t data = pending.record + RECORD_CHECKSUM_HEADER_SIZE + pending.key.size();
+    try {
+        pending.checksum = objectIo.recvRange(socket, pending.writeFd, static_cast<off_t>(data), pending.length);
+    } catch (...) {
+        finish(pending, false);
+        throw;
+    }
+    // 预留时校验和还未知，在记录提交之前补写
+    std::vector<unsigned char> checksum;
+    appendValue<uint32_t>(checksum, pending.checksum);
+    if (!pwriteFull(pending.writeFd, checksum.data(), checksum.size(), pending.record + RECORD_CHECKSUM_OFFSET)) {
+        log_error("Unable to write checksum of " + pending.key + " in packed store " + storePath_ + ": " +
+                  strerror(errno));
+        finish(pending, false);
+        return false;
+    }
+    log_debug("Packed " + pending.key + " (" + std::to_string(pending.length) + " bytes) into segment " +
+              std::to_string(pending.segment) + " at " + std::to_string(data));
+    return true;
+}
+
+bool PackedStore::markCommitted(uint32_t segment, uint64_t record) {
+    // 与压缩进程回收R记录互斥，记录不会在检查状态之后被改为A
+    StoreLock storeLock(storePath_);
+    int fd = open(segmentPath(segment, ".seg").c_str(), O_RDWR | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    unsigned char state = 0;
+    bool ok = preadFull(fd, &state, 1, record + RECORD_STATE_OFFSET);
+    if (ok && state == STATE_RESERVED) {
+        unsigned char committed = STATE_COMMITTED;
+        ok = pwriteFull(fd, &committed, 1, record + RECORD_STATE_OFFSET);
+        state = committed;
+    }
+    close(fd);
+    return ok && state == STATE_COMMITTED;
+}
+
+void PackedStore::finish(Pending& pending, bool committed) {
+    if (!committed) {
+        unsigned char state = STATE_ABORTED;
+        if (!pwriteFull(pending.writeFd, &state, 1, pending.record + RECORD_STATE_OFFSET)) {
+            // 状态仍是R且没有锁，压缩进程会把它标记为A
+            log_error("Unable to abandon packed store record " + pending.key + ": " + strerror(errno));
+        }
+    }
+    // 关闭描述符同时释放记录上的OFD锁
+    close(pending.writeFd);
+    pending.writeFd = -1;
+    if (committed) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        apply(pending.key, Location{pending.segment, pending.seq, pending.record, pending.length,
+                                    RECORD_CHECKSUM_HEADER_SIZE + pending.key.size() + pending.length,
+                                    true, pending.checksum});
+    }
+}
+
+bool PackedStore::recvObject(int socket, ObjectIoBackend& objectIo, const std::string& fileFolder,
+                             const std::string& fileName, int& splitId, uint64_t& size) {
+    Pending pending;
+    if (!receive(socket, objectIo, fileFolder, fileName, splitId, pending)) {
+        size = pending.length;
+        return false;
+    }
+    size = pending.length;
+    bool committed = markCommitted(pending.segment, pending.record);
+    finish(pending, committed);
+    return committed;
+}
+
+bool PackedStore::sendObject(int socket, ObjectIoBackend& objectIo, int splitId, const std::string& objectFile) {
+    std::shared_ptr<SegmentFd> file;
+    Location location;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        refreshIndex(false);
+        auto it = objects_.find(keyFor(objectFile));
+        if (it == objects_.end()) {
+            return false;
+        }
+        auto segment = segments_.find(it->second.segment);
+        if (segment == segments_.end()) {
+            return false;
+        }
+        location = it->second;
+        file = segment->second.file;
+    }
+    // 发送期间不持有锁；段即使被压缩删除，已打开的描述符仍然可读
+    uint64_t data = location.record + location.recordSize - location.length;
+    // 记录被覆盖或被压缩复制到其他段后版本随之改变
+    ObjectCache* cache = ObjectCache::shared();
+    ObjectCache::Version version{location.segment, location.seq, location.length};
+    const uint32_t* checksum = location.checksummed ? &location.checksum : nullptr;
+    if (cache != nullptr && cache->sendObject(socket, splitId, objectFile, version, file->fd,
+                                              static_cast<off_t>(data), location.length, checksum)) {
+        return true;
+    }
+    if (checksum != nullptr &&
+        !objectIo.verifyRange(file->fd, static_cast<off_t>(data), location.length, *checksum, false)) {
+        ObjectIoBackend::sendCorrupt(socket, splitId, objectFile);
+        return true;
+    }
+    objectIo.sendRange(socket, splitId, file->fd, static_cast<off_t>(data), location.length);
+    return true;
+}
+
+bool PackedStore::contains(const std::string& objectFile) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    refreshIndex(false);
+    return objects_.find(keyFor(objectFile)) != objects_.end();
+}
+
+bool PackedStore::readObject(const std::string& objectFile, std::vector<unsigned char>& data) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    refreshIndex(false);
+    auto it = objects_.find(keyFor(objectFile));
+    if (it == objects_.end()) {
+        return false;
+    }
+    const Location& location = it->second;
+    auto segment = segments_.find(location.segment);
+    if (segment == segments_.end()) {
+        return false;
+    }
+    data.resize(location.length);
+    return preadFull(segment->second.file->fd, data.data(), data.size(),
+                     location.record + location.recordSize - location.length);
+}
+
+void PackedStore::listFolder(const std::string& folderPath,
+                             std::map<std::string, std::map<int, uint64_t>>& files) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    refreshIndex(false);
+    std::string prefix = keyFor(folderPath) + "/";
+    for (const auto& object : objects_) {
+        const std::string& key = object.first;
+        if (key.compare(0, prefix.size(), prefix) != 0 || key.find('/', prefix.size()) != std::string::npos) {
+            continue;
+        }
+        std::string fileName;
+        int objectId;
+        if (parseObjectName(key.substr(prefix.size()), fileName, objectId)) {
+            files[fileName][objectId] = object.second.length;
+        }
+    }
+}
+
+void PackedStore::refresh() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    refreshIndex(false);
+}
+
+PackedStore::Stats PackedStore::stats() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    refreshIndex(false);
+    Stats stats = {segments_.size(), objects_.size(), 0, 0};
+    for (const auto& segment : segments_) {
+        stats.liveBytes += segment.second.liveBytes;
+        stats.totalBytes += segment.second.end - SEGMENT_HEADER_SIZE;
+    }
+    return stats;
+}
+
+void PackedStore::loadIndex() {
+    DIR* dp = opendir(storePath_.c_str());
+    if (!dp) {
+        log_error("Unable to scan packed store " + storePath_ + ": " + strerror(errno));
+        return;
+    }
+    std::vector<uint32_t> ids;
+    struct dirent* ep;
+    while ((ep = readdir(dp)) != nullptr) {
+        uint32_t id;
+        if (parseSegmentName(ep->d_name, id)) {
+            ids.push_back(id);
+        }
+    }
+    closedir(dp);
+    std::sort(ids.begin(), ids.end());
+
+    for (size_t i = 0; i < ids.size(); i++) {
+        if (!openSegment(ids[i])) {
+            continue;
+        }
+        Segment& segment = segments_[ids[i]];
+        // 活动段可能还在追加，只有封存段使用提示文件
+        if (i + 1 == ids.size() || !loadHint(ids[i], segment)) {
+            scanSegment(ids[i], segment, false);
+        }
+    }
+    loaded_ = true;
+    log_debug("Loaded packed store " + storePath_ + ": " + std::to_string(segments_.size()) + " segment(s), " +
+              std::to_string(objects_.size()) + " object(s)");
+}
+
+void PackedStore::refreshIndex(bool reap) {
+    if (!loaded_) {
+        loadIndex();
+    } else {
+        // 段编号只增不减，其他进程创建的新段紧接在最后一个段之后
+        uint32_t next = segments_.empty() ? 1 : segments_.rbegin()->first + 1;
+        while (openSegment(next)) {
+            next++;
+        }
+    }
+    if (segments_.empty()) {
+        return;
+    }
+
+    uint32_t last = segments_.rbegin()->first;
+    for (auto& segment : segments_) {
+        if (segment.first == last || segment.second.stable < segment.second.end) {
+            scanSegment(segment.first, segment.second, reap);
+        }
+    }
+
+    // 被其他进程压缩删除的段：记录都已复制到新段，关闭描述符
+    for (auto it = segments_.begin(); it != segments_.end(); ) {
+        if (it->first != last && it->second.liveObjects == 0 && it->second.stable == it->second.end &&
+            access(segmentPath(it->first, ".seg").c_str(), F_OK) != 0) {
+            it = segments_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+bool PackedStore::openSegment(uint32_t id) {
+    std::string path = segmentPath(id, ".seg");
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    char magic[sizeof(PACKED_SEGMENT_MAGIC)];
+    if (!preadFull(fd, reinterpret_cast<unsigned char*>(magic), sizeof(magic), 0) ||
+        memcmp(magic, PACKED_SEGMENT_MAGIC, sizeof(magic)) != 0) {
+        close(fd);
+        log_error("Ignoring damaged packed store segment " + path);
+        return false;
+    }
+
+    Segment segment;
+    segment.file = std::make_shared<SegmentFd>(fd);
+    segment.end = SEGMENT_HEADER_SIZE;
+    segment.stable = SEGMENT_HEADER_SIZE;
+    segment.liveBytes = 0;
+    segment.liveObjects = 0;
+    segment.hinted = false;
+    segments_[id] = segment;
+    return true;
+}
+
+void PackedStore::scanSegment(uint32_t id, Segment& segment, bool reap) {
+    int fd = segment.file->fd;
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        return;
+    }
+    uint64_t fileSize = static_cast<uint64_t>(st.st_size);
+    if (segment.stable == segment.end && fileSize < segment.end + RECORD_HEADER_SIZE) {
+        return;
+    }
+
+    std::vector<unsigned char> header(RECORD_CHECKSUM_HEADER_SIZE + RECORD_KEY_MAX);
+    uint64_t pos = segment.stable;
+    bool allFinal = true;
+    while (pos + RECORD_HEADER_SIZE <= fileSize) {
+        size_t want = static_cast<size_t>(std::min<uint64_t>(header.size(), fileSize - pos));
+        ssize_t got = pread(fd, header.data(), want, static_cast<off_t>(pos));
+        uint32_t magic = got < static_cast<ssize_t>(RECORD_HEADER_SIZE) ? 0 : readValue<uint32_t>(header.data());
+        if (magic != RECORD_MAGIC && magic != RECORD_MAGIC_CHECKSUM) {
+            // 记录链在这里结束（尚未写完的记录头或中断的追加），下一次追加会覆盖
+            break;
+        }
+        bool checksummed = magic == RECORD_MAGIC_CHECKSUM;
+        size_t headerSize = recordHeaderSize(checksummed);
+        unsigned char state = header[RECORD_STATE_OFFSET];
+        size_t keyLength = readValue<uint16_t>(header.data() + 6);
+        uint64_t seq = readValue<uint64_t>(header.data() + 8);
+        uint64_t length = readValue<uint64_t>(header.data() + 16);
+        if (keyLength > RECORD_KEY_MAX || headerSize + keyLength > static_cast<size_t>(got)) {
+            log_error("Damaged record in packed store segment " + segmentPath(id, ".seg") + " at " +
+                      std::to_string(pos));
+            break;
+        }
+        uint32_t checksum = checksummed ? readValue<uint32_t>(header.data() + RECORD_CHECKSUM_OFFSET) : 0;
+        std::string key(reinterpret_cast<const char*>(header.data() + headerSize), keyLength);
+        uint64_t recordSize = headerSize + keyLength + length;
+        maxSeq_ = std::max(maxSeq_, seq);
+
+        if (state == STATE_RESERVED && reap && !recordLocked(fd, pos)) {
+            int writeFd = open(segmentPath(id, ".seg").c_str(), O_WRONLY | O_CLOEXEC);
+            if (writeFd >= 0 && pwriteFull(writeFd, &STATE_ABORTED, 1, pos + RECORD_STATE_OFFSET)) {
+                log_info("Aborted abandoned packed store record " + key);
+                state = STATE_ABORTED;
+            }
+            if (writeFd >= 0) {
+                close(writeFd);
+            }
+        }
+        if (state == STATE_COMMITTED) {
+            apply(key, Location{id, seq, pos, length, recordSize, checksummed, checksum});
+        } else if (state == STATE_RESERVED) {
+            allFinal = false;
+        }
+
+        pos += recordSize;
+        if (allFinal) {
+            segment.stable = pos;
+        }
+    }
+    segment.end = std::max(segment.end, pos);
+}
+
+bool PackedStore::loadHint(uint32_t id, Segment& segment) {
+    int fd = open(segmentPath(id, ".hint").c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    std::vector<unsigned char> contents;
+    if (fstat(fd, &st) == 0) {
+        contents.resize(static_cast<size_t>(st.st_size));
+    }
+    bool ok = !contents.empty() && preadFull(fd, contents.data(), contents.size(), 0);
+    close(fd);
+
+    size_t headerSize = sizeof(PACKED_HINT_MAGIC) + 2 * sizeof(uint64_t);
+    if (ok && contents.size() >= sizeof(LEGACY_HINT_MAGIC) &&
+        memcmp(contents.data(), LEGACY_HINT_MAGIC, sizeof(LEGACY_HINT_MAGIC)) == 0) {
+        // 旧版本的提示文件没有校验和，扫描段文件，压缩进程随后重写提示文件
+        log_debug("Rescanning packed store segment " + std::to_string(id) + " with an outdated hint");
+        return false;
+    }
+    if (!ok || contents.size() < headerSize ||
+        memcmp(contents.data(), PACKED_HINT_MAGIC, sizeof(PACKED_HINT_MAGIC)) != 0) {
+        log_error("Ignoring damaged packed store hint for segment " + std::to_string(id));
+        return false;
+    }
+    uint64_t end = readValue<uint64_t>(contents.data() + sizeof(PACKED_HINT_MAGIC));
+    uint64_t count = readValue<uint64_t>(contents.data() + sizeof(PACKED_HINT_MAGIC) + sizeof(uint64_t));
+
+    // 先完整解析再应用，损坏的提示文件不会留下一半的条目
+    std::vector<std::pair<std::string, Location>> entries;
+    size_t pos = headerSize;
+    for (uint64_t i = 0; i < count; i++) {
+        if (contents.size() - pos < HINT_ENTRY_SIZE) {
+            return false;
+        }
+        size_t keyLength = readValue<uint16_t>(contents.data() + pos);
+        uint64_t seq = readValue<uint64_t>(contents.data() + pos + 2);
+        uint64_t record = readValue<uint64_t>(contents.data() + pos + 10);
+        uint64_t length = readValue<uint64_t>(contents.data() + pos + 18);
+        bool checksummed = contents[pos + 26] != 0;
+        uint32_t checksum = readValue<uint32_t>(contents.data() + pos + 27);
+        pos += HINT_ENTRY_SIZE;
+        if (contents.size() - pos < keyLength) {
+            return false;
+        }
+        std::string key(reinterpret_cast<const char*>(contents.data() + pos), keyLength);
+        pos += keyLength;
+        entries.emplace_back(key, Location{id, seq, record, length,
+                                           recordHeaderSize(checksummed) + keyLength + length, checksummed, checksum});
+    }
+    for (const auto& entry : entries) {
+        maxSeq_ = std::max(maxSeq_, entry.second.seq);
+        apply(entry.first, entry.second);
+    }
+    segment.end = end;
+    segment.stable = end;
+    segment.hinted = true;
+    return true;
+}
+
+void PackedStore::writeHintLocked(uint32_t id, Segment& segment) {
+    std::vector<unsigned char> contents(PACKED_HINT_MAGIC, PACKED_HINT_MAGIC + sizeof(PACKED_HINT_MAGIC));
+    appendValue<uint64_t>(contents, segment.end);
+    size_t countPos = contents.size();
+    appendValue<uint64_t>(contents, 0);
+    uint64_t count = 0;
+    for (const auto& object : objects_) {
+        const Location& location = object.second;
+        if (location.segment != id) {
+            continue;
+        }
+        appendValue<uint16_t>(contents, static_cast<uint16_t>(object.first.size()));
+        appendValue<uint64_t>(contents, location.seq);
+        appendValue<uint64_t>(contents, location.record);
+        appendValue<uint64_t>(contents, location.length);
+        contents.push_back(location.checksummed ? 1 : 0);
+        appendValue<uint32_t>(contents, location.checksum);
+        contents.insert(contents.end(), object.first.begin(), object.first.end());
+        count++;
+    }
+    memcpy(contents.data() + countPos, &count, sizeof(count));
+
+    std::string hintPath = segmentPath(id, ".hint");
+    std::string tmpPath = hintPath + ".tmp";
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    bool ok = fd >= 0 && pwriteFull(fd, contents.data(), contents.size(), 0) && fdatasync(fd) == 0;
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (!ok || rename(tmpPath.c_str(), hintPath.c_str()) < 0) {
+        log_error("Unable to write packed store hint " + hintPath + ": " + strerror(errno));
+        unlink(tmpPath.c_str());
+        return;
+    }
+    segment.hinted = true;
+}
+
+void PackedStore::apply(const std::string& key, const Location& location) {
+    auto result = objects_.emplace(key, location);
+    if (!result.second) {
+        Location& current = result.first->second;
+        // 序号大的记录覆盖序号小的；序号相同的是压缩复制出的同一条记录，以新段为准
+        if (location.seq < current.seq || (location.seq == current.seq && location.segment <= current.segment)) {
+            return;
+        }
+        auto old = segments_.find(current.segment);
+        if (old != segments_.end()) {
+            old->second.liveBytes -= current.recordSize;
+            old->second.liveObjects--;
+        }
+        current = location;
+    }
+    auto segment = segments_.find(location.segment);
+    if (segment != segments_.end()) {
+        segment->second.liveBytes += location.recordSize;
+        segment->second.liveObjects++;
+    }
+}
+
+void PackedStore::createSegmentLocked(uint32_t id) {
+    // 先写临时文件再rename，其他进程看到的段文件总是带有完整的魔数
+    std::string path = segmentPath(id, ".seg");
+    std::string tmpPath = path + ".tmp";
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    bool ok = fd >= 0 && pwriteFull(fd, reinterpret_cast<const unsigned char*>(PACKED_SEGMENT_MAGIC),
+                                    sizeof(PACKED_SEGMENT_MAGIC), 0);
+    if (fd >= 0) {
+        close(fd);
+    }
+    if (!ok || rename(tmpPath.c_str(), path.c_str()) < 0 || !openSegment(id)) {
+        int err = errno;
+        unlink(tmpPath.c_str());
+        throw std::runtime_error("Unable to create packed store segment " + path + ": " + strerror(err));
+    }
+    log_debug("Created packed store segment " + path);
+}
+
+bool PackedStore::reserveLocked(Pending& pending) {
+    if (pending.key.size() > RECORD_KEY_MAX) {
+        return false;
+    }
+    uint64_t recordSize = RECORD_CHECKSUM_HEADER_SIZE + pending.key.size() + pending.length;
+    try {
+        if (segments_.empty()) {
+            createSegmentLocked(1);
+        } else {
+            const Segment& active = segments_.rbegin()->second;
+            if (active.end > SEGMENT_HEADER_SIZE && active.end + recordSize > segmentSize_) {
+                createSegmentLocked(segments_.rbegin()->first + 1);
+            }
+        }
+    } catch (const std::exception& e) {
+        log_error(e.what());
+        return false;
+    }
+
+    uint32_t id = segments_.rbegin()->first;
+    Segment& segment = segments_.rbegin()->second;
+    int fd = open(segmentPath(id, ".seg").c_str(), O_WRONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct flock lock;
+    memset(&lock, 0, sizeof(lock));
+    lock.l_type = F_WRLCK;
+    lock.l_whence = SEEK_SET;
+    lock.l_start = static_cast<off_t>(segment.end);
+    lock.l_len = 1;
+    std::vector<unsigned char> header;
+    encodeRecordHeader(header, STATE_RESERVED, pending.key, pending.seq, pending.length, true, 0);
+    if (fcntl(fd, F_OFD_SETLK, &lock) < 0 || !pwriteFull(fd, header.data(), header.size(), segment.end) ||
+        !writeMagic(fd, segment.end, true)) {
+        log_error("Unable to append to packed store segment " + segmentPath(id, ".seg") + ": " + strerror(errno));
+        close(fd);
+        return false;
+    }
+
+    pending.segment = id;
+    pending.record = segment.end;
+    pending.writeFd = fd;
+    segment.end += recordSize;
+    maxSeq_ = std::max(maxSeq_, pending.seq);
+    return true;
+}
+
+size_t PackedStore::compact() {
+    std::vector<uint32_t> victims;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        StoreLock storeLock(storePath_);
+        if (!storeLock.held()) {
+            return 0;
+        }
+        refreshIndex(true);
+        uint32_t last = segments_.empty() ? 0 : segments_.rbegin()->first;
+        for (auto& segment : segments_) {
+            Segment& seg = segment.second;
+            if (segment.first == last || seg.stable < seg.end) {
+                continue;
+            }
+            uint64_t used = seg.end - SEGMENT_HEADER_SIZE;
+            if (seg.liveBytes <= static_cast<uint64_t>(used * (1 - PACKED_COMPACT_GARBAGE_RATIO))) {
+                victims.push_back(segment.first);
+            } else if (!seg.hinted) {
+                writeHintLocked(segment.first, seg);
+            }
+        }
+    }
+
+    // 每个段单独加锁，压缩期间其他连接的PUT只在段之间等待
+    size_t removed = 0;
+    for (uint32_t id : victims) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        StoreLock storeLock(storePath_);
+        if (!storeLock.held()) {
+            break;
+        }
+        refreshIndex(false);
+        if (segments_.count(id) && compactSegmentLocked(id)) {
+            removed++;
+        }
+    }
+    return removed;
+}
+
+bool PackedStore::compactSegmentLocked(uint32_t id) {
+    Segment& victim = segments_[id];
+    std::shared_ptr<SegmentFd> source = victim.file;
+    std::vector<std::pair<std::string, Location>> live;
+    for (const auto& object : objects_) {
+        if (object.second.segment == id) {
+            live.push_back(object);
+        }
+    }
+    std::sort(live.begin(), live.end(), [](const auto& a, const auto& b) {
+        return a.second.record < b.second.record;
+    });
+
+    // 复制的记录先写数据和头部（魔数为0），全部落盘后再依次写魔数：
+    // 中途失败或崩溃时这些记录对其他进程不可见，下一次追加会覆盖它们
+    struct Copy {
+        uint32_t segment;
+        uint64_t record;
+        int fd;
+        bool checksummed;
+    };
+    std::vector<Copy> copies;
+    std::map<uint32_t, int> writeFds;
+    bool ok = true;
+    std::vector<unsigned char> header;
+    for (const auto& object : live) {
+        const Location& location = object.second;
+        try {
+            const Segment& active = segments_.rbegin()->second;
+            if (active.end > SEGMENT_HEADER_SIZE && active.end + location.recordSize > segmentSize_) {
+                createSegmentLocked(segments_.rbegin()->first + 1);
+            }
+        } catch (const std::exception& e) {
+            log_error(e.what());
+            ok = false;
+            break;
+        }
+        uint32_t target = segments_.rbegin()->first;
+        Segment& segment = segments_.rbegin()->second;
+        if (!writeFds.count(target)) {
+            int fd = open(segmentPath(target, ".seg").c_str(), O_WRONLY | O_CLOEXEC);
+            if (fd < 0) {
+                ok = false;
+                break;
+            }
+            writeFds[target] = fd;
+        }
+        int fd = writeFds[target];
+        encodeRecordHeader(header, STATE_COMMITTED, object.first, location.seq, location.length,
+                           location.checksummed, location.checksum);
+        uint64_t sourceData = location.record + location.recordSize - location.length;
+        if (!copyRange(source->fd, sourceData, fd, segment.end + header.size(), location.length) ||
+            !pwriteFull(fd, header.data(), header.size(), segment.end)) {
+            ok = false;
+            break;
+        }
+        copies.push_back(Copy{target, segment.end, fd, location.checksummed});
+        segment.end += location.recordSize;
+    }
+
+    for (const auto& writeFd : writeFds) {
+        ok = ok && fdatasync(writeFd.second) == 0;
+    }
+    size_t visible = 0;
+    while (ok && visible < copies.size()) {
+        ok = writeMagic(copies[visible].fd, copies[visible].record, copies[visible].checksummed);
+        visible += ok ? 1 : 0;
+    }
+    for (const auto& writeFd : writeFds) {
+        ok = fdatasync(writeFd.second) == 0 && ok;
+        close(writeFd.second);
+    }
+
+    // 已写入魔数的复制记录与原记录内容相同，可以直接生效
+    for (size_t i = 0; i < visible; i++) {
+        const Location& location = live[i].second;
+        apply(live[i].first, Location{copies[i].segment, location.seq, copies[i].record, location.length,
+                                      location.recordSize, location.checksummed, location.checksum});
+    }
+    if (!ok) {
+        log_error("Unable to compact packed store segment " + segmentPath(id, ".seg") + ": " + strerror(errno));
+        // 没有魔数的记录对其他进程不可见，把记录链末尾退回到第一条这样的记录，下一次追加覆盖它们
+        for (size_t i = copies.size(); i > visible; i--) {
+            segments_[copies[i - 1].segment].end = copies[i - 1].record;
+        }
+        return false;
+    }
+
+    unlink(segmentPath(id, ".hint").c_str());
+    if (unlink(segmentPath(id, ".seg").c_str()) < 0) {
+        log_error("Unable to remove compacted segment " + segmentPath(id, ".seg") + ": " + strerror(errno));
+    }
+    log_info("Compacted packed store segment " + segmentPath(id, ".seg") + ": moved " +
+             std::to_string(copies.size()) + " object(s)");
+    segments_.erase(id);
+    return true;
+}
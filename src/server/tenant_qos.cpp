@@ -0,0 +1,378 @@
+#include "tenant_qos.hpp"
+#include "logger.hpp"
+#include <sys/mman.h>
+#include <pthread.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <memory>
+
+namespace {
+
+uint64_t nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+void sleepUs(uint64_t us) {
+    struct timespec request = {static_cast<time_t>(us / 1000000), static_cast<long>(us % 1000000) * 1000L};
+    struct timespec remaining;
+    while (nanosleep(&request, &remaining) < 0 && errno == EINTR) {
+        request = remaining;
+    }
+}
+
+// FNV-1a，用户名在表中的起始位置
+uint64_t hashName(const std::string& name) {
+    uint64_t hash = 1469598103934665603ULL;
+    for (unsigned char c : name) {
+        hash = (hash ^ c) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+size_t alignUp(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+std::unique_ptr<TenantQos> g_shared;
+
+// 当前线程正在执行的命令所属用户在共享表中的位置，-1表示不限速；命令开始时该用户是否有字节限速
+thread_local int32_t t_tenant = -1;
+thread_local bool t_bytesLimited = false;
+// 在Deferral作用域内：不睡眠，只记录令牌补回的时间。桶允许透支，每次返回的等待已包含之前欠下的令牌，
+// 因此取最晚的时间而不是把等待相加
+thread_local bool t_deferred = false;
+thread_local uint64_t t_deferredUntilNs = 0;
+
+void throttleFor(uint64_t us) {
+    if (t_deferred) {
+        t_deferredUntilNs = std::max(t_deferredUntilNs, nowNs() + us * 1000);
+    } else {
+        sleepUs(us);
+    }
+}
+
+} // namespace
+
+struct TenantQos::Header {
+    pthread_mutex_t mutex;      // PTHREAD_PROCESS_SHARED | PTHREAD_MUTEX_ROBUST
+    uint32_t capacity;
+    uint32_t count;
+};
+
+// 一个桶：tokens可以为负（透支），stampNs是上次补充令牌的时间
+struct TenantQos::Entry {
+    char username[TENANT_QOS_NAME_MAX];     // 空字符串表示空闲
+    uint64_t bytesPerSecond;
+    uint32_t opsPerSecond;
+    double byteTokens;
+    double opTokens;
+    uint64_t byteStampNs;
+    uint64_t opStampNs;
+    uint64_t bytes;
+    uint64_t ops;
+    uint64_t throttledUs;
+};
+
+TenantQos::TenantQos(size_t capacity)
+    : map_(MAP_FAILED), mapSize_(0), header_(nullptr), entries_(nullptr) {
+    if (capacity == 0) {
+        log_error("Invalid tenant QoS capacity");
+        return;
+    }
+    size_t entriesOffset = alignUp(sizeof(Header), alignof(Entry));
+    mapSize_ = entriesOffset + capacity * sizeof(Entry);
+
+    // 匿名共享映射由fork出的子进程继承，初始内容全为0（所有位置空闲）
+    map_ = mmap(nullptr, mapSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (map_ == MAP_FAILED) {
+        log_error("Unable to map tenant QoS state: " + std::string(strerror(errno)));
+        return;
+    }
+    unsigned char* base = static_cast<unsigned char*>(map_);
+    header_ = reinterpret_cast<Header*>(base);
+    entries_ = reinterpret_cast<Entry*>(base + entriesOffset);
+
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutex_init(&header_->mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    header_->capacity = static_cast<uint32_t>(capacity);
+}
+
+TenantQos::~TenantQos() {
+    if (map_ != MAP_FAILED) {
+        munmap(map_, mapSize_);
+    }
+}
+
+void TenantQos::createShared(const std::unordered_map<std::string, TenantLimits>& limits) {
+    // 开放寻址的表保持半满以内，之后新增的用户也有空间
+    size_t capacity = std::min(std::max<size_t>(64, limits.size() * 2), TENANT_QOS_MAX_TENANTS);
+    g_shared = std::make_unique<TenantQos>(capacity);
+    if (!g_shared->isAvailable()) {
+        g_shared.reset();
+        return;
+    }
+    for (const auto& pair : limits) {
+        if (!g_shared->configure(pair.first, pair.second)) {
+            log_error("Unable to rate limit user " + pair.first);
+            continue;
+        }
+        log_info("Rate limiting user " + pair.first + ": " +
+                 (pair.second.bytesPerSecond > 0 ? std::to_string(pair.second.bytesPerSecond) + " bytes/s" : "unlimited bytes") +
+                 ", " +
+                 (pair.second.opsPerSecond > 0 ? std::to_string(pair.second.opsPerSecond) + " ops/s" : "unlimited ops"));
+    }
+}
+
+TenantQos* TenantQos::shared() {
+    return g_shared.get();
+}
+
+void TenantQos::lock() {
+    int ret = pthread_mutex_lock(&header_->mutex);
+    if (ret == EOWNERDEAD) {
+        // 持锁的进程在临界区中被杀死；桶里的数值最多差一个数据块，不需要修复
+        pthread_mutex_consistent(&header_->mutex);
+    }
+}
+
+void TenantQos::unlock() {
+    pthread_mutex_unlock(&header_->mutex);
+}
+
+int32_t TenantQos::findLocked(const std::string& username, bool insert) {
+    if (username.empty() || username.size() >= TENANT_QOS_NAME_MAX) {
+        return -1;
+    }
+    uint32_t capacity = header_->capacity;
+    uint32_t start = static_cast<uint32_t>(hashName(username) % capacity);
+    // 位置只增不删，遇到空闲位置即可确定用户不在表中
+    for (uint32_t probe = 0; probe < capacity; probe++) {
+        uint32_t index = (start + probe) % capacity;
+        Entry& entry = entries_[index];
+        if (entry.username[0] == '\0') {
+            if (!insert) {
+                return -1;
+            }
+            memcpy(entry.username, username.c_str(), username.size() + 1);
+            header_->count++;
+            return static_cast<int32_t>(index);
+        }
+        if (username == entry.username) {
+            return static_cast<int32_t>(index);
+        }
+    }
+    return -1;
+}
+
+bool TenantQos::configure(const std::string& username, const TenantLimits& limits) {
+    lock();
+    bool existing = findLocked(username, false) >= 0;
+    int32_t index = existing || limits.limited() ? findLocked(username, true) : -1;
+    if (index < 0) {
+        unlock();
+        return !limits.limited();
+    }
+    Entry& entry = entries_[index];
+    uint64_t now = nowNs();
+    // 新用户从满桶开始；已有用户改限速时保留当前的令牌，避免借此清掉透支
+    if (!existing || entry.bytesPerSecond == 0) {
+        entry.byteTokens = static_cast<double>(std::max(TENANT_MIN_BYTES_BURST,
+                                                        limits.bytesPerSecond * TENANT_BYTES_BURST_MS / 1000));
+        entry.byteStampNs = now;
+    }
+    if (!existing || entry.opsPerSecond == 0) {
+        entry.opTokens = static_cast<double>(std::max<uint64_t>(1, limits.opsPerSecond * TENANT_OPS_BURST_MS / 1000));
+        entry.opStampNs = now;
+    }
+    entry.bytesPerSecond = limits.bytesPerSecond;
+    entry.opsPerSecond = limits.opsPerSecond;
+    unlock();
+    return true;
+}
+
+int32_t TenantQos::find(const std::string& username) {
+    lock();
+    int32_t index = findLocked(username, false);
+    unlock();
+    return index;
+}
+
+namespace {
+
+// 按经过的时间补充令牌（不超过桶容量），扣除amount，返回透支部分按速率补回需要的微秒数
+uint64_t takeTokens(double& tokens, uint64_t& stampNs, uint64_t rate, uint64_t burst, uint64_t amount) {
+    uint64_t now = nowNs();
+    double refill = static_cast<double>(now - stampNs) * static_cast<double>(rate) / 1e9;
+    tokens = std::min(tokens + refill, static_cast<double>(burst));
+    stampNs = now;
+    tokens -= static_cast<double>(amount);
+    return tokens < 0 ? static_cast<uint64_t>(-tokens * 1e6 / static_cast<double>(rate)) : 0;
+}
+
+} // namespace
+
+uint64_t TenantQos::acquireOps(int32_t tenant, uint32_t ops) {
+    if (tenant < 0) {
+        return 0;
+    }
+    lock();
+    Entry& entry = entries_[tenant];
+    entry.ops += ops;
+    uint64_t waitUs = 0;
+    if (entry.opsPerSecond > 0) {
+        uint64_t burst = std::max<uint64_t>(1, static_cast<uint64_t>(entry.opsPerSecond) * TENANT_OPS_BURST_MS / 1000);
+        waitUs = takeTokens(entry.opTokens, entry.opStampNs, entry.opsPerSecond, burst, ops);
+        entry.throttledUs += waitUs;
+    }
+    unlock();
+    return waitUs;
+}
+
+uint64_t TenantQos::acquireBytes(int32_t tenant, uint64_t bytes) {
+    if (tenant < 0) {
+        return 0;
+    }
+    lock();
+    Entry& entry = entries_[tenant];
+    entry.bytes += bytes;
+    uint64_t waitUs = 0;
+    if (entry.bytesPerSecond > 0) {
+        uint64_t burst = std::max(TENANT_MIN_BYTES_BURST, entry.bytesPerSecond * TENANT_BYTES_BURST_MS / 1000);
+        waitUs = takeTokens(entry.byteTokens, entry.byteStampNs, entry.bytesPerSecond, burst, bytes);
+        entry.throttledUs += waitUs;
+    }
+    unlock();
+    return waitUs;
+}
+
+bool TenantQos::bytesLimited(int32_t tenant) {
+    lock();
+    bool limited = entries_[tenant].bytesPerSecond > 0;
+    unlock();
+    return limited;
+}
+
+std::vector<TenantQos::Stats> TenantQos::stats() {
+    std::vector<Stats> result;
+    lock();
+    for (uint32_t i = 0; i < header_->capacity; i++) {
+        const Entry& entry = entries_[i];
+        if (entry.username[0] == '\0') {
+            continue;
+        }
+        Stats stats;
+        stats.username = entry.username;
+        stats.limits.bytesPerSecond = entry.bytesPerSecond;
+        stats.limits.opsPerSecond = entry.opsPerSecond;
+        stats.bytes = entry.bytes;
+        stats.ops = entry.ops;
+        stats.throttledUs = entry.throttledUs;
+        result.push_back(stats);
+    }
+    unlock();
+    return result;
+}
+
+TenantQos::Scope::Scope(const std::string& username) : previous_(t_tenant), previousBytesLimited_(t_bytesLimited) {
+    TenantQos* qos = TenantQos::shared();
+    t_tenant = qos != nullptr ? qos->find(username) : -1;
+    t_bytesLimited = false;
+    if (t_tenant >= 0) {
+        t_bytesLimited = qos->bytesLimited(t_tenant);
+        uint64_t waitUs = qos->acquireOps(t_tenant, 1);
+        if (waitUs > 0) {
+            log_debug("Throttling " + username + " for " + std::to_string(waitUs) + "us (ops)");
+            throttleFor(waitUs);
+        }
+    }
+}
+
+TenantQos::Scope::~Scope() {
+    t_tenant = previous_;
+    t_bytesLimited = previousBytesLimited_;
+}
+
+void TenantQos::charge(size_t bytes) {
+    if (!t_bytesLimited || bytes == 0) {
+        return;
+    }
+    uint64_t waitUs = g_shared->acquireBytes(t_tenant, bytes);
+    if (waitUs > 0) {
+        throttleFor(waitUs);
+    }
+}
+
+TenantQos::Deferral::Deferral() : previous_(t_deferred), previousUntilNs_(t_deferredUntilNs) {
+    t_deferred = true;
+    t_deferredUntilNs = 0;
+}
+
+TenantQos::Deferral::~Deferral() {
+    t_deferred = previous_;
+    t_deferredUntilNs = previousUntilNs_;
+}
+
+uint64_t TenantQos::Deferral::takeUs() {
+    uint64_t now = nowNs();
+    uint64_t us = t_deferredUntilNs > now ? (t_deferredUntilNs - now) / 1000 : 0;
+    t_deferredUntilNs = 0;
+    return us;
+}
+
+bool TenantQos::throttled() {
+    return t_bytesLimited;
+}
+
+bool TenantQos::parseLimit(const std::string& token, TenantLimits& limits) {
+    size_t equals = token.find('=');
+    if (equals == std::string::npos || equals + 1 >= token.size()) {
+        return false;
+    }
+    std::string key = token.substr(0, equals);
+    std::string value = token.substr(equals + 1);
+
+    size_t digits = 0;
+    while (digits < value.size() && value[digits] >= '0' && value[digits] <= '9') {
+        digits++;
+    }
+    if (digits == 0 || digits > 18) {
+        return false;
+    }
+    uint64_t number = std::stoull(value.substr(0, digits));
+    std::string suffix = value.substr(digits);
+
+    if (key == "bandwidth") {
+        uint64_t unit = 1;
+        if (suffix == "K" || suffix == "k") {
+            unit = 1024ULL;
+        } else if (suffix == "M" || suffix == "m") {
+            unit = 1024ULL * 1024;
+        } else if (suffix == "G" || suffix == "g") {
+            unit = 1024ULL * 1024 * 1024;
+        } else if (!suffix.empty()) {
+            return false;
+        }
+        if (number > UINT64_MAX / unit) {
+            return false;
+        }
+        limits.bytesPerSecond = number * unit;
+        return true;
+    }
+    if (key == "ops") {
+        if (!suffix.empty() || number > UINT32_MAX) {
+            return false;
+        }
+        limits.opsPerSecond = static_cast<uint32_t>(number);
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,467 @@
+#include "wal.hpp"
+#include "dir_index.hpp"
+#include "logger.hpp"
+#include "metrics.hpp"
+#include "object_io.hpp"
+#include "packed_store.hpp"
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <map>
+#include <memory>
+
+namespace {
+
+constexpr uint32_t RECORD_MAGIC = 0x4C415744;   // "DWAL"
+constexpr size_t RECORD_HEADER_SIZE = 3 * sizeof(uint32_t);
+constexpr size_t ENTRY_FIXED_SIZE = 2 + 2 * sizeof(uint16_t) + sizeof(int32_t) + sizeof(uint64_t) +
+                                    sizeof(uint32_t) + sizeof(uint64_t);
+constexpr unsigned char ENTRY_FILE = 'F';
+constexpr unsigned char ENTRY_PACKED = 'P';
+constexpr off_t APPEND_LOCK_BYTE = 0;           // 日志头上的两个字节分别作为追加锁和同步锁
+constexpr off_t SYNC_LOCK_BYTE = 1;
+constexpr long WAL_WAIT_TIMEOUT_NS = 100 * 1000 * 1000;
+
+std::mutex g_logsMutex;
+std::map<std::string, std::unique_ptr<WriteAheadLog>> g_logs;
+pid_t g_logsPid = 0;
+
+// 日志头某个字节上的OFD写锁：不同进程、同一进程中不同的打开文件描述之间互斥
+class RangeLock {
+public:
+    RangeLock(int fd, off_t byte, bool wait = true) : fd_(fd), byte_(byte), held_(false) {
+        if (wait) {
+            while (!(held_ = setLock(F_WRLCK, F_OFD_SETLKW)) && errno == EINTR) {
+            }
+        } else {
+            held_ = setLock(F_WRLCK, F_OFD_SETLK);
+        }
+    }
+    ~RangeLock() {
+        if (held_) {
+            setLock(F_UNLCK, F_OFD_SETLK);
+        }
+    }
+    RangeLock(const RangeLock&) = delete;
+    RangeLock& operator=(const RangeLock&) = delete;
+
+    bool held() const { return held_; }
+
+private:
+    bool setLock(short type, int command) {
+        struct flock lock;
+        memset(&lock, 0, sizeof(lock));
+        lock.l_type = type;
+        lock.l_whence = SEEK_SET;
+        lock.l_start = byte_;
+        lock.l_len = 1;
+        return fcntl(fd_, command, &lock) == 0;
+    }
+
+    int fd_;
+    off_t byte_;
+    bool held_;
+};
+
+template <typename T>
+void appendValue(std::vector<unsigned char>& buffer, T value) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&value);
+    buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+template <typename T>
+T readValue(const unsigned char* data) {
+    T value;
+    memcpy(&value, data, sizeof(T));
+    return value;
+}
+
+bool preadFull(int fd, unsigned char* data, size_t length, uint64_t offset) {
+    size_t got = 0;
+    while (got < length) {
+        ssize_t n = pread(fd, data + got, length - got, static_cast<off_t>(offset + got));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        got += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+bool pwriteFull(int fd, const unsigned char* data, size_t length, uint64_t offset) {
+    size_t written = 0;
+    while (written < length) {
+        ssize_t n = pwrite(fd, data + written, length - written, static_cast<off_t>(offset + written));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        written += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// FNV-1a，用于识别崩溃时只写了一部分的记录
+uint32_t checksum(const unsigned char* data, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= data[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// 共享映射中的字段由多个进程读写，统一用原子操作访问
+uint64_t loadShared(const uint64_t& value) {
+    return __atomic_load_n(&value, __ATOMIC_ACQUIRE);
+}
+
+void storeShared(uint64_t& value, uint64_t newValue) {
+    __atomic_store_n(&value, newValue, __ATOMIC_RELEASE);
+}
+
+} // namespace
+
+struct WriteAheadLog::Header {
+    char magic[8];
+    uint64_t checkpoint;    // 此前的记录都已生效并落盘，恢复从这里开始
+    uint64_t appendEnd;     // 运行时：下一条记录的偏移
+    uint64_t durable;       // 运行时：此前的记录都已同步并生效
+    uint64_t failed;        // 运行时：同步失败后置1，直到重启恢复
+    uint32_t generation;    // 运行时：每次同步结束加1，等待中的PUT在这个futex上睡眠
+};
+
+WriteAheadLog::WriteAheadLog(const std::string& rootPath, uint64_t checkpointBytes)
+    : rootPath_(rootPath), walPath_(rootPath + "/" + WAL_FILE), checkpointBytes_(checkpointBytes),
+      fd_(open(walPath_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644)), header_(nullptr),
+      commits_(0), syncs_(0) {
+    if (fd_ < 0) {
+        log_error("Unable to open write-ahead log " + walPath_ + ": " + strerror(errno));
+        return;
+    }
+
+    // 与其他进程的初始化和提交互斥
+    RangeLock appendLock(fd_, APPEND_LOCK_BYTE);
+    RangeLock syncLock(fd_, SYNC_LOCK_BYTE);
+    struct stat st;
+    if (fstat(fd_, &st) < 0 ||
+        (static_cast<uint64_t>(st.st_size) < WAL_HEADER_SIZE && ftruncate(fd_, WAL_HEADER_SIZE) < 0)) {
+        log_error("Unable to initialize write-ahead log " + walPath_ + ": " + strerror(errno));
+        close(fd_);
+        fd_ = -1;
+        return;
+    }
+    void* mapping = mmap(nullptr, WAL_HEADER_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (mapping == MAP_FAILED) {
+        log_error("Unable to map write-ahead log " + walPath_ + ": " + strerror(errno));
+        close(fd_);
+        fd_ = -1;
+        return;
+    }
+    header_ = static_cast<Header*>(mapping);
+    if (memcmp(header_->magic, WAL_MAGIC, sizeof(WAL_MAGIC)) != 0) {
+        memset(header_, 0, sizeof(Header));
+        header_->checkpoint = WAL_HEADER_SIZE;
+        header_->appendEnd = WAL_HEADER_SIZE;
+        header_->durable = WAL_HEADER_SIZE;
+        memcpy(header_->magic, WAL_MAGIC, sizeof(WAL_MAGIC));
+        fdatasync(fd_);
+    }
+}
+
+WriteAheadLog::~WriteAheadLog() {
+    if (header_ != nullptr) {
+        munmap(header_, WAL_HEADER_SIZE);
+    }
+    if (fd_ >= 0) {
+        close(fd_);
+    }
+}
+
+WriteAheadLog& WriteAheadLog::forRoot(const std::string& rootPath) {
+    std::lock_guard<std::mutex> lock(g_logsMutex);
+    if (g_logsPid != getpid()) {
+        // fork出的子进程与父进程共享打开文件描述，OFD锁无法区分它们，子进程重新打开日志
+        g_logs.clear();
+        g_logsPid = getpid();
+    }
+    auto& wal = g_logs[rootPath];
+    if (!wal) {
+        wal = std::make_unique<WriteAheadLog>(rootPath);
+    }
+    return *wal;
+}
+
+bool WriteAheadLog::commit(const std::vector<Entry>& entries, int windowUs) {
+    if (header_ == nullptr) {
+        return false;
+    }
+
+    std::vector<unsigned char> payload;
+    appendValue<uint32_t>(payload, static_cast<uint32_t>(entries.size()));
+    for (const Entry& entry : entries) {
+        if (entry.folder.compare(0, rootPath_.size(), rootPath_) != 0 || entry.folder.size() <= rootPath_.size() ||
+            entry.folder[rootPath_.size()] != '/') {
+            log_error("Object folder " + entry.folder + " is outside of " + rootPath_);
+            return false;
+        }
+        std::string folder = entry.folder.substr(rootPath_.size() + 1);
+        payload.push_back(entry.packed ? ENTRY_PACKED : ENTRY_FILE);
+        payload.push_back(0);
+        appendValue<uint16_t>(payload, static_cast<uint16_t>(folder.size()));
+        appendValue<uint16_t>(payload, static_cast<uint16_t>(entry.fileName.size()));
+        appendValue<int32_t>(payload, entry.objectId);
+        appendValue<uint64_t>(payload, entry.size);
+        appendValue<uint32_t>(payload, entry.segment);
+        appendValue<uint64_t>(payload, entry.record);
+        payload.insert(payload.end(), folder.begin(), folder.end());
+        payload.insert(payload.end(), entry.fileName.begin(), entry.fileName.end());
+    }
+
+    std::vector<unsigned char> record;
+    record.reserve(RECORD_HEADER_SIZE + payload.size());
+    appendValue<uint32_t>(record, RECORD_MAGIC);
+    appendValue<uint32_t>(record, static_cast<uint32_t>(payload.size()));
+    appendValue<uint32_t>(record, checksum(payload.data(), payload.size()));
+    record.insert(record.end(), payload.begin(), payload.end());
+
+    uint64_t end;
+    return appendRecord(record, end) && waitDurable(end, windowUs);
+}
+
+bool WriteAheadLog::appendRecord(const std::vector<unsigned char>& record, uint64_t& end) {
+    std::lock_guard<std::mutex> lock(appendMutex_);
+    RangeLock appendLock(fd_, APPEND_LOCK_BYTE);
+    // 追加位置只在整条记录写完后前移，崩溃时写了一半的记录会被下一次追加覆盖
+    uint64_t offset = loadShared(header_->appendEnd);
+    if (!pwriteFull(fd_, record.data(), record.size(), offset)) {
+        log_error("Unable to append to write-ahead log " + walPath_ + ": " + strerror(errno));
+        return false;
+    }
+    end = offset + record.size();
+    storeShared(header_->appendEnd, end);
+    commits_++;
+    return true;
+}
+
+bool WriteAheadLog::waitDurable(uint64_t end, int windowUs) {
+    while (true) {
+        // 先读代数再检查位置：领导者发布位置后才增加代数，睡眠前的检查不会错过唤醒
+        uint32_t generation = __atomic_load_n(&header_->generation, __ATOMIC_ACQUIRE);
+        if (loadShared(header_->durable) >= end) {
+            return true;
+        }
+        if (loadShared(header_->failed) != 0) {
+            return false;
+        }
+        {
+            std::unique_lock<std::mutex> lock(syncMutex_, std::try_to_lock);
+            if (lock.owns_lock()) {
+                RangeLock syncLock(fd_, SYNC_LOCK_BYTE, false);
+                if (syncLock.held()) {
+                    if (loadShared(header_->durable) < end) {
+                        syncLocked(windowUs);
+                    }
+                    continue;
+                }
+            }
+        }
+        // 其他连接（或进程）正在同步，等它发布新的位置后再检查；超时用于领导者进程崩溃的情况
+        struct timespec timeout = {0, WAL_WAIT_TIMEOUT_NS};
+        syscall(SYS_futex, &header_->generation, FUTEX_WAIT, generation, &timeout, nullptr, 0);
+    }
+}
+
+void WriteAheadLog::syncLocked(int windowUs) {
+    // 成为领导者：等待提交窗口内的其他PUT追加记录，一次同步覆盖它们
+    if (windowUs > 0) {
+        usleep(static_cast<useconds_t>(windowUs));
+    }
+    uint64_t start = loadShared(header_->durable);
+    uint64_t batchEnd = loadShared(header_->appendEnd);
+    // syncfs同时落盘各进程写入的对象数据、新建的临时文件和日志记录
+    int synced;
+    {
+        Metrics::Timer timer(MetricStage::DISK_SYNC);
+        synced = syncfs(fd_);
+    }
+    if (synced < 0) {
+        // 写回失败后页缓存中的数据可能已经丢失，再次同步也可能错误地返回成功，因此此后不再确认PUT
+        log_error("Write-ahead log sync failed, rejecting PUTs until restart: " + std::string(strerror(errno)));
+        storeShared(header_->failed, 1);
+    } else {
+        syncs_++;
+        size_t records = 0;
+        uint64_t applied = applyRecords(start, batchEnd, records);
+        storeShared(header_->durable, applied);
+        if (applied < batchEnd) {
+            log_error("Corrupt write-ahead log record at " + std::to_string(applied) + " in " + walPath_);
+            storeShared(header_->failed, 1);
+        } else {
+            log_debug("Group commit of " + std::to_string(records) + " WAL record(s)");
+            // 此前的记录已在更早的同步之后生效，本次同步让这些生效操作也落了盘
+            checkpointLocked(start);
+        }
+    }
+    __atomic_add_fetch(&header_->generation, 1, __ATOMIC_RELEASE);
+    syscall(SYS_futex, &header_->generation, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+}
+
+uint64_t WriteAheadLog::applyRecords(uint64_t start, uint64_t end, size_t& records) {
+    std::vector<unsigned char> data(end - start);
+    if (data.empty() || !preadFull(fd_, data.data(), data.size(), start)) {
+        return start;
+    }
+
+    size_t pos = 0;
+    while (data.size() - pos >= RECORD_HEADER_SIZE) {
+        const unsigned char* header = data.data() + pos;
+        uint32_t length = readValue<uint32_t>(header + 4);
+        if (readValue<uint32_t>(header) != RECORD_MAGIC || length > data.size() - pos - RECORD_HEADER_SIZE ||
+            length < sizeof(uint32_t)) {
+            break;
+        }
+        const unsigned char* payload = header + RECORD_HEADER_SIZE;
+        if (readValue<uint32_t>(header + 8) != checksum(payload, length)) {
+            break;
+        }
+
+        std::vector<Entry> entries;
+        uint32_t count = readValue<uint32_t>(payload);
+        size_t offset = sizeof(uint32_t);
+        bool valid = true;
+        for (uint32_t i = 0; i < count && valid; i++) {
+            if (length - offset < ENTRY_FIXED_SIZE) {
+                valid = false;
+                break;
+            }
+            const unsigned char* fields = payload + offset;
+            uint16_t folderLength = readValue<uint16_t>(fields + 2);
+            uint16_t nameLength = readValue<uint16_t>(fields + 4);
+            offset += ENTRY_FIXED_SIZE;
+            if (length - offset < static_cast<size_t>(folderLength) + nameLength) {
+                valid = false;
+                break;
+            }
+            Entry entry;
+            entry.packed = fields[0] == ENTRY_PACKED;
+            entry.objectId = readValue<int32_t>(fields + 6);
+            entry.size = readValue<uint64_t>(fields + 10);
+            entry.segment = readValue<uint32_t>(fields + 18);
+            entry.record = readValue<uint64_t>(fields + 22);
+            entry.folder = rootPath_ + "/" + std::string(reinterpret_cast<const char*>(payload + offset), folderLength);
+            offset += folderLength;
+            entry.fileName.assign(reinterpret_cast<const char*>(payload + offset), nameLength);
+            offset += nameLength;
+            entries.push_back(std::move(entry));
+        }
+        if (!valid) {
+            break;
+        }
+
+        for (const Entry& entry : entries) {
+            applyEntry(entry);
+        }
+        pos += RECORD_HEADER_SIZE + length;
+        records++;
+    }
+    return start + pos;
+}
+
+void WriteAheadLog::applyEntry(const Entry& entry) {
+    std::string objectFile = ObjectIoBackend::objectPath(entry.folder, entry.fileName, entry.objectId);
+    if (entry.packed) {
+        if (!PackedStore::forRoot(rootPath_).markCommitted(entry.segment, entry.record)) {
+            log_error("Packed store record of " + objectFile + " was abandoned before commit");
+            return;
+        }
+    } else {
+        std::string partial = ObjectIoBackend::partialPath(objectFile);
+        struct stat st;
+        if (stat(partial.c_str(), &st) == 0 && static_cast<uint64_t>(st.st_size) == entry.size) {
+            if (rename(partial.c_str(), objectFile.c_str()) < 0) {
+                log_error("Unable to commit object file " + objectFile + ": " + strerror(errno));
+                return;
+            }
+        } else if (stat(objectFile.c_str(), &st) < 0 || static_cast<uint64_t>(st.st_size) != entry.size) {
+            // 恢复时重放的记录此前已经生效，之后对象又被覆盖
+            log_debug("Skipping write-ahead log record of " + objectFile);
+            return;
+        }
+    }
+    DirIndex::forDirectory(entry.folder)->recordObject(entry.fileName, entry.objectId, entry.size);
+}
+
+void WriteAheadLog::checkpointLocked(uint64_t applied) {
+    uint64_t checkpoint = loadShared(header_->checkpoint);
+    if (applied < checkpoint + checkpointBytes_) {
+        return;
+    }
+    // 先让新的检查点落盘再释放之前的空间，恢复时不会读到被释放的区域
+    storeShared(header_->checkpoint, applied);
+    if (fdatasync(fd_) < 0) {
+        log_error("Unable to persist write-ahead log checkpoint: " + std::string(strerror(errno)));
+        return;
+    }
+    // 偏移只增不减，已生效的记录以文件空洞的形式释放；重启恢复后日志从头开始
+    // 按页对齐，不完整的块只会被清零而不会释放；上次未释放的页尾在这次一起释放
+    uint64_t holeStart = checkpoint / WAL_HEADER_SIZE * WAL_HEADER_SIZE;
+    uint64_t holeEnd = applied / WAL_HEADER_SIZE * WAL_HEADER_SIZE;
+    if (holeEnd > holeStart &&
+        fallocate(fd_, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, static_cast<off_t>(holeStart),
+                  static_cast<off_t>(holeEnd - holeStart)) < 0) {
+        log_debug("Unable to release write-ahead log space: " + std::string(strerror(errno)));
+    }
+}
+
+size_t WriteAheadLog::recover() {
+    if (header_ == nullptr) {
+        return 0;
+    }
+    std::lock_guard<std::mutex> appendLock(appendMutex_);
+    std::lock_guard<std::mutex> syncLock(syncMutex_);
+    RangeLock appendRange(fd_, APPEND_LOCK_BYTE);
+    RangeLock syncRange(fd_, SYNC_LOCK_BYTE);
+
+    struct stat st;
+    if (fstat(fd_, &st) < 0) {
+        return 0;
+    }
+    size_t records = 0;
+    uint64_t checkpoint = loadShared(header_->checkpoint);
+    if (static_cast<uint64_t>(st.st_size) > checkpoint) {
+        applyRecords(checkpoint, static_cast<uint64_t>(st.st_size), records);
+    }
+    // 重做的rename和目录索引落盘之后日志不再需要；同步失败时保留日志，下次启动再重做
+    if (records > 0 && syncfs(fd_) < 0) {
+        log_error("Unable to sync recovered objects: " + std::string(strerror(errno)));
+        return records;
+    }
+    if (ftruncate(fd_, WAL_HEADER_SIZE) < 0) {
+        log_error("Unable to truncate write-ahead log " + walPath_ + ": " + strerror(errno));
+        return records;
+    }
+    storeShared(header_->checkpoint, WAL_HEADER_SIZE);
+    storeShared(header_->appendEnd, WAL_HEADER_SIZE);
+    storeShared(header_->durable, WAL_HEADER_SIZE);
+    storeShared(header_->failed, 0);
+    fdatasync(fd_);
+    return records;
+}
+
+WriteAheadLog::Stats WriteAheadLog::stats() {
+    std::lock_guard<std::mutex> appendLock(appendMutex_);
+    std::lock_guard<std::mutex> syncLock(syncMutex_);
+    return Stats{commits_, syncs_};
+}
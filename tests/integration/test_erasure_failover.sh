@@ -0,0 +1,88 @@
+#!/bin/bash
+# 纠删码2+4，6个服务器：杀掉保存对象0的分段0-3的m个服务器后GET仍能恢复文件
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+PROJECT_DIR="$(cd "$SCRIPT_DIR/../.." && pwd)"
+cd "$PROJECT_DIR"
+
+SERVERS=6
+BASE_PORT=10100
+CONF="$(mktemp /tmp/dfc_erasure.XXXXXX)"
+PIDS=()
+
+cleanup() {
+    for pid in "${PIDS[@]}"; do
+        kill "$pid" 2>/dev/null
+    done
+    wait 2>/dev/null
+    rm -f "$CONF" "$SCRIPT_DIR/erasure_source.bin" "$SCRIPT_DIR/downloaded_erasure.bin"
+    rm -rf server/EC*
+}
+trap cleanup EXIT
+
+rm -rf server/EC*
+for i in $(seq 1 $SERVERS); do
+    mkdir -p server/EC$i
+    bin/dfs server/EC$i $((BASE_PORT + i)) --no-debug > /dev/null 2>&1 &
+    PIDS[$i]=$!
+done
+sleep 2
+
+{
+    for i in $(seq 1 $SERVERS); do
+        echo "Server EC$i 127.0.0.1:$((BASE_PORT + i))"
+    done
+    echo ""
+    echo "Username: Bob"
+    echo "Password: ComplextPassword"
+    echo "EncryptionType: AES_256_CTR"
+    echo "ErasureCoding: 2+4"
+} > "$CONF"
+
+# 3个4MB对象，共18个分段
+head -c 10000000 /dev/urandom > "$SCRIPT_DIR/erasure_source.bin"
+{
+    sleep 1
+    echo "PUT $SCRIPT_DIR/erasure_source.bin /erasure.bin"
+    sleep 5
+    echo "EXIT"
+} | timeout 20s bin/dfc "$CONF" > /dev/null 2>&1
+
+VICTIMS=()
+for fragment in 0 1 2 3; do
+    for i in $(seq 1 $SERVERS); do
+        if [ -f "server/EC$i/Bob/.erasure.bin.$fragment" ]; then
+            VICTIMS+=($i)
+        fi
+    done
+done
+if [ ${#VICTIMS[@]} -ne 4 ]; then
+    echo "Erasure failover test failed: fragments 0-3 found on ${#VICTIMS[@]} servers"
+    exit 1
+fi
+for i in "${VICTIMS[@]}"; do
+    kill "${PIDS[$i]}"
+done
+echo "Stopped servers holding fragments 0-3: ${VICTIMS[*]}"
+sleep 1
+
+OUTPUT=$({
+    sleep 1
+    echo "LIST /"
+    sleep 2
+    echo "GET /erasure.bin $SCRIPT_DIR/downloaded_erasure.bin"
+    sleep 6
+    echo "EXIT"
+} | timeout 20s bin/dfc "$CONF" 2>&1)
+
+if echo "$OUTPUT" | grep -q "erasure.bin \[INCOMPLETE\]"; then
+    echo "Erasure failover test failed: LIST reports the file incomplete"
+    exit 1
+fi
+if cmp -s "$SCRIPT_DIR/erasure_source.bin" "$SCRIPT_DIR/downloaded_erasure.bin"; then
+    echo "Erasure failover test successful!"
+else
+    echo "Erasure failover test failed!"
+    echo "$OUTPUT" | grep "<<<"
+    exit 1
+fi
@@ -0,0 +1,89 @@
+#!/bin/bash
+# 没有元数据对象的文件（本系列之前上传的文件）：LIST不标为[INCOMPLETE]，GET按从0开始连续的对象读取
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+PROJECT_DIR="$(cd "$SCRIPT_DIR/../.." && pwd)"
+cd "$PROJECT_DIR"
+
+SERVERS=4
+BASE_PORT=10110
+CONF="$(mktemp /tmp/dfc_legacy.XXXXXX)"
+PIDS=()
+
+start_servers() {
+    for i in $(seq 1 $SERVERS); do
+        mkdir -p server/LG$i
+        bin/dfs server/LG$i $((BASE_PORT + i)) --no-debug > /dev/null 2>&1 &
+        PIDS[$i]=$!
+    done
+    sleep 2
+}
+
+stop_servers() {
+    for pid in "${PIDS[@]}"; do
+        kill "$pid" 2>/dev/null
+    done
+    wait 2>/dev/null
+    PIDS=()
+}
+
+cleanup() {
+    stop_servers
+    rm -f "$CONF" "$SCRIPT_DIR/legacy_source.bin" "$SCRIPT_DIR/downloaded_legacy.bin"
+    rm -rf server/LG*
+}
+trap cleanup EXIT
+
+rm -rf server/LG*
+start_servers
+
+{
+    for i in $(seq 1 $SERVERS); do
+        echo "Server LG$i 127.0.0.1:$((BASE_PORT + i))"
+    done
+    echo ""
+    echo "Username: Bob"
+    echo "Password: ComplextPassword"
+    echo "EncryptionType: AES_256_CTR"
+} > "$CONF"
+
+# 3个4MB对象
+head -c 10000000 /dev/urandom > "$SCRIPT_DIR/legacy_source.bin"
+{
+    sleep 1
+    echo "PUT $SCRIPT_DIR/legacy_source.bin /legacy.bin"
+    sleep 5
+    echo "EXIT"
+} | timeout 20s bin/dfc "$CONF" > /dev/null 2>&1
+
+# 删除元数据对象，索引在服务器重启后从目录重建，得到与旧客户端上传的文件相同的布局
+stop_servers
+MANIFESTS=$(find server/LG* -name ".legacy.bin.1073741824" | wc -l)
+if [ "$MANIFESTS" -eq 0 ]; then
+    echo "Legacy GET test failed: no metadata object was written"
+    exit 1
+fi
+find server/LG* -name ".legacy.bin.1073741824" -delete
+find server/LG* -name ".dfs.index" -delete
+start_servers
+
+OUTPUT=$({
+    sleep 1
+    echo "LIST /"
+    sleep 2
+    echo "GET /legacy.bin $SCRIPT_DIR/downloaded_legacy.bin"
+    sleep 6
+    echo "EXIT"
+} | timeout 20s bin/dfc "$CONF" 2>&1)
+
+if echo "$OUTPUT" | grep -q "legacy.bin \[INCOMPLETE\]"; then
+    echo "Legacy GET test failed: LIST reports the file incomplete"
+    exit 1
+fi
+if cmp -s "$SCRIPT_DIR/legacy_source.bin" "$SCRIPT_DIR/downloaded_legacy.bin"; then
+    echo "Legacy GET test successful!"
+else
+    echo "Legacy GET test failed!"
+    echo "$OUTPUT" | grep "<<<"
+    exit 1
+fi
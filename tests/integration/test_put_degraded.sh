@@ -0,0 +1,109 @@
+#!/bin/bash
+# 部分服务器停止时PUT：两个副本、4个服务器中2个停止时副本改放到在线服务器上，
+# 全部服务器恢复后GET得到相同的文件；纠删码2+2只剩1个服务器时PUT失败
+
+SCRIPT_DIR="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+PROJECT_DIR="$(cd "$SCRIPT_DIR/../.." && pwd)"
+cd "$PROJECT_DIR"
+
+SERVERS=4
+BASE_PORT=10120
+CONF="$(mktemp /tmp/dfc_degraded.XXXXXX)"
+PIDS=()
+
+start_server() {
+    mkdir -p server/PD$1
+    bin/dfs server/PD$1 $((BASE_PORT + $1)) --no-debug > /dev/null 2>&1 &
+    PIDS[$1]=$!
+}
+
+cleanup() {
+    for pid in "${PIDS[@]}"; do
+        kill "$pid" 2>/dev/null
+    done
+    wait 2>/dev/null
+    rm -f "$CONF" "$SCRIPT_DIR/degraded_source.bin" "$SCRIPT_DIR/downloaded_degraded.bin"
+    rm -rf server/PD*
+}
+trap cleanup EXIT
+
+write_conf() {
+    {
+        for i in $(seq 1 $SERVERS); do
+            echo "Server PD$i 127.0.0.1:$((BASE_PORT + i))"
+        done
+        echo ""
+        echo "Username: Bob"
+        echo "Password: ComplextPassword"
+        echo "EncryptionType: AES_256_CTR"
+        echo "$1"
+    } > "$CONF"
+}
+
+rm -rf server/PD*
+start_server 1
+start_server 2
+sleep 2
+
+# 3个4MB对象，服务器3和4停止
+write_conf "Replicas: 2"
+head -c 10000000 /dev/urandom > "$SCRIPT_DIR/degraded_source.bin"
+OUTPUT=$({
+    sleep 1
+    echo "PUT $SCRIPT_DIR/degraded_source.bin /degraded.bin"
+    sleep 5
+    echo "EXIT"
+} | timeout 20s bin/dfc "$CONF" 2>&1)
+if ! echo "$OUTPUT" | grep -q "File uploaded successfully"; then
+    echo "Degraded PUT test failed: PUT with 2 of 4 servers up did not succeed"
+    echo "$OUTPUT" | grep "<<<"
+    exit 1
+fi
+for obj in 0 1 2; do
+    COPIES=$(find server/PD* -name ".degraded.bin.$obj" | wc -l)
+    if [ "$COPIES" -ne 2 ]; then
+        echo "Degraded PUT test failed: object $obj stored on $COPIES servers, expected 2"
+        exit 1
+    fi
+done
+
+# 服务器恢复后，原来的副本服务器没有这些对象，GET从接替的服务器读取
+start_server 3
+start_server 4
+sleep 2
+OUTPUT=$({
+    sleep 1
+    echo "GET /degraded.bin $SCRIPT_DIR/downloaded_degraded.bin"
+    sleep 6
+    echo "EXIT"
+} | timeout 20s bin/dfc "$CONF" 2>&1)
+if ! cmp -s "$SCRIPT_DIR/degraded_source.bin" "$SCRIPT_DIR/downloaded_degraded.bin"; then
+    echo "Degraded PUT test failed: GET after the servers came back differs"
+    echo "$OUTPUT" | grep "<<<"
+    exit 1
+fi
+
+# 纠删码2+2：只剩1个服务器时每个对象最多保存1个分段，PUT必须失败而不是报告成功
+for i in 2 3 4; do
+    kill "${PIDS[$i]}"
+    unset "PIDS[$i]"
+done
+sleep 1
+write_conf "ErasureCoding: 2+2"
+OUTPUT=$({
+    sleep 1
+    echo "PUT $SCRIPT_DIR/degraded_source.bin /lost.bin"
+    sleep 5
+    echo "EXIT"
+} | timeout 20s bin/dfc "$CONF" 2>&1)
+if echo "$OUTPUT" | grep -q "File uploaded successfully" || ! echo "$OUTPUT" | grep -q "cannot be stored"; then
+    echo "Degraded PUT test failed: PUT with too few servers up was not rejected"
+    echo "$OUTPUT" | grep "<<<"
+    exit 1
+fi
+if find server/PD* -name ".lost.bin.*" | grep -q .; then
+    echo "Degraded PUT test failed: a rejected PUT left objects behind"
+    exit 1
+fi
+
+echo "Degraded PUT test successful!"
@@ -0,0 +1,279 @@
+// 对象I/O后端基准测试：比较阻塞路径与io_uring路径的吞吐量和每个对象的系统调用次数
+//
+// 吞吐量：服务器侧后端在socketpair一端收发对象，另一端由独立进程作为客户端
+// 系统调用：在被ptrace跟踪的子进程中执行同样的负载，统计系统调用进入/退出次数，
+//           减去不执行任何对象操作时的基线后除以对象数
+// --direct时每种后端再以O_DIRECT（全部对象都不小于阈值）各测一次，GET每次都从磁盘读取
+//
+// 用法: bench_io [--iterations N] [--direct] [size_kb ...]
+#include "object_io.hpp"
+#include "netutils.hpp"
+#include "logger.hpp"
+#include <sys/ptrace.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+enum class BenchOp { GET, PUT };
+
+struct BenchResult {
+    double mbPerSec;
+    double syscallsPerObject;
+};
+
+std::string g_workDir;
+uint64_t g_directThreshold = 0;     // 当前测试行使用的直接I/O阈值
+
+const char* opName(BenchOp op) {
+    return op == BenchOp::GET ? "GET" : "PUT";
+}
+
+void writeObjectFile(const std::string& path, size_t size) {
+    std::vector<char> data(size);
+    for (size_t i = 0; i < size; i++) {
+        data[i] = static_cast<char>(i * 131 + 7);
+    }
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    file.write(data.data(), static_cast<std::streamsize>(data.size()));
+}
+
+// 客户端进程：GET时读走所有对象，PUT时发送所有对象
+void runPeer(int socket, BenchOp op, size_t size, int iterations) {
+    try {
+        if (op == BenchOp::GET) {
+            std::vector<unsigned char> content;
+            for (int i = 0; i < iterations; i++) {
+                int splitId, contentLength;
+                NetUtils::recvSplitHeader(socket, splitId, contentLength);
+                content.resize(static_cast<size_t>(contentLength));
+                if (!content.empty()) {
+                    NetUtils::recvFromSocket(socket, content);
+                }
+            }
+        } else {
+            std::vector<unsigned char> content(size, 0x5a);
+            for (int i = 0; i < iterations; i++) {
+                std::vector<unsigned char> header;
+                NetUtils::encodeSplitHeader(header, 1, static_cast<int>(size));
+                NetUtils::sendToSocket(socket, header);
+                NetUtils::sendToSocket(socket, content);
+            }
+        }
+    } catch (const std::exception& e) {
+        fprintf(stderr, "peer: %s\n", e.what());
+        _exit(1);
+    }
+    _exit(0);
+}
+
+// 数据路径中的调试输出会淹没结果表格，负载执行期间将其丢弃
+class QuietStreams {
+public:
+    QuietStreams() : null_("/dev/null"), out_(std::cout.rdbuf(null_.rdbuf())), err_(std::cerr.rdbuf(null_.rdbuf())) {}
+    ~QuietStreams() {
+        std::cout.rdbuf(out_);
+        std::cerr.rdbuf(err_);
+    }
+
+private:
+    std::ofstream null_;
+    std::streambuf* out_;
+    std::streambuf* err_;
+};
+
+// 在当前进程中执行iterations次对象操作，客户端在独立进程中运行（不被跟踪）
+void runWorkload(DfsIoBackend type, BenchOp op, size_t size, int iterations) {
+    QuietStreams quiet;
+    // 先创建后端，使io_uring_setup等一次性开销落在基线中
+    std::unique_ptr<ObjectIoBackend> backend = ObjectIoBackend::create(type, g_directThreshold);
+
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+        fprintf(stderr, "socketpair: %s\n", strerror(errno));
+        exit(1);
+    }
+
+    pid_t peer = fork();
+    if (peer == 0) {
+        close(fds[0]);
+        runPeer(fds[1], op, size, iterations);
+    }
+    close(fds[1]);
+
+    std::string objectFile = ObjectIoBackend::objectPath(g_workDir, "bench", 1);
+    for (int i = 0; i < iterations; i++) {
+        if (op == BenchOp::GET) {
+            backend->sendObject(fds[0], 1, objectFile);
+        } else {
+            backend->recvObject(fds[0], g_workDir, "bench");
+        }
+    }
+
+    close(fds[0]);
+    int status;
+    waitpid(peer, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "peer process failed\n");
+        exit(1);
+    }
+}
+
+double measureThroughput(DfsIoBackend type, BenchOp op, size_t size, int iterations) {
+    auto start = std::chrono::steady_clock::now();
+    runWorkload(type, op, size, iterations);
+    auto end = std::chrono::steady_clock::now();
+    double seconds = std::chrono::duration<double>(end - start).count();
+    return static_cast<double>(size) * iterations / (1024.0 * 1024.0) / seconds;
+}
+
+// 统计子进程执行负载期间的系统调用次数，失败时返回-1
+long countSyscalls(DfsIoBackend type, BenchOp op, size_t size, int iterations) {
+    pid_t child = fork();
+    if (child == 0) {
+        if (ptrace(PTRACE_TRACEME, 0, nullptr, nullptr) < 0) {
+            _exit(2);
+        }
+        raise(SIGSTOP);
+        runWorkload(type, op, size, iterations);
+        _exit(0);
+    }
+
+    int status;
+    waitpid(child, &status, 0);
+    if (!WIFSTOPPED(status)) {
+        return -1;
+    }
+    ptrace(PTRACE_SETOPTIONS, child, nullptr, PTRACE_O_TRACESYSGOOD | PTRACE_O_EXITKILL);
+
+    // 每个系统调用产生进入和退出两次停止
+    long stops = 0;
+    int pendingSignal = 0;
+    while (true) {
+        if (ptrace(PTRACE_SYSCALL, child, nullptr, reinterpret_cast<void*>(static_cast<long>(pendingSignal))) < 0) {
+            return -1;
+        }
+        pendingSignal = 0;
+        if (waitpid(child, &status, 0) < 0) {
+            return -1;
+        }
+        if (WIFEXITED(status)) {
+            return WEXITSTATUS(status) == 0 ? stops / 2 : -1;
+        }
+        if (WIFSIGNALED(status)) {
+            return -1;
+        }
+        if (WSTOPSIG(status) == (SIGTRAP | 0x80)) {
+            stops++;
+        } else {
+            pendingSignal = WSTOPSIG(status);
+        }
+    }
+}
+
+BenchResult runBenchmark(DfsIoBackend type, BenchOp op, size_t size, int iterations) {
+    BenchResult result;
+
+    // 预热一次，避免首次页缓存填充影响结果
+    runWorkload(type, op, size, 1);
+    result.mbPerSec = measureThroughput(type, op, size, iterations);
+
+    long baseline = countSyscalls(type, op, size, 0);
+    long loaded = countSyscalls(type, op, size, iterations);
+    if (baseline < 0 || loaded < 0) {
+        result.syscallsPerObject = -1;
+    } else {
+        result.syscallsPerObject = static_cast<double>(loaded - baseline) / iterations;
+    }
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    int iterations = 20;
+    bool direct = false;
+    std::vector<size_t> sizesKb;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--iterations" && i + 1 < argc) {
+            iterations = std::atoi(argv[++i]);
+        } else if (arg == "--direct") {
+            direct = true;
+        } else {
+            sizesKb.push_back(static_cast<size_t>(std::atol(argv[i])));
+        }
+    }
+    if (iterations <= 0) {
+        std::cerr << "USAGE: bench_io [--iterations N] [--direct] [size_kb ...]" << std::endl;
+        return 1;
+    }
+    if (sizesKb.empty()) {
+        sizesKb = {4, 64, 1024, 16384};
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    Logger::set_debug_enabled(false);
+
+    char dirTemplate[] = "/tmp/dfs_bench_io_XXXXXX";
+    if (mkdtemp(dirTemplate) == nullptr) {
+        perror("mkdtemp");
+        return 1;
+    }
+    g_workDir = dirTemplate;
+
+    {
+        IoUring probe;
+        std::cout << "io_uring: " << (probe.isAvailable() ? "available" : "NOT available (uring rows use blocking fallback)")
+                  << ", iterations per case: " << iterations << std::endl;
+    }
+
+    std::cout << std::left << std::setw(6) << "op" << std::setw(12) << "size_kb"
+              << std::setw(18) << "backend" << std::setw(14) << "MB/s" << "syscalls/object" << std::endl;
+
+    const DfsIoBackend backends[] = {DfsIoBackend::BLOCKING, DfsIoBackend::IO_URING};
+    const BenchOp ops[] = {BenchOp::GET, BenchOp::PUT};
+    std::vector<uint64_t> thresholds = {0};
+    if (direct) {
+        thresholds.push_back(1);
+    }
+    for (BenchOp op : ops) {
+        for (size_t sizeKb : sizesKb) {
+            size_t size = sizeKb * 1024;
+            writeObjectFile(ObjectIoBackend::objectPath(g_workDir, "bench", 1), size);
+            for (uint64_t threshold : thresholds) {
+                g_directThreshold = threshold;
+                for (DfsIoBackend type : backends) {
+                    BenchResult result = runBenchmark(type, op, size, iterations);
+                    std::string name = type == DfsIoBackend::IO_URING ? "io_uring" : "blocking";
+                    std::cout << std::left << std::setw(6) << opName(op) << std::setw(12) << sizeKb
+                              << std::setw(18) << (threshold > 0 ? name + "+direct" : name)
+                              << std::setw(14) << std::fixed << std::setprecision(1) << result.mbPerSec;
+                    if (result.syscallsPerObject < 0) {
+                        std::cout << "n/a (ptrace unavailable)";
+                    } else {
+                        std::cout << std::setprecision(1) << result.syscallsPerObject;
+                    }
+                    std::cout << std::endl;
+                }
+            }
+        }
+    }
+
+    unlink(ObjectIoBackend::objectPath(g_workDir, "bench", 1).c_str());
+    rmdir(g_workDir.c_str());
+    return 0;
+}
@@ -0,0 +1,187 @@
+// PUT组提交基准测试：比较不落盘、每个对象fdatasync以及不同提交窗口下WAL组提交的确认速率
+//
+// 每个客户端是一个独立进程（与fork模式的服务器一致），循环执行与服务器PUT相同的步骤：
+// 写入.part临时文件 -> 提交（rename或WAL组提交） -> 记录目录索引 -> 计为一次确认
+//
+// 用法: bench_wal [--clients N] [--puts N] [--size KB] [window_us ...]
+#include "wal.hpp"
+#include "dir_index.hpp"
+#include "object_io.hpp"
+#include "logger.hpp"
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+
+enum class CommitMode { NONE, FSYNC, WAL };
+
+struct ClientResult {
+    uint64_t acks;
+    uint64_t syncs;
+    double latencyMs;       // 所有确认的延迟之和
+};
+
+std::string g_root;
+
+const char* modeName(CommitMode mode) {
+    switch (mode) {
+        case CommitMode::NONE: return "no-sync";
+        case CommitMode::FSYNC: return "fdatasync";
+        default: return "wal";
+    }
+}
+
+bool writePartial(const std::string& objectFile, const std::vector<unsigned char>& data, bool sync) {
+    int fd = open(ObjectIoBackend::partialPath(objectFile).c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = write(fd, data.data(), data.size()) == static_cast<ssize_t>(data.size());
+    if (sync) {
+        ok = fdatasync(fd) == 0 && ok;
+    }
+    close(fd);
+    return ok;
+}
+
+ClientResult runClient(int client, CommitMode mode, int windowUs, int puts, size_t size) {
+    ClientResult result{0, 0, 0};
+    std::string folder = g_root + "/bench/";
+    std::vector<unsigned char> data(size, static_cast<unsigned char>('a' + client % 26));
+    WriteAheadLog& wal = WriteAheadLog::forRoot(g_root);
+
+    for (int i = 0; i < puts; i++) {
+        std::string fileName = "c" + std::to_string(client) + "_" + std::to_string(i);
+        std::string objectFile = ObjectIoBackend::objectPath(folder, fileName, 0);
+        auto start = std::chrono::steady_clock::now();
+        if (!writePartial(objectFile, data, mode == CommitMode::FSYNC)) {
+            continue;
+        }
+        bool acked;
+        if (mode == CommitMode::WAL) {
+            acked = wal.commit({WriteAheadLog::Entry{folder, fileName, 0, size, false, 0, 0}}, windowUs);
+        } else {
+            acked = rename(ObjectIoBackend::partialPath(objectFile).c_str(), objectFile.c_str()) == 0;
+            if (acked) {
+                DirIndex::forDirectory(folder)->recordObject(fileName, 0, size);
+            }
+        }
+        if (acked) {
+            result.acks++;
+            result.latencyMs += std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count();
+        }
+    }
+    result.syncs = wal.stats().syncs;
+    return result;
+}
+
+// 所有客户端进程就绪后同时开始，打印确认速率、平均延迟和每次同步覆盖的对象数
+void runCase(CommitMode mode, int windowUs, int clients, int puts, size_t size) {
+    std::string cleanup = "rm -rf " + g_root + "/bench " + g_root + "/" + WAL_FILE;
+    (void)system(cleanup.c_str());
+    mkdir((g_root + "/bench").c_str(), 0755);
+    WriteAheadLog(g_root).recover();
+
+    int startPipe[2], resultPipe[2];
+    if (pipe(startPipe) < 0 || pipe(resultPipe) < 0) {
+        perror("pipe");
+        return;
+    }
+    for (int client = 0; client < clients; client++) {
+        if (fork() == 0) {
+            close(startPipe[1]);
+            char go;
+            (void)!read(startPipe[0], &go, 1);
+            ClientResult result = runClient(client, mode, windowUs, puts, size);
+            (void)!write(resultPipe[1], &result, sizeof(result));
+            _exit(0);
+        }
+    }
+    close(startPipe[0]);
+    close(resultPipe[1]);
+
+    auto start = std::chrono::steady_clock::now();
+    close(startPipe[1]);    // 关闭写端，所有客户端的read同时返回
+    ClientResult total{0, 0, 0};
+    ClientResult result;
+    while (read(resultPipe[0], &result, sizeof(result)) == static_cast<ssize_t>(sizeof(result))) {
+        total.acks += result.acks;
+        total.syncs += result.syncs;
+        total.latencyMs += result.latencyMs;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    close(resultPipe[0]);
+    while (wait(nullptr) > 0) {
+    }
+
+    std::cout << std::left << std::setw(12) << modeName(mode) << std::setw(12)
+              << (mode == CommitMode::WAL ? std::to_string(windowUs) : std::string("-"))
+              << std::setw(12) << std::fixed << std::setprecision(0) << total.acks / seconds
+              << std::setw(16) << std::setprecision(2) << (total.acks > 0 ? total.latencyMs / total.acks : 0.0);
+    if (mode == CommitMode::WAL && total.syncs > 0) {
+        std::cout << std::setprecision(1) << static_cast<double>(total.acks) / total.syncs;
+    } else {
+        std::cout << (mode == CommitMode::FSYNC ? "1.0" : "-");
+    }
+    std::cout << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    int clients = 32;
+    int puts = 50;
+    size_t sizeKb = 4;
+    std::vector<int> windows;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--clients" && i + 1 < argc) {
+            clients = std::atoi(argv[++i]);
+        } else if (arg == "--puts" && i + 1 < argc) {
+            puts = std::atoi(argv[++i]);
+        } else if (arg == "--size" && i + 1 < argc) {
+            sizeKb = static_cast<size_t>(std::atol(argv[++i]));
+        } else {
+            windows.push_back(std::atoi(argv[i]));
+        }
+    }
+    if (clients <= 0 || puts <= 0) {
+        std::cerr << "USAGE: bench_wal [--clients N] [--puts N] [--size KB] [window_us ...]" << std::endl;
+        return 1;
+    }
+    if (windows.empty()) {
+        windows = {0, 200, 1000, 5000};
+    }
+
+    Logger::set_debug_enabled(false);
+    char dirTemplate[] = "/tmp/dfs_bench_wal_XXXXXX";
+    if (mkdtemp(dirTemplate) == nullptr) {
+        perror("mkdtemp");
+        return 1;
+    }
+    g_root = dirTemplate;
+
+    std::cout << clients << " client processes x " << puts << " PUTs of " << sizeKb << "KB" << std::endl;
+    std::cout << std::left << std::setw(12) << "commit" << std::setw(12) << "window_us" << std::setw(12) << "acks/s"
+              << std::setw(16) << "avg_latency_ms" << "objects/sync" << std::endl;
+    runCase(CommitMode::NONE, 0, clients, puts, sizeKb * 1024);
+    runCase(CommitMode::FSYNC, 0, clients, puts, sizeKb * 1024);
+    for (int window : windows) {
+        runCase(CommitMode::WAL, window, clients, puts, sizeKb * 1024);
+    }
+
+    std::string cleanup = "rm -rf " + g_root;
+    (void)system(cleanup.c_str());
+    return 0;
+}
@@ -0,0 +1,180 @@
+#include "admission.hpp"
+#include "netutils.hpp"
+#include "test_common.hpp"
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+long elapsedMs(std::chrono::steady_clock::time_point start) {
+    return static_cast<long>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count());
+}
+
+void testSlotsAndQueue() {
+    std::cout << "\n=== Concurrent commands are capped and queued ===" << std::endl;
+    AdmissionControl control(AdmissionControl::Limits{2, 1, 300, 1024 * 1024});
+    check(control.isAvailable(), "Admission state mapped");
+
+    AdmissionControl::Ticket first = control.admit();
+    AdmissionControl::Ticket second = control.admit();
+    check(first.admitted() && second.admitted(), "Commands up to the limit are admitted");
+
+    // 第三条命令排队，直到有槽位释放
+    std::atomic<bool> queuedAdmitted(false);
+    std::thread queued([&]() {
+        AdmissionControl::Ticket ticket = control.admit();
+        queuedAdmitted = ticket.admitted();
+    });
+    while (control.stats().waiting == 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    // 队列已满：立即拒绝，不等待
+    auto start = std::chrono::steady_clock::now();
+    AdmissionControl::Ticket rejected = control.admit();
+    check(!rejected.admitted() && elapsedMs(start) < 50, "Command beyond the queue is rejected immediately");
+    check(rejected.retryAfterMs() >= ADMISSION_MIN_RETRY_AFTER_MS &&
+          rejected.retryAfterMs() <= ADMISSION_MAX_RETRY_AFTER_MS, "Rejection carries a retry-after hint");
+
+    first = AdmissionControl::Ticket();
+    queued.join();
+    check(queuedAdmitted, "Queued command admitted once a slot is released");
+
+    // 槽位一直被占用时，排队的命令在超时后被拒绝
+    AdmissionControl::Ticket held = control.admit();
+    start = std::chrono::steady_clock::now();
+    AdmissionControl::Ticket timedOut = control.admit();
+    long waited = elapsedMs(start);
+    check(!timedOut.admitted() && waited >= 250 && waited < 1000, "Queued command rejected after the timeout");
+
+    AdmissionControl::Stats stats = control.stats();
+    check(stats.admitted == 4 && stats.rejected == 2 && stats.queued == 2, "Admissions, queueing and rejections counted");
+    check(stats.active == 2 && stats.waiting == 0, "Active commands accounted");
+}
+
+void testInflightBudget() {
+    std::cout << "\n=== PUT objects wait for the in-flight budget ===" << std::endl;
+    AdmissionControl control(AdmissionControl::Limits{4, 4, 1000, 1024 * 1024});
+    AdmissionControl::Ticket first = control.admit();
+    AdmissionControl::Ticket second = control.admit();
+
+    first.reserve(768 * 1024);
+    check(control.stats().inflightBytes == 768 * 1024, "Reservation accounted");
+
+    std::atomic<bool> reserved(false);
+    std::thread waiter([&]() {
+        second.reserve(512 * 1024);
+        reserved = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    check(!reserved, "Object over the budget waits");
+    first.reserve(0);
+    waiter.join();
+    check(reserved && control.stats().inflightBytes == 512 * 1024, "Object proceeds once the budget is released");
+
+    // 大于整个预算的对象在没有其他对象接收时单独放行
+    second.reserve(0);
+    auto start = std::chrono::steady_clock::now();
+    first.reserve(4 * 1024 * 1024);
+    check(elapsedMs(start) < 50 && control.stats().inflightBytes == 1024 * 1024,
+          "Object larger than the budget proceeds alone");
+
+    first = AdmissionControl::Ticket();
+    check(control.stats().inflightBytes == 0 && control.stats().active == 1, "Releasing the slot releases its bytes");
+}
+
+void testAcrossProcesses() {
+    std::cout << "\n=== Slots are shared by forked connection processes ===" << std::endl;
+    AdmissionControl control(AdmissionControl::Limits{1, 4, 2000, 1024 * 1024});
+
+    // 子进程占用唯一的槽位一段时间后正常退出，父进程排队等待
+    pid_t child = fork();
+    if (child == 0) {
+        AdmissionControl::Ticket ticket = control.admit();
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        ticket = AdmissionControl::Ticket();
+        _exit(0);
+    }
+    while (control.stats().active == 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    auto start = std::chrono::steady_clock::now();
+    AdmissionControl::Ticket ticket = control.admit();
+    check(ticket.admitted() && elapsedMs(start) >= 100, "Parent admitted after the child releases its slot");
+    ticket = AdmissionControl::Ticket();
+    waitpid(child, nullptr, 0);
+
+    // 子进程带着槽位和预留的字节被杀死，等待者回收它们
+    int ready[2];
+    if (pipe(ready) < 0) {
+        check(false, "Pipe created");
+        return;
+    }
+    child = fork();
+    if (child == 0) {
+        AdmissionControl::Ticket held = control.admit();
+        held.reserve(4096);
+        (void)!write(ready[1], "x", 1);
+        pause();
+        _exit(0);
+    }
+    char byte;
+    (void)!read(ready[0], &byte, 1);
+    close(ready[0]);
+    close(ready[1]);
+    kill(child, SIGKILL);
+    waitpid(child, nullptr, 0);
+    check(control.stats().active == 1 && control.stats().inflightBytes == 4096, "Killed process still holds its slot");
+
+    ticket = control.admit();
+    check(ticket.admitted(), "Slot of a killed process is reclaimed");
+    check(control.stats().inflightBytes == 0, "Bytes of a killed process are reclaimed");
+}
+
+void testPeekSplitHeader() {
+    std::cout << "\n=== Split header is peeked without consuming it ===" << std::endl;
+    int fds[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    std::vector<unsigned char> header;
+    NetUtils::encodeSplitHeader(header, 7, 3);
+    NetUtils::sendToSocket(fds[1], header);
+    NetUtils::sendToSocket(fds[1], std::vector<unsigned char>{'a', 'b', 'c'});
+
+    int splitId = 0, length = 0;
+    NetUtils::peekSplitHeader(fds[0], splitId, length);
+    check(splitId == 7 && length == 3, "Peeked split id and length");
+    Split split;
+    NetUtils::writeSplitFromSocketAsStream(fds[0], split);
+    check(split.id == 7 && split.content_length == 3 && split.content[2] == 'c', "Split still received in full");
+
+    close(fds[1]);
+    bool thrown = false;
+    try {
+        NetUtils::peekSplitHeader(fds[0], splitId, length);
+    } catch (const std::exception&) {
+        thrown = true;
+    }
+    check(thrown, "Peek fails when the peer closes");
+    close(fds[0]);
+}
+
+} // namespace
+
+int main() {
+    printBanner("DFS Admission Control Tests");
+
+    testSlotsAndQueue();
+    testInflightBudget();
+    testAcrossProcesses();
+    testPeekSplitHeader();
+
+    return finishTests();
+}
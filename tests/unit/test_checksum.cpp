@@ -0,0 +1,286 @@
+#include "crc32c.hpp"
+#include "object_io.hpp"
+#include "object_cache.hpp"
+#include "packed_store.hpp"
+#include "netutils.hpp"
+#include "test_common.hpp"
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+std::vector<unsigned char> makeContent(size_t size, unsigned char seed) {
+    std::vector<unsigned char> content(size);
+    for (size_t i = 0; i < size; i++) {
+        content[i] = static_cast<unsigned char>(i * 131 + seed);
+    }
+    return content;
+}
+
+// 通过socketpair发送一个分片，由receive在另一端接收
+bool putObject(const std::function<void(int)>& receive, int splitId, const std::vector<unsigned char>& content) {
+    int fds[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    std::thread peer([&]() {
+        std::vector<unsigned char> header;
+        NetUtils::encodeSplitHeader(header, splitId, static_cast<int>(content.size()));
+        NetUtils::sendToSocket(fds[1], header);
+        if (!content.empty()) {
+            NetUtils::sendToSocket(fds[1], content);
+        }
+    });
+    bool ok = true;
+    try {
+        receive(fds[0]);
+    } catch (const std::exception&) {
+        ok = false;
+    }
+    peer.join();
+    close(fds[0]);
+    close(fds[1]);
+    return ok;
+}
+
+// 在socketpair一端执行send，另一端按客户端GET的方式读回分片
+bool getObject(const std::function<void(int)>& send, Split& split) {
+    int fds[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    bool sent = false;
+    std::thread server([&]() {
+        try {
+            send(fds[0]);
+            sent = true;
+        } catch (const std::exception&) {
+        }
+        shutdown(fds[0], SHUT_WR);
+    });
+    split = Split();
+    bool received = true;
+    try {
+        NetUtils::writeSplitFromSocketAsStream(fds[1], split);
+    } catch (const std::exception&) {
+        received = false;
+    }
+    server.join();
+    close(fds[0]);
+    close(fds[1]);
+    return sent && received;
+}
+
+// 在原位置改写一个字节，模拟磁盘上的静默损坏
+void corruptAt(const std::string& path, off_t offset) {
+    int fd = open(path.c_str(), O_RDWR);
+    unsigned char byte = 0;
+    if (pread(fd, &byte, 1, offset) == 1) {
+        byte ^= 0x5A;
+        (void)!pwrite(fd, &byte, 1, offset);
+    }
+    close(fd);
+}
+
+bool storedChecksum(const std::string& path, uint32_t& checksum) {
+    int fd = open(path.c_str(), O_RDONLY);
+    bool ok = fd >= 0 && ObjectIoBackend::readChecksum(fd, checksum);
+    if (fd >= 0) {
+        close(fd);
+    }
+    return ok;
+}
+
+void testCrc32c() {
+    std::cout << "\n=== CRC32C (" << (Crc32c::hardwareAccelerated() ? "SSE4.2/PCLMUL" : "table") << ") ===" << std::endl;
+    check(Crc32c::compute("123456789", 9) == 0xE3069283, "Standard check value");
+    check(Crc32c::compute("", 0) == 0, "Empty input");
+
+    std::vector<unsigned char> data = makeContent(200 * 1024, 7);
+    bool same = true;
+    const size_t lengths[] = {1, 7, 8, 9, 255, 767, 768, 769, 24575, 24576, 24577, 100000, 200 * 1024 - 8};
+    for (size_t offset = 0; offset < 8; offset++) {
+        for (size_t length : lengths) {
+            same = same && Crc32c::extend(0x1234, data.data() + offset, length) ==
+                           Crc32c::extendPortable(0x1234, data.data() + offset, length);
+        }
+    }
+    check(same, "Hardware and table implementations agree for all lengths and alignments");
+
+    uint32_t pieces = 0;
+    for (size_t done = 0; done < data.size(); ) {
+        size_t chunk = std::min<size_t>(data.size() - done, 1 + done % 50000);
+        pieces = Crc32c::extend(pieces, data.data() + done, chunk);
+        done += chunk;
+    }
+    check(pieces == Crc32c::compute(data.data(), data.size()), "Incremental computation matches one pass");
+}
+
+void testFileObjects(const std::string& root, DfsIoBackend type, uint64_t directThreshold) {
+    std::unique_ptr<ObjectIoBackend> io = ObjectIoBackend::create(type, directThreshold);
+    std::string label = std::string(io->name()) + (directThreshold > 0 ? ", direct I/O" : "");
+    std::cout << "\n=== Object files verified on GET (" << label << ") ===" << std::endl;
+    std::string folder = root + "/" + io->name() + (directThreshold > 0 ? "_direct" : "");
+    mkdir(folder.c_str(), 0755);
+
+    bool stored = true, returned = true, detected = true;
+    const size_t sizes[] = {1, 4097, 300 * 1024 + 5, 3 * 1024 * 1024 + 17};
+    int splitId = 0;
+    for (size_t size : sizes) {
+        std::vector<unsigned char> content = makeContent(size, static_cast<unsigned char>(splitId));
+        std::string objectFile = ObjectIoBackend::objectPath(folder, "obj", splitId);
+        putObject([&](int socket) { io->recvObject(socket, folder, "obj"); }, splitId, content);
+
+        uint32_t checksum = 0;
+        stored = stored && storedChecksum(objectFile, checksum) &&
+                 checksum == Crc32c::compute(content.data(), content.size());
+
+        Split split;
+        auto get = [&](int socket) { io->sendObject(socket, splitId, objectFile); };
+        returned = returned && getObject(get, split) && !split.corrupt && split.content == content;
+
+        corruptAt(objectFile, static_cast<off_t>(size / 2));
+        detected = detected && getObject(get, split) && split.corrupt && split.id == splitId &&
+                   split.content_length == 0;
+        splitId++;
+    }
+    check(stored, "PUT stores the CRC32C of the content");
+    check(returned, "Intact objects are returned");
+    check(detected, "Corrupted objects are reported instead of sent");
+
+    // 校验和功能之前写入的对象没有扩展属性，仍然正常返回
+    std::string legacyFile = ObjectIoBackend::objectPath(folder, "legacy", 0);
+    std::vector<unsigned char> legacy = makeContent(5000, 9);
+    putObject([&](int socket) { io->recvObject(socket, folder, "legacy"); }, 0, legacy);
+    removexattr(legacyFile.c_str(), OBJECT_CHECKSUM_XATTR);
+    Split split;
+    check(getObject([&](int socket) { io->sendObject(socket, 0, legacyFile); }, split) &&
+          !split.corrupt && split.content == legacy, "Objects without a checksum are sent unverified");
+}
+
+// 段文件中对象数据的位置
+off_t findInSegments(const std::string& root, const std::vector<unsigned char>& content, std::string& segment) {
+    for (uint32_t id = 1; id < 16; id++) {
+        char name[32];
+        snprintf(name, sizeof(name), "/%s/%08u.seg", PACKED_STORE_DIR, id);
+        segment = root + name;
+        int fd = open(segment.c_str(), O_RDONLY);
+        if (fd < 0) {
+            continue;
+        }
+        struct stat st;
+        fstat(fd, &st);
+        std::vector<unsigned char> bytes(static_cast<size_t>(st.st_size));
+        (void)!pread(fd, bytes.data(), bytes.size(), 0);
+        close(fd);
+        auto it = std::search(bytes.begin(), bytes.end(), content.begin(), content.end());
+        if (it != bytes.end()) {
+            return static_cast<off_t>(it - bytes.begin());
+        }
+    }
+    return -1;
+}
+
+void testPackedRecords(const std::string& root) {
+    std::cout << "\n=== Packed records verified on GET ===" << std::endl;
+    std::string storeRoot = root + "/packed";
+    std::string folder = storeRoot + "/Bob";
+    mkdir(storeRoot.c_str(), 0755);
+    mkdir(folder.c_str(), 0755);
+    std::unique_ptr<ObjectIoBackend> io = ObjectIoBackend::create(DfsIoBackend::BLOCKING);
+
+    // 小段让前面的对象所在的段被封存，压缩时为它写入提示文件
+    const uint64_t segmentSize = 64 * 1024;
+    std::vector<std::vector<unsigned char>> contents;
+    {
+        PackedStore store(storeRoot, segmentSize);
+        for (int i = 0; i < 6; i++) {
+            contents.push_back(makeContent(20 * 1024 + static_cast<size_t>(i), static_cast<unsigned char>(i)));
+            putObject([&](int socket) {
+                int splitId;
+                uint64_t size;
+                store.recvObject(socket, *io, folder, "p.txt", splitId, size);
+            }, i, contents.back());
+        }
+
+        bool returned = true;
+        for (int i = 0; i < 6; i++) {
+            Split split;
+            std::string objectFile = ObjectIoBackend::objectPath(folder, "p.txt", i);
+            returned = returned && getObject([&](int socket) { store.sendObject(socket, *io, i, objectFile); }, split) &&
+                       !split.corrupt && split.content == contents[i];
+        }
+        check(returned, "Intact records are returned");
+        store.compact();
+    }
+    check(access((storeRoot + "/" + PACKED_STORE_DIR + "/00000001.hint").c_str(), F_OK) == 0,
+          "Hint written for the sealed segment");
+
+    std::string segment;
+    off_t offset = findInSegments(storeRoot, contents[1], segment);
+    check(offset > 0, "Record data located in a segment");
+    corruptAt(segment, offset + 100);
+
+    // 新实例从提示文件加载封存段，校验和随提示文件一起保存
+    PackedStore store(storeRoot, segmentSize);
+    Split split;
+    std::string objectFile = ObjectIoBackend::objectPath(folder, "p.txt", 1);
+    check(getObject([&](int socket) { store.sendObject(socket, *io, 1, objectFile); }, split) &&
+          split.corrupt && split.id == 1, "Corrupted record is reported after loading the hint");
+    objectFile = ObjectIoBackend::objectPath(folder, "p.txt", 5);
+    check(getObject([&](int socket) { store.sendObject(socket, *io, 5, objectFile); }, split) &&
+          !split.corrupt && split.content == contents[5], "Records in the active segment are returned");
+}
+
+void testCachedObjects(const std::string& root) {
+    std::cout << "\n=== Corrupted objects are not cached ===" << std::endl;
+    ObjectCache::createShared(8 * 1024 * 1024);
+    std::unique_ptr<ObjectIoBackend> io = ObjectIoBackend::create(DfsIoBackend::BLOCKING);
+    std::string folder = root + "/cached";
+    mkdir(folder.c_str(), 0755);
+
+    std::vector<unsigned char> content = makeContent(100 * 1024, 3);
+    std::string objectFile = ObjectIoBackend::objectPath(folder, "c.txt", 0);
+    putObject([&](int socket) { io->recvObject(socket, folder, "c.txt"); }, 0, content);
+    corruptAt(objectFile, 1000);
+
+    Split split;
+    auto get = [&](int socket) { io->sendObject(socket, 0, objectFile); };
+    check(getObject(get, split) && split.corrupt, "Corruption detected while loading into the cache");
+    ObjectCache::Stats stats = ObjectCache::shared()->stats();
+    check(stats.insertions == 0 && stats.objects == 0, "Corrupted object not inserted");
+
+    // PUT覆盖后缓存载入完好的新对象，之后的GET从缓存命中
+    putObject([&](int socket) { io->recvObject(socket, folder, "c.txt"); }, 0, content);
+    bool intact = getObject(get, split) && !split.corrupt && split.content == content;
+    intact = intact && getObject(get, split) && !split.corrupt && split.content == content;
+    stats = ObjectCache::shared()->stats();
+    check(intact && stats.insertions == 1 && stats.hits == 1, "Rewritten object cached and hit");
+    ObjectCache::createShared(0);
+}
+
+} // namespace
+
+int main() {
+    printBanner("DFS Checksum Tests");
+
+    std::string root = makeTempDir("checksum");
+    testCrc32c();
+    testFileObjects(root, DfsIoBackend::BLOCKING, 0);
+    testFileObjects(root, DfsIoBackend::IO_URING, 0);
+    testFileObjects(root, DfsIoBackend::BLOCKING, 4096);
+    testFileObjects(root, DfsIoBackend::IO_URING, 4096);
+    testPackedRecords(root);
+    testCachedObjects(root);
+
+    removeTempDir(root);
+
+    return finishTests();
+}
@@ -0,0 +1,61 @@
+#ifndef TEST_COMMON_HPP
+#define TEST_COMMON_HPP
+
+// 单元测试共用的检查、临时目录和结果汇总，输出格式与test_crypto相同：
+// 每项检查一行 PASSED!/FAILED!，最后汇总通过和失败的数量，有失败时返回1
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <stdlib.h>
+
+struct TestResults {
+    int passed = 0;
+    int failed = 0;
+};
+
+inline TestResults& testResults() {
+    static TestResults results;
+    return results;
+}
+
+inline void printBanner(const std::string& title) {
+    std::cout << "========================================" << std::endl;
+    std::cout << "    " << title << std::endl;
+    std::cout << "========================================" << std::endl;
+}
+
+inline void check(bool condition, const std::string& name) {
+    if (condition) {
+        testResults().passed++;
+        std::cout << name << " PASSED!" << std::endl;
+    } else {
+        testResults().failed++;
+        std::cerr << name << " FAILED!" << std::endl;
+    }
+}
+
+// /tmp下以dfs_<name>_开头的新目录
+inline std::string makeTempDir(const std::string& name) {
+    std::string path = "/tmp/dfs_" + name + "_XXXXXX";
+    if (!mkdtemp(&path[0])) {
+        std::cerr << "Unable to create temporary directory " << path << std::endl;
+        std::exit(1);
+    }
+    return path;
+}
+
+inline void removeTempDir(const std::string& path) {
+    std::string command = "rm -rf " + path;
+    (void)!system(command.c_str());
+}
+
+inline int finishTests() {
+    const TestResults& results = testResults();
+    std::cout << "\n========================================" << std::endl;
+    std::cout << "Test Results: " << results.passed << " passed, " << results.failed << " failed" << std::endl;
+    std::cout << "========================================" << std::endl;
+    return results.failed == 0 ? 0 : 1;
+}
+
+#endif // TEST_COMMON_HPP
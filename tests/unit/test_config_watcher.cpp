@@ -0,0 +1,69 @@
+#include "config_watcher.hpp"
+#include "test_common.hpp"
+#include <signal.h>
+#include <unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+namespace {
+
+void writeFile(const std::string& path, const std::string& content) {
+    std::ofstream file(path, std::ios::trunc);
+    file << content;
+}
+
+void testFileChanges(const std::string& folder) {
+    std::cout << "\n=== Rewrites of the config file trigger a reload ===" << std::endl;
+    std::string path = folder + "/dfs.conf";
+    writeFile(path, "Bob ComplextPassword\n");
+
+    ConfigWatcher watcher(path);
+    check(watcher.isAvailable() && watcher.fd() >= 0, "Watcher created");
+    check(!watcher.wait(50), "No reload without changes");
+
+    writeFile(path, "Bob ComplextPassword\nCarol NewcomerPassword\n");
+    check(watcher.wait(1000), "In-place rewrite detected");
+    check(!watcher.consume(), "Events consumed once");
+
+    // 编辑器和配置管理工具常见的写法：写临时文件后rename替换
+    writeFile(folder + "/dfs.conf.tmp", "Bob ComplextPassword\n");
+    check(!watcher.wait(50), "Other files in the directory ignored");
+    check(rename((folder + "/dfs.conf.tmp").c_str(), path.c_str()) == 0 && watcher.wait(1000),
+          "Atomic rename detected");
+
+    writeFile(folder + "/other.conf", "Alice SimplePassword\n");
+    check(!watcher.wait(50), "Unrelated file ignored");
+}
+
+void testSignal(const std::string& folder) {
+    std::cout << "\n=== SIGHUP triggers a reload ===" << std::endl;
+    ConfigWatcher watcher(folder + "/dfs.conf");
+    kill(getpid(), SIGHUP);
+    check(watcher.wait(1000), "SIGHUP received through the watcher");
+    check(!watcher.wait(50), "Signal consumed once");
+
+    // 信号在没有人等待时到达也不会丢失或终止进程
+    kill(getpid(), SIGHUP);
+    kill(getpid(), SIGHUP);
+    check(watcher.consume(), "Pending signals coalesced into one reload");
+}
+
+} // namespace
+
+int main() {
+    printBanner("DFS Config Watcher Tests");
+
+    // 与服务器启动时相同，先屏蔽SIGHUP
+    ConfigWatcher::blockReloadSignal();
+
+    std::string folder = makeTempDir("config_watcher");
+    testFileChanges(folder);
+    testSignal(folder);
+
+    removeTempDir(folder);
+
+    return finishTests();
+}
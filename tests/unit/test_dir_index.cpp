@@ -0,0 +1,229 @@
+#include "dir_index.hpp"
+#include "utils.hpp"
+#include "netutils.hpp"
+#include "test_common.hpp"
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+
+namespace {
+
+void writeObject(const std::string& folder, const std::string& fileName, int objectId, size_t size) {
+    std::ofstream file(folder + "/." + fileName + "." + std::to_string(objectId), std::ios::binary);
+    file << std::string(size, 'x');
+}
+
+bool sameChunks(const ServerChunksInfo& a, const ServerChunksInfo& b) {
+    if (a.chunks != b.chunks) {
+        return false;
+    }
+    for (int i = 0; i < a.chunks; i++) {
+        if (a.chunk_info[i].file_name != b.chunk_info[i].file_name ||
+            a.chunk_info[i].chunks != b.chunk_info[i].chunks) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void testRebuildMatchesScan(const std::string& root) {
+    std::cout << "\n=== Rebuild from existing objects ===" << std::endl;
+    std::string folder = root + "/rebuild";
+    mkdir(folder.c_str(), 0755);
+    writeObject(folder, "a.txt", 0, 10);
+    writeObject(folder, "a.txt", 1, 10);
+    writeObject(folder, "report.pdf", 2, 20);
+    writeObject(folder, "report.pdf", 3, 20);
+    writeObject(folder, "single.bin", 1, 5);
+    mkdir((folder + "/sub").c_str(), 0755);
+    std::ofstream(folder + "/.partial.0.part") << "x";
+
+    DirIndex index(folder);
+    ServerChunksInfo fromIndex, fromScan;
+    index.listFiles(fromIndex);
+    Utils::getFilesInFolder(folder, fromScan, "");
+    check(fromIndex.chunks == 3, "three files indexed, partial upload ignored");
+    check(sameChunks(fromIndex, fromScan), "LIST matches the directory scan");
+
+    ServerChunksInfo one, oneScan;
+    check(index.findFile("report.pdf", one), "existing file found");
+    Utils::getFilesInFolder(folder, oneScan, "report.pdf");
+    check(sameChunks(one, oneScan), "GET lookup matches the directory scan");
+    check(!index.findFile("missing.txt", one) && one.chunks == 0, "missing file not found");
+
+    ServerChunksInfo page;
+    bool more = index.listFilesPage("", 2, page);
+    check(more && page.chunks == 2 && page.chunk_info[1].file_name == "report.pdf", "first page of two files");
+    more = index.listFilesPage(page.chunk_info[1].file_name, 2, page);
+    check(!more && page.chunks == 1 && page.chunk_info[0].file_name == "single.bin", "last page after the cursor");
+
+    std::vector<unsigned char> folders;
+    index.listFolders(folders);
+    check(std::string(folders.begin(), folders.end()) == "sub/\n", "subfolder listed");
+    check(access((folder + "/" + DIR_INDEX_FILE).c_str(), F_OK) == 0, "index file persisted");
+}
+
+void testSharedUpdates(const std::string& root) {
+    std::cout << "\n=== Updates from another process ===" << std::endl;
+    std::string folder = root + "/shared";
+    mkdir(folder.c_str(), 0755);
+
+    // 两个实例模拟两个fork出的子进程，各自持有内存中的索引
+    DirIndex writer(folder);
+    DirIndex reader(folder);
+    ServerChunksInfo info;
+    reader.listFiles(info);
+    check(info.chunks == 0, "empty folder");
+
+    writeObject(folder, "new.txt", 0, 7);
+    writer.recordObject("new.txt", 0, 7);
+    writer.recordFolder("photos");
+    check(reader.findFile("new.txt", info) && info.chunk_info[0].chunks[0] == 0,
+          "object recorded by another instance is visible");
+    std::vector<unsigned char> folders;
+    reader.listFolders(folders);
+    check(std::string(folders.begin(), folders.end()) == "photos/\n", "folder recorded by another instance is visible");
+
+    // 追加一半的记录（写入中断），读取方忽略，下一次追加截掉
+    std::string indexPath = folder + "/" + DIR_INDEX_FILE;
+    struct stat before;
+    stat(indexPath.c_str(), &before);
+    int fd = open(indexPath.c_str(), O_WRONLY | O_APPEND);
+    check(write(fd, "O\x05\x00", 3) == 3, "torn record appended");
+    close(fd);
+    reader.listFiles(info);
+    check(info.chunks == 1, "torn record ignored by reader");
+    writer.recordObject("new.txt", 1, 7);
+    DirIndex fresh(folder);
+    fresh.findFile("new.txt", info);
+    check(info.chunks == 1 && info.chunk_info[0].chunks[1] == 1, "torn record truncated by next append");
+
+    unlink(indexPath.c_str());
+    DirIndex rebuilt(folder);
+    rebuilt.listFiles(info);
+    check(info.chunks == 1, "deleted index rebuilt from the directory");
+}
+
+void testCompaction(const std::string& root) {
+    std::cout << "\n=== Compaction ===" << std::endl;
+    std::string folder = root + "/compact";
+    mkdir(folder.c_str(), 0755);
+    DirIndex index(folder);
+    // 反复覆盖同一个对象，日志超过阈值后被压缩
+    for (size_t i = 0; i < DIR_INDEX_COMPACT_MIN_RECORDS + 10; i++) {
+        index.recordObject("hot.bin", 0, i + 1);
+    }
+    struct stat st;
+    stat((folder + "/" + DIR_INDEX_FILE).c_str(), &st);
+    check(st.st_size < 4096, "index compacted to live entries");
+
+    DirIndex reader(folder);
+    ServerChunksInfo info;
+    check(reader.findFile("hot.bin", info) && info.chunks == 1, "compacted index still answers lookups");
+}
+
+void writeObjectCount(const std::string& folder, const std::string& fileName, int objectCount) {
+    std::vector<unsigned char> count(INT_SIZE);
+    NetUtils::encodeIntToUchar(count, objectCount);
+    std::ofstream file(folder + "/." + fileName + "." + std::to_string(FILE_MANIFEST_ID), std::ios::binary);
+    file.write(reinterpret_cast<const char*>(count.data()), count.size());
+}
+
+void testObjectCount(const std::string& root) {
+    std::cout << "\n=== Object ids and object count ===" << std::endl;
+    std::string folder = root + "/count";
+    mkdir(folder.c_str(), 0755);
+    for (int objectId : {0, 2, 5}) {
+        writeObject(folder, "big.bin", objectId, 10);
+    }
+    writeObjectCount(folder, "big.bin", 6);
+    writeObject(folder, "old.bin", 0, 10);
+
+    DirIndex index(folder);
+    ServerChunksInfo info;
+    check(index.findFile("big.bin", info) && info.chunk_info[0].objects == std::vector<int>({0, 2, 5}),
+          "every object id reported, the manifest excluded");
+    check(info.chunk_info[0].chunks[0] == 0 && info.chunk_info[0].chunks[1] == 2, "first two ids kept for text replies");
+    check(info.chunk_info[0].object_count == 6, "object count read from the manifest after a rebuild");
+    check(index.findFile("old.bin", info) && info.chunk_info[0].object_count == -1, "file without a manifest has no count");
+
+    // 覆盖写入元数据对象后，新的记录使缓存的对象数失效
+    writeObjectCount(folder, "big.bin", 3);
+    index.recordObject("big.bin", FILE_MANIFEST_ID, INT_SIZE);
+    check(index.findFile("big.bin", info) && info.chunk_info[0].object_count == 3, "count reread after the manifest changes");
+}
+
+void benchLookup(const std::string& root) {
+    std::cout << "\n=== Lookup cost vs folder size ===" << std::endl;
+    const int fileCount = 20000;
+    std::string folder = root + "/bench";
+    mkdir(folder.c_str(), 0755);
+    for (int i = 0; i < fileCount; i++) {
+        writeObject(folder, "file" + std::to_string(i), i % 4, 0);
+        writeObject(folder, "file" + std::to_string(i), (i + 1) % 4, 0);
+    }
+
+    ServerChunksInfo info;
+    auto start = std::chrono::steady_clock::now();
+    Utils::getFilesInFolder(folder, info, "file777");
+    auto scanUs = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+
+    std::shared_ptr<DirIndex> index = DirIndex::forDirectory(folder);
+    index->findFile("file0", info);   // 首次访问时重建索引
+    const int lookups = 1000;
+    start = std::chrono::steady_clock::now();
+    bool found = true;
+    for (int i = 0; i < lookups; i++) {
+        found = index->findFile("file" + std::to_string(i), info) && found;
+    }
+    auto indexUs = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count() / lookups;
+
+    std::cout << fileCount << " files: glob scan " << scanUs << " us, index lookup " << indexUs << " us" << std::endl;
+    check(found, "all benchmark files found through the index");
+    check(indexUs * 10 < scanUs, "index lookup is at least 10x faster than a scan");
+}
+
+void testCacheBound(const std::string& root) {
+    std::cout << "\n=== Bounded index cache ===" << std::endl;
+    std::string folder = root + "/cached";
+    mkdir(folder.c_str(), 0755);
+    writeObject(folder, "kept.bin", 0, 10);
+    std::shared_ptr<DirIndex> held = DirIndex::forDirectory(folder);
+    check(DirIndex::forDirectory(folder) == held, "same directory shares one instance");
+
+    // 访问超过上限的目录（不需要真实存在，首次查询前不会读取索引文件）
+    for (size_t i = 0; i < DIR_INDEX_CACHE_MAX + 100; i++) {
+        DirIndex::forDirectory(root + "/untouched" + std::to_string(i));
+    }
+    check(DirIndex::cachedDirectories() <= DIR_INDEX_CACHE_MAX, "cache never exceeds DIR_INDEX_CACHE_MAX");
+
+    ServerChunksInfo info;
+    check(held->findFile("kept.bin", info), "evicted instance still usable by its holder");
+    std::shared_ptr<DirIndex> reloaded = DirIndex::forDirectory(folder);
+    check(reloaded != held && reloaded->findFile("kept.bin", info), "evicted directory reloads on next access");
+}
+
+} // namespace
+
+int main() {
+    printBanner("DFS Directory Index Tests");
+
+    std::string root = makeTempDir("dir_index");
+    testRebuildMatchesScan(root);
+    testSharedUpdates(root);
+    testCompaction(root);
+    testObjectCount(root);
+    testCacheBound(root);
+    benchLookup(root);
+    removeTempDir(root);
+
+    return finishTests();
+}
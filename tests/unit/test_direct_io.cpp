@@ -0,0 +1,211 @@
+#include "object_io.hpp"
+#include "netutils.hpp"
+#include "test_common.hpp"
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+std::vector<unsigned char> makeContent(size_t size, unsigned char seed) {
+    std::vector<unsigned char> content(size);
+    for (size_t i = 0; i < size; i++) {
+        content[i] = static_cast<unsigned char>(i * 131 + seed);
+    }
+    return content;
+}
+
+// 通过socketpair发送一个分片，由后端在另一端写入对象文件
+bool putObject(ObjectIoBackend& io, const std::string& folder, const std::string& fileName, int splitId,
+               const std::vector<unsigned char>& content) {
+    int fds[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    std::thread peer([&]() {
+        std::vector<unsigned char> header;
+        NetUtils::encodeSplitHeader(header, splitId, static_cast<int>(content.size()));
+        NetUtils::sendToSocket(fds[1], header);
+        if (!content.empty()) {
+            NetUtils::sendToSocket(fds[1], content);
+        }
+    });
+    int receivedId = -1;
+    try {
+        receivedId = io.recvObject(fds[0], folder, fileName);
+    } catch (const std::exception&) {
+    }
+    peer.join();
+    close(fds[0]);
+    close(fds[1]);
+    return receivedId == splitId;
+}
+
+// 由后端发送对象文件，读回分片内容
+bool getObject(ObjectIoBackend& io, const std::string& objectFile, int splitId, std::vector<unsigned char>& content) {
+    int fds[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    bool sent = false;
+    std::thread server([&]() {
+        try {
+            io.sendObject(fds[0], splitId, objectFile);
+            sent = true;
+        } catch (const std::exception&) {
+        }
+        shutdown(fds[0], SHUT_WR);
+    });
+    int receivedId = -1, length = 0;
+    content.clear();
+    try {
+        NetUtils::recvSplitHeader(fds[1], receivedId, length);
+        content.resize(static_cast<size_t>(length));
+        if (length > 0) {
+            NetUtils::recvBytesFromSocket(fds[1], content.data(), content.size());
+        }
+    } catch (const std::exception&) {
+    }
+    server.join();
+    close(fds[0]);
+    close(fds[1]);
+    return sent && receivedId == splitId;
+}
+
+// 文件在页缓存中的页数
+size_t residentPages(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0 || st.st_size == 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return 0;
+    }
+    size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t pages = (static_cast<size_t>(st.st_size) + pageSize - 1) / pageSize;
+    void* map = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return 0;
+    }
+    std::vector<unsigned char> vec(pages);
+    size_t resident = 0;
+    if (mincore(map, static_cast<size_t>(st.st_size), vec.data()) == 0) {
+        for (unsigned char page : vec) {
+            resident += page & 1;
+        }
+    }
+    munmap(map, static_cast<size_t>(st.st_size));
+    return resident;
+}
+
+// 把文件从页缓存中逐出，作为GET前的初始状态
+void dropCache(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        fdatasync(fd);
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+}
+
+void testRoundTrip(const std::string& root, DfsIoBackend type) {
+    std::unique_ptr<ObjectIoBackend> io = ObjectIoBackend::create(type, 1);
+    std::cout << "\n=== Direct I/O round trip (" << io->name() << ") ===" << std::endl;
+    std::string folder = root + "/" + io->name();
+    mkdir(folder.c_str(), 0755);
+
+    // 包括不足一块、恰好对齐、跨越缓冲区边界的大小
+    const size_t sizes[] = {1, 4095, 4096, 4097, DIRECT_IO_BUFFER_SIZE, DIRECT_IO_BUFFER_SIZE + 1,
+                            3 * DIRECT_IO_BUFFER_SIZE + 17, 9 * DIRECT_IO_BUFFER_SIZE};
+    int splitId = 0;
+    for (size_t size : sizes) {
+        std::vector<unsigned char> content = makeContent(size, static_cast<unsigned char>(splitId));
+        std::string objectFile = ObjectIoBackend::objectPath(folder, "obj", splitId);
+        bool put = putObject(*io, folder, "obj", splitId, content);
+        struct stat st;
+        bool sized = stat(objectFile.c_str(), &st) == 0 && static_cast<size_t>(st.st_size) == size;
+        std::vector<unsigned char> data;
+        bool got = getObject(*io, objectFile, splitId, data);
+        check(put && sized && got && data == content, std::to_string(size) + " bytes survive PUT and GET");
+        splitId++;
+    }
+
+    std::vector<unsigned char> data;
+    check(getObject(*io, ObjectIoBackend::objectPath(folder, "missing", 0), 0, data) && data.empty(),
+          "Missing object returns an empty split");
+}
+
+void testPageCacheBypass(const std::string& root, DfsIoBackend type) {
+    std::unique_ptr<ObjectIoBackend> io = ObjectIoBackend::create(type, 1024 * 1024);
+    std::cout << "\n=== Page cache bypass above the threshold (" << io->name() << ") ===" << std::endl;
+    std::string folder = root + "/cache_" + io->name();
+    mkdir(folder.c_str(), 0755);
+
+    std::vector<unsigned char> large = makeContent(4 * 1024 * 1024 + 100, 3);
+    std::string largeFile = ObjectIoBackend::objectPath(folder, "large", 0);
+    check(io->useDirect(large.size()), "Large object selects direct I/O");
+    putObject(*io, folder, "large", 0, large);
+    check(residentPages(largeFile) == 0, "Large PUT leaves the page cache untouched");
+    std::vector<unsigned char> data;
+    check(getObject(*io, largeFile, 0, data) && data == large, "Large GET returns the object");
+    check(residentPages(largeFile) == 0, "Large GET leaves the page cache untouched");
+
+    std::vector<unsigned char> small = makeContent(64 * 1024, 4);
+    std::string smallFile = ObjectIoBackend::objectPath(folder, "small", 0);
+    check(!io->useDirect(small.size()), "Small object stays on the page cache path");
+    putObject(*io, folder, "small", 0, small);
+    dropCache(smallFile);
+    check(getObject(*io, smallFile, 0, data) && data == small, "Small GET returns the object");
+    check(residentPages(smallFile) > 0, "Small GET is cached");
+
+    std::unique_ptr<ObjectIoBackend> buffered = ObjectIoBackend::create(type);
+    check(!buffered->useDirect(large.size()), "Threshold 0 disables direct I/O");
+}
+
+void testBufferPool() {
+    std::cout << "\n=== Aligned buffer pool ===" << std::endl;
+    AlignedBufferPool pool;
+    {
+        AlignedBufferPool::Buffer a = pool.acquire();
+        AlignedBufferPool::Buffer b = pool.acquire();
+        check(reinterpret_cast<uintptr_t>(a.data()) % DIRECT_IO_ALIGNMENT == 0 &&
+              reinterpret_cast<uintptr_t>(b.data()) % DIRECT_IO_ALIGNMENT == 0, "Buffers are aligned");
+        check(a.data() != b.data() && pool.stats().allocated == 2, "Concurrent leases get separate buffers");
+    }
+    check(pool.stats().idle == 2, "Released buffers return to the pool");
+    AlignedBufferPool::Buffer again = pool.acquire();
+    check(pool.stats().allocated == 2 && pool.stats().idle == 1, "Idle buffers are reused");
+
+    {
+        std::vector<AlignedBufferPool::Buffer> leases;
+        for (size_t i = 0; i < DIRECT_IO_POOL_BUFFERS + 8; i++) {
+            leases.push_back(pool.acquire());
+        }
+    }
+    check(pool.stats().idle == DIRECT_IO_POOL_BUFFERS, "Idle buffers are capped");
+
+    AlignedBufferPool::Stats shared = AlignedBufferPool::instance().stats();
+    check(shared.allocated == shared.idle && shared.allocated <= 2, "Object I/O returns every leased buffer");
+}
+
+} // namespace
+
+int main() {
+    printBanner("DFS Direct I/O Tests");
+
+    std::string root = makeTempDir("direct_io");
+    testRoundTrip(root, DfsIoBackend::BLOCKING);
+    testRoundTrip(root, DfsIoBackend::IO_URING);
+    testPageCacheBypass(root, DfsIoBackend::BLOCKING);
+    testPageCacheBypass(root, DfsIoBackend::IO_URING);
+    testBufferPool();
+
+    removeTempDir(root);
+
+    return finishTests();
+}
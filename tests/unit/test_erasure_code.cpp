@@ -0,0 +1,186 @@
+#include "erasure_code.hpp"
+#include "test_common.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::vector<uint8_t> makeContent(size_t size, uint32_t seed) {
+    std::vector<uint8_t> content(size);
+    uint32_t state = seed * 2654435761u + 1;
+    for (size_t i = 0; i < size; i++) {
+        state = state * 1103515245u + 12345u;
+        content[i] = static_cast<uint8_t>(state >> 16);
+    }
+    return content;
+}
+
+// 原始数据是否是还原结果的前缀，其余部分为编码时补的0
+bool restored(const std::vector<uint8_t>& original, const std::vector<uint8_t>& data) {
+    if (data.size() < original.size() || !std::equal(original.begin(), original.end(), data.begin())) {
+        return false;
+    }
+    return std::all_of(data.begin() + static_cast<long>(original.size()), data.end(), [](uint8_t b) { return b == 0; });
+}
+
+void testField() {
+    std::cout << "\n=== GF(2^8) arithmetic ===" << std::endl;
+    bool inverses = true;
+    for (int a = 1; a < 256; a++) {
+        inverses = inverses && Gf256::mul(static_cast<uint8_t>(a), Gf256::inv(static_cast<uint8_t>(a))) == 1;
+    }
+    check(inverses, "Every non-zero element has an inverse");
+    check(Gf256::mul(2, 0x80) == 0x1D, "Multiplication reduces by 0x11D");
+
+    bool distributive = true;
+    for (int a = 0; a < 256; a += 7) {
+        for (int b = 0; b < 256; b += 5) {
+            for (int c = 0; c < 256; c += 11) {
+                distributive = distributive && Gf256::mul(static_cast<uint8_t>(a), static_cast<uint8_t>(b ^ c)) ==
+                    (Gf256::mul(static_cast<uint8_t>(a), static_cast<uint8_t>(b)) ^
+                     Gf256::mul(static_cast<uint8_t>(a), static_cast<uint8_t>(c)));
+            }
+        }
+    }
+    check(distributive, "Multiplication distributes over addition");
+}
+
+void testKernels() {
+    std::cout << "\n=== Region kernels (" << Gf256::kernelName(Gf256::kernel()) << ") ===" << std::endl;
+    std::vector<uint8_t> source = makeContent(4096 + 64, 1);
+    std::vector<uint8_t> base = makeContent(4096 + 64, 2);
+    const size_t lengths[] = {0, 1, 15, 16, 17, 31, 32, 33, 63, 64, 65, 100, 4096};
+    for (Gf256::Kernel kernel : {Gf256::Kernel::SSSE3, Gf256::Kernel::AVX2}) {
+        bool same = true;
+        for (int c = 0; c < 256; c++) {
+            for (size_t offset = 0; offset < 3; offset++) {
+                for (size_t length : lengths) {
+                    std::vector<uint8_t> expected = base;
+                    std::vector<uint8_t> actual = base;
+                    Gf256::mulAddPortable(static_cast<uint8_t>(c), source.data() + offset, expected.data() + offset, length);
+                    Gf256::mulAddWith(kernel, static_cast<uint8_t>(c), source.data() + offset, actual.data() + offset, length);
+                    same = same && expected == actual;
+                }
+            }
+        }
+        check(same, std::string(Gf256::kernelName(kernel)) + " matches the table for every constant, length and alignment");
+    }
+}
+
+void testRoundTrip(int k, int m) {
+    std::string code = std::to_string(k) + "+" + std::to_string(m);
+    std::cout << "\n=== " << code << ": any " << k << " fragments restore the data ===" << std::endl;
+    ErasureCode erasure(k, m);
+    int total = k + m;
+
+    for (size_t length : {static_cast<size_t>(1), static_cast<size_t>(1000), static_cast<size_t>(300 * 1024 + 7)}) {
+        std::vector<uint8_t> original = makeContent(length, static_cast<uint32_t>(length));
+        std::vector<std::vector<uint8_t>> fragments;
+        erasure.encode(original.data(), original.size(), fragments);
+        bool shaped = static_cast<int>(fragments.size()) == total;
+        for (const std::vector<uint8_t>& fragment : fragments) {
+            shaped = shaped && fragment.size() == erasure.fragmentSize(length) &&
+                     fragment.size() % ERASURE_FRAGMENT_ALIGN == 0;
+        }
+        check(shaped, std::to_string(length) + " bytes: " + std::to_string(total) + " aligned fragments");
+
+        // 依次去掉所有不超过m个分段的组合
+        bool all = true;
+        bool tooFew = true;
+        for (uint32_t lost = 0; lost < (1u << total); lost++) {
+            int lostCount = __builtin_popcount(lost);
+            std::vector<std::vector<uint8_t>> received = fragments;
+            for (int i = 0; i < total; i++) {
+                if (lost & (1u << i)) {
+                    received[i].clear();
+                }
+            }
+            std::vector<uint8_t> data;
+            bool decoded = erasure.decode(received, data);
+            if (lostCount <= m) {
+                all = all && decoded && restored(original, data);
+            } else {
+                tooFew = tooFew && !decoded;
+            }
+        }
+        check(all, std::to_string(length) + " bytes: restored after losing any " + std::to_string(m) + " fragments");
+        check(tooFew, std::to_string(length) + " bytes: fewer than " + std::to_string(k) + " fragments rejected");
+    }
+}
+
+void testValidation() {
+    std::cout << "\n=== Code parameters are validated ===" << std::endl;
+    int k = 0;
+    int m = 0;
+    check(ErasureCode::parse("4+2", k, m) && k == 4 && m == 2, "4+2 parsed");
+    check(ErasureCode::parse("10+4", k, m) && k == 10 && m == 4, "10+4 parsed");
+    check(!ErasureCode::parse("4", k, m) && !ErasureCode::parse("+2", k, m) && !ErasureCode::parse("4+x", k, m) &&
+          !ErasureCode::parse("30+3", k, m) && !ErasureCode::parse("0+2", k, m), "Malformed codes rejected");
+
+    bool threw = false;
+    try {
+        ErasureCode code(0, 2);
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    check(threw, "No data fragments rejected");
+
+    ErasureCode code(4, 2);
+    std::vector<std::vector<uint8_t>> mismatched(6, std::vector<uint8_t>(64, 1));
+    mismatched[0].assign(32, 1);
+    mismatched[1].assign(32, 1);
+    mismatched[2].assign(32, 1);
+    std::vector<uint8_t> data;
+    check(!code.decode(mismatched, data), "Fragments of a different size are not mixed");
+}
+
+void benchThroughput() {
+    std::cout << "\n=== 4+2 throughput on one core (" << Gf256::kernelName(Gf256::kernel()) << ") ===" << std::endl;
+    ErasureCode erasure(4, 2);
+    std::vector<uint8_t> original = makeContent(16 * 1024 * 1024, 3);
+    std::vector<std::vector<uint8_t>> fragments;
+    const int rounds = 8;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        erasure.encode(original.data(), original.size(), fragments);
+    }
+    double encodeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // 两个数据分段丢失，只能从校验分段还原
+    fragments[0].clear();
+    fragments[3].clear();
+    std::vector<uint8_t> data;
+    bool decoded = true;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++) {
+        decoded = decoded && erasure.decode(fragments, data);
+    }
+    double decodeSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    check(decoded && restored(original, data), "Restored without two data fragments");
+
+    double gigabytes = static_cast<double>(original.size()) * rounds / 1e9;
+    std::cout << "  encode: " << gigabytes / encodeSeconds << " GB/s" << std::endl;
+    std::cout << "  decode: " << gigabytes / decodeSeconds << " GB/s" << std::endl;
+}
+
+} // namespace
+
+int main() {
+    printBanner("DFS Erasure Code Tests");
+
+    testField();
+    testKernels();
+    testRoundTrip(4, 2);
+    testRoundTrip(6, 3);
+    testRoundTrip(10, 4);
+    testRoundTrip(3, 0);
+    testValidation();
+    benchThroughput();
+
+    return finishTests();
+}
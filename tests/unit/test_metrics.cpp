@@ -0,0 +1,193 @@
+#include "metrics.hpp"
+#include "admission.hpp"
+#include "test_common.hpp"
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <signal.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+bool contains(const std::string& text, const std::string& line) {
+    return text.find(line) != std::string::npos;
+}
+
+// 发送一个HTTP请求，返回完整的回复
+std::string httpGet(int port, const std::string& path) {
+    for (int attempt = 0; attempt < 50; attempt++) {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons(static_cast<uint16_t>(port));
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (connect(fd, reinterpret_cast<struct sockaddr*>(&address), sizeof(address)) < 0) {
+            // 导出进程可能还没有开始监听
+            close(fd);
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            continue;
+        }
+        std::string request = "GET " + path + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+        (void)!send(fd, request.data(), request.size(), MSG_NOSIGNAL);
+        std::string response;
+        char buffer[4096];
+        ssize_t received;
+        while ((received = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+            response.append(buffer, static_cast<size_t>(received));
+        }
+        close(fd);
+        return response;
+    }
+    return "";
+}
+
+void testBuckets() {
+    std::cout << "\n=== HDR buckets cover every value with bounded error ===" << std::endl;
+    bool contiguous = true;
+    for (size_t i = 1; i < HISTOGRAM_BUCKETS; i++) {
+        contiguous = contiguous && LatencyHistogram::bucketLow(i) == LatencyHistogram::bucketHigh(i - 1) + 1;
+    }
+    check(contiguous, "Buckets are contiguous");
+    check(LatencyHistogram::bucketHigh(HISTOGRAM_BUCKETS - 1) == UINT64_MAX, "Last bucket ends at the largest value");
+
+    bool inBucket = true;
+    bool precise = true;
+    for (uint64_t value : std::vector<uint64_t>{0, 1, 63, 64, 65, 100, 1000, 123456, 999999999, UINT64_MAX}) {
+        size_t index = LatencyHistogram::bucketIndex(value);
+        inBucket = inBucket && index < HISTOGRAM_BUCKETS && LatencyHistogram::bucketLow(index) <= value &&
+                   value <= LatencyHistogram::bucketHigh(index);
+        uint64_t width = LatencyHistogram::bucketHigh(index) - LatencyHistogram::bucketLow(index);
+        precise = precise && width <= value / 32;
+    }
+    check(inBucket, "Values fall into their bucket");
+    check(precise, "Bucket width within 1/32 of the value");
+}
+
+void testQuantiles() {
+    std::cout << "\n=== Quantiles are reported at bucket precision ===" << std::endl;
+    // 直方图通常放在共享内存中，这里用清零的堆内存代替
+    std::unique_ptr<LatencyHistogram> histogram(new LatencyHistogram());
+    check(histogram->valueAtQuantile(0.99) == 0, "Empty histogram reports 0");
+    for (uint64_t us = 1; us <= 10000; us++) {
+        histogram->record(us);
+    }
+    check(histogram->count() == 10000 && histogram->maxUs() == 10000, "Count and maximum recorded");
+    check(histogram->sumUs() == 10000ULL * 10001 / 2, "Sum recorded");
+
+    uint64_t p50 = histogram->valueAtQuantile(0.5);
+    uint64_t p99 = histogram->valueAtQuantile(0.99);
+    check(p50 >= 5000 && p50 <= 5000 + 5000 / 32, "Median within 3% (" + std::to_string(p50) + ")");
+    check(p99 >= 9900 && p99 <= 10000, "p99 within 3% (" + std::to_string(p99) + ")");
+    check(histogram->valueAtQuantile(1.0) == 10000, "p100 is the maximum");
+    check(histogram->countAtOrBelow(1000) >= 1000 && histogram->countAtOrBelow(1000) <= 1000 + 1000 / 32,
+          "Cumulative count at a bound");
+}
+
+void testSharedRecording() {
+    std::cout << "\n=== Forked processes record into the shared metrics ===" << std::endl;
+    Metrics::createShared();
+    Metrics* metrics = Metrics::shared();
+    check(metrics != nullptr, "Shared metrics created");
+
+    std::vector<pid_t> children;
+    for (int i = 0; i < 4; i++) {
+        pid_t child = fork();
+        if (child == 0) {
+            for (int j = 0; j < 1000; j++) {
+                Metrics::add(MetricCounter::BYTES_IN, 10);
+                Metrics::recordStage(MetricStage::DISK_WRITE, static_cast<uint64_t>(j));
+            }
+            _exit(0);
+        }
+        children.push_back(child);
+    }
+    for (pid_t child : children) {
+        waitpid(child, nullptr, 0);
+    }
+    check(metrics->counter(MetricCounter::BYTES_IN) == 40000, "Counters from all processes added up");
+    check(metrics->stageLatency(MetricStage::DISK_WRITE).count() == 4000 &&
+          metrics->stageLatency(MetricStage::DISK_WRITE).maxUs() == 999, "Histograms from all processes merged");
+
+    {
+        Metrics::Timer timer(MetricStage::DISK_SYNC);
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    const LatencyHistogram& sync = metrics->stageLatency(MetricStage::DISK_SYNC);
+    check(sync.count() == 1 && sync.maxUs() >= 20000 && sync.maxUs() < 200000, "Timer records the elapsed time");
+
+    {
+        Metrics::CommandTimer timer(MetricCommand::GET);
+        timer.succeeded();
+    }
+    try {
+        Metrics::CommandTimer timer(MetricCommand::PUT);
+        throw std::runtime_error("connection lost");
+    } catch (const std::exception&) {
+    }
+    check(metrics->commands(MetricCommand::GET, true) == 1 && metrics->commands(MetricCommand::PUT, false) == 1 &&
+          metrics->commands(MetricCommand::PUT, true) == 0, "Command results recorded");
+}
+
+void testExporter() {
+    std::cout << "\n=== Metrics are served in Prometheus text format ===" << std::endl;
+    AdmissionControl::createShared(AdmissionControl::Limits{4, 4, 100, 1024 * 1024});
+    {
+        AdmissionControl::Ticket ticket = AdmissionControl::admitShared();
+    }
+    Metrics::add(MetricCounter::AUTH_FAILURES, 2);
+
+    std::string text = Metrics::shared()->render();
+    check(contains(text, "# TYPE dfs_command_duration_seconds histogram\n"), "Histogram family declared");
+    check(contains(text, "dfs_commands_total{command=\"GET\",result=\"ok\"} 1\n"), "Command counter rendered");
+    check(contains(text, "dfs_command_duration_seconds_count{command=\"GET\"} 1\n"), "Command histogram count");
+    check(contains(text, "dfs_stage_duration_seconds_bucket{stage=\"disk_write\",le=\"+Inf\"} 4000\n"),
+          "Stage histogram +Inf bucket");
+    check(contains(text, "dfs_stage_duration_seconds_bucket{stage=\"disk_write\",le=\"0.0001\"} "),
+          "Stage histogram bounds in seconds");
+    check(contains(text, "dfs_stage_duration_seconds_quantile{stage=\"disk_write\",quantile=\"0.99\"} "),
+          "Quantiles rendered");
+    check(contains(text, "dfs_received_bytes_total 40000\n") && contains(text, "dfs_auth_failures_total 2\n"),
+          "Byte and auth failure counters rendered");
+    check(contains(text, "dfs_admission_admitted_total 1\n"), "Admission statistics rendered");
+    check(!contains(text, "dfs_cache_hits_total"), "Absent components are left out");
+
+    // 导出进程在测试结束时随父进程退出
+    int port = 20000 + getpid() % 20000;
+    pid_t exporter = Metrics::startExporter(port);
+    check(exporter > 0, "Exporter started");
+    std::string response = httpGet(port, "/metrics");
+    check(response.compare(0, 15, "HTTP/1.1 200 OK") == 0, "GET /metrics answered");
+    check(contains(response, "Content-Type: text/plain; version=0.0.4") &&
+          contains(response, "dfs_admission_admitted_total 1\n"), "Response carries the metrics");
+
+    // 导出进程读取的是共享的计数，之后的记录也能看到
+    Metrics::add(MetricCounter::BYTES_OUT, 123);
+    check(contains(httpGet(port, "/metrics"), "dfs_sent_bytes_total 123\n"), "Later records visible to the exporter");
+    check(httpGet(port, "/other").compare(0, 12, "HTTP/1.1 404") == 0, "Unknown path answered with 404");
+
+    kill(exporter, SIGTERM);
+    waitpid(exporter, nullptr, 0);
+}
+
+} // namespace
+
+int main() {
+    printBanner("DFS Metrics Tests");
+
+    testBuckets();
+    testQuantiles();
+    testSharedRecording();
+    testExporter();
+
+    return finishTests();
+}
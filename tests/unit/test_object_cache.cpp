@@ -0,0 +1,268 @@
+#include "object_cache.hpp"
+#include "object_io.hpp"
+#include "netutils.hpp"
+#include "test_common.hpp"
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+std::string makeContent(size_t size, unsigned char seed) {
+    std::string content(size, '\0');
+    for (size_t i = 0; i < size; i++) {
+        content[i] = static_cast<char>(i * 131 + seed);
+    }
+    return content;
+}
+
+void writeFile(const std::string& path, const std::string& content) {
+    std::string partial = path + ".tmp";
+    int fd = open(partial.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    (void)!write(fd, content.data(), content.size());
+    close(fd);
+    rename(partial.c_str(), path.c_str());
+}
+
+ObjectCache::Version versionOf(int fd) {
+    struct stat st;
+    fstat(fd, &st);
+    return ObjectCache::Version{static_cast<uint64_t>(st.st_ino),
+                                static_cast<uint64_t>(st.st_mtim.tv_sec) * 1000000000ULL +
+                                    static_cast<uint64_t>(st.st_mtim.tv_nsec),
+                                static_cast<uint64_t>(st.st_size)};
+}
+
+// 在socketpair一端执行send，另一端读回分片；send没有发送任何内容时返回false
+bool fetch(const std::function<bool(int)>& send, int splitId, std::string& content) {
+    int fds[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    bool sent = false;
+    std::thread server([&]() {
+        try {
+            sent = send(fds[0]);
+        } catch (const std::exception&) {
+        }
+        shutdown(fds[0], SHUT_WR);
+    });
+    content.clear();
+    int receivedId = -1, length = 0;
+    try {
+        NetUtils::recvSplitHeader(fds[1], receivedId, length);
+        content.resize(static_cast<size_t>(length));
+        if (length > 0) {
+            NetUtils::recvBytesFromSocket(fds[1], reinterpret_cast<unsigned char*>(&content[0]), content.size());
+        }
+    } catch (const std::exception&) {
+    }
+    server.join();
+    close(fds[0]);
+    close(fds[1]);
+    return sent && receivedId == splitId;
+}
+
+// 通过缓存发送文件中的对象
+bool cachedGet(ObjectCache& cache, const std::string& path, int splitId, std::string& content) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    ObjectCache::Version version = versionOf(fd);
+    bool ok = fetch([&](int socket) {
+        return cache.sendObject(socket, splitId, path, version, fd, 0, version.length);
+    }, splitId, content);
+    close(fd);
+    return ok;
+}
+
+void testHitAndMiss(const std::string& root) {
+    std::cout << "\n=== Repeated GETs are served from the cache ===" << std::endl;
+    ObjectCache cache(4 * 1024 * 1024);
+    check(cache.isAvailable(), "Cache mapped");
+
+    std::string path = root + "/.a.txt.0";
+    std::string content = makeContent(100 * 1024 + 7, 1);
+    writeFile(path, content);
+
+    std::string data;
+    check(cachedGet(cache, path, 0, data) && data == content, "First GET loads and sends the object");
+    ObjectCache::Stats stats = cache.stats();
+    check(stats.misses == 1 && stats.hits == 0 && stats.insertions == 1, "First GET is a miss");
+    check(stats.objects == 1 && stats.bytes == content.size(), "Object accounted");
+
+    check(cachedGet(cache, path, 0, data) && data == content, "Second GET returns the object");
+    check(cache.stats().hits == 1, "Second GET is a hit");
+
+    int fd = open(path.c_str(), O_RDONLY);
+    std::string cached;
+    check(cache.readObject(path, versionOf(fd), cached) && cached == content, "Cached bytes match the file");
+    close(fd);
+
+    // PUT覆盖对象：新文件的版本不同，旧内容不能再被读到
+    std::string updated = makeContent(50 * 1024, 2);
+    writeFile(path, updated);
+    check(cachedGet(cache, path, 0, data) && data == updated, "Overwritten object is reloaded");
+    stats = cache.stats();
+    check(stats.misses == 2 && stats.objects == 1 && stats.bytes == updated.size(), "Stale entry replaced");
+
+    std::string big = root + "/.big.0";
+    writeFile(big, makeContent(2 * 1024 * 1024, 3));
+    check(!cachedGet(cache, big, 0, data) && data.empty(), "Object above a quarter of the budget is not cached");
+}
+
+void testClockEviction(const std::string& root) {
+    std::cout << "\n=== CLOCK eviction within the byte budget ===" << std::endl;
+    ObjectCache cache(1024 * 1024);
+    std::vector<std::string> paths;
+    for (int i = 0; i < 5; i++) {
+        paths.push_back(root + "/.evict.txt." + std::to_string(i));
+        writeFile(paths.back(), makeContent(200 * 1024, static_cast<unsigned char>(i)));
+    }
+
+    std::string data;
+    for (int i = 0; i < 4; i++) {
+        cachedGet(cache, paths[i], i, data);
+    }
+    check(cache.stats().objects == 4 && cache.stats().evictions == 0, "Four objects fit in the budget");
+    cachedGet(cache, paths[0], 0, data);
+
+    check(cachedGet(cache, paths[4], 4, data) && data == makeContent(200 * 1024, 4), "Fifth object cached");
+    ObjectCache::Stats stats = cache.stats();
+    check(stats.evictions == 1 && stats.objects == 4 && stats.bytes <= stats.capacity, "One object evicted");
+
+    auto cached = [&](int i) {
+        int fd = open(paths[i].c_str(), O_RDONLY);
+        std::string bytes;
+        bool hit = cache.readObject(paths[i], versionOf(fd), bytes);
+        close(fd);
+        return hit;
+    };
+    check(cached(0), "Recently hit object survives");
+    check(!cached(1), "Unreferenced object is evicted first");
+    check(cached(2) && cached(3) && cached(4), "Other objects stay cached");
+}
+
+void testSharedAcrossProcesses(const std::string& root) {
+    std::cout << "\n=== Cache is shared by forked workers ===" << std::endl;
+    ObjectCache cache(8 * 1024 * 1024);
+    std::vector<std::string> paths;
+    for (int i = 0; i < 8; i++) {
+        paths.push_back(root + "/.shared.txt." + std::to_string(i));
+        writeFile(paths.back(), makeContent(64 * 1024 + static_cast<size_t>(i) * 4096, static_cast<unsigned char>(i)));
+    }
+
+    // 子进程（相当于fork模式的连接进程）载入对象后退出
+    pid_t child = fork();
+    if (child == 0) {
+        std::string data;
+        for (size_t i = 0; i < paths.size(); i++) {
+            cachedGet(cache, paths[i], static_cast<int>(i), data);
+        }
+        _exit(0);
+    }
+    waitpid(child, nullptr, 0);
+    check(cache.stats().insertions == paths.size(), "Objects loaded by a child process");
+
+    std::string data;
+    bool same = true;
+    for (size_t i = 0; i < paths.size(); i++) {
+        same = cachedGet(cache, paths[i], static_cast<int>(i), data) &&
+               data == makeContent(64 * 1024 + i * 4096, static_cast<unsigned char>(i)) && same;
+    }
+    check(same && cache.stats().hits == paths.size(), "Parent hits objects loaded by the child");
+
+    // 多个进程的多个线程同时读取，条目在发送期间被钉住
+    int results[2];
+    if (pipe(results) < 0) {
+        check(false, "Result pipe created");
+        return;
+    }
+    const int processes = 3;
+    for (int p = 0; p < processes; p++) {
+        if (fork() == 0) {
+            int errors = 0;
+            std::vector<std::thread> threads;
+            for (int t = 0; t < 4; t++) {
+                threads.emplace_back([&, t]() {
+                    std::string bytes;
+                    for (int round = 0; round < 20; round++) {
+                        size_t i = static_cast<size_t>(round + t) % paths.size();
+                        if (!cachedGet(cache, paths[i], static_cast<int>(i), bytes) ||
+                            bytes != makeContent(64 * 1024 + i * 4096, static_cast<unsigned char>(i))) {
+                            __atomic_add_fetch(&errors, 1, __ATOMIC_RELAXED);
+                        }
+                    }
+                });
+            }
+            for (auto& thread : threads) {
+                thread.join();
+            }
+            (void)!write(results[1], &errors, sizeof(errors));
+            _exit(0);
+        }
+    }
+    close(results[1]);
+    int errors = 0, childErrors;
+    while (read(results[0], &childErrors, sizeof(childErrors)) == static_cast<ssize_t>(sizeof(childErrors))) {
+        errors += childErrors;
+    }
+    close(results[0]);
+    while (wait(nullptr) > 0) {
+    }
+    check(errors == 0, "Concurrent GETs from several processes return correct objects");
+    check(cache.stats().hits == paths.size() + processes * 4 * 20, "Every concurrent GET is a hit");
+}
+
+void testObjectIoIntegration(const std::string& root) {
+    std::cout << "\n=== GET through the object I/O backend uses the shared cache ===" << std::endl;
+    ObjectCache::createShared(4 * 1024 * 1024);
+    check(ObjectCache::shared() != nullptr, "Shared cache created");
+    std::unique_ptr<ObjectIoBackend> io = ObjectIoBackend::create(DfsIoBackend::BLOCKING);
+
+    std::string path = ObjectIoBackend::objectPath(root, "io.txt", 2);
+    std::string content = makeContent(300 * 1024, 9);
+    writeFile(path, content);
+    std::string data;
+    auto get = [&](int socket) {
+        io->sendObject(socket, 2, path);
+        return true;
+    };
+    check(fetch(get, 2, data) && data == content, "First GET through the backend");
+    check(fetch(get, 2, data) && data == content, "Second GET through the backend");
+    ObjectCache::Stats stats = ObjectCache::shared()->stats();
+    check(stats.misses == 1 && stats.hits == 1, "Backend GETs counted as miss then hit");
+
+    std::string missing = ObjectIoBackend::objectPath(root, "missing.txt", 0);
+    auto getMissing = [&](int socket) {
+        io->sendObject(socket, 0, missing);
+        return true;
+    };
+    check(fetch(getMissing, 0, data) && data.empty(), "Missing object still returns an empty split");
+
+    ObjectCache::createShared(0);
+    check(ObjectCache::shared() == nullptr, "Cache disabled with a zero budget");
+}
+
+} // namespace
+
+int main() {
+    printBanner("DFS Object Cache Tests");
+
+    std::string root = makeTempDir("object_cache");
+    testHitAndMiss(root);
+    testClockEviction(root);
+    testSharedAcrossProcesses(root);
+    testObjectIoIntegration(root);
+
+    removeTempDir(root);
+
+    return finishTests();
+}
@@ -0,0 +1,288 @@
+#include "packed_store.hpp"
+#include "dir_index.hpp"
+#include "netutils.hpp"
+#include "test_common.hpp"
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+std::vector<unsigned char> makeContent(size_t size, unsigned char seed) {
+    std::vector<unsigned char> content(size);
+    for (size_t i = 0; i < size; i++) {
+        content[i] = static_cast<unsigned char>(i * 131 + seed);
+    }
+    return content;
+}
+
+// 通过socketpair发送一个分片，由存储在另一端接收
+bool putObject(PackedStore& store, ObjectIoBackend& io, const std::string& folder, const std::string& fileName,
+               int splitId, const std::vector<unsigned char>& content) {
+    int fds[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    std::thread peer([&]() {
+        std::vector<unsigned char> header;
+        NetUtils::encodeSplitHeader(header, splitId, static_cast<int>(content.size()));
+        NetUtils::sendToSocket(fds[1], header);
+        if (!content.empty()) {
+            NetUtils::sendToSocket(fds[1], content);
+        }
+    });
+    int receivedId = -1;
+    uint64_t size = 0;
+    bool ok = store.recvObject(fds[0], io, folder, fileName, receivedId, size);
+    peer.join();
+    close(fds[0]);
+    close(fds[1]);
+    return ok && receivedId == splitId && size == content.size();
+}
+
+// 通过存储的GET路径发送对象，读回分片内容
+bool getObject(PackedStore& store, ObjectIoBackend& io, const std::string& objectFile, int splitId,
+               std::vector<unsigned char>& content) {
+    int fds[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    bool found = false;
+    std::thread server([&]() {
+        found = store.sendObject(fds[0], io, splitId, objectFile);
+        shutdown(fds[0], SHUT_WR);
+    });
+    int receivedId = -1, length = 0;
+    content.clear();
+    try {
+        NetUtils::recvSplitHeader(fds[1], receivedId, length);
+        content.resize(static_cast<size_t>(length));
+        if (length > 0) {
+            NetUtils::recvBytesFromSocket(fds[1], content.data(), content.size());
+        }
+    } catch (const std::exception&) {
+    }
+    server.join();
+    close(fds[0]);
+    close(fds[1]);
+    return found && receivedId == splitId;
+}
+
+size_t countFiles(const std::string& path) {
+    size_t count = 0;
+    DIR* dp = opendir(path.c_str());
+    if (!dp) {
+        return 0;
+    }
+    while (struct dirent* ep = readdir(dp)) {
+        std::string name = ep->d_name;
+        if (name != "." && name != "..") {
+            count++;
+        }
+    }
+    closedir(dp);
+    return count;
+}
+
+void testPutGet(const std::string& root, DfsIoBackend type) {
+    std::unique_ptr<ObjectIoBackend> io = ObjectIoBackend::create(type);
+    std::cout << "\n=== PUT/GET through segments (" << io->name() << ") ===" << std::endl;
+    std::string server = root + "/" + io->name();
+    std::string folder = server + "/Bob/docs";
+    mkdir(server.c_str(), 0755);
+    PackedStore store(server);
+
+    std::vector<unsigned char> small = makeContent(100, 1);
+    std::vector<unsigned char> large = makeContent(3 * 1024 * 1024 + 17, 2);
+    check(putObject(store, *io, folder, "a.txt", 0, small), "small object stored");
+    check(putObject(store, *io, folder, "a.txt", 1, large), "large object stored at an unaligned offset");
+    check(putObject(store, *io, folder, "empty.bin", 2, {}), "empty object stored");
+
+    std::vector<unsigned char> content;
+    check(getObject(store, *io, ObjectIoBackend::objectPath(folder, "a.txt", 0), 0, content) && content == small,
+          "small object read back");
+    check(getObject(store, *io, ObjectIoBackend::objectPath(folder, "a.txt", 1), 1, content) && content == large,
+          "large object read back");
+    check(getObject(store, *io, ObjectIoBackend::objectPath(folder, "empty.bin", 2), 2, content) && content.empty(),
+          "empty object read back");
+    check(!store.contains(ObjectIoBackend::objectPath(folder, "a.txt", 3)), "missing object not found");
+    check(access(ObjectIoBackend::objectPath(folder, "a.txt", 0).c_str(), F_OK) != 0,
+          "no per-object file created");
+}
+
+void testOverwriteAndReload(const std::string& root) {
+    std::cout << "\n=== Overwrites and other processes ===" << std::endl;
+    std::string server = root + "/reload";
+    std::string folder = server + "/Bob";
+    mkdir(server.c_str(), 0755);
+    BlockingObjectIo io;
+    std::string objectFile = ObjectIoBackend::objectPath(folder, "f.txt", 0);
+
+    // 两个实例模拟两个fork出的子进程
+    PackedStore writer(server);
+    PackedStore reader(server);
+    check(!reader.contains(objectFile), "empty store");
+    putObject(writer, io, folder, "f.txt", 0, makeContent(1000, 3));
+    std::vector<unsigned char> latest = makeContent(2000, 4);
+    putObject(writer, io, folder, "f.txt", 0, latest);
+
+    std::vector<unsigned char> content;
+    check(reader.readObject(objectFile, content) && content == latest, "other instance sees the latest version");
+    PackedStore reopened(server);
+    check(reopened.readObject(objectFile, content) && content == latest, "reloaded store keeps the latest version");
+    PackedStore::Stats stats = reopened.stats();
+    check(stats.objects == 1 && stats.liveBytes < stats.totalBytes, "overwritten record counted as garbage");
+}
+
+void testCompaction(const std::string& root) {
+    std::cout << "\n=== Compaction ===" << std::endl;
+    std::string server = root + "/compact";
+    std::string folder = server + "/Bob";
+    mkdir(server.c_str(), 0755);
+    const uint64_t segmentSize = 64 * 1024;
+    BlockingObjectIo io;
+
+    // 写入进程在接收数据途中被杀死，留下没有锁的R记录
+    {
+        int fds[2];
+        socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+        pid_t pid = fork();
+        if (pid == 0) {
+            PackedStore store(server, segmentSize);
+            int splitId;
+            uint64_t size;
+            try {
+                store.recvObject(fds[0], io, folder, "crash.bin", splitId, size);
+            } catch (...) {
+            }
+            _exit(0);
+        }
+        std::vector<unsigned char> header;
+        NetUtils::encodeSplitHeader(header, 0, 10000);
+        NetUtils::sendToSocket(fds[1], header);
+        NetUtils::sendToSocket(fds[1], makeContent(5000, 5));
+        usleep(200000);
+        kill(pid, SIGKILL);
+        waitpid(pid, nullptr, 0);
+        close(fds[0]);
+        close(fds[1]);
+    }
+
+    PackedStore store(server, segmentSize);
+    const int objects = 24;
+    for (int round = 0; round < 2; round++) {
+        for (int i = 0; i < objects; i++) {
+            putObject(store, io, folder, "obj" + std::to_string(i), 0, makeContent(8000, static_cast<unsigned char>(round)));
+        }
+    }
+    PackedStore::Stats before = store.stats();
+    size_t removed = store.compact();
+    PackedStore::Stats after = store.stats();
+    std::cout << "segments " << before.segments << " -> " << after.segments << ", bytes " << before.totalBytes
+              << " -> " << after.totalBytes << std::endl;
+    check(removed > 0 && after.totalBytes < before.totalBytes, "sealed segments with garbage compacted");
+    check(!store.contains(ObjectIoBackend::objectPath(folder, "crash.bin", 0)), "abandoned record not visible");
+
+    bool intact = true;
+    PackedStore fresh(server, segmentSize);
+    std::vector<unsigned char> content;
+    std::vector<unsigned char> expected = makeContent(8000, 1);
+    for (int i = 0; i < objects; i++) {
+        std::string objectFile = ObjectIoBackend::objectPath(folder, "obj" + std::to_string(i), 0);
+        intact = intact && fresh.readObject(objectFile, content) && content == expected;
+    }
+    check(intact, "all objects intact after compaction");
+    check(fresh.stats().objects == static_cast<size_t>(objects), "reloaded store has every object once");
+
+    // 第二次压缩为剩下的封存段写出提示文件，重新加载结果相同
+    store.compact();
+    PackedStore hinted(server, segmentSize);
+    check(hinted.stats().objects == static_cast<size_t>(objects), "store reloaded through hint files");
+}
+
+void testDirIndexRebuild(const std::string& root) {
+    std::cout << "\n=== Directory index rebuild ===" << std::endl;
+    std::string server = root + "/rebuild";
+    std::string folder = server + "/Bob";
+    mkdir(server.c_str(), 0755);
+    mkdir(folder.c_str(), 0755);
+    BlockingObjectIo io;
+    PackedStore& store = PackedStore::forRoot(server);
+    putObject(store, io, folder, "report.pdf", 0, makeContent(10, 6));
+    putObject(store, io, folder, "report.pdf", 1, makeContent(10, 6));
+
+    DirIndex index(folder);
+    ServerChunksInfo info;
+    check(index.findFile("report.pdf", info) && info.chunk_info[0].chunks[0] == 0 &&
+          info.chunk_info[0].chunks[1] == 1, "rebuilt index lists packed objects");
+}
+
+void benchSmallPuts(const std::string& root) {
+    std::cout << "\n=== Small object PUT: files vs packed ===" << std::endl;
+    const int count = 5000;
+    const size_t size = 4096;
+    std::vector<unsigned char> content = makeContent(size, 7);
+    BlockingObjectIo io;
+
+    std::string filesFolder = root + "/bench-files";
+    mkdir(filesFolder.c_str(), 0755);
+    auto start = std::chrono::steady_clock::now();
+    int fds[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    for (int i = 0; i < count; i++) {
+        std::vector<unsigned char> header;
+        NetUtils::encodeSplitHeader(header, 0, static_cast<int>(size));
+        NetUtils::sendToSocket(fds[1], header);
+        NetUtils::sendToSocket(fds[1], content);
+        io.recvObject(fds[0], filesFolder, "f" + std::to_string(i));
+    }
+    auto filesUs = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+
+    std::string server = root + "/bench-packed";
+    mkdir(server.c_str(), 0755);
+    PackedStore store(server);
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; i++) {
+        std::vector<unsigned char> header;
+        NetUtils::encodeSplitHeader(header, 0, static_cast<int>(size));
+        NetUtils::sendToSocket(fds[1], header);
+        NetUtils::sendToSocket(fds[1], content);
+        int splitId;
+        uint64_t stored;
+        store.recvObject(fds[0], io, server + "/Bob", "f" + std::to_string(i), splitId, stored);
+    }
+    auto packedUs = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    close(fds[0]);
+    close(fds[1]);
+
+    size_t filesCreated = countFiles(filesFolder);
+    size_t segmentFiles = countFiles(server + "/" + PACKED_STORE_DIR);
+    std::cout << count << " x " << size / 1024 << "KB: files " << filesUs / count << " us/object, "
+              << filesCreated << " files; packed " << packedUs / count << " us/object, "
+              << segmentFiles << " segment file(s)" << std::endl;
+    check(filesCreated == static_cast<size_t>(count) && segmentFiles == 1, "packed store uses one file instead of one per object");
+}
+
+} // namespace
+
+int main() {
+    printBanner("DFS Packed Object Store Tests");
+
+    std::string root = makeTempDir("packed_store");
+    testPutGet(root, DfsIoBackend::BLOCKING);
+    testPutGet(root, DfsIoBackend::IO_URING);
+    testOverwriteAndReload(root);
+    testCompaction(root);
+    testDirIndexRebuild(root);
+    benchSmallPuts(root);
+    removeTempDir(root);
+
+    return finishTests();
+}
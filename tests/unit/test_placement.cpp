@@ -0,0 +1,220 @@
+#include "placement.hpp"
+#include "test_common.hpp"
+#include <algorithm>
+#include <iostream>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace {
+
+std::vector<std::string> serverNames(int count) {
+    std::vector<std::string> names;
+    for (int i = 1; i <= count; i++) {
+        names.push_back("DFS" + std::to_string(i));
+    }
+    return names;
+}
+
+const char* typeName(PlacementType type) {
+    return type == PlacementType::RING ? "ring" : "rendezvous";
+}
+
+void testReplicas(PlacementType type) {
+    std::cout << "\n=== " << typeName(type) << ": replicas are distinct and deterministic ===" << std::endl;
+    std::unique_ptr<Placement> placement = Placement::create(type, serverNames(8), 3);
+    std::unique_ptr<Placement> again = Placement::create(type, serverNames(8), 3);
+    bool distinct = true;
+    bool same = true;
+    std::vector<int> servers;
+    std::vector<int> other;
+    for (int objId = 0; objId < 1000; objId++) {
+        uint64_t key = Placement::objectKey("/docs/report.pdf", objId);
+        placement->replicas(key, servers);
+        again->replicas(key, other);
+        std::set<int> unique(servers.begin(), servers.end());
+        distinct = distinct && servers.size() == 3 && unique.size() == 3 && *unique.rbegin() < 8;
+        same = same && servers == other;
+    }
+    check(distinct, "Three distinct servers per object");
+    check(same, "Separately built placements agree");
+
+    placement->replicas(Placement::objectKey("/docs/report.pdf", 7), servers);
+    check(placement->stores(Placement::objectKey("/docs/report.pdf", 7), servers[0]), "stores() matches replicas()");
+
+    std::unique_ptr<Placement> small = Placement::create(type, serverNames(2), 3);
+    small->replicas(Placement::objectKey("/a", 0), servers);
+    check(small->replicationFactor() == 2 && servers.size() == 2, "Fewer servers than replicas: every server stores it");
+}
+
+void testBalance(PlacementType type, int serverCount) {
+    std::cout << "\n=== " << typeName(type) << ": " << serverCount << " servers share the objects evenly ===" << std::endl;
+    std::unique_ptr<Placement> placement = Placement::create(type, serverNames(serverCount), 2);
+    constexpr int files = 200;
+    constexpr int objectsPerFile = 256;
+    std::vector<int> load(serverCount, 0);
+    std::vector<std::vector<int>> objects;
+    for (int file = 0; file < files; file++) {
+        placement->objectsByServer("/data/file" + std::to_string(file), objectsPerFile, objects);
+        for (int serverIdx = 0; serverIdx < serverCount; serverIdx++) {
+            load[serverIdx] += static_cast<int>(objects[serverIdx].size());
+        }
+    }
+    double mean = 2.0 * files * objectsPerFile / serverCount;
+    auto bounds = std::minmax_element(load.begin(), load.end());
+    check(*bounds.first > mean * 0.7 && *bounds.second < mean * 1.3,
+          "Every server within 30% of the mean (" + std::to_string(*bounds.first) + ".." +
+          std::to_string(*bounds.second) + ", mean " + std::to_string(static_cast<int>(mean)) + ")");
+}
+
+void testGrowth(PlacementType type, int serverCount) {
+    std::cout << "\n=== " << typeName(type) << ": adding server " << serverCount + 1
+              << " moves about 1/N of the replicas ===" << std::endl;
+    std::unique_ptr<Placement> before = Placement::create(type, serverNames(serverCount), 2);
+    std::unique_ptr<Placement> after = Placement::create(type, serverNames(serverCount + 1), 2);
+    constexpr int objects = 100000;
+    int moved = 0;
+    bool onlyToNew = true;
+    std::vector<int> oldServers;
+    std::vector<int> newServers;
+    for (int objId = 0; objId < objects; objId++) {
+        uint64_t key = Placement::objectKey("/growth", objId);
+        before->replicas(key, oldServers);
+        after->replicas(key, newServers);
+        for (int serverIdx : newServers) {
+            if (std::find(oldServers.begin(), oldServers.end(), serverIdx) == oldServers.end()) {
+                moved++;
+                // 旧服务器之间不搬移对象，新位置只能是新加入的服务器
+                onlyToNew = onlyToNew && serverIdx == serverCount;
+            }
+        }
+    }
+    double fraction = static_cast<double>(moved) / (2.0 * objects);
+    double expected = 1.0 / (serverCount + 1);
+    check(onlyToNew, "Replicas only move to the new server");
+    check(fraction > expected * 0.7 && fraction < expected * 1.3,
+          "Moved fraction " + std::to_string(fraction) + " close to " + std::to_string(expected));
+}
+
+void testOrderIndependent() {
+    std::cout << "\n=== Placement follows server names, not their order ===" << std::endl;
+    std::vector<std::string> names = serverNames(6);
+    std::vector<std::string> reversed(names.rbegin(), names.rend());
+    for (PlacementType type : {PlacementType::RING, PlacementType::RENDEZVOUS}) {
+        std::unique_ptr<Placement> placement = Placement::create(type, names, 2);
+        std::unique_ptr<Placement> shuffled = Placement::create(type, reversed, 2);
+        bool same = true;
+        std::vector<int> servers;
+        std::vector<int> other;
+        for (int objId = 0; objId < 1000; objId++) {
+            uint64_t key = Placement::objectKey("/order", objId);
+            placement->replicas(key, servers);
+            shuffled->replicas(key, other);
+            std::set<std::string> a;
+            std::set<std::string> b;
+            for (int serverIdx : servers) a.insert(names[serverIdx]);
+            for (int serverIdx : other) b.insert(reversed[serverIdx]);
+            same = same && a == b;
+        }
+        check(same, std::string(typeName(type)) + ": reordered servers keep their objects");
+    }
+}
+
+void testLivePlacement(PlacementType type) {
+    std::cout << "\n=== " << typeName(type) << ": pieces on down servers move to the next live servers ===" << std::endl;
+    std::unique_ptr<Placement> placement = Placement::create(type, serverNames(6), 2);
+    std::vector<int> servers;
+    std::vector<int> order;
+    uint64_t key = Placement::objectKey("/live", 0);
+    placement->preferenceList(key, 6, order);
+    placement->replicas(key, servers);
+    check(order.size() == 6 && std::set<int>(order.begin(), order.end()).size() == 6, "Preference list covers every server once");
+    check(std::equal(servers.begin(), servers.end(), order.begin()), "Replicas lead the preference list");
+    placement->handoffs(key, servers);
+    check(std::equal(servers.begin(), servers.end(), order.begin() + 2), "Handoffs follow the replicas");
+
+    std::vector<bool> live(6, true);
+    live[order[0]] = false;
+    live[order[2]] = false;
+    placement->liveReplicas(key, live, servers);
+    check(std::set<int>(servers.begin(), servers.end()) == std::set<int>{order[1], order[3]},
+          "Down replica replaced by the first live handoff");
+
+    // 全部在线时与不考虑在线情况的放置相同
+    std::vector<std::vector<int>> objects;
+    std::vector<std::vector<int>> liveObjects;
+    placement->objectsByServer("/live", 50, objects);
+    placement->liveObjectsByServer("/live", 50, std::vector<bool>(6, true), liveObjects);
+    check(objects == liveObjects, "Objects unchanged when every server is live");
+
+    // 一半服务器不可达时每个对象仍有2个在线副本
+    live.assign(6, true);
+    live[1] = live[3] = live[5] = false;
+    placement->liveObjectsByServer("/live", 50, live, liveObjects);
+    std::vector<int> copies(50, 0);
+    bool onLive = true;
+    for (int serverIdx = 0; serverIdx < 6; serverIdx++) {
+        onLive = onLive && (live[serverIdx] || liveObjects[serverIdx].empty());
+        for (int objId : liveObjects[serverIdx]) copies[objId]++;
+    }
+    check(onLive && std::all_of(copies.begin(), copies.end(), [](int n) { return n == 2; }),
+          "Every object keeps 2 copies on live servers");
+
+    // 纠删码：4个分段在6个服务器上，2个不可达时分段改放到其余服务器，同一对象的分段仍在不同服务器上
+    std::unique_ptr<Placement> erasure = Placement::create(type, serverNames(6), 4);
+    std::vector<std::vector<int>> fragments;
+    live = {true, false, true, true, false, true};
+    erasure->liveFragmentsByServer("/live", 50, 4, live, fragments);
+    std::vector<std::set<int>> holders(50);
+    size_t placed = 0;
+    for (int serverIdx = 0; serverIdx < 6; serverIdx++) {
+        check(live[serverIdx] || fragments[serverIdx].empty(), "No fragment on down server " + std::to_string(serverIdx));
+        check(std::is_sorted(fragments[serverIdx].begin(), fragments[serverIdx].end()), "Fragment ids stay sorted");
+        for (int id : fragments[serverIdx]) holders[id / 4].insert(serverIdx);
+        placed += fragments[serverIdx].size();
+    }
+    check(placed == 200 && std::all_of(holders.begin(), holders.end(), [](const std::set<int>& h) { return h.size() == 4; }),
+          "Every fragment placed on a distinct live server");
+
+    // 在线服务器不够时丢弃分段，由调用者检查
+    erasure->liveFragmentsByServer("/live", 1, 4, {true, false, true, true, false, false}, fragments);
+    placed = 0;
+    for (const std::vector<int>& ids : fragments) placed += ids.size();
+    check(placed == 3, "Only as many fragments as live servers are placed");
+}
+
+void testConfig() {
+    std::cout << "\n=== Placement settings are validated ===" << std::endl;
+    PlacementType type = PlacementType::RING;
+    check(Placement::parseType("rendezvous", type) && type == PlacementType::RENDEZVOUS, "rendezvous parsed");
+    check(Placement::parseType("ring", type) && type == PlacementType::RING, "ring parsed");
+    check(!Placement::parseType("modulo", type), "Unknown name rejected");
+
+    bool threw = false;
+    try {
+        Placement::create(PlacementType::RING, serverNames(4), 0);
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    check(threw, "Replication factor 0 rejected");
+}
+
+} // namespace
+
+int main() {
+    printBanner("DFS Placement Tests");
+
+    for (PlacementType type : {PlacementType::RING, PlacementType::RENDEZVOUS}) {
+        testReplicas(type);
+        testBalance(type, 4);
+        testBalance(type, 48);
+        testGrowth(type, 4);
+        testGrowth(type, 32);
+        testLivePlacement(type);
+    }
+    testOrderIndependent();
+    testConfig();
+
+    return finishTests();
+}
@@ -0,0 +1,216 @@
+#include "put_pipeline.hpp"
+#include "test_common.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// 分片内容由对象ID和分片序号决定，接收端据此核对
+std::vector<unsigned char> pieceContent(int objId, int piece) {
+    return std::vector<unsigned char>(64 + objId % 7, static_cast<unsigned char>(objId * 31 + piece));
+}
+
+PutPipeline::ReadStage readIds() {
+    return [](int objId, Split& object) {
+        object.id = objId;
+        object.content = pieceContent(objId, 0);
+        object.content_length = object.content.size();
+    };
+}
+
+PutPipeline::EncodeStage splitInto(int width) {
+    return [width](Split& object, std::vector<std::unique_ptr<Split>>& pieces) {
+        for (int j = 0; j < width; j++) {
+            pieces[j] = std::make_unique<Split>(object.id * width + j, 0, pieceContent(object.id, j));
+        }
+    };
+}
+
+// 服务器s保存ID满足 id % servers == s 以及 (id + 1) % servers == s 的分片，即每个分片两个副本
+std::vector<std::vector<int>> placePieces(int pieceCount, int servers) {
+    std::vector<std::vector<int>> byServer(servers);
+    for (int id = 0; id < pieceCount; id++) {
+        byServer[id % servers].push_back(id);
+        byServer[(id + 1) % servers].push_back(id);
+    }
+    for (std::vector<int>& ids : byServer) {
+        std::sort(ids.begin(), ids.end());
+    }
+    return byServer;
+}
+
+void testRouting(int width) {
+    std::cout << "\n=== Every server receives its pieces in order (" << width << " per object) ===" << std::endl;
+    const int objects = 40;
+    const int servers = 5;
+    std::vector<std::vector<int>> byServer = placePieces(objects * width, servers);
+    // 每个服务器只由它自己的发送线程写入
+    std::vector<std::vector<int>> received(servers);
+    bool intact = true;
+    std::atomic<bool> corrupt(false);
+
+    PutPipeline pipeline(objects, width, 4);
+    pipeline.run(readIds(), splitInto(width),
+                 [&received, &corrupt, width](int serverIdx, const Split& piece) {
+                     if (piece.content != pieceContent(piece.id / width, piece.id % width)) {
+                         corrupt = true;
+                     }
+                     received[serverIdx].push_back(piece.id);
+                 },
+                 byServer);
+    for (int s = 0; s < servers; s++) {
+        intact = intact && received[s] == byServer[s];
+    }
+    check(intact, "Each server got exactly its piece ids, in ascending order");
+    check(!corrupt, "Every piece arrived with its own content");
+    check(pipeline.peakInFlight() <= 4, "No more than 4 objects in flight");
+}
+
+void testBoundedMemory() {
+    std::cout << "\n=== A slow server holds back reading ===" << std::endl;
+    const int objects = 64;
+    const int depth = 3;
+    std::atomic<int> alive(0);
+    std::atomic<int> peakAlive(0);
+    std::atomic<int> sent(0);
+    std::atomic<int> aheadOfSend(0);
+
+    PutPipeline pipeline(objects, 1, depth);
+    pipeline.run(
+        [&](int objId, Split& object) {
+            // 读取第objId个对象时，最多还有depth - 1个更早的对象没有发送完
+            aheadOfSend = std::max(aheadOfSend.load(), objId - sent.load());
+            readIds()(objId, object);
+        },
+        [&](Split& object, std::vector<std::unique_ptr<Split>>& pieces) {
+            int now = ++alive;
+            peakAlive = std::max(peakAlive.load(), now);
+            pieces[0] = std::make_unique<Split>(std::move(object));
+        },
+        [&](int, const Split&) {
+            std::this_thread::sleep_for(std::chrono::microseconds(500));
+            alive--;
+            sent++;
+        },
+        std::vector<std::vector<int>>{[] {
+            std::vector<int> ids(objects);
+            for (int i = 0; i < objects; i++) ids[i] = i;
+            return ids;
+        }()});
+    check(sent == objects, "All objects sent");
+    check(pipeline.peakInFlight() == depth, "The pipeline filled all " + std::to_string(depth) + " slots");
+    check(peakAlive <= depth, "At most " + std::to_string(depth) + " encoded objects were held at once");
+    check(aheadOfSend < depth, "Reading never ran more than " + std::to_string(depth) + " objects ahead of sending");
+}
+
+void testOverlap() {
+    std::cout << "\n=== Stages overlap ===" << std::endl;
+    const int objects = 30;
+    const auto stage = std::chrono::milliseconds(3);
+    std::vector<std::vector<int>> byServer(1);
+    for (int i = 0; i < objects; i++) {
+        byServer[0].push_back(i);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    PutPipeline pipeline(objects, 1);
+    pipeline.run(
+        [&](int objId, Split& object) {
+            std::this_thread::sleep_for(stage);
+            readIds()(objId, object);
+        },
+        [&](Split& object, std::vector<std::unique_ptr<Split>>& pieces) {
+            std::this_thread::sleep_for(stage);
+            pieces[0] = std::make_unique<Split>(std::move(object));
+        },
+        [&](int, const Split&) { std::this_thread::sleep_for(stage); },
+        byServer);
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double serial = 3 * objects * 0.003;
+    std::cout << "  " << elapsed * 1000 << " ms, " << serial * 1000 << " ms if the stages ran one after another" << std::endl;
+    // 三个阶段重叠时接近单个阶段的总时间，留出调度抖动的余量
+    check(elapsed < serial * 0.7, "Pipelined PUT is faster than running the stages in turn");
+}
+
+void testFailures() {
+    std::cout << "\n=== A failing stage stops the pipeline ===" << std::endl;
+    const int objects = 50;
+    std::vector<std::vector<int>> byServer = placePieces(objects, 3);
+
+    bool threw = false;
+    try {
+        PutPipeline pipeline(objects, 1, 4);
+        pipeline.run(readIds(), splitInto(1),
+                     [](int serverIdx, const Split& piece) {
+                         if (serverIdx == 1 && piece.id == 19) {
+                             throw std::runtime_error("connection reset");
+                         }
+                     },
+                     byServer);
+    } catch (const std::runtime_error& e) {
+        threw = std::string(e.what()) == "connection reset";
+    }
+    check(threw, "A send error is rethrown after the other senders stop");
+
+    threw = false;
+    try {
+        PutPipeline pipeline(objects, 1, 4);
+        pipeline.run(
+            [](int objId, Split& object) {
+                if (objId == 10) {
+                    throw std::runtime_error("short read");
+                }
+                readIds()(objId, object);
+            },
+            splitInto(1), [](int, const Split&) {}, byServer);
+    } catch (const std::runtime_error& e) {
+        threw = std::string(e.what()) == "short read";
+    }
+    check(threw, "A read error is rethrown instead of leaving senders waiting");
+
+    threw = false;
+    try {
+        PutPipeline pipeline(objects, 2, 4);
+        pipeline.run(readIds(), [](Split&, std::vector<std::unique_ptr<Split>>&) {}, [](int, const Split&) {},
+                     placePieces(objects * 2, 3));
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    check(threw, "An object encoded into too few pieces is an error");
+}
+
+void testEdgeCases() {
+    std::cout << "\n=== Empty files and unplaced objects ===" << std::endl;
+    int sends = 0;
+    PutPipeline empty(0, 1);
+    empty.run(readIds(), splitInto(1), [&sends](int, const Split&) { sends++; }, placePieces(0, 3));
+    check(sends == 0, "An empty file sends nothing");
+
+    // 所有目标服务器都已停止：对象编码后立即释放槽位
+    std::atomic<int> reads(0);
+    PutPipeline unplaced(20, 1, 2);
+    unplaced.run([&reads](int objId, Split& object) { reads++; readIds()(objId, object); }, splitInto(1),
+                 [](int, const Split&) {}, std::vector<std::vector<int>>(3));
+    check(reads == 20, "Objects with no live server do not hold their slots");
+}
+
+} // namespace
+
+int main() {
+    printBanner("DFS PUT Pipeline Tests");
+
+    testRouting(1);
+    testRouting(3);
+    testBoundedMemory();
+    testOverlap();
+    testFailures();
+    testEdgeCases();
+
+    return finishTests();
+}
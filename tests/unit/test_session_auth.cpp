@@ -0,0 +1,151 @@
+#include "dfs_auth.hpp"
+#include "test_common.hpp"
+#include <chrono>
+#include <atomic>
+#include <ctime>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+User makeUser(const std::string& username, const std::string& password) {
+    User user;
+    user.username = username;
+    user.password = password;
+    return user;
+}
+
+void testUserTable() {
+    std::cout << "\n=== User table ===" << std::endl;
+    UserTable table;
+    table.add(makeUser("Bob", "ComplextPassword"));
+    table.add(makeUser("Alice", "SimplePassword"));
+
+    check(table.size() == 2, "two users loaded");
+    check(table.authenticate(makeUser("Bob", "ComplextPassword")), "correct password accepted");
+    check(!table.authenticate(makeUser("Bob", "SimplePassword")), "another user's password rejected");
+    check(!table.authenticate(makeUser("Carol", "ComplextPassword")), "unknown user rejected");
+    check(!table.authenticate(makeUser("Bob", "")), "empty password rejected");
+    check(table.contains("Alice") && !table.contains("alice"), "usernames are case sensitive");
+
+    table.add(makeUser("Bob", "NewPassword"));
+    check(table.size() == 2 && table.authenticate(makeUser("Bob", "NewPassword")) &&
+          !table.authenticate(makeUser("Bob", "ComplextPassword")),
+          "later entry replaces an earlier one");
+}
+
+void testSessionTokens() {
+    std::cout << "\n=== Session tokens ===" << std::endl;
+    SessionTokens tokens;
+    time_t now = time(nullptr);
+    std::string username;
+
+    std::string token = tokens.issue("Bob", now);
+    check(tokens.verify(token, now, username) && username == "Bob", "fresh token accepted");
+    check(tokens.verify(token, now + SESSION_TOKEN_TTL_SECONDS - 1, username), "token valid until its expiry");
+    check(!tokens.verify(token, now + SESSION_TOKEN_TTL_SECONDS, username), "expired token rejected");
+
+    std::string tampered = token;
+    tampered[8] = 'R';   // 用户名的第一个字节
+    check(!tokens.verify(tampered, now, username), "token with a changed username rejected");
+    tampered = token;
+    tampered[0] ^= 0x01;   // 过期时间
+    check(!tokens.verify(tampered, now, username), "token with a changed expiry rejected");
+    check(!tokens.verify(token.substr(0, token.size() - 1), now, username), "truncated token rejected");
+    check(!tokens.verify("", now, username), "empty token rejected");
+
+    SessionTokens restarted;
+    check(!restarted.verify(token, now, username), "token from another server key rejected");
+}
+
+void testLiveUserTable() {
+    std::cout << "\n=== Live user table ===" << std::endl;
+    LiveUserTable live;
+    check(live.size() == 0 && !live.contains("Bob"), "starts empty");
+
+    auto first = std::make_shared<UserTable>();
+    first->add(makeUser("Bob", "ComplextPassword"));
+    live.publish(first);
+    std::shared_ptr<const UserTable> held = live.snapshot();
+
+    auto second = std::make_shared<UserTable>();
+    second->add(makeUser("Bob", "ComplextPassword"));
+    second->add(makeUser("Carol", "NewcomerPassword"));
+    live.publish(second);
+    check(live.authenticate(makeUser("Carol", "NewcomerPassword")), "published user authenticated");
+    check(held->size() == 1 && held->authenticate(makeUser("Bob", "ComplextPassword")),
+          "earlier snapshot still usable after publication");
+
+    // 读线程不停认证Bob，发布线程反复替换整张表：每次认证都看到某一张完整的表
+    std::atomic<bool> stop(false);
+    std::atomic<int> failures(0);
+    std::atomic<long> authentications(0);
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 4; i++) {
+        readers.emplace_back([&]() {
+            while (!stop.load()) {
+                if (!live.authenticate(makeUser("Bob", "ComplextPassword"))) {
+                    failures++;
+                }
+                authentications++;
+            }
+        });
+    }
+    // 读线程启动后才开始发布，否则发布可能在任何一次认证之前就已全部完成
+    while (authentications.load() < 4) {
+        std::this_thread::yield();
+    }
+    for (int i = 0; i < 200; i++) {
+        auto table = std::make_shared<UserTable>();
+        table->add(makeUser("Bob", "ComplextPassword"));
+        table->add(makeUser("user" + std::to_string(i), "password"));
+        live.publish(table);
+    }
+    stop = true;
+    for (std::thread& reader : readers) {
+        reader.join();
+    }
+    check(failures.load() == 0 && authentications.load() > 0,
+          "no failed authentication across " + std::to_string(authentications.load()) + " during 200 publications");
+    check(live.contains("user199") && !live.contains("user0"), "last publication wins");
+
+    live.clear();
+    check(live.size() == 0 && held->size() == 1, "clear publishes an empty table");
+}
+
+void benchAuthentication() {
+    std::cout << "\n=== Authentication cost vs user count ===" << std::endl;
+    const int lookups = 20000;
+    for (int userCount : {10, 10000}) {
+        UserTable table;
+        for (int i = 0; i < userCount; i++) {
+            table.add(makeUser("user" + std::to_string(i), "password" + std::to_string(i)));
+        }
+        User last = makeUser("user" + std::to_string(userCount - 1), "password" + std::to_string(userCount - 1));
+        auto start = std::chrono::steady_clock::now();
+        bool ok = true;
+        for (int i = 0; i < lookups; i++) {
+            ok = table.authenticate(last) && ok;
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        std::cout << userCount << " users: " << elapsed / lookups << " ns per authentication" << std::endl;
+        check(ok, "last of " + std::to_string(userCount) + " users authenticated");
+    }
+}
+
+} // namespace
+
+int main() {
+    printBanner("DFS Session Authentication Tests");
+
+    testUserTable();
+    testSessionTokens();
+    testLiveUserTable();
+    benchAuthentication();
+
+    return finishTests();
+}
@@ -0,0 +1,245 @@
+#include "tenant_qos.hpp"
+#include "object_io.hpp"
+#include "netutils.hpp"
+#include "test_common.hpp"
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+long elapsedMs(std::chrono::steady_clock::time_point start) {
+    return static_cast<long>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count());
+}
+
+std::vector<unsigned char> makeContent(size_t size, unsigned char seed) {
+    std::vector<unsigned char> content(size);
+    for (size_t i = 0; i < size; i++) {
+        content[i] = static_cast<unsigned char>(i * 131 + seed);
+    }
+    return content;
+}
+
+// 以当前线程的用户限速发送bytes字节，返回耗时
+long chargeAs(const std::string& username, size_t bytes) {
+    TenantQos::Scope scope(username);
+    auto start = std::chrono::steady_clock::now();
+    for (size_t charged = 0; charged < bytes; charged += 256 * 1024) {
+        TenantQos::charge(256 * 1024);
+    }
+    return elapsedMs(start);
+}
+
+// 等待桶重新装满
+void refill() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+}
+
+void testParseLimit() {
+    std::cout << "\n=== Limits parsed from dfs.conf tokens ===" << std::endl;
+    TenantLimits limits;
+    check(TenantQos::parseLimit("bandwidth=20M", limits) && limits.bytesPerSecond == 20ULL * 1024 * 1024,
+          "bandwidth with M suffix");
+    check(TenantQos::parseLimit("bandwidth=512K", limits) && limits.bytesPerSecond == 512ULL * 1024,
+          "bandwidth with K suffix");
+    check(TenantQos::parseLimit("bandwidth=2G", limits) && limits.bytesPerSecond == 2ULL * 1024 * 1024 * 1024,
+          "bandwidth with G suffix");
+    check(TenantQos::parseLimit("bandwidth=1000", limits) && limits.bytesPerSecond == 1000, "bandwidth in bytes");
+    check(TenantQos::parseLimit("ops=100", limits) && limits.opsPerSecond == 100 && limits.limited(), "ops");
+
+    TenantLimits untouched;
+    check(!TenantQos::parseLimit("bandwidth=", untouched) && !TenantQos::parseLimit("bandwidth=10X", untouched) &&
+          !TenantQos::parseLimit("ops=5K", untouched) && !TenantQos::parseLimit("speed=1", untouched) &&
+          !TenantQos::parseLimit("Password", untouched) && !untouched.limited(),
+          "Malformed tokens rejected (left in the password)");
+}
+
+void testPacing() {
+    std::cout << "\n=== Buckets pace a tenant to its limits ===" << std::endl;
+    check(TenantQos::shared() != nullptr, "Shared table created");
+
+    // 桶容量1MB：3MB中超出的2MB按4MB/s需要约500ms
+    long elapsed = chargeAs("slow", 3 * 1024 * 1024);
+    check(elapsed >= 400 && elapsed < 900, "Bytes paced to the bandwidth limit (" + std::to_string(elapsed) + "ms)");
+
+    // 没有限速的用户不等待
+    elapsed = chargeAs("fast", 64 * 1024 * 1024);
+    check(elapsed < 50, "Unlimited tenant is not throttled");
+    {
+        TenantQos::Scope scope("fast");
+        check(!TenantQos::throttled(), "Unlimited tenant has no byte limit");
+    }
+    {
+        TenantQos::Scope scope("slow");
+        check(TenantQos::throttled(), "Limited tenant has a byte limit");
+    }
+    check(!TenantQos::throttled(), "Scope restores the previous tenant");
+
+    // 命令桶容量20：30条命令中超出的10条按20/s需要约500ms
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 30; i++) {
+        TenantQos::Scope scope("calm");
+    }
+    elapsed = elapsedMs(start);
+    check(elapsed >= 400 && elapsed < 900, "Commands paced to the ops limit (" + std::to_string(elapsed) + "ms)");
+    {
+        TenantQos::Scope scope("calm");
+        check(!TenantQos::throttled(), "Ops-only tenant has no byte limit");
+    }
+}
+
+void testAcrossProcesses() {
+    std::cout << "\n=== Buckets are shared by forked connection processes ===" << std::endl;
+    refill();
+    // 子进程用完桶里的令牌并透支1MB，父进程随后的1MB需要等待
+    pid_t child = fork();
+    if (child == 0) {
+        chargeAs("slow", 2 * 1024 * 1024);
+        _exit(0);
+    }
+    waitpid(child, nullptr, 0);
+    long elapsed = chargeAs("slow", 1024 * 1024);
+    check(elapsed >= 150, "Parent waits for tokens used by the child (" + std::to_string(elapsed) + "ms)");
+}
+
+void testDeferral() {
+    std::cout << "\n=== Event loop threads defer waits instead of sleeping ===" << std::endl;
+    refill();
+    uint64_t deferredUs;
+    long elapsed;
+    {
+        TenantQos::Deferral throttle;
+        elapsed = chargeAs("slow", 3 * 1024 * 1024);
+        deferredUs = throttle.takeUs();
+        check(throttle.takeUs() == 0, "Taking the deferred wait clears it");
+    }
+    check(elapsed < 50, "Charging inside a deferral does not sleep (" + std::to_string(elapsed) + "ms)");
+    // 与testPacing相同：超出桶容量的2MB按4MB/s约500ms
+    check(deferredUs >= 400000 && deferredUs < 900000,
+          "The wait until the tokens are repaid is recorded instead (" + std::to_string(deferredUs / 1000) + "ms)");
+
+    // 欠下的令牌在共享桶中：作用域外的同一用户仍需等待
+    elapsed = chargeAs("slow", 256 * 1024);
+    check(elapsed >= 300, "The tenant's next charge outside the deferral waits (" + std::to_string(elapsed) + "ms)");
+
+    refill();
+    {
+        TenantQos::Deferral throttle;
+        for (int i = 0; i < 30; i++) {
+            TenantQos::Scope scope("calm");
+        }
+        deferredUs = throttle.takeUs();
+    }
+    check(deferredUs >= 400000 && deferredUs < 900000, "Command waits are deferred too (" + std::to_string(deferredUs / 1000) + "ms)");
+}
+
+void testObjectIo() {
+    std::cout << "\n=== Object I/O charges the tenant of the command ===" << std::endl;
+    std::string folder = makeTempDir("tenant_qos");
+    std::unique_ptr<ObjectIoBackend> io = ObjectIoBackend::create(DfsIoBackend::BLOCKING);
+    std::vector<unsigned char> content = makeContent(3 * 1024 * 1024, 7);
+
+    // PUT：recvObject在当前线程接收，按当前线程的用户计费
+    refill();
+    int fds[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    std::thread client([&]() {
+        std::vector<unsigned char> header;
+        NetUtils::encodeSplitHeader(header, 1, static_cast<int>(content.size()));
+        NetUtils::sendToSocket(fds[1], header);
+        NetUtils::sendToSocket(fds[1], content);
+    });
+    auto start = std::chrono::steady_clock::now();
+    int receivedId = -1;
+    {
+        TenantQos::Scope scope("slow");
+        try {
+            receivedId = io->recvObject(fds[0], folder, "obj");
+        } catch (const std::exception&) {
+        }
+    }
+    long elapsed = elapsedMs(start);
+    client.join();
+    close(fds[0]);
+    close(fds[1]);
+    check(receivedId == 1 && elapsed >= 400, "PUT paced to the bandwidth limit (" + std::to_string(elapsed) + "ms)");
+
+    // GET：sendfile路径对限速的用户分块发送
+    refill();
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    std::thread server([&]() {
+        TenantQos::Scope scope("slow");
+        try {
+            io->sendObject(fds[0], 1, ObjectIoBackend::objectPath(folder, "obj", 1));
+        } catch (const std::exception&) {
+        }
+    });
+    start = std::chrono::steady_clock::now();
+    int splitId = -1, length = 0;
+    std::vector<unsigned char> data;
+    try {
+        NetUtils::recvSplitHeader(fds[1], splitId, length);
+        data.resize(static_cast<size_t>(length));
+        NetUtils::recvBytesFromSocket(fds[1], data.data(), data.size());
+    } catch (const std::exception&) {
+    }
+    elapsed = elapsedMs(start);
+    server.join();
+    close(fds[0]);
+    close(fds[1]);
+    check(data == content, "Throttled GET returns the object");
+    check(elapsed >= 400, "GET paced to the bandwidth limit (" + std::to_string(elapsed) + "ms)");
+
+    removeTempDir(folder);
+}
+
+void testReconfigure() {
+    std::cout << "\n=== Limits can be changed at run time ===" << std::endl;
+    TenantQos* qos = TenantQos::shared();
+    bool slowFound = false;
+    for (const TenantQos::Stats& stats : qos->stats()) {
+        if (stats.username == "slow") {
+            slowFound = stats.bytes >= 12ULL * 1024 * 1024 && stats.throttledUs > 0;
+        }
+    }
+    check(slowFound, "Bytes and throttled time accounted per tenant");
+
+    TenantLimits unlimited;
+    check(qos->configure("slow", unlimited), "Limit removed");
+    check(chargeAs("slow", 16 * 1024 * 1024) < 50, "Tenant no longer throttled");
+
+    TenantLimits limits;
+    limits.bytesPerSecond = 4 * 1024 * 1024;
+    check(qos->configure("newcomer", limits) && qos->find("newcomer") >= 0, "New tenant added");
+    long elapsed = chargeAs("newcomer", 2 * 1024 * 1024);
+    check(elapsed >= 150, "New tenant throttled (" + std::to_string(elapsed) + "ms)");
+    check(!qos->configure(std::string(TENANT_QOS_NAME_MAX, 'x'), limits), "Over-long username rejected");
+}
+
+} // namespace
+
+int main() {
+    printBanner("DFS Tenant QoS Tests");
+
+    testParseLimit();
+
+    std::unordered_map<std::string, TenantLimits> limits;
+    limits["slow"].bytesPerSecond = 4 * 1024 * 1024;
+    limits["calm"].opsPerSecond = 20;
+    TenantQos::createShared(limits);
+
+    testPacing();
+    testAcrossProcesses();
+    testDeferral();
+    testObjectIo();
+    testReconfigure();
+
+    return finishTests();
+}
@@ -0,0 +1,272 @@
+#include "wal.hpp"
+#include "packed_store.hpp"
+#include "dir_index.hpp"
+#include "object_io.hpp"
+#include "netutils.hpp"
+#include "test_common.hpp"
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+bool fileExists(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0;
+}
+
+// 与PUT相同：对象内容先写入.part临时文件，等待提交
+bool writePartial(const std::string& folder, const std::string& fileName, int objectId, size_t size) {
+    std::string objectFile = ObjectIoBackend::objectPath(folder, fileName, objectId);
+    int fd = open(ObjectIoBackend::partialPath(objectFile).c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+    std::vector<unsigned char> content(size, static_cast<unsigned char>('a' + objectId));
+    bool ok = write(fd, content.data(), content.size()) == static_cast<ssize_t>(content.size());
+    close(fd);
+    return ok;
+}
+
+// 目录索引中记录了该对象
+bool indexed(const std::string& folder, const std::string& fileName, int objectId) {
+    ServerChunksInfo info;
+    if (!DirIndex::forDirectory(folder)->findFile(fileName, info) || info.chunks != 1) {
+        return false;
+    }
+    const auto& chunks = info.chunk_info[0].chunks;
+    return chunks[0] == objectId || chunks[1] == objectId;
+}
+
+WriteAheadLog::Entry fileEntry(const std::string& folder, const std::string& fileName, int objectId, uint64_t size) {
+    return WriteAheadLog::Entry{folder, fileName, objectId, size, false, 0, 0};
+}
+
+void testCommitAppliesObjects(const std::string& root) {
+    std::cout << "\n=== Commit renames objects and records them ===" << std::endl;
+    std::string folder = root + "/Bob/";
+    mkdir(folder.c_str(), 0755);
+
+    WriteAheadLog wal(root);
+    bool written = writePartial(folder, "a.txt", 0, 100) && writePartial(folder, "a.txt", 1, 200);
+    check(written, "Objects written to temporary files");
+    check(!fileExists(ObjectIoBackend::objectPath(folder, "a.txt", 0)), "Object invisible before commit");
+
+    bool committed = wal.commit({fileEntry(folder, "a.txt", 0, 100), fileEntry(folder, "a.txt", 1, 200)}, 0);
+    check(committed, "Commit acknowledged");
+    std::string object0 = ObjectIoBackend::objectPath(folder, "a.txt", 0);
+    std::string object1 = ObjectIoBackend::objectPath(folder, "a.txt", 1);
+    check(fileExists(object0) && fileExists(object1), "Objects visible after commit");
+    check(!fileExists(ObjectIoBackend::partialPath(object0)) && !fileExists(ObjectIoBackend::partialPath(object1)),
+          "Temporary files removed");
+
+    check(indexed(folder, "a.txt", 0) && indexed(folder, "a.txt", 1), "Directory index updated");
+
+    WriteAheadLog::Stats stats = wal.stats();
+    check(stats.commits == 1 && stats.syncs == 1, "One record synced once");
+    check(wal.commit({}, 0), "Empty commit acknowledged");
+}
+
+void testGroupCommit(const std::string& root) {
+    std::cout << "\n=== Concurrent PUTs share syncs ===" << std::endl;
+    std::string folder = root + "/group/";
+    mkdir(folder.c_str(), 0755);
+    const int processes = 4;
+    const int threads = 4;
+    const int puts = 10;
+
+    // 每个进程（与fork模式的服务器一致）中再开多个线程同时提交，通过管道汇报同步次数
+    int results[2];
+    if (pipe(results) < 0) {
+        check(false, "Result pipe created");
+        return;
+    }
+    for (int p = 0; p < processes; p++) {
+        if (fork() == 0) {
+            WriteAheadLog& wal = WriteAheadLog::forRoot(root);
+            std::vector<std::thread> workers;
+            int failed = 0;
+            for (int t = 0; t < threads; t++) {
+                workers.emplace_back([&, t]() {
+                    for (int i = 0; i < puts; i++) {
+                        std::string fileName = "p" + std::to_string(p) + "t" + std::to_string(t) + "_" + std::to_string(i);
+                        if (!writePartial(folder, fileName, 0, 64) ||
+                            !wal.commit({fileEntry(folder, fileName, 0, 64)}, 2000)) {
+                            __atomic_add_fetch(&failed, 1, __ATOMIC_RELAXED);
+                        }
+                    }
+                });
+            }
+            for (auto& worker : workers) {
+                worker.join();
+            }
+            uint64_t report[2] = {wal.stats().syncs, static_cast<uint64_t>(failed)};
+            (void)!write(results[1], report, sizeof(report));
+            _exit(0);
+        }
+    }
+    close(results[1]);
+    uint64_t syncs = 0, failed = 0;
+    uint64_t report[2];
+    while (read(results[0], report, sizeof(report)) == static_cast<ssize_t>(sizeof(report))) {
+        syncs += report[0];
+        failed += report[1];
+    }
+    close(results[0]);
+    while (wait(nullptr) > 0) {
+    }
+
+    int commits = processes * threads * puts;
+    size_t visible = 0;
+    for (int p = 0; p < processes; p++) {
+        for (int t = 0; t < threads; t++) {
+            for (int i = 0; i < puts; i++) {
+                std::string fileName = "p" + std::to_string(p) + "t" + std::to_string(t) + "_" + std::to_string(i);
+                visible += fileExists(ObjectIoBackend::objectPath(folder, fileName, 0)) ? 1 : 0;
+            }
+        }
+    }
+    check(failed == 0, "All commits acknowledged");
+    check(visible == static_cast<size_t>(commits), "All objects visible");
+    check(syncs > 0 && syncs * 4 <= static_cast<uint64_t>(commits),
+          "Commits batched (" + std::to_string(commits) + " commits, " + std::to_string(syncs) + " syncs)");
+}
+
+// 子进程追加记录后成为领导者，在提交窗口中被杀死：记录在日志中但没有生效
+void killDuringCommit(const std::string& root, const std::vector<WriteAheadLog::Entry>& entries) {
+    pid_t child = fork();
+    if (child == 0) {
+        WriteAheadLog wal(root);
+        wal.commit(entries, 5 * 1000 * 1000);
+        _exit(0);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    kill(child, SIGKILL);
+    waitpid(child, nullptr, 0);
+}
+
+void testRecoverFiles(const std::string& root) {
+    std::cout << "\n=== Recovery redoes unapplied file records ===" << std::endl;
+    std::string folder = root + "/crash/";
+    mkdir(folder.c_str(), 0755);
+    writePartial(folder, "b.txt", 2, 300);
+    killDuringCommit(root, {fileEntry(folder, "b.txt", 2, 300)});
+
+    std::string objectFile = ObjectIoBackend::objectPath(folder, "b.txt", 2);
+    check(!fileExists(objectFile) && fileExists(ObjectIoBackend::partialPath(objectFile)),
+          "Killed commit left the object unapplied");
+
+    size_t replayed = WriteAheadLog(root).recover();
+    check(replayed >= 1, "Recovery replayed the record");
+    check(fileExists(objectFile) && !fileExists(ObjectIoBackend::partialPath(objectFile)), "Object renamed on recovery");
+    check(indexed(folder, "b.txt", 2), "Directory index updated on recovery");
+
+    struct stat st;
+    check(stat((root + "/" + WAL_FILE).c_str(), &st) == 0 && static_cast<uint64_t>(st.st_size) == WAL_HEADER_SIZE,
+          "Log truncated after recovery");
+    check(WriteAheadLog(root).recover() == 0, "Second recovery has nothing to redo");
+    check(fileExists(ObjectIoBackend::objectPath(root + "/Bob/", "a.txt", 0)), "Earlier objects untouched");
+}
+
+void testRecoverPacked(const std::string& root) {
+    std::cout << "\n=== Recovery commits unapplied packed records ===" << std::endl;
+    std::string folder = root + "/packed/";
+    mkdir(folder.c_str(), 0755);
+    std::unique_ptr<ObjectIoBackend> io = ObjectIoBackend::create(DfsIoBackend::BLOCKING);
+    std::vector<unsigned char> content(5000);
+    for (size_t i = 0; i < content.size(); i++) {
+        content[i] = static_cast<unsigned char>(i * 7);
+    }
+
+    // 子进程接收对象（R记录）后在组提交窗口中被杀死
+    int fds[2];
+    socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+    std::vector<unsigned char> header;
+    NetUtils::encodeSplitHeader(header, 3, static_cast<int>(content.size()));
+    NetUtils::sendToSocket(fds[1], header);
+    NetUtils::sendToSocket(fds[1], content);
+    pid_t child = fork();
+    if (child == 0) {
+        PackedStore& store = PackedStore::forRoot(root);
+        PackedStore::Pending pending;
+        int splitId = -1;
+        if (!store.receive(fds[0], *io, folder, "c.txt", splitId, pending)) {
+            _exit(1);
+        }
+        WriteAheadLog wal(root);
+        wal.commit({WriteAheadLog::Entry{folder, "c.txt", splitId, pending.length, true, pending.segment,
+                                         pending.record}}, 5 * 1000 * 1000);
+        store.finish(pending, true);
+        _exit(0);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    kill(child, SIGKILL);
+    waitpid(child, nullptr, 0);
+    close(fds[0]);
+    close(fds[1]);
+
+    std::string objectFile = ObjectIoBackend::objectPath(folder, "c.txt", 3);
+    check(!PackedStore(root).contains(objectFile), "Killed commit left the record uncommitted");
+    check(WriteAheadLog(root).recover() == 1, "Recovery replayed the record");
+
+    PackedStore store(root);
+    std::vector<unsigned char> data;
+    check(store.readObject(objectFile, data) && data == content, "Record committed on recovery");
+    store.compact();
+    check(PackedStore(root).contains(objectFile), "Compaction keeps the recovered record");
+    check(indexed(folder, "c.txt", 3), "Directory index updated on recovery");
+}
+
+void testCheckpoint(const std::string& root) {
+    std::cout << "\n=== Checkpoints release applied records ===" << std::endl;
+    std::string folder = root + "/checkpoint/";
+    mkdir(folder.c_str(), 0755);
+    const int commits = 2000;
+    {
+        WriteAheadLog wal(root, 4096);
+        for (int i = 0; i < commits; i++) {
+            std::string fileName = "d" + std::to_string(i);
+            writePartial(folder, fileName, 0, 16);
+            wal.commit({fileEntry(folder, fileName, 0, 16)}, 0);
+        }
+    }
+    struct stat st;
+    stat((root + "/" + WAL_FILE).c_str(), &st);
+    uint64_t allocated = static_cast<uint64_t>(st.st_blocks) * 512;
+    check(static_cast<uint64_t>(st.st_size) > 64 * 1024 && allocated < 32 * 1024,
+          "Applied records punched out (" + std::to_string(st.st_size) + " bytes, " +
+          std::to_string(allocated) + " allocated)");
+
+    size_t replayed = WriteAheadLog(root).recover();
+    check(replayed < static_cast<size_t>(commits) / 10, "Recovery starts at the checkpoint (" +
+          std::to_string(replayed) + " records)");
+    check(fileExists(ObjectIoBackend::objectPath(folder, "d0", 0)) &&
+          fileExists(ObjectIoBackend::objectPath(folder, "d" + std::to_string(commits - 1), 0)),
+          "Objects remain committed");
+}
+
+} // namespace
+
+int main() {
+    printBanner("DFS Write-Ahead Log Tests");
+
+    std::string root = makeTempDir("wal");
+    testCommitAppliesObjects(root);
+    testGroupCommit(root);
+    testRecoverFiles(root);
+    testRecoverPacked(root);
+    testCheckpoint(root);
+
+    removeTempDir(root);
+
+    return finishTests();
+}
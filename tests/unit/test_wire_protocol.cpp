@@ -0,0 +1,289 @@
+#include "network/wire_protocol.hpp"
+#include "network/netutils.hpp"
+#include "test_common.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace {
+
+// 去掉4字节长度前缀，得到与服务器recvFrameBody接收到的相同的帧体
+std::vector<unsigned char> frameBody(const std::vector<unsigned char>& frame) {
+    return std::vector<unsigned char>(frame.begin() + INT_SIZE, frame.end());
+}
+
+template <typename F>
+bool throwsRuntimeError(F fn) {
+    try {
+        fn();
+    } catch (const std::runtime_error&) {
+        return true;
+    }
+    return false;
+}
+
+void testVarints() {
+    std::cout << "\n=== Varint encoding ===" << std::endl;
+    const std::vector<uint64_t> unsignedValues = {0, 1, 127, 128, 300, 16383, 16384,
+                                                  std::numeric_limits<uint32_t>::max(),
+                                                  std::numeric_limits<uint64_t>::max()};
+    const std::vector<int64_t> signedValues = {0, -1, 1, -64, 64, std::numeric_limits<int32_t>::min(),
+                                               std::numeric_limits<int64_t>::max(),
+                                               std::numeric_limits<int64_t>::min()};
+
+    WireWriter writer(WireOpcode::CHUNK_INFO, 42);
+    for (uint64_t value : unsignedValues) {
+        writer.putVarint(value);
+    }
+    for (int64_t value : signedValues) {
+        writer.putSigned(value);
+    }
+    std::vector<unsigned char> body = frameBody(writer.finish());
+
+    WireReader reader(body.data() + 1, body.size() - 1);
+    check(reader.getVarint() == 42, "request id round trip");
+    bool unsignedOk = true;
+    for (uint64_t value : unsignedValues) {
+        unsignedOk = unsignedOk && reader.getVarint() == value;
+    }
+    check(unsignedOk, "unsigned varint round trip");
+    bool signedOk = true;
+    for (int64_t value : signedValues) {
+        signedOk = signedOk && reader.getSigned() == value;
+    }
+    check(signedOk, "zigzag signed varint round trip");
+    check(reader.atEnd(), "reader consumed the whole frame");
+
+    WireWriter small(WireOpcode::CHUNK_INFO, 1);
+    small.putSigned(-1);
+    check(small.finish().size() == INT_SIZE + 3, "small negative value takes one byte");
+}
+
+void testCommands() {
+    std::cout << "\n=== Command frames ===" << std::endl;
+    // 超过旧的MAX_CHAR_BUFF（100字节）上限的名字
+    std::string longName(300, 'x');
+    std::vector<unsigned char> frame;
+    WireProtocol::encodeCommand(frame, GET_FLAG, 7, "photos/2024/", longName + ".jpg");
+
+    int frameSize;
+    NetUtils::decodeIntFromUchar(frame, frameSize);
+    check(static_cast<size_t>(frameSize) == frame.size() - INT_SIZE, "length prefix matches frame body");
+
+    WireCommand command;
+    WireProtocol::decodeCommand(frameBody(frame), command);
+    check(command.flag == GET_FLAG, "opcode maps back to GET_FLAG");
+    check(command.request_id == 7, "request id preserved");
+    check(command.folder == "photos/2024/", "folder preserved");
+    check(command.file_name == longName + ".jpg", "names longer than 100 bytes preserved");
+
+    User user;
+    user.username = "Bob";
+    user.password = "ComplextPassword";
+    WireProtocol::encodeAuth(frame, 8, user);
+    WireCommand auth;
+    WireProtocol::decodeCommand(frameBody(frame), auth);
+    check(auth.flag == AUTH_FLAG && auth.user == user, "AUTH frame round trip");
+
+    // 文本协议的AUTH命令同样不截断长名字
+    User longUser;
+    longUser.username = longName;
+    longUser.password = "ComplextPassword";
+    std::string authText;
+    NetUtils::encodeUserStruct(authText, longUser);
+    std::vector<char> username(authText.size() + 1, 0), password(authText.size() + 1, 0);
+    int authFlag = -1;
+    check(sscanf(authText.c_str(), AUTH_TEMPLATE, &authFlag, username.data(), password.data()) == 3 &&
+          authFlag == AUTH_FLAG && longUser.username == username.data() && longUser.password == password.data(),
+          "text AUTH keeps names longer than 256 bytes");
+
+    WireProtocol::encodeResume(frame, 10, std::string(48, '\x01'));
+    WireCommand resume;
+    WireProtocol::decodeCommand(frameBody(frame), resume);
+    check(resume.flag == RESUME_FLAG && resume.token == std::string(48, '\x01'), "RESUME frame round trip");
+
+    WireProtocol::encodeSessionToken(frame, 10, std::string(48, '\x02'), 900);
+    std::string token;
+    uint64_t requestId;
+    int ttlSeconds;
+    WireProtocol::decodeSessionToken(frameBody(frame), requestId, token, ttlSeconds);
+    check(requestId == 10 && token == std::string(48, '\x02') && ttlSeconds == 900,
+          "SESSION_TOKEN frame round trip");
+
+    std::string text = "FLAG 0 USERNAME Bob PASSWORD ComplextPassword FOLDER / FILENAME NULL\n";
+    WireProtocol::encodeCommand(frame, LIST_FLAG, 9, "/", "");
+    std::cout << "LIST command: text " << INT_SIZE + text.size() << " bytes, binary " << frame.size()
+              << " bytes" << std::endl;
+    check(frame.size() < INT_SIZE + text.size(), "binary LIST command is smaller than the text template");
+}
+
+void testChunksInfo() {
+    std::cout << "\n=== CHUNK_INFO frames ===" << std::endl;
+    ServerChunksInfo info;
+    info.chunks = 3;
+    info.chunk_info.resize(3);
+    info.chunk_info[0].file_name = "a.txt";
+    info.chunk_info[0].chunks = {0, 1};
+    info.chunk_info[1].file_name = "report-final.pdf";
+    info.chunk_info[1].chunks = {2, 0};
+    info.chunk_info[2].file_name = std::string(200, 'y');
+    info.chunk_info[2].chunks = {3, -1};
+
+    std::vector<unsigned char> frame;
+    WireProtocol::encodeServerChunksInfo(frame, 11, info);
+
+    ServerChunksInfo decoded;
+    uint64_t requestId;
+    WireProtocol::decodeServerChunksInfo(frameBody(frame), requestId, decoded);
+    check(requestId == 11, "reply carries the request id");
+    bool same = decoded.chunks == info.chunks;
+    for (int i = 0; same && i < info.chunks; i++) {
+        same = decoded.chunk_info[i].file_name == info.chunk_info[i].file_name &&
+               decoded.chunk_info[i].chunks == info.chunk_info[i].chunks;
+    }
+    check(same, "chunk info round trip");
+
+    // 分页字段追加在CHUNK_INFO末尾，不认识分页的解析方仍能读出这一页
+    bool more = false;
+    std::string cursor;
+    WireProtocol::encodeListPage(frame, 12, info, true, info.chunk_info[2].file_name);
+    WireProtocol::decodeListPage(frameBody(frame), requestId, decoded, more, cursor);
+    check(requestId == 12 && decoded.chunks == 3 && more && cursor == info.chunk_info[2].file_name,
+          "LIST page carries the continuation cursor");
+    WireProtocol::decodeServerChunksInfo(frameBody(frame), requestId, decoded);
+    check(decoded.chunks == 3, "LIST page readable as plain CHUNK_INFO");
+    WireProtocol::encodeServerChunksInfo(frame, 12, info);
+    WireProtocol::decodeListPage(frameBody(frame), requestId, decoded, more, cursor);
+    check(!more && cursor.empty(), "plain CHUNK_INFO is a final page");
+
+    // 二进制回复带上全部对象ID和对象数，追加在分页字段之后
+    info.chunk_info[0].objects = {0, 1, 4, 7};
+    info.chunk_info[0].object_count = 8;
+    WireProtocol::encodeListPage(frame, 14, info, false, "");
+    WireProtocol::decodeListPage(frameBody(frame), requestId, decoded, more, cursor);
+    check(decoded.chunk_info[0].objects == info.chunk_info[0].objects && decoded.chunk_info[0].object_count == 8 &&
+          decoded.chunk_info[1].object_count == -1, "object ids and object counts round trip");
+    check(decoded.chunk_info[0].chunks[0] == 0 && decoded.chunk_info[0].chunks[1] == 1,
+          "first two object ids fill the fixed chunks");
+    WireProtocol::decodeServerChunksInfo(frameBody(frame), requestId, decoded);
+    check(decoded.chunks == 3 && decoded.chunk_info[0].object_count == 8, "GET reply carries the object count");
+    info.chunk_info[0].objects.clear();
+    info.chunk_info[0].object_count = -1;
+
+    WireProtocol::encodeListNext(frame, 13, "report-final.pdf");
+    WireProtocol::decodeListNext(frameBody(frame), requestId, cursor);
+    check(requestId == 13 && cursor == "report-final.pdf", "LIST_NEXT frame round trip");
+
+    size_t legacySize = INT_SIZE + INT_SIZE + 2 * CHUNK_INFO_STRUCT_SIZE;
+    info.chunks = 2;
+    WireProtocol::encodeServerChunksInfo(frame, 11, info);
+    std::cout << "Two short names: fixed records " << legacySize << " bytes, binary " << frame.size()
+              << " bytes" << std::endl;
+    check(frame.size() * 3 < legacySize, "metadata reply shrinks by more than 3x for short names");
+}
+
+void testCompleteness() {
+    std::cout << "\n=== File completeness ===" << std::endl;
+    ServerChunksCollate collate;
+    ServerChunksInfo first;
+    first.chunks = 1;
+    first.chunk_info.resize(1);
+    first.chunk_info[0].file_name = "f";
+    first.chunk_info[0].objects = {0, 2, 5};
+    first.chunk_info[0].object_count = 6;
+    Utils::insertToServerChunksCollate(collate, first);
+    check(!Utils::checkComplete(collate.files["f"]), "objects 1, 3 and 4 missing");
+    ServerChunksInfo second = first;
+    second.chunk_info[0].objects = {1, 3, 4};
+    second.chunk_info[0].object_count = -1;
+    Utils::insertToServerChunksCollate(collate, second);
+    check(Utils::checkComplete(collate.files["f"]), "objects 0..5 reported across servers");
+    collate.files["f"].object_count = 7;
+    check(!Utils::checkComplete(collate.files["f"]), "missing last object detected from the count");
+    // 没有元数据对象的旧文件按从0开始连续的对象ID判断
+    collate.files["f"].object_count = -1;
+    check(Utils::checkComplete(collate.files["f"]), "legacy file with contiguous objects 0..5 is complete");
+    FileObjects gap;
+    gap.objects = {0, 1, 3};
+    check(!Utils::checkComplete(gap), "legacy file with a gap in its object ids is incomplete");
+    gap.objects = {1, 2};
+    check(!Utils::checkComplete(gap), "legacy file without object 0 is incomplete");
+    check(!Utils::checkComplete(FileObjects()), "file without objects is incomplete");
+
+    // 文本协议的回复不带对象数，只要有服务器持有文件就交给GET判断
+    ServerChunksCollate text;
+    ServerChunksInfo legacy;
+    legacy.chunks = 1;
+    legacy.chunk_info.resize(1);
+    legacy.chunk_info[0].file_name = "t";
+    legacy.chunk_info[0].chunks = {3, -1};
+    Utils::insertToServerChunksCollate(text, legacy);
+    check(Utils::checkComplete(text.files["t"]), "text protocol replies fall back to presence");
+    legacy.chunk_info[0].file_name = "m";
+    legacy.chunk_info[0].chunks = {0, FILE_MANIFEST_ID};
+    Utils::insertToServerChunksCollate(text, legacy);
+    check(text.files["m"].objects == std::set<int>({0}), "manifest id reported over text is not an object");
+}
+
+void testMalformedFrames() {
+    std::cout << "\n=== Malformed frames ===" << std::endl;
+    WireCommand command;
+    check(throwsRuntimeError([&] { WireProtocol::decodeCommand({0x7f, 0x01}, command); }),
+          "unknown opcode rejected");
+    check(throwsRuntimeError([&] { WireProtocol::decodeCommand({0x03, 0x80}, command); }),
+          "truncated varint rejected");
+    check(throwsRuntimeError([&] { WireProtocol::decodeCommand({0x03, 0x01, 0x05, 'a'}, command); }),
+          "field longer than the frame rejected");
+
+    std::vector<unsigned char> overlong = {0x03};
+    for (int i = 0; i < 11; i++) {
+        overlong.push_back(0xff);
+    }
+    check(throwsRuntimeError([&] { WireProtocol::decodeCommand(overlong, command); }),
+          "varint longer than 10 bytes rejected");
+
+    WireWriter writer(WireOpcode::GET, 1);
+    writer.putBytes(std::string(WIRE_MAX_NAME_SIZE + 1, 'z'));
+    writer.putBytes("");
+    std::vector<unsigned char> body = frameBody(writer.finish());
+    check(throwsRuntimeError([&] { WireProtocol::decodeCommand(body, command); }),
+          "name above WIRE_MAX_NAME_SIZE rejected");
+
+    ServerChunksInfo info;
+    uint64_t requestId;
+    check(throwsRuntimeError([&] {
+              WireProtocol::decodeServerChunksInfo({0x81, 0x01, 0xff, 0xff, 0x03}, requestId, info);
+          }),
+          "chunk count larger than the frame rejected");
+}
+
+void testHello() {
+    std::cout << "\n=== HELLO ===" << std::endl;
+    std::vector<unsigned char> magic(WIRE_MAGIC, WIRE_MAGIC + sizeof(WIRE_MAGIC));
+    int value;
+    NetUtils::decodeIntFromUchar(magic, value);
+    check(WireProtocol::isHello(value), "magic recognised as HELLO");
+    // 旧服务器直接按这个长度分配命令缓冲区，只有负数会立即失败而不是分配上GB内存
+    check(value < 0, "magic is a negative legacy command size");
+    check(!WireProtocol::isHello(72), "ordinary command size is not HELLO");
+}
+
+} // namespace
+
+int main() {
+    printBanner("DFS Wire Protocol Tests");
+
+    testVarints();
+    testCommands();
+    testChunksInfo();
+    testCompleteness();
+    testMalformedFrames();
+    testHello();
+
+    return finishTests();
+}